@@ -0,0 +1,646 @@
+// turbones_bench: Benchmarks of the emulator's hot paths, with results as JSON, to track performance over time.
+//
+// Usage: turbones_bench [--frames <n>] [--output <file>] [<path-to-rom-file>...]
+//
+// Microbenchmarks time single operations (each opcode through CPU::execute, memory accesses by region, OAM DMA,
+// mapper bank switches, cartridge loading, PPU steps, catch up and rendering, frame conversion, APU frames, scheduling events,
+// saving and loading state, compressing states into a rewind history and stepping back through it). Macro benchmarks run whole ROMs for a number of frames:
+// a built in synthetic ROM, then each ROM given, both interpreted and recompiled.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Checksum.hpp"
+#include "NES.hpp"
+#include "Palette.hpp"
+#include "Resampler.hpp"
+#include "Rewind.hpp"
+
+namespace {
+
+struct Result {
+    std::string group;
+    std::string name;
+    uint64_t    iterations;
+    double      ns_per_op;
+    // Macro benchmarks only.
+    uint64_t    frames = 0;
+    uint64_t    instructions = 0;
+    double      frames_per_second = 0;
+};
+
+// Keeps results from being optimized away.
+volatile uint64_t sink;
+
+// Times 'iterations' calls of 'body'. Returns nanoseconds per call.
+template <typename Body>
+double measure(const uint64_t& iterations, Body body) {
+    body(); // Warm up caches.
+    const auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < iterations; ++i) {
+        body(); }
+    const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+// A 32 KB NROM program, busy with a mix of loads, stores, arithmetic, indexing and subroutine calls.
+// It never waits for vblank, so no time is skipped as idle.
+std::vector<uint8_t> syntheticRom() {
+    const std::vector<uint8_t> program = {
+        0xA2, 0xFF,       // $8000       LDX #$FF
+        0x9A,             // $8002       TXS
+        0xA0, 0x00,       // $8003 loop: LDY #$00
+        0xB9, 0x00, 0x03, // $8005 inner: LDA $0300,Y
+        0x18,             // $8008       CLC
+        0x69, 0x07,       // $8009       ADC #$07
+        0x99, 0x00, 0x03, // $800B       STA $0300,Y
+        0x45, 0x10,       // $800E       EOR $10
+        0x85, 0x10,       // $8010       STA $10
+        0x20, 0x1D, 0x80, // $8012       JSR sub
+        0xC8,             // $8015       INY
+        0xD0, 0xED,       // $8016       BNE inner
+        0xE6, 0x11,       // $8018       INC $11
+        0x4C, 0x03, 0x80, // $801A       JMP loop
+        0xA5, 0x10,       // $801D sub:  LDA $10
+        0x0A,             // $801F       ASL A
+        0x26, 0x12,       // $8020       ROL $12
+        0x60              // $8022       RTS
+    };
+
+    std::vector<uint8_t> rom = { 'N', 'E', 'S', 0x1A, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+    std::vector<uint8_t> prg(2 * Cartridge::PRG_PAGE_SIZE, 0xEA); // NOP
+    std::copy(program.begin(), program.end(), prg.begin());
+    // NMI, reset and IRQ vectors, all at $8000.
+    for (int vector = 0x7FFA; vector < 0x8000; vector += 2) {
+        prg[vector]     = 0x00;
+        prg[vector + 1] = 0x80;
+    }
+    rom.insert(rom.end(), prg.begin(), prg.end());
+    return rom;
+}
+
+// A cartridge for 'mapper', with 256 KB of PRG ROM and 128 KB of CHR ROM, for timing bank switches. Never run.
+std::vector<uint8_t> mapperRom(const int& mapper) {
+    std::vector<uint8_t> rom = { 'N', 'E', 'S', 0x1A, 16, 16, (uint8_t)((mapper & 0x0F) << 4), (uint8_t)(mapper & 0xF0),
+                                 0, 0, 0, 0, 0, 0, 0, 0 };
+    rom.resize(rom.size() + (16 * Cartridge::PRG_PAGE_SIZE) + (16 * Cartridge::CHR_PAGE_SIZE), 0xEA);
+    return rom;
+}
+
+void writeFile(const std::string& path, const std::vector<uint8_t>& data) {
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(data.data()), data.size());
+    if (file.fail()) {
+        std::cerr << "Couldn't write file: " << path << std::endl;
+        throw std::runtime_error("Failed ofstream");
+    }
+}
+
+std::string hex(const int& value, const int& digits) {
+    std::ostringstream out;
+    out << std::uppercase << std::hex;
+    out.width(digits);
+    out.fill('0');
+    out << value;
+    return out.str();
+}
+
+const char* modeName(const AddressingMode& mode) {
+    static const char* names[] = { "IMP", "ACC", "IMM", "ZP0", "ZPX", "ZPY", "REL", "ABS", "ABX", "ABY", "IND", "IZX", "IZY" };
+    return names[mode];
+}
+
+std::string escape(const std::string& text) {
+    std::string escaped;
+    for (const char& c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\'; }
+        escaped += c;
+    }
+    return escaped;
+}
+
+void writeJson(std::ostream& out, const std::vector<Result>& results) {
+    out << "{\n"
+        << "  \"version\": 1,\n"
+        << "  \"recompiler_supported\": " << (Recompiler::isSupported() ? "true" : "false") << ",\n"
+        << "  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& result = results[i];
+        out << "    {\"group\": \"" << escape(result.group) << "\", \"name\": \"" << escape(result.name) << "\""
+            << ", \"iterations\": " << result.iterations
+            << ", \"ns_per_op\": " << result.ns_per_op;
+        if (result.frames != 0) {
+            out << ", \"frames\": " << result.frames
+                << ", \"instructions\": " << result.instructions
+                << ", \"frames_per_second\": " << result.frames_per_second; }
+        out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n"
+        << "}" << std::endl;
+}
+
+}
+
+// Friend of NES and CPU, for access to their parts, CPU::execute and the registers.
+class Benchmark {
+public:
+    Benchmark(const std::string& synthetic_path) : synthetic_path(synthetic_path) {}
+
+    void runMicro();
+    void runMacro(const std::string& rom_path, const std::string& name, const uint64_t& frames);
+
+    std::vector<Result> results;
+
+private:
+    // Every official opcode, through CPU::execute, as the interpreter runs it.
+    void benchmarkOpcodes();
+    void benchmarkMemory();
+    void benchmarkMapper();
+    void benchmarkCartridge();
+    void benchmarkChecksum();
+    void benchmarkPPU();
+    void benchmarkAPU();
+    void benchmarkScheduler();
+    void benchmarkSaveState();
+    void benchmarkRewind();
+
+    void add(const std::string& group, const std::string& name, const uint64_t& iterations, const double& ns) {
+        Result result;
+        result.group      = group;
+        result.name       = name;
+        result.iterations = iterations;
+        result.ns_per_op  = ns;
+        results.push_back(result);
+    }
+
+    std::string synthetic_path;
+};
+
+void Benchmark::runMicro() {
+    benchmarkOpcodes();
+    benchmarkMemory();
+    benchmarkMapper();
+    benchmarkCartridge();
+    benchmarkChecksum();
+    benchmarkPPU();
+    benchmarkAPU();
+    benchmarkScheduler();
+    benchmarkSaveState();
+    benchmarkRewind();
+}
+
+void Benchmark::benchmarkOpcodes() {
+    constexpr uint64_t ITERATIONS = 200'000;
+    constexpr uint16_t CODE = 0x0200;
+
+    std::unique_ptr<NES> nes(new NES());
+    nes->load(synthetic_path);
+    nes->powerOn();
+    CPU& cpu = nes->cpu;
+    Memory& memory = nes->memory;
+
+    // Operands point into RAM: $10 for zero page, $0310 for absolute.
+    // Zero page pointers and the JMP indirect pointer point into page $03.
+    for (int address = 0; address < 0x100; ++address) {
+        memory.write(address, 0x03); }
+    memory.write(0x0310, 0x00);
+    memory.write(0x0311, 0x04);
+
+    std::map<AddressingMode, std::pair<double, int>> by_mode; // Total ns, and opcode count.
+    for (int opcode = 0; opcode < 0x100; ++opcode) {
+        if (CPU::operation_table[opcode].decoded == nullptr) {
+            continue; } // Unofficial. Only logged.
+
+        memory.write(CODE,     opcode);
+        memory.write(CODE + 1, 0x10);
+        memory.write(CODE + 2, 0x03);
+
+        // Registers are reset each time, so that indexed operands stay in RAM.
+        const double ns = measure(ITERATIONS, [&]() {
+            cpu.pc  = CODE + 1;
+            cpu.r_x = 0;
+            cpu.r_y = 0;
+            cpu.sp  = 0xFD;
+            cpu.execute(opcode);
+        });
+
+        const AddressingMode mode = addressing_mode_table[opcode];
+        add("cpu_opcode", hex(opcode, 2) + " " + instruction_table[opcode] + " " + modeName(mode), ITERATIONS, ns);
+        by_mode[mode].first += ns;
+        ++by_mode[mode].second;
+    }
+
+    for (const auto& mode : by_mode) {
+        add("cpu_addressing_mode", modeName(mode.first), ITERATIONS * mode.second.second,
+            mode.second.first / mode.second.second); }
+}
+
+void Benchmark::benchmarkMemory() {
+    constexpr uint64_t ITERATIONS = 2'000'000;
+
+    std::unique_ptr<NES> nes(new NES());
+    nes->load(synthetic_path);
+    nes->powerOn();
+    Memory& memory = nes->memory;
+    // Devices are caught up to the access's cycle, the last of the instruction making it (see CPU::accessCycle).
+    nes->cpu.stall(1);
+
+    const std::pair<const char*, uint16_t> read_regions[] = {
+        { "ram",            0x0042 },
+        { "ram_mirror",     0x1842 },
+        { "ppu_register",   0x2002 },
+        { "apu_io",         0x4015 },
+        { "controller",     0x4016 },
+        { "cartridge_sram", 0x6000 },
+        { "prg_rom",        0x8042 }
+    };
+    for (const auto& region : read_regions) {
+        const uint16_t address = region.second;
+        uint64_t total = 0;
+        const double ns = measure(ITERATIONS, [&]() { total += memory.read(address); });
+        sink = total;
+        add("memory_read", region.first, ITERATIONS, ns);
+    }
+
+    // PRG ROM writes go to the mapper, which has no registers on NROM.
+    const std::pair<const char*, uint16_t> write_regions[] = {
+        { "ram",          0x0042 },
+        { "ram_mirror",   0x1842 },
+        { "ppu_register", 0x2003 },
+        { "apu_io",       0x4015 },
+        { "controller",   0x4016 }
+    };
+    for (const auto& region : write_regions) {
+        const uint16_t address = region.second;
+        uint8_t value = 0;
+        const double ns = measure(ITERATIONS, [&]() { memory.write(address, ++value); });
+        add("memory_write", region.first, ITERATIONS, ns);
+    }
+
+    // OAM DMA from each kind of page: copied in one go from host memory, or read byte by byte on the I/O path.
+    // Each stalls the CPU, so the PPU has that much more to catch up to for the next.
+    constexpr uint64_t DMA_ITERATIONS = 100'000;
+    const std::pair<const char*, uint8_t> dma_pages[] = {
+        { "ram",      0x02 },
+        { "prg_rom",  0x80 },
+        { "open_bus", 0x50 }
+    };
+    for (const auto& source : dma_pages) {
+        const double ns = measure(DMA_ITERATIONS, [&]() { memory.write(0x4014, source.second); });
+        add("oam_dma", source.first, DMA_ITERATIONS, ns);
+    }
+}
+
+void Benchmark::benchmarkMapper() {
+    constexpr uint64_t ITERATIONS = 1'000'000;
+
+    // Register writes that switch a bank, straight to the mapper (through Memory, the PPU would be caught up too).
+    struct Switch {
+        const char* name;
+        int mapper;
+        int select;       // Value written to $8000 first (MMC3's bank select), or -1.
+        uint16_t address; // Where the bank is written.
+        bool serial;      // Written a bit at a time, over five writes (MMC1).
+    };
+    const Switch switches[] = {
+        { "nrom_register_write", Mapper::NROM,  -1, 0x8000, false },
+        { "mmc1_prg_switch",     Mapper::MMC1,  -1, 0xE000, true },
+        { "mmc1_chr_switch",     Mapper::MMC1,  -1, 0xA000, true },
+        { "uxrom_prg_switch",    Mapper::UXROM, -1, 0x8000, false },
+        { "cnrom_chr_switch",    Mapper::CNROM, -1, 0x8000, false },
+        { "mmc3_prg_switch",     Mapper::MMC3,   6, 0x8001, false },
+        { "mmc3_chr_switch",     Mapper::MMC3,   2, 0x8001, false },
+        { "axrom_prg_switch",    Mapper::AXROM, -1, 0x8000, false }
+    };
+
+    const std::string rom_path = "turbones_bench_mapper.nes";
+    for (const Switch& bank_switch : switches) {
+        writeFile(rom_path, mapperRom(bank_switch.mapper));
+        std::unique_ptr<NES> nes(new NES());
+        nes->load(rom_path);
+        nes->powerOn();
+        Mapper& mapper = *nes->mapper;
+
+        uint8_t bank = 0;
+        const double ns = measure(ITERATIONS, [&]() {
+            ++bank;
+            if (bank_switch.serial) {
+                for (int bit = 0; bit < 5; ++bit) {
+                    nes->cpu.stall(2); // MMC1 ignores writes on consecutive cycles.
+                    mapper.write(bank_switch.address, bank >> bit);
+                }
+                return;
+            }
+            if (bank_switch.select >= 0) {
+                mapper.write(0x8000, (uint8_t)bank_switch.select); }
+            mapper.write(bank_switch.address, bank);
+        });
+        add("mapper", bank_switch.name, ITERATIONS, ns);
+    }
+    remove(rom_path.c_str());
+}
+
+void Benchmark::benchmarkCartridge() {
+    constexpr uint64_t ITERATIONS = 2'000;
+
+    uint64_t total = 0;
+    const double ns = measure(ITERATIONS, [&]() {
+        const Cartridge cartridge(synthetic_path);
+        total += cartridge.prg_rom.size();
+    });
+    sink = total;
+    add("cartridge", "load_32k_nrom", ITERATIONS, ns);
+}
+
+void Benchmark::benchmarkChecksum() {
+    constexpr uint64_t ITERATIONS = 200;
+
+    // 256 KB PRG and CHR ROM, as indexing hashes them.
+    std::vector<uint8_t> rom(0x40000);
+    for (size_t i = 0; i < rom.size(); ++i) {
+        rom[i] = (uint8_t)((i * 2654435761U) >> 24); }
+
+    uint32_t crc = 0;
+    const double crc_ns = measure(ITERATIONS, [&]() { crc = updateCrc32(crc, rom.data(), rom.size()); });
+    sink = crc;
+    add("checksum", "crc32_256k", ITERATIONS, crc_ns);
+
+    Sha1 sha1;
+    Sha1::Digest digest;
+    const double sha1_ns = measure(ITERATIONS, [&]() {
+        sha1.update(rom.data(), rom.size());
+        digest = sha1.finish();
+    });
+    sink = digest[0];
+    add("checksum", "sha1_256k", ITERATIONS, sha1_ns);
+}
+
+void Benchmark::benchmarkPPU() {
+    constexpr uint64_t ITERATIONS = 20'000'000;
+
+    std::unique_ptr<NES> nes(new NES());
+    nes->load(synthetic_path);
+    nes->powerOn();
+    PPU& ppu = nes->ppu;
+
+    const double ns = measure(ITERATIONS, [&]() { ppu.step(); });
+    add("ppu", "step", ITERATIONS, ns);
+
+    // A whole frame's worth of CPU cycles at a time, as when the CPU never touches the PPU.
+    constexpr uint64_t FRAMES = 10'000,
+                       CPU_CYCLES_PER_FRAME = 29'781;
+    nes->powerOn();
+    uint64_t cpu_cycle = 0;
+    const double frame_ns = measure(FRAMES, [&]() {
+        cpu_cycle += CPU_CYCLES_PER_FRAME;
+        ppu.catchUp(cpu_cycle);
+    });
+    add("ppu", "catch_up_frame", FRAMES, frame_ns);
+
+    // The same, rendering background and sprites, all 64 of them spread over the screen.
+    nes->powerOn();
+    for (int i = 0; i < 0x100; ++i) {
+        ppu.writeRegister(0x2004, (uint8_t)(i * 37)); }
+    ppu.writeRegister(0x2001, 0x1E);
+    cpu_cycle = 0;
+    const double render_ns = measure(FRAMES, [&]() {
+        cpu_cycle += CPU_CYCLES_PER_FRAME;
+        ppu.catchUp(cpu_cycle);
+    });
+    add("ppu", "render_frame", FRAMES, render_ns);
+
+    constexpr uint64_t TILE_CACHE_LOADS = 20'000;
+    TileCache tile_cache;
+    const std::vector<uint8_t> chr(0x2000, 0x5A);
+    const double load_ns = measure(TILE_CACHE_LOADS, [&]() { tile_cache.load(chr.data(), chr.size()); });
+    sink = tile_cache.row(1, 1);
+    add("ppu", "tile_cache_load_8k", TILE_CACHE_LOADS, load_ns);
+
+    // Converting the rendered frame to each host format, into one buffer, as into a texture.
+    constexpr uint64_t CONVERSIONS = 20'000;
+    const std::pair<Palette::Format, const char*> formats[] = {
+        { Palette::RGBA8888, "convert_frame_rgba8888" },
+        { Palette::BGRA8888, "convert_frame_bgra8888" },
+        { Palette::RGB565,   "convert_frame_rgb565" },
+        { Palette::INDEXED8, "convert_frame_indexed8" }
+    };
+    std::vector<uint8_t> pixels(PPU::WIDTH * PPU::HEIGHT * 4);
+    for (const auto& format : formats) {
+        const Palette palette(format.first);
+        const double convert_ns = measure(CONVERSIONS, [&]() {
+            palette.convert(ppu.frameBuffer().data(), ppu.frameBuffer().size(), pixels.data());
+        });
+        sink = pixels[PPU::WIDTH];
+        add("ppu", format.second, CONVERSIONS, convert_ns);
+    }
+}
+
+void Benchmark::benchmarkAPU() {
+    constexpr uint64_t FRAMES = 2'000,
+                       CPU_CYCLES_PER_FRAME = 29'781;
+
+    std::unique_ptr<NES> nes(new NES());
+    nes->load(synthetic_path);
+    APU& apu = nes->apu;
+    std::array<int16_t, 2048> samples;
+
+    // A frame's worth of CPU cycles at a time, then its samples, as at the end of each frame.
+    const auto frame = [&](uint64_t& cpu_cycle) {
+        cpu_cycle += CPU_CYCLES_PER_FRAME;
+        apu.catchUp(cpu_cycle);
+        apu.endFrame();
+        while (apu.readSamples(samples.data(), samples.size()) > 0) {}
+    };
+
+    nes->powerOn();
+    uint64_t cpu_cycle = 0;
+    const double silent_ns = measure(FRAMES, [&]() { frame(cpu_cycle); });
+    add("apu", "frame_silent", FRAMES, silent_ns);
+
+    // Every channel playing: pulses, triangle, noise, and a looping DMC sample.
+    nes->powerOn();
+    const std::pair<uint16_t, uint8_t> writes[] = {
+        { 0x4015, 0x1F },
+        { 0x4000, 0xBF }, { 0x4002, 0xFD }, { 0x4003, 0x00 },
+        { 0x4004, 0x7F }, { 0x4006, 0x7E }, { 0x4007, 0x00 },
+        { 0x4008, 0xFF }, { 0x400A, 0x7E }, { 0x400B, 0x00 },
+        { 0x400C, 0x3F }, { 0x400E, 0x04 }, { 0x400F, 0x00 },
+        { 0x4010, 0x4F }, { 0x4012, 0x00 }, { 0x4013, 0xFF }, { 0x4015, 0x1F }
+    };
+    for (const auto& write : writes) {
+        apu.writeRegister(write.first, write.second); }
+    cpu_cycle = 0;
+    const double playing_ns = measure(FRAMES, [&]() { frame(cpu_cycle); });
+    sink = samples[0];
+    add("apu", "frame_playing", FRAMES, playing_ns);
+
+    // A frame's samples, resampled to 48 kHz, as the emulator does before playing them.
+    const size_t count = APU::SAMPLE_RATE / 60;
+    for (size_t i = 0; i < count; ++i) {
+        samples[i] = (int16_t)((i * 97) & 0x3FFF); }
+    Resampler resampler;
+    resampler.setRates(APU::SAMPLE_RATE, 48000);
+    std::vector<int16_t> resampled;
+    resampled.reserve(2048);
+    const double resample_ns = measure(FRAMES, [&]() {
+        resampler.process(samples.data(), count, resampled);
+        resampled.clear();
+    });
+    add("apu", "resample_frame_48k", FRAMES, resample_ns);
+}
+
+void Benchmark::benchmarkScheduler() {
+    constexpr uint64_t ITERATIONS = 20'000'000;
+
+    // As in the run loop: each event reschedules itself when handled, with another pending.
+    Scheduler scheduler;
+    scheduler.schedule(Scheduler::NMI, Scheduler::NEVER - 1);
+    uint64_t cycle = 0;
+    Scheduler::Event event;
+    const double ns = measure(ITERATIONS, [&]() {
+        scheduler.schedule(Scheduler::PPU_EVENT, ++cycle);
+        scheduler.pop(cycle, event);
+    });
+    sink = event;
+    add("scheduler", "schedule_pop", ITERATIONS, ns);
+}
+
+void Benchmark::benchmarkSaveState() {
+    constexpr uint64_t ITERATIONS = 200'000;
+
+    std::unique_ptr<NES> nes(new NES());
+    nes->load(synthetic_path);
+    nes->powerOn();
+    for (int frame = 0; frame < 10; ++frame) {
+        nes->runFrame(UINT64_MAX); }
+
+    SaveState state;
+    nes->saveState(state); // Sizes it, as a rewind or run-ahead buffer would be, ahead of time.
+    const double save_ns = measure(ITERATIONS, [&]() { nes->saveState(state); });
+    add("save_state", "save", ITERATIONS, save_ns);
+    const double load_ns = measure(ITERATIONS, [&]() { nes->loadState(state); });
+    add("save_state", "load", ITERATIONS, load_ns);
+}
+
+void Benchmark::benchmarkRewind() {
+    constexpr uint64_t ITERATIONS = 20'000;
+
+    std::unique_ptr<NES> nes(new NES());
+    nes->load(synthetic_path);
+    nes->powerOn();
+    for (int frame = 0; frame < 10; ++frame) {
+        nes->runFrame(UINT64_MAX); }
+    Memory& memory = nes->memory;
+
+    // Each state differs from the one before in a byte of RAM. Timed until they're all compressed, so it's the
+    // compression thread's throughput, rather than only the emulation thread's copy.
+    Rewind rewind(64 * 1024 * 1024);
+    const auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < ITERATIONS; ++i) {
+        memory.write((uint16_t)(i & 0x7FF), (uint8_t)i);
+        rewind.push(*nes);
+    }
+    const size_t held = rewind.size(); // Waits for the compression.
+    const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    add("rewind", "push", ITERATIONS, elapsed.count() / ITERATIONS);
+
+    const double step_ns = measure(held - 1, [&]() { rewind.stepBack(*nes); });
+    add("rewind", "step_back", held - 1, step_ns);
+}
+
+void Benchmark::runMacro(const std::string& rom_path, const std::string& name, const uint64_t& frames) {
+    for (const bool recompile : { false, true }) {
+        if (recompile && !Recompiler::isSupported()) {
+            continue; }
+
+        std::unique_ptr<NES> nes(new NES());
+        if (recompile) {
+            nes->enableRecompiler(); }
+        nes->load(rom_path);
+        nes->powerOn();
+
+        const auto start = std::chrono::steady_clock::now();
+        while (nes->frameCount() < frames) {
+            nes->runFrame(UINT64_MAX); }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        Result result;
+        result.group             = recompile ? "rom_recompiled" : "rom_interpreted";
+        result.name              = name;
+        result.iterations        = nes->instructionCount();
+        result.ns_per_op         = elapsed.count() * 1e9 / std::max<uint64_t>(nes->instructionCount(), 1);
+        result.frames            = nes->frameCount();
+        result.instructions      = nes->instructionCount();
+        result.frames_per_second = nes->frameCount() / elapsed.count();
+        results.push_back(result);
+    }
+}
+
+int main(const int argc, char* argv[]) {
+    uint64_t frames = 600;
+    std::string output_path;
+    std::vector<std::string> rom_paths;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--frames"
+             && i + 1 < argc) {
+            frames = std::stoull(argv[++i]);
+        }
+        else if (arg == "--output"
+                  && i + 1 < argc) {
+            output_path = argv[++i];
+        }
+        else if (arg == "-h"
+                  || arg == "--help") {
+            std::cout << "Usage: turbones_bench [--frames <n>] [--output <file>] [<path-to-rom-file>...]" << std::endl;
+            return EXIT_SUCCESS;
+        }
+        else {
+            rom_paths.push_back(arg); }
+    }
+
+    const std::string synthetic_path = "turbones_bench_synthetic.nes";
+    writeFile(synthetic_path, syntheticRom());
+
+    // The emulator reports progress (e.g. "File loaded.") on stdout. Keep it out of the results.
+    std::ostringstream discarded;
+    std::streambuf* const stdout_buffer = std::cout.rdbuf(discarded.rdbuf());
+
+    Benchmark benchmark(synthetic_path);
+    try {
+        benchmark.runMicro();
+        benchmark.runMacro(synthetic_path, "synthetic", frames);
+        for (const std::string& rom_path : rom_paths) {
+            benchmark.runMacro(rom_path, rom_path, frames); }
+    }
+    catch (const std::runtime_error& e) {
+        std::cout.rdbuf(stdout_buffer);
+        std::cerr << "Benchmark failed (" << e.what() << ")." << std::endl;
+        remove(synthetic_path.c_str());
+        return EXIT_FAILURE;
+    }
+
+    std::cout.rdbuf(stdout_buffer);
+    remove(synthetic_path.c_str());
+
+    if (output_path.empty()) {
+        writeJson(std::cout, benchmark.results); }
+    else {
+        std::ofstream output(output_path);
+        writeJson(output, benchmark.results);
+    }
+}
@@ -1,12 +1,201 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+#include <array>
+
+#include <BlipBuffer.hpp>
+#include <SaveState.hpp>
+
+class CPU;
+class Memory;
+class Scheduler;
+
 // Audio Processing Unit.
-// Generates sound.
+// Generates sound, from five channels: two pulse waves, a triangle wave, noise, and delta modulated samples (DMC).
+// The frame counter clocks their envelopes, length counters and sweeps, and may raise an IRQ.
+//
+// Like the PPU, it runs lazily, only caught up to the CPU's cycle when something needs its state:
+// an access to its registers (see Memory), one of its events (see nextEventCycle), or the end of a frame.
+// The mixed output is a level held between changes, so each change is added to a BlipBuffer as a band-limited step,
+// rather than generating samples per cycle. Catching up goes from change to change the same way: only timer clocks of
+// channels that can be heard, and frame counter steps, break the run. The other channels' timers are caught up in bulk.
+// So the cost follows the changes in the output, not the cycles run.
 class APU {
 public:
+    // Output sample rate.
+    static constexpr int SAMPLE_RATE = 44100;
+
+    APU();
+    // The CPU takes the APU's IRQs and is stalled by DMC sample fetches, which read memory.
+    void setCPU(CPU* cpu);
+    void setMemory(Memory* memory);
+    // Sets the scheduler that the APU's events are kept in, as Scheduler::APU_EVENT.
+    void setScheduler(Scheduler* scheduler);
+
+    void powerOn();
+    // Runs the APU up to the CPU's cycle 'cpu_cycle'.
+    void catchUp(const uint64_t& cpu_cycle);
+    // The next CPU cycle the CPU could observe a change at: a frame counter IRQ, or a DMC sample fetch
+    // (which stalls the CPU, and may raise an IRQ). Scheduler::NEVER if none is coming.
+    uint64_t nextEventCycle() const;
+    // CPU cycles of DMC sample fetches since the last call. The CPU was stalled for them.
+    int takeStallCycles();
 
+    // Ends the audio frame at the cycle the APU is caught up to, making its samples available to read.
+    void endFrame();
+    size_t samplesAvailable() const { return blip.samplesAvailable(); }
+    // Reads up to 'count' mono samples into 'out'. Returns the number read.
+    size_t readSamples(int16_t* out, const size_t& count) { return blip.readSamples(out, count); }
+
+    // $4015 read: length counter and IRQ status.
+    uint8_t readStatus();
+    // $4000-$4013, $4015, $4017 writes.
+    void writeRegister(const uint16_t& address, const uint8_t& value);
+
+    // Channels, frame counter and IRQs (see NES::saveState). Not the audio generated: loading ends the audio frame,
+    // and carries on from the level already output, so the sound jumps to the loaded state's without a gap.
+    // Loading doesn't reschedule: the scheduler loads its own state.
+    void saveState(StateWriter& out) const;
+    void loadState(StateReader& in);
 
 private:
+    // Microbenchmarks (see bench/) time the channels.
+    friend class Benchmark;
+
+    // Volume, either constant or decaying. Used by the pulse and noise channels.
+    struct Envelope {
+        uint8_t volume;   // Constant volume, or the decay's divider period.
+        bool    constant;
+        bool    loop;     // Decay loops back to 15. Also halts the length counter.
+        bool    start;
+        uint8_t divider;
+        uint8_t decay;
+
+        void clock();
+        uint8_t output() const { return constant ? volume : decay; }
+    };
+
+    struct Pulse {
+        bool     channel_1; // Pulse 1's sweep negates with one's complement.
+        bool     enabled;
+        uint8_t  duty;
+        uint8_t  step;       // 0-7, in the duty cycle.
+        uint16_t period;     // Timer period, 11 bits. A step every 2 * (period + 1) CPU cycles.
+        int      timer;      // CPU cycles until the next step.
+        uint8_t  length;
+        Envelope envelope;
+        bool     sweep_enabled;
+        uint8_t  sweep_period;
+        bool     sweep_negate;
+        uint8_t  sweep_shift;
+        bool     sweep_reload;
+        uint8_t  sweep_divider;
+
+        uint16_t sweepTarget() const;
+        bool muted() const { return period < 8 || sweepTarget() > 0x7FF; }
+        // The output changes with the duty cycle's steps.
+        bool audible() const { return length > 0 && !muted() && envelope.output() > 0; }
+        void clockSweep();
+        uint8_t output() const;
+    };
+
+    struct Triangle {
+        bool     enabled;
+        uint8_t  step;       // 0-31, in the triangle.
+        uint16_t period;     // A step every period + 1 CPU cycles.
+        int      timer;
+        uint8_t  length;
+        bool     control;    // Holds the linear counter reloading. Also halts the length counter.
+        uint8_t  linear_reload_value;
+        uint8_t  linear;
+        bool     linear_reload;
+
+        // The timer moves along the triangle. Otherwise, the output holds.
+        bool stepping() const { return length > 0 && linear > 0; }
+        uint8_t output() const;
+    };
+
+    struct Noise {
+        bool     enabled;
+        bool     mode;       // Short (93 step) sequence.
+        uint16_t period;     // CPU cycles per shift.
+        int      timer;
+        uint16_t shift;      // 15 bit linear feedback shift register.
+        uint8_t  length;
+        Envelope envelope;
+
+        bool audible() const { return length > 0 && envelope.output() > 0; }
+        uint8_t output() const { return ((shift & 1) || length == 0) ? 0 : envelope.output(); }
+    };
+
+    struct DMC {
+        bool     irq_enabled;
+        bool     loop;
+        uint16_t period;     // CPU cycles per output bit.
+        int      timer;
+        uint8_t  level;      // 7 bit output level.
+        uint16_t sample_address;
+        uint16_t sample_length;
+        // Memory reader.
+        uint16_t address;
+        uint16_t bytes_remaining;
+        uint8_t  sample_buffer;
+        bool     buffer_empty;
+        // Output unit.
+        uint8_t  shifter;
+        uint8_t  bits_remaining;
+        bool     silence;
+    };
+
+    // CPU cycles until the output may change: the next frame counter step, or timer clock of a channel that can be heard.
+    int cyclesUntilChange() const;
+    int cyclesUntilFrameStep() const;
+    // Runs 'cycles' CPU cycles, over which the output is constant, except perhaps on the last.
+    void advance(const int& cycles);
+    // Counts 'timer' down by 'cycles', reloading it with 'period' each time it runs out.
+    // Returns the number of times it ran out, each a clock of its channel.
+    static int clockTimer(int& timer, const int& period, const int& cycles);
+    // Frame counter steps: envelopes and the triangle's linear counter, then length counters and sweeps.
+    void clockQuarterFrame();
+    void clockHalfFrame();
+    // Fetches the DMC's next sample byte, if its buffer is empty and the sample isn't over.
+    void fetchSample();
+    void restartSample();
+    void setFrameIRQ(const bool& active);
+    void setDMCIRQ(const bool& active);
+    // Keeps Scheduler::APU_EVENT at nextEventCycle.
+    void reschedule();
+    // Mixed output level of the channels, for the BlipBuffer.
+    int output() const;
+    // Adds any change in the output since it was last updated, at the current cycle.
+    void updateOutput();
+
+    CPU* cpu = nullptr;
+    Memory* memory = nullptr;
+    Scheduler* scheduler = nullptr;
+
+    uint64_t cycle;             // CPU cycles since power on.
+    uint64_t frame_start_cycle; // Of the current audio frame.
+    int      stall_cycles;
+
+    Pulse    pulse_1;
+    Pulse    pulse_2;
+    Triangle triangle;
+    Noise    noise;
+    DMC      dmc;
 
+    // Frame counter.
+    bool     five_step_mode;
+    bool     frame_irq_inhibit;
+    bool     frame_irq;
+    bool     dmc_irq;
+    int      frame_cycle;       // CPU cycles into the frame counter's sequence.
 
-};
\ No newline at end of file
+    // Nonlinear mixer: output levels of the pulse channels' sum (0-30),
+    // and of 3 * triangle + 2 * noise + DMC (0-202).
+    std::array<int16_t, 31>  pulse_levels;
+    std::array<int16_t, 203> tnd_levels;
+    int last_output;
+    BlipBuffer blip;
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#if TURBONES_SFML
+
+#include <stddef.h>
+#include <stdint.h>
+#include <array>
+
+#include <SFML/Audio.hpp>
+
+#include <RingBuffer.hpp>
+
+// Plays audio samples through SFML.
+// The emulation thread queues samples as each frame completes, and SFML's audio thread takes them as it needs more,
+// through a lock-free queue, so neither waits on the other.
+class AudioStream : public sf::SoundStream {
+public:
+    AudioStream();
+
+    // Before playing.
+    void setSampleRate(const unsigned& sample_rate) { initialize(1, sample_rate); }
+
+    // Emulation thread only. Queues 'count' mono samples to play.
+    // Returns the number queued: if the queue is full (emulation is running ahead), the rest are dropped.
+    size_t push(const int16_t* samples, const size_t& count);
+    // Samples queued, not yet taken by SFML. The emulation thread steers by it (see Emulator).
+    size_t queued() const { return queue.size(); }
+
+private:
+    // Samples handed to SFML at a time. About 23 ms.
+    static constexpr size_t CHUNK_SIZE = 1024;
+
+    // SFML's audio thread.
+    bool onGetData(Chunk& data) override;
+    void onSeek(sf::Time) override {}
+
+    RingBuffer<int16_t, 16384> queue;
+    std::array<int16_t, CHUNK_SIZE> chunk;
+    int16_t last_sample = 0;
+};
+
+#endif
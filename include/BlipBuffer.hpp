@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <array>
+#include <vector>
+
+// Band-limited synthesis of a signal made of steps, as the APU's output is: it holds a level, then jumps to another.
+// Rather than computing the signal at every input clock and filtering it down to the output rate, each change in level
+// is added once, as a band-limited step: a windowed sinc impulse, at the change's position between two output samples,
+// into a buffer of differences. Reading integrates the differences into samples. So the cost is per change, not per clock,
+// and the output has no aliasing from the steps' sharp edges.
+class BlipBuffer {
+public:
+    BlipBuffer();
+
+    // Sets the rate of the clock that changes are timed by, and the output sample rate (both per second). Clears the buffer.
+    void setRates(const double& clock_rate, const double& sample_rate);
+    // Removes every sample, and returns the level to 0.
+    void clear();
+
+    // Adds a change in level of 'delta' at 'clock' clocks into the current frame.
+    void addDelta(const uint32_t& clock, const int& delta);
+    // Ends the current frame 'clocks' clocks in. Its samples can then be read; the next frame starts there.
+    void endFrame(const uint32_t& clocks);
+
+    // Samples ready to be read.
+    size_t samplesAvailable() const { return available; }
+    // Reads up to 'count' samples into 'out', removing them. Returns the number read.
+    size_t readSamples(int16_t* out, const size_t& count);
+
+private:
+    // Resolution of a change's position between two samples. Finer positions use the nearest.
+    static constexpr int PHASE_BITS = 5,
+                         PHASES     = 1 << PHASE_BITS;
+    // Samples each impulse spreads over. Output lags behind by half of them.
+    static constexpr int TAPS = 16;
+    // Each phase of the impulse sums to 1 << KERNEL_BITS, so that integrated, a step rises exactly by its delta.
+    static constexpr int KERNEL_BITS = 12;
+    // Fraction bits of sample positions.
+    static constexpr int FRACTION_BITS = 32;
+    // Fixed-point decay of the integrator per sample, as a high-pass filter that removes DC offset.
+    static constexpr int HIGH_PASS_SHIFT = 9;
+    // Samples held. Frames that aren't read in time have their oldest samples dropped.
+    static constexpr size_t CAPACITY = 8192;
+
+    // Removes the oldest 'count' samples, writing them to 'out' unless it's null.
+    void removeSamples(int16_t* out, const size_t& count);
+
+    uint64_t factor; // Samples per clock, with FRACTION_BITS fraction bits.
+    uint64_t offset; // Position of the current frame's start, in samples, with FRACTION_BITS fraction bits.
+    size_t available;
+    int32_t integrator;
+
+    std::array<std::array<int32_t, TAPS>, PHASES> kernel;
+    std::vector<int32_t> differences;
+};
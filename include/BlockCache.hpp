@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+class CPU;
+
+// Cache of predecoded basic blocks of PRG ROM code.
+// A block is a run of instructions ending at the first one that changes control flow (branch, jump, return, BRK),
+// or Interrupt Disable (see 'endsBlock').
+// Each instruction is stored with its handler, its operand already fetched, and its cycle cost,
+// so executing it skips fetching and decoding.
+//
+// Blocks are keyed by the host address of their first instruction, rather than its CPU address.
+// A mapper switching banks changes which ROM bytes are behind a CPU address,
+// and so which blocks are found there, without invalidating any block.
+// Operands are decoded for a CPU address, though, so a bank mapped at more than one (e.g. mirrored NROM-128)
+// has a block for each, chained from the same host address.
+// To keep that true, blocks never extend past the end of the 256-byte memory page they start in,
+// as the next page may be mapped to a different bank.
+// Only read-only memory is cached, so writes never invalidate a block.
+class BlockCache {
+public:
+    static constexpr int MAX_BLOCK_LENGTH = 64; // Instructions.
+
+    using Handler = void (*)(CPU& cpu, const uint16_t& operand);
+
+    // An instruction, decoded.
+    struct Operation {
+        Handler handler;
+        uint16_t operand; // Bytes following the opcode. For immediate and relative modes, their address.
+        uint16_t next_pc; // PC once the instruction is fetched.
+        uint8_t  cycles;
+    };
+
+    struct Block {
+        uint16_t pc;         // CPU address the block was decoded at.
+        uint32_t first;      // Index of the first operation.
+        uint32_t length;     // Number of operations.
+        uint32_t cycles;     // Taken by all of them.
+        uint32_t executions; // Times run, counted until it's hot enough to recompile.
+        void*    native;     // Recompiled code (see Recompiler), or null.
+        bool     idle_loop;  // Set by the CPU. See CPU::idleLoopCycles.
+        uint32_t next;       // Index of the block at the same host address, for another CPU address, or NONE.
+    };
+
+    // True if the instruction 'opcode' is the last of its block.
+    // Besides control flow, that's CLI, SEI and PLP, as the CPU polls for interrupts (between blocks) right after
+    // Interrupt Disable changes. Blocks are run interpreted or recompiled, which both end them here.
+    static bool endsBlock(const uint8_t& opcode) {
+        return (opcode & 0x1F) == 0x10 // Branches.
+            || opcode == 0x00  // BRK
+            || opcode == 0x20  // JSR
+            || opcode == 0x28  // PLP
+            || opcode == 0x40  // RTI
+            || opcode == 0x4C  // JMP
+            || opcode == 0x58  // CLI
+            || opcode == 0x60  // RTS
+            || opcode == 0x6C  // JMP (indirect)
+            || opcode == 0x78; // SEI
+    }
+
+    // Discards all blocks, and sets the memory that may be cached (i.e. PRG ROM).
+    void reset(const uint8_t* rom, const size_t& rom_size);
+
+    // True if 'code' points into cacheable memory.
+    bool covers(const uint8_t* code) const {
+        return code >= rom && code < rom + rom_size;
+    }
+
+    // Returns the block starting at 'code', decoded at CPU address 'pc'. Null if it isn't cached.
+    // 'code' must be covered.
+    Block* find(const uint8_t* code, const uint16_t& pc) {
+        uint32_t index = block_index[code - rom];
+        if (index == UNCACHEABLE) {
+            return nullptr; }
+        while (index != NONE) {
+            Block& block = blocks[index];
+            if (block.pc == pc) {
+                return &block; }
+            index = block.next;
+        }
+        return nullptr;
+    }
+
+    // True if decoding at 'code' previously failed, so no block can be cached there.
+    bool isUncacheable(const uint8_t* code) const {
+        return block_index[code - rom] == UNCACHEABLE;
+    }
+
+    // Stores a block. There must be none at 'code' for 'pc' already (see 'find').
+    Block& insert(const uint8_t* code, const uint16_t& pc, const std::vector<Operation>& decoded);
+    // Marks 'code' as impossible to cache (e.g. its first instruction crosses a page).
+    void markUncacheable(const uint8_t* code);
+    // Drops every block's recompiled code, keeping the blocks. Each must become hot again to be recompiled.
+    void clearNative();
+
+    const Operation* operations(const Block& block) const {
+        return &operations_storage[block.first];
+    }
+
+private:
+    static constexpr uint32_t NONE        = 0xFFFFFFFF,
+                              UNCACHEABLE = 0xFFFFFFFE;
+
+    const uint8_t* rom = nullptr;
+    size_t rom_size = 0;
+
+    // Index into 'blocks' of the last block stored starting at each byte of ROM, or NONE or UNCACHEABLE.
+    std::vector<uint32_t> block_index;
+    std::vector<Block> blocks;
+    std::vector<Operation> operations_storage;
+};
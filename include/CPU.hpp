@@ -2,21 +2,89 @@
 
 #include <stdint.h>
 #include <array>
-#include <bitset>
+#include <vector>
 
+#include <BlockCache.hpp>
 #include <Memory.hpp>
+#include <Opcodes.hpp>
+#include <Recompiler.hpp>
+#include <SaveState.hpp>
+#include <Scheduler.hpp>
+#include <Tracer.hpp>
 
 // The NES CPU, the 2A03 (or 2A07 for PAL), is based on the 6502.
 class CPU {
 public:
-    CPU(Memory* mem);
+    CPU(Memory* mem, Tracer* tracer);
 
     // Initialize registers to their power on state.
     void powerOn();
-    // Handle any interrupt and execute next opcode.
-    void step();
+    // Sets the scheduler whose events a step must not run past.
+    void setScheduler(Scheduler* scheduler) { this->scheduler = scheduler; }
+    // Handle any interrupt and execute the next instruction,
+    // or the basic block starting at the PC, if it's in ROM, up to the instruction that reaches 'deadline'
+    // (the next event, which must not be run past), or that brings an event before it.
+    // A recompiled block is followed by any others that can run before 'deadline' (see 'nextNativeBlock').
+    // Returns the number of cycles taken.
+    int step(const uint64_t& deadline);
+
+    // Interrupts. Checked before each step, so serviced between instructions (or blocks).
+    // Blocks end wherever one may become serviceable: at events, and after instructions that change Interrupt Disable.
+    // Sources of the IRQ line. Each holds it independently, as the line is shared (wired-OR).
+    enum IRQSource : uint8_t {
+        IRQ_MAPPER        = 1 << 0,
+        IRQ_FRAME_COUNTER = 1 << 1,
+        IRQ_DMC           = 1 << 2
+    };
+    // NMI is edge triggered: each request is serviced once, regardless of Interrupt Disable.
+    void requestNMI() { nmi_pending = true; }
+    // IRQ is level triggered: serviced for as long as any source holds the line, while Interrupt Disable is clear.
+    void setIRQ(const IRQSource& source, const bool& active);
+
+    // Discards predecoded code, and sets the memory that code may be predecoded from (i.e. PRG ROM).
+    void resetBlockCache(const uint8_t* rom, const size_t& rom_size);
+    // Sets the recompiler that hot blocks are translated with. Null (the default) only interprets.
+    void setRecompiler(Recompiler* recompiler);
+
+    // Idle loops: short loops that only poll RAM or PPUSTATUS, e.g. waiting for vblank or an NMI.
+    // If the last step ran one whole iteration of an idle loop, and returned to its start,
+    // returns that iteration's cycles. Otherwise 0.
+    // Until something the loop reads changes (i.e. a hardware event), every further iteration does the same,
+    // so they can be skipped with 'skipIdleLoop'.
+    int idleLoopCycles() const { return idle_loop_cycles; }
+    // Accounts for 'iterations' more iterations of the idle loop, without executing them.
+    void skipIdleLoop(const int& iterations);
+    // Total cycles skipped in idle loops.
+    uint64_t idleCyclesSkipped() const { return idle_cycles_skipped; }
+    // Total cycles since power on, including skipped ones. The console's master clock, in CPU cycles.
+    // An instruction's cost is added before it runs, so while it runs, this is the cycle it ends on.
+    uint64_t cycleCount() const { return cycles; }
+    // While an instruction runs, the cycle of its bus access, for devices to catch up to before it:
+    // its last cycle, which is where the operand read or write falls for every addressing mode that reaches I/O.
+    uint64_t accessCycle() const { return cycles - 1; }
+    // Suspends the CPU for 'cycles' cycles, e.g. while DMA uses the bus. Its clock runs on.
+    void stall(const int& cycles) { this->cycles += cycles; }
+    // Total instructions executed, not counting skipped idle loop iterations.
+    uint64_t instructionCount() const { return instructions; }
+
+    // Adds the CPU's state to a hash of the whole console's (see NES::stateHash).
+    uint64_t hashState(const uint64_t& hash) const;
+    // Registers, flags, cycle count and interrupt lines (see NES::saveState).
+    void saveState(StateWriter& out) const;
+    void loadState(StateReader& in);
 
 private:
+    // Generated code runs on the CPU's registers.
+    friend class Recompiler;
+    // Microbenchmarks (see bench/) execute single instructions.
+    friend class Benchmark;
+
+    // Executions of a block before it's recompiled.
+    // Most blocks run only a few times, e.g. during start up, and aren't worth translating.
+    static constexpr uint32_t HOT_BLOCK_THRESHOLD = 8;
+    // Instructions in an idle loop, including the closing jump or branch.
+    static constexpr uint32_t MAX_IDLE_LOOP_LENGTH = 4;
+
     // Positions of status register flags. See status register comments.
     static constexpr int CARRY_FLAG = 0,
                          ZERO_FLAG = 1,
@@ -27,8 +95,77 @@ private:
                          OVERFLOW_FLAG = 6,
                          NEGATIVE_FLAG = 7;
 
+    // Services a pending NMI, or IRQ unless they're disabled. Returns false if neither was serviced.
+    // 'delayed' is whether the last instruction changed Interrupt Disable (see 'interrupt_disable_delayed').
+    bool handleInterrupt(const bool& delayed);
+    // Pushes the PC and status, and jumps to the handler at 'vector'.
+    void interrupt(const uint16_t& vector);
+
     // Execute opcode instruction.
     void execute(const uint8_t& opcode);
+    // Logs the instruction at the PC, and the registers, before it executes.
+    void trace();
+
+    // Executes the predecoded block starting at the PC, decoding it first if it isn't cached, up to 'deadline'.
+    // Returns false, executing nothing, if the code there can't be cached.
+    bool executeBlock(const uint8_t* code, const uint64_t& deadline);
+    // Runs a block starting at the PC, recompiled, or else predecoded, stopping at the instruction that reaches
+    // 'deadline', or that schedules an event before it. Recompiled code only checks after writes (which are what
+    // schedule events), so it's only run if the whole block ends before 'deadline'.
+    void runBlock(const uint8_t* code, BlockCache::Block& block, const uint64_t& deadline);
+    // The recompiled block at the PC, if it can be run straight after the one before, within the same step:
+    // no interrupt is due, no event was scheduled before 'deadline', the whole block ends by it,
+    // and it isn't an idle loop, which is left for NES::step to skip. Null otherwise.
+    BlockCache::Block* nextNativeBlock(const uint64_t& deadline);
+    // True if the block is an idle loop: it jumps back to its own start,
+    // and everything before that only reads memory that changes on hardware events.
+    bool isIdleLoop(const uint8_t* code, const BlockCache::Block& block) const;
+    // Decodes the instructions starting at the PC, up to the end of the block, or the end of the memory page.
+    // Returns the number of instructions decoded. May be 0.
+    int decodeBlock(const uint8_t* code, std::vector<BlockCache::Operation>& decoded);
+
+    // Operation handlers, indexed by opcode value in 'operation_table'.
+    // Each is generated at compile time from an addressing mode and an instruction,
+    // so that both are inlined into a single function.
+    // 'handler' fetches the operand at the PC, and also adds the operation's cost from 'cycle_table', before it runs.
+    // 'decoded' takes an operand already fetched, for predecoded blocks, which add the cost themselves.
+    using Handler = void (*)(CPU& cpu);
+    struct Operation {
+        Handler handler;
+        BlockCache::Handler decoded;
+    };
+    static const std::array<Operation, 0x100> operation_table;
+
+    // Pairs the handlers of an instruction, with the addressing mode giving it an address.
+    template <uint8_t opcode, uint16_t (CPU::*mode)(const uint16_t&), void (CPU::*instruction)(const uint16_t&)>
+    static constexpr Operation operation() {
+        return { &handle<opcode, mode, instruction>, &handleDecoded<opcode, mode, instruction> };
+    }
+    // Implied or accumulator addressing. All the necessary information is in the opcode.
+    template <uint8_t opcode, void (CPU::*instruction)()>
+    static constexpr Operation operation() {
+        return { &handle<opcode, instruction>, &handleDecoded<opcode, instruction> };
+    }
+    // Unofficial opcodes. Logged and skipped. Never predecoded.
+    template <uint8_t opcode>
+    static constexpr Operation unsupported() {
+        return { &handleUnsupported<opcode>, nullptr };
+    }
+
+    template <uint8_t opcode, uint16_t (CPU::*mode)(const uint16_t&), void (CPU::*instruction)(const uint16_t&)>
+    static void handle(CPU& cpu);
+    template <uint8_t opcode, uint16_t (CPU::*mode)(const uint16_t&), void (CPU::*instruction)(const uint16_t&)>
+    static void handleDecoded(CPU& cpu, const uint16_t& operand);
+    template <uint8_t opcode, void (CPU::*instruction)()>
+    static void handle(CPU& cpu);
+    template <uint8_t opcode, void (CPU::*instruction)()>
+    static void handleDecoded(CPU& cpu, const uint16_t& operand);
+    template <uint8_t opcode>
+    static void handleUnsupported(CPU& cpu);
+
+    // Fetches the bytes following the opcode. For immediate and relative modes, returns their address instead.
+    template <AddressingMode mode>
+    uint16_t fetchOperand();
 
     // Returns value at address in the program counter (PC), then increments the PC.
     uint8_t fetch();
@@ -43,18 +180,58 @@ private:
     // Returns 16-bit value, concatenated (in little endian order)
     // from 8-bit values located at address+1 and address.
     uint16_t read16(const uint16_t& address);
+    // Like read16, but the high byte is read from the start of the same page, if address is at its end.
+    // The 6502 doesn't carry into the high byte of pointers, for zero page pointers and JMP indirect.
+    uint16_t read16WithinPage(const uint16_t& address);
     // Splits 16-bit value into two 8-bit values and push them to stack.
     void push16(const uint16_t& value);
     // Pops two 8-bit values and returns them concatenated as a 16-bit value.
     uint16_t pop16();
 
-    void setZeroFlag(const uint8_t& value);
-    void setNegativeFlag(const uint8_t& value);
+    // Packs the flags into the status register's format.
+    // 'break_flag' is only set in copies pushed by PHP and BRK. The unused bit is always set.
+    uint8_t status(const bool& break_flag) const;
+    // Unpacks a value in the status register's format into the flags. Ignores the break and unused bits.
+    void setStatus(const uint8_t& value);
+
+    // Flags derived from the lazily kept results. See 'Status register'.
+    bool carry()    const { return carry_result & 0x100; }
+    bool zero()     const { return zero_result == 0; }
+    bool overflow() const { return overflow_result & 0x80; }
+    bool negative() const { return negative_result & 0x80; }
+
+    // Sets Zero and Negative flags from an 8-bit result.
+    void setZeroNegative(const uint8_t& value) {
+        zero_result = value;
+        negative_result = value;
+    }
+
+    // Shared by ADC and SBC (which adds the complement of its operand).
+    void addWithCarry(const uint8_t& value);
+    // Shared by CMP, CPX and CPY. Sets Carry, Zero and Negative flags from (reg - value).
+    void compare(const uint8_t& reg, const uint8_t& value);
 
     Memory* memory;
+    Tracer* tracer;
+    Scheduler* scheduler = nullptr;
+    Recompiler* recompiler = nullptr;
+
+    BlockCache block_cache;
+    std::vector<BlockCache::Operation> decode_buffer;
 
     // Tracks number of emulated cycles.
-    int cycles;
+    uint64_t cycles;
+
+    int      idle_loop_cycles = 0; // See 'idleLoopCycles'.
+    uint64_t idle_cycles_skipped = 0;
+    uint64_t instructions = 0;
+
+    bool    nmi_pending = false;
+    uint8_t irq_lines   = 0; // IRQSource flags of the sources holding the line.
+    // Set by CLI, SEI and PLP when they change Interrupt Disable, until the next interrupt poll.
+    // The 6502 polls before the change takes effect, so that poll still sees the value from before,
+    // e.g. an IRQ held back by the flag is only serviced after the instruction following CLI.
+    bool    interrupt_disable_delayed = false;
 
     // Accumulator. Used for arithmethical and logical operations.
     uint8_t r_a;
@@ -80,82 +257,72 @@ private:
     // 6: Overflow Flag. Set when a signed arithmetic operation results in an invalid (overflowed) value. (e.g. 127+127 = -2).
     // 7: Negative Flag. Set if the result of the last operation had bit 7 (the leftmost) set to a one,
     //    denoting negativity in a signed binary number.
-    std::bitset<8> r_p;
+    //
+    // Nearly every instruction sets Zero and Negative, and most of those values are overwritten
+    // before anything reads them. So rather than packing bits on each instruction,
+    // the flags are stored unpacked, and Carry, Zero, Overflow and Negative keep the value they're derived from.
+    // The flag itself is only computed when a branch reads it,
+    // and the register is only packed (see 'status') when PHP, BRK or an interrupt pushes it.
+    uint16_t carry_result;    // Carry is bit 8. (Bit 8 of an unsigned sum, or the bit shifted out.)
+    uint8_t  zero_result;     // Zero is set if this is 0.
+    uint8_t  overflow_result; // Overflow is bit 7.
+    uint8_t  negative_result; // Negative is bit 7.
+    bool interrupt_disable,
+         decimal_mode;
 
 
 
-    // Addressing Modes. Gives an address to an instruction.
+    // Addressing Modes. Gives an address to an instruction, from its operand (see 'fetchOperand').
     // Many instructions have multiple opcodes, for each addressing mode they use.
 
     // Operand is an 8-bit constant value.
-    uint16_t immediate() {
-        const uint16_t address = pc;
-        ++pc;
-        return address;
+    uint16_t immediate(const uint16_t& operand) {
+        return operand;
     }
     // Operand is an 8-bit address, addressing only the first 0x100 bytes of memory.
-    uint16_t zeroPage() {
-        const uint16_t address = fetch();
-        return address;
+    uint16_t zeroPage(const uint16_t& operand) {
+        return operand;
     }
-    // Like Zero Page, but adds X register to the address.
-    uint16_t zeroPageX() {
-        const uint16_t address = fetch() + r_x;
-        return address;
+    // Like Zero Page, but adds X register to the address. Wraps around within the zero page.
+    uint16_t zeroPageX(const uint16_t& operand) {
+        return (operand + r_x) & 0xFF;
     }
-    // Like Zero Page, but adds Y register to the address.
-    uint16_t zeroPageY() {
-        const uint16_t address = fetch() + r_y;
-        return address;
+    // Like Zero Page, but adds Y register to the address. Wraps around within the zero page.
+    uint16_t zeroPageY(const uint16_t& operand) {
+        return (operand + r_y) & 0xFF;
     }
     // Corresponds to branch instructions. The (signed) 8-bit operand is an offset,
     // to be added to the PC if the condition is true, or ignored if false.
-    uint16_t relative() {
-        const uint16_t address = pc;
-        ++pc;
-        return address;
+    uint16_t relative(const uint16_t& operand) {
+        return operand;
     }
     // Operand is a full 16-bit address.
-    uint16_t absolute() {
-        const uint16_t address = fetch16();
-        return address;
+    uint16_t absolute(const uint16_t& operand) {
+        return operand;
     }
     // Like Absolute, but adds X register to the address.
-    uint16_t absoluteX() {
-        const uint16_t address = fetch16() + r_x;
-        return address;
+    uint16_t absoluteX(const uint16_t& operand) {
+        return operand + r_x;
     }
     // Like Absolute, but adds Y register to the address.
-    uint16_t absoluteY() {
-        const uint16_t address = fetch16() + r_y;
-        return address;
+    uint16_t absoluteY(const uint16_t& operand) {
+        return operand + r_y;
     }
     // Operand is a 16-bit address points to another address.
-    uint16_t indirect() {
-        const uint16_t firstAddress = fetch16();
-        const uint16_t secondAddress = read16(firstAddress);
-        return secondAddress;
+    uint16_t indirect(const uint16_t& operand) {
+        return read16WithinPage(operand);
     }
     // Operand is an 8-bit address to which the X register is added,
     // pointing to another address.
-    uint16_t indexedIndirect() {
-        const uint16_t firstAddress = fetch() + r_x;
-        const uint16_t secondAddress = read16(firstAddress);
-        return secondAddress;
+    uint16_t indexedIndirect(const uint16_t& operand) {
+        return read16WithinPage((operand + r_x) & 0xFF);
     }
     // Operand is an 8-bit address pointing to another address,
     // (the latter) to which the Y register is added.
-    uint16_t indirectIndexed() {
-        const uint16_t firstAddress = fetch();
-        const uint16_t secondAddress = read16(firstAddress) + r_y;
-        return secondAddress;
+    uint16_t indirectIndexed(const uint16_t& operand) {
+        return read16WithinPage(operand) + r_y;
     }
 
-    //// No operands. All the necessary information is in the opcode.
-    //void implied();
-    //// Special type of Implied, operating directing on the accumulator register. May be unnecessary.
-    //void accumulator();
-
 
 
     // Instructions
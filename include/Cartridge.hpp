@@ -3,34 +3,63 @@
 #include <stdint.h>
 #include <string>
 #include <array>
-#include <vector>
+#include <memory>
 
-// Game cartridge. Takes iNES formatted NES ROMs (iNES is the standard format).
+#include <MappedFile.hpp>
+#include <Span.hpp>
+
+// Game cartridge. Takes iNES formatted NES ROMs (iNES is the standard format), including NES 2.0 headers.
+// The ROM file is mapped into memory (see MappedFile), and PRG and CHR ROM point straight into it, rather than being
+// copied out. Copies of a cartridge share the mapping.
 class Cartridge {
 public:
     static constexpr int TRAINER_SIZE  =  0x200, // Size of space allocated for trainer. 512 B.
                          PRG_PAGE_SIZE = 0x4000, // Program ROM page size. 16 KB.
                          CHR_PAGE_SIZE = 0x2000; // Character ROM page size.  8 KB.
 
+    class Header;
+
     Cartridge();
     Cartridge(const std::string& rom_path);
+    // Takes the header as given (e.g. from a RomIndex), rather than parsing and checking the file's.
+    // Only checks that the file holds the ROM the header describes.
+    Cartridge(const std::string& rom_path, const Header& known_header);
 
     // Program data.
-    std::vector<uint8_t> prg_rom;
-    // Character data, aka pattern tables. Used for graphics.
-    std::vector<uint8_t> chr_rom;
+    Span<const uint8_t> prg_rom;
+    // Character data, aka pattern tables. Used for graphics. Empty if the cartridge has CHR RAM instead.
+    Span<const uint8_t> chr_rom;
+
+    // Of the ROM file, header included.
+    size_t fileSize() const { return file ? file->size() : 0; }
 
     // iNES header data, found in the first 16 bytes of iNES formatted ROMs.
     class Header {
     public:
         static constexpr int HEADER_SIZE = 0x10; // Size of iNES header. 16 B.
 
+        // CPU/PPU timing the game was made for.
+        enum Timing {
+            NTSC,         // RP2C02. North America, Japan.
+            PAL,          // RP2C07. Europe, Australia.
+            MULTI_REGION, // Runs on either.
+            DENDY         // UMC 6527P clones. Russia.
+        };
+
         // Takes first 16 bytes of loaded ROM file.
         void load(const std::array<uint8_t, HEADER_SIZE>& input);
 
-        uint8_t prg_rom_pages, // Number of 16 KB program ROM pages.
-            chr_rom_pages, // Number of  8 KB character ROM pages (0 indicates CHR RAM).
-            mapper_number;
+        // Sizes in bytes.
+        uint64_t prg_rom_size,
+                 chr_rom_size;    // 0 indicates CHR RAM.
+        uint32_t prg_ram_size,    // Work RAM at $6000-$7FFF, lost at power off.
+                 prg_nvram_size,  // Battery backed PRG RAM (or EEPROM).
+                 chr_ram_size,
+                 chr_nvram_size;
+
+        uint16_t mapper_number;   // 12 bits with NES 2.0, 8 otherwise.
+        uint8_t  submapper;       // NES 2.0 only. 0 otherwise.
+        Timing   timing;
 
         bool mirroring, // 0 = horizontal, 1 = vertical.
             battery, // SRAM at $6000-$7FFF battery backed.
@@ -39,27 +68,31 @@ public:
             vs_unisystem, // VS. System arcade ROM.
             playchoice_10, // PlayChoice-10 arcade system ROM.
             nes_2; // NES 2.0 header. The format extends iNES.
-                   // TODO: Add NES 2.0 extension.
+
+        // NES 2.0 only. 0 otherwise.
+        uint8_t console_type,     // 0: NES/Famicom, 1: VS. System, 2: PlayChoice-10, 3: extended (see below).
+                vs_type,          // VS. System PPU (low nibble) and hardware type (high nibble),
+                                  // or with an extended console type, the type (low nibble).
+                misc_roms,        // Number of miscellaneous ROMs after CHR ROM.
+                expansion_device; // Default expansion device (e.g. 1 is standard controllers).
+
     private:
         // Checks if ROM file begins with an iNES header.
         void checkHeader(const std::array<uint8_t, HEADER_SIZE>& input);
+        // Fields of iNES 1.0 headers, or of NES 2.0.
+        void loadINES(const std::array<uint8_t, HEADER_SIZE>& input);
+        void loadNES2(const std::array<uint8_t, HEADER_SIZE>& input);
     };
 
     Header header;
 
 private:
-    // Sizes in bytes.
-    static constexpr int MAX_FILE_SIZE = 0x100000; // Max NES ROM file size accepted. 1 MB.
-                                                   // The biggest official NES ROM is 6 Mb.
-
     // Attempts to load file. Accepts iNES files (typically denoted .nes in the file extension).
     void loadRom(const std::string& rom_path);
-    // Throws exception if stream's fail or bad bits are set.
-    void checkStream(const std::ifstream& rom, const std::string& rom_path);
-    // Throws exception if file size is greater than max allowed.
-    void checkFileSize(std::ifstream& rom);
-
-    void loadHeader(std::ifstream& rom);
-    void loadPRG(std::ifstream& rom);
-    void loadCHR(std::ifstream& rom);
-};
\ No newline at end of file
+    // Throws exception if the file is smaller than its header says.
+    void checkFileSize(const std::string& rom_path) const;
+    // Points PRG and CHR ROM into the file, where the header says they are.
+    void mapRom();
+
+    std::shared_ptr<const MappedFile> file; // The ROM file, which 'prg_rom' and 'chr_rom' point into.
+};
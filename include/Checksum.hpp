@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <array>
+#include <string>
+
+// Checksums that ROM databases (No-Intro, NesCartDB) identify games by: CRC32 and SHA-1, of the ROM data without its header.
+// Both use the CPU's instructions for them where it has them: carry-less multiplication (PCLMULQDQ) to fold
+// 64 bytes at a time for CRC32, and the SHA extensions for SHA-1. Otherwise, table driven and plain code.
+
+// Adds 'size' bytes at 'data' to 'crc'. Start with 0. The same CRC32 as zlib's.
+uint32_t updateCrc32(const uint32_t& crc, const void* data, const size_t& size);
+
+class Sha1 {
+public:
+    typedef std::array<uint8_t, 20> Digest;
+
+    Sha1();
+    void update(const void* data, const size_t& size);
+    // The digest of everything added. Resets, to start again.
+    Digest finish();
+
+private:
+    static constexpr size_t BLOCK_SIZE = 64;
+
+    // Hashes 'blocks' whole blocks at 'data'.
+    void processBlocks(const uint8_t* data, const size_t& blocks);
+    void reset();
+
+    std::array<uint32_t, 5> state;
+    std::array<uint8_t, BLOCK_SIZE> buffer; // Input short of a whole block.
+    size_t   buffered;
+    uint64_t length;     // Bytes added.
+    bool     use_sha_ni; // The CPU has the SHA extensions.
+};
+
+// 'size' bytes, as lowercase hex.
+std::string toHex(const uint8_t* bytes, const size_t& size);
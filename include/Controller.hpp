@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <SaveState.hpp>
+
+// Standard NES controller.
+// Writing 1 then 0 to $4016 latches the buttons held, which are then read out one per read,
+// through $4016 (controller 1) or $4017 (controller 2), in the order of 'Button'.
+class Controller {
+public:
+    enum Button : uint8_t {
+        A      = 1 << 0,
+        B      = 1 << 1,
+        SELECT = 1 << 2,
+        START  = 1 << 3,
+        UP     = 1 << 4,
+        DOWN   = 1 << 5,
+        LEFT   = 1 << 6,
+        RIGHT  = 1 << 7
+    };
+
+    // Sets the buttons currently held, as Button flags.
+    void setButtons(const uint8_t& buttons);
+
+    // $4016 write. Bit 0 is the strobe. While it's set, the buttons are continuously reloaded.
+    void write(const uint8_t& value);
+    // Returns the next button's state in bit 0. After all 8, returns 1.
+    uint8_t read();
+
+    // The latched buttons and strobe, but not the buttons held, which are input (see SaveState).
+    void saveState(StateWriter& out) const;
+    void loadState(StateReader& in);
+
+private:
+    uint8_t buttons = 0;
+    uint8_t shift = 0; // Buttons latched, yet to be read.
+    bool strobe = false;
+};
@@ -1,16 +1,110 @@
 #pragma once
 
+#include <stdint.h>
+#include <array>
+#include <atomic>
+#include <fstream>
+#include <memory>
 #include <string>
+#include <vector>
 
+#include <AudioStream.hpp>
+#include <InputScript.hpp>
 #include <NES.hpp>
+#include <Palette.hpp>
+#include <Resampler.hpp>
+#include <Rewind.hpp>
+#include <RingBuffer.hpp>
+#include <TripleBuffer.hpp>
 
+// Runs the NES, headless or in a window.
+// In a window, the NES runs on a thread of its own, at its own frame rate. It publishes each completed frame through
+// a triple buffer, and the window thread presents the latest one, so window events, texture uploads and vsync waits
+// never hold up emulation. Controller input goes back through a queue, and audio samples go out through another,
+// to SFML's audio thread. No thread waits on a lock.
+//
+// Audio is resampled from the APU's rate to 'sample_rate'. The audio device plays at that rate by its own clock, which
+// drifts from the one frames are paced by, so the resampling ratio is nudged by up to half a percent, by how far the
+// samples queued for the device are from their target: too few, and more are made per frame; too many, fewer.
+// The device's consumption so steers the output, and the queue neither runs dry (crackling) nor fills up (lag).
+//
+// With a rewind budget, each frame's state is kept (see Rewind), and holding Backspace steps back through them.
 class Emulator {
 public:
     void run();
 
     std::string rom_path;
+    // ROM index (see RomIndex). If set, 'rom_path' is looked up in it, by path, CRC32 or SHA-1, and loaded as indexed.
+    std::string index_path;
+    // Rather than running, scan the directory 'rom_path' for ROM files, and write their index to 'index_path',
+    // with the header corrections from 'header_database_path' (see HeaderDatabase), if set.
+    bool build_index = false;
+    std::string header_database_path;
+    std::string trace_path; // Instruction trace log. Not traced if empty.
+    bool recompile = false; // Translate hot code to native code.
+    bool headless = false;  // Run without a window, as fast as possible. Always, in builds without SFML.
+    PPU::Engine ppu_engine = PPU::SCANLINE;
+
+    // Run budget. The run stops at whichever comes first. 0 is unlimited.
+    uint64_t frame_budget = 0;
+    uint64_t cycle_budget = 0; // CPU cycles.
+
+    std::string input_path; // Input script (see InputScript). No input if empty.
+
+    size_t rewind_budget = 0; // Bytes of rewind history. No rewinding if 0.
+
+    int sample_rate = 48000; // Of the audio, as played and written.
+    std::string audio_path;  // Audio, as a 16-bit mono WAV file, written as it's made. Not written if empty.
+
+    // Written once the run stops. Not written if empty.
+    std::string frame_buffer_path; // Raw pixels, 256x240, row by row, in 'frame_format'.
+    Palette::Format frame_format = Palette::INDEXED8;
+    std::string ram_path;          // Raw 2 KB of internal RAM.
+    std::string hash_path;         // State hash (see NES::stateHash), in hex.
 
 private:
+    // Controller buttons changed by the window thread, for the emulation thread.
+    struct InputEvent {
+        uint8_t controller;
+        uint8_t buttons; // Controller::Button flags.
+    };
+    // A frame, converted for the window.
+    typedef std::array<uint8_t, PPU::WIDTH * PPU::HEIGHT * 4> Frame;
+
+    // Runs frames until a budget runs out or 'running' is cleared. If 'realtime', at the NES's frame rate,
+    // publishing each frame to 'frames'. Otherwise, as fast as possible.
+    void emulate(const bool& realtime);
+    // Resamples the frame's audio, writing it to 'audio_file', and if 'realtime', queuing it to play.
+    void outputAudio(const bool& realtime);
+#if TURBONES_SFML
+    // Runs 'emulate' on a thread of its own while presenting frames and reading the keyboard, until either stops.
+    void runWindowed();
+#endif
+    // Builds and writes the ROM index.
+    void buildIndex() const;
+    // Prints emulation speed.
+    void printStats(const double& seconds) const;
+    // Writes the output files requested.
+    void writeOutputs() const;
+    // Writes the WAV header of 'audio_file', for 'audio_bytes' of samples.
+    void writeAudioHeader();
+
     NES nes;
+    InputScript input;
+
+    std::atomic<bool> running{false};
+    std::atomic<bool> rewinding{false}; // Rewind key held, for the emulation thread.
+    std::unique_ptr<Rewind> rewind;
+    std::array<uint8_t, 2> keyboard_buttons{}; // Emulation thread's copy, from 'input_events'.
+    RingBuffer<InputEvent, 64> input_events;
+    TripleBuffer<Frame> frames;
+    Palette frame_palette{Palette::RGBA8888};
+    Resampler resampler;
+    std::vector<int16_t> resampled;
+    std::ofstream audio_file;
+    uint32_t audio_bytes = 0;
+#if TURBONES_SFML
+    AudioStream audio;
+#endif
 
 };
\ No newline at end of file
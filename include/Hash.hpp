@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 64-bit FNV-1a. Fast and simple, but not cryptographic.
+// Used to fingerprint emulator state, so that runs can be compared without dumping all of it.
+constexpr uint64_t FNV_OFFSET_BASIS = 0xCBF2'9CE4'8422'2325,
+                   FNV_PRIME        = 0x0000'0100'0000'01B3;
+
+// Adds 'size' bytes at 'data' to 'hash'. Start with FNV_OFFSET_BASIS.
+inline uint64_t fnv1a(const uint64_t& hash, const void* data, const size_t& size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint64_t result = hash;
+    for (size_t i = 0; i < size; ++i) {
+        result ^= bytes[i];
+        result *= FNV_PRIME;
+    }
+    return result;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+
+#include <Cartridge.hpp>
+#include <Checksum.hpp>
+
+// Corrections to iNES headers, for ROM files whose headers are wrong or missing information (e.g. iNES 1.0 headers,
+// which can't give a submapper or PRG RAM size reliably). Keyed by the checksum of the ROM data, so that a correction
+// follows the game whatever its file is called. Applied when indexing (see RomIndex).
+// A text file, with a line per game:
+//   <crc32 or sha-1, in hex> <field>=<value>...
+// Fields: mapper, submapper, mirroring (horizontal, vertical or four-screen), battery (0 or 1),
+// prg-rom, chr-rom, prg-ram, prg-nvram, chr-ram, chr-nvram (sizes in bytes), and timing (ntsc, pal, multi or dendy).
+// e.g. "1a2b3c4d mapper=4 mirroring=four-screen prg-ram=8192". Blank lines, and lines starting with '#', are skipped.
+class HeaderDatabase {
+public:
+    // Throws if the file can't be read, or has a malformed line.
+    void load(const std::string& database_path);
+
+    // Applies the correction for the ROM data with checksums 'crc32' and 'sha1', if there's one. Returns whether there was.
+    // A SHA-1 match is taken over a CRC32 one.
+    bool apply(const uint32_t& crc32, const Sha1::Digest& sha1, Cartridge::Header& header) const;
+
+    bool empty() const { return corrections.empty(); }
+
+private:
+    // Header fields a correction sets.
+    enum Field {
+        MAPPER      = 1 << 0,
+        SUBMAPPER   = 1 << 1,
+        MIRRORING   = 1 << 2,
+        BATTERY     = 1 << 3,
+        PRG_ROM     = 1 << 4,
+        CHR_ROM     = 1 << 5,
+        PRG_RAM     = 1 << 6,
+        PRG_NVRAM   = 1 << 7,
+        CHR_RAM     = 1 << 8,
+        CHR_NVRAM   = 1 << 9,
+        TIMING      = 1 << 10
+    };
+
+    struct Correction {
+        int fields = 0;           // Field flags.
+        Cartridge::Header values; // Of the fields set.
+    };
+
+    // Parses 'field=value' into 'correction'. Throws if it isn't a known field, or a valid value for it.
+    void parseField(const std::string& field, const int& line_number, Correction& correction) const;
+
+    std::unordered_map<std::string, Correction> corrections; // By checksum, in lowercase hex.
+};
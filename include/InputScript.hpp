@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include <array>
+#include <string>
+#include <vector>
+
+// Controller input scripted ahead of time, for unattended runs (e.g. benchmarks).
+// A text file, with a line for each frame the input changes on:
+//   <frame> <controller 1> [<controller 2>]
+// Each controller is 8 characters, one per button, in the order of FCEUX movies: RLDUTSBA
+// (Right, Left, Down, Up, sTart, Select, B, A). '.' is released. Anything else is pressed.
+// e.g. "120 ....T..." presses Start on frame 120, and "125 ........" releases it.
+// Input holds until the next line. Frames must increase. Blank lines, and lines starting with '#', are skipped.
+class InputScript {
+public:
+    // Throws if the file can't be read, or has a malformed line.
+    void load(const std::string& script_path);
+
+    // Buttons held on 'controller' (0 or 1) during 'frame', as Controller::Button flags.
+    uint8_t buttons(const uint64_t& frame, const int& controller) const;
+
+private:
+    struct Entry {
+        uint64_t frame;
+        std::array<uint8_t, 2> buttons;
+    };
+
+    // Returns 'field' as Controller::Button flags. Throws if it isn't 8 characters.
+    uint8_t parseButtons(const std::string& field, const int& line_number) const;
+
+    std::vector<Entry> entries; // In order of frame.
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// A whole file, mapped read-only into memory, rather than read into a copy.
+// Pages are loaded as they're first touched, and shared with every other process mapping the same file,
+// so opening a big file is quick, and many instances running the same one keep a single copy between them.
+// Where mapping isn't supported, the file is read into memory instead.
+class MappedFile {
+public:
+    // Throws if the file can't be opened.
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const uint8_t* bytes  = nullptr;
+    size_t         length = 0;
+    void*          handle = nullptr; // Windows file mapping object.
+    std::vector<uint8_t> copy;       // Without mapping, the file's contents.
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <array>
+#include <memory>
+#include <vector>
+
+#include <Cartridge.hpp>
+#include <PPU.hpp>
+#include <SaveState.hpp>
+
+class CPU;
+class Memory;
+class Scheduler;
+
+// Cartridge hardware that maps PRG and CHR memory into the CPU's and PPU's address spaces,
+// usually in banks that the game switches by writing to registers in cartridge space.
+//
+// Banks are mapped as host pointers: PRG banks into Memory's page table, CHR banks into the PPU's pattern table slots.
+// So a read never reaches the mapper (it's a page table lookup and an index), and a bank switch only moves pointers.
+// Only writes to cartridge space that isn't mapped to RAM (i.e. to mapper registers) come here.
+//
+// Calls into a mapper aren't virtual: each has a type, which 'write', 'powerOn' and the hooks below switch on,
+// calling the concrete class's 'writeRegister', 'reset' and so on directly. Only the destructor is virtual.
+// Mappers without the hooks' concrete methods do nothing for them.
+class Mapper {
+public:
+    // Supported mappers, by iNES mapper number.
+    enum Type : uint16_t {
+        NROM  = 0,
+        MMC1  = 1,
+        UXROM = 2,
+        CNROM = 3,
+        MMC3  = 4,
+        AXROM = 7
+    };
+
+    // The mapper for the cartridge with 'header'. Throws if it isn't supported.
+    static std::unique_ptr<Mapper> create(const Cartridge::Header& header);
+    virtual ~Mapper() = default;
+
+    // Connects the cartridge, and maps its power on banks into 'memory' and 'ppu' (which must already be loaded with it).
+    // The CPU times writes, and takes IRQs, for mappers that depend on it, which schedule them on 'scheduler'.
+    // Throws if the cartridge's PRG ROM can't be banked.
+    void load(Cartridge* cartridge, Memory* memory, PPU* ppu, CPU* cpu, Scheduler* scheduler);
+
+    // Resets the registers, and maps the banks they select.
+    void powerOn();
+    // A write to cartridge space ($4020-$FFFF) that isn't mapped to RAM.
+    void write(const uint16_t& address, const uint8_t& value);
+
+    // Scheduler::MAPPER_EVENT is due.
+    void handleEvent();
+    // Around a write to PPUCTRL or PPUMASK, which may change what the PPU fetches and when: the mapper catches up
+    // to the PPU (already caught up itself) before it, and predicts again from the new settings after it.
+    void syncPPU();
+    void ppuSettingsChanged();
+
+    // The PRG banks mapped, PRG RAM, and the registers of mappers that keep any (see NES::saveState).
+    // CHR banks and mirroring are the PPU's. Loading maps the banks back in, without going through the registers.
+    void saveState(StateWriter& out) const;
+    void loadState(StateReader& in);
+
+    Type type() const { return mapper_type; }
+
+protected:
+    static constexpr int PRG_BANK_SIZE = 0x2000; // Granularity of PRG bank switching. 8 KB.
+
+    // What the CPU can do with PRG RAM ($6000-$7FFF).
+    enum PrgRamAccess : uint8_t {
+        PRG_RAM_DISABLED,  // Open bus.
+        PRG_RAM_READ_ONLY, // Writes are ignored.
+        PRG_RAM_ENABLED
+    };
+
+    explicit Mapper(const Type& type) : mapper_type(type) {}
+
+    // Maps bank 'bank' of PRG ROM, in units of 'size' bytes (a multiple of PRG_BANK_SIZE), at 'address'.
+    // Negative banks count back from the end: -1 is the last. Banks past the end wrap around to the start.
+    void mapPrg(const uint16_t& address, const size_t& size, const int& bank);
+    // Maps PRG RAM at $6000-$7FFF, if the cartridge has any.
+    void mapPrgRam(const PrgRamAccess& access);
+    // Selects the 8 KB bank of PRG RAM mapped, on boards with more than one. Banks past the end wrap around.
+    void selectPrgRamBank(const int& bank);
+    // Number of 8 KB banks of PRG RAM. 0 if the cartridge has none.
+    int prgRamBanks() const { return (int)(prg_ram.size() / PRG_BANK_SIZE); }
+    // Shows bank 'bank' of CHR memory, in units of 'size' bytes (a multiple of PPU::CHR_SLOT_SIZE), at 'address'
+    // in the pattern tables. Banks past the end wrap around to the start.
+    void mapChr(const uint16_t& address, const size_t& size, const int& bank);
+    // Ignored if the cartridge has four screen mirroring, which takes over nametables entirely.
+    void setMirroring(const PPU::Mirroring& mirroring);
+    // The value a register write at 'address' actually gives the mapper. On boards with bus conflicts,
+    // the ROM drives the bus at the same time as the CPU, so the mapper sees both ANDed together.
+    uint8_t busConflict(const uint16_t& address, const uint8_t& value) const;
+
+    Cartridge* cart = nullptr;
+    Memory* memory  = nullptr;
+    PPU* ppu        = nullptr;
+    CPU* cpu        = nullptr;
+    Scheduler* scheduler = nullptr;
+
+private:
+    const Type mapper_type;
+
+    // NES 2.0 submapper 2 of UxROM, CNROM and AxROM. Other boards don't conflict, or are assumed not to.
+    bool bus_conflicts = false;
+
+    // Maps the selected bank of PRG RAM as 'prg_ram_access' allows.
+    void remapPrgRam();
+
+    std::vector<uint8_t> prg_ram; // Work RAM, then battery backed RAM, in 8 KB banks. Or none.
+    PrgRamAccess prg_ram_access = PRG_RAM_DISABLED;
+    uint8_t prg_ram_bank = 0;
+};
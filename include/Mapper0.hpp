@@ -1,20 +1,13 @@
 #pragma once
 
-#include "Cartridge.hpp"
+#include <Mapper.hpp>
 
-// NROM.
-class Mapper0 {
+// NROM. No bank switching: 16 or 32 KB of PRG ROM at $8000-$FFFF (16 KB is mirrored at $C000), and 8 KB of CHR.
+class Mapper0 : public Mapper {
 public:
-    void load(Cartridge* cartridge);
+    Mapper0() : Mapper(NROM) {}
 
-    uint8_t read(const uint16_t& address);
-    void write(const uint16_t& address, const uint8_t& value);
-
-private:
-    Cartridge* cart;
-
-    //std::vector<uint_t> chr_ram; // 0x2000
-
-    int prg_mirrored;
-    //bool uses_chr_ram;
-};
\ No newline at end of file
+    void reset();
+    // No registers.
+    void writeRegister(const uint16_t& /*address*/, const uint8_t& /*value*/) {}
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <Mapper.hpp>
+
+// MMC1 (SxROM). Up to 512 KB of PRG ROM, in 16 or 32 KB banks, and 128 KB of CHR, in 4 or 8 KB banks.
+// Registers are written a bit at a time, through a serial port: five writes to $8000-$FFFF, bit 0 first.
+// The fifth write's address picks the register loaded. A write with bit 7 set resets the port instead.
+//   $8000-$9FFF: Control:     ---C PPMM
+//     M: Mirroring (0: single screen, low; 1: single screen, high; 2: vertical; 3: horizontal).
+//     P: PRG ROM bank mode (0, 1: 32 KB at $8000; 2: first bank fixed at $8000, 16 KB switchable at $C000;
+//                           3: 16 KB switchable at $8000, last bank fixed at $C000).
+//     C: CHR bank mode (0: 8 KB; 1: two 4 KB banks).
+//   $A000-$BFFF: CHR bank 0, at $0000 (low bit ignored in 8 KB mode).
+//                With 512 KB of PRG ROM (SUROM), bit 4 selects the 256 KB half that PRG banks are in.
+//                With 16 KB of PRG RAM (SOROM), bit 3 selects its 8 KB bank, and with 32 KB (SXROM), bits 2-3.
+//   $C000-$DFFF: CHR bank 1, at $1000 (4 KB mode only).
+//   $E000-$FFFF: PRG bank:    ---R PPPP
+//     P: PRG ROM bank (low bit ignored in 32 KB mode).
+//     R: PRG RAM disable.
+class Mapper1 : public Mapper {
+public:
+    Mapper1() : Mapper(MMC1) {}
+
+    void reset();
+    void writeRegister(const uint16_t& address, const uint8_t& value);
+
+    void saveState(StateWriter& out) const;
+    void loadState(StateReader& in);
+
+private:
+    // Maps the banks the registers select.
+    void updateBanks();
+
+    uint8_t shift_register, // Bits written so far, in the order written, from bit 0.
+            shift_count;
+    uint8_t control,
+            chr_bank_0,
+            chr_bank_1,
+            prg_bank;
+    // CPU cycle of the last write to the serial port. The port ignores a write on the cycle after another,
+    // as with the second write of a read-modify-write instruction.
+    uint64_t last_write_cycle;
+};
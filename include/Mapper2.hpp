@@ -0,0 +1,15 @@
+#pragma once
+
+#include <Mapper.hpp>
+
+// UxROM (UNROM, UOROM). Up to 4 MB of PRG ROM, in 16 KB banks, and 8 KB of CHR RAM.
+//   $8000-$BFFF: Switchable PRG ROM bank.
+//   $C000-$FFFF: Fixed to the last bank.
+// Writes to $8000-$FFFF select the switchable bank.
+class Mapper2 : public Mapper {
+public:
+    Mapper2() : Mapper(UXROM) {}
+
+    void reset();
+    void writeRegister(const uint16_t& address, const uint8_t& value);
+};
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <Mapper.hpp>
+
+// CNROM. 16 or 32 KB of PRG ROM, as with NROM, and up to 2 MB of CHR ROM, in 8 KB banks.
+// Writes to $8000-$FFFF select the CHR bank.
+class Mapper3 : public Mapper {
+public:
+    Mapper3() : Mapper(CNROM) {}
+
+    void reset();
+    void writeRegister(const uint16_t& address, const uint8_t& value);
+};
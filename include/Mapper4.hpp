@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+#include <array>
+
+#include <Mapper.hpp>
+
+// MMC3 (TxROM). Up to 512 KB of PRG ROM, in 8 KB banks, and 256 KB of CHR, in 1 and 2 KB banks.
+// Registers are in pairs, at even and odd addresses, each mirrored across an 8 KB range:
+//   $8000: Bank select: CP-- -RRR
+//     R: Bank register the next bank data write goes to.
+//     P: PRG ROM bank mode (0: R6 at $8000, second to last bank fixed at $C000; 1: the other way around).
+//     C: CHR A12 inversion (0: R0-R1 at $0000-$0FFF, R2-R5 at $1000-$1FFF; 1: the other way around).
+//   $8001: Bank data: the bank for register R.
+//     R0, R1: 2 KB CHR banks (low bit ignored). R2-R5: 1 KB CHR banks. R6, R7: 8 KB PRG ROM banks ($A000 for R7).
+//   $A000: Mirroring (0: vertical; 1: horizontal).
+//   $A001: PRG RAM protect: EW-- ----
+//     E: Enable PRG RAM. W: Deny writes to it.
+//   $C000: IRQ latch, $C001: IRQ reload, $E000: IRQ disable, $E001: IRQ enable.
+// $E000-$FFFF is fixed to the last bank.
+//
+// The IRQ counter is clocked by each rise of PPU A12, i.e. once per rendered line: it's reloaded from the latch
+// when it's 0 (or a reload is pending), and decremented otherwise. Reaching 0 raises an IRQ, while enabled.
+// Rather than watch the PPU's fetches, the counter is caught up lazily, by counting the rises the PPU predicts
+// (see PPU::a12Rises), and the IRQ is scheduled for the rise that will raise it, while enabled.
+// Both only change with the IRQ registers, or with PPUCTRL and PPUMASK, which move or stop the rises.
+// Rises from PPUADDR writes during vblank aren't counted.
+class Mapper4 : public Mapper {
+public:
+    Mapper4() : Mapper(MMC3) {}
+
+    void reset();
+    void writeRegister(const uint16_t& address, const uint8_t& value);
+
+    void handleEvent();
+    // Clocks the counter for the rises since it was last synced, up to CPU cycle 'cycle'.
+    void syncCounter(const uint64_t& cycle);
+    // Schedules Scheduler::MAPPER_EVENT at the rise that will raise the IRQ, if it's enabled. The counter must be synced.
+    void reschedule();
+
+    void saveState(StateWriter& out) const;
+    void loadState(StateReader& in);
+
+private:
+    // Maps the banks the registers select.
+    void updateBanks();
+
+    uint8_t bank_select;
+    std::array<uint8_t, 8> bank_registers; // R0-R7.
+    uint8_t prg_ram_protect;
+
+    uint8_t irq_latch,
+            irq_counter;
+    bool    irq_reload,
+            irq_enabled;
+    uint64_t synced_dot; // PPU dot the counter is caught up to.
+};
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <Mapper.hpp>
+
+// AxROM (ANROM, AOROM). Up to 256 KB of PRG ROM, in 32 KB banks, 8 KB of CHR RAM, and single screen mirroring.
+// Writes to $8000-$FFFF: ---N -PPP
+//   P: PRG ROM bank at $8000-$FFFF.
+//   N: Nametable shown on all four slots.
+class Mapper7 : public Mapper {
+public:
+    Mapper7() : Mapper(AXROM) {}
+
+    void reset();
+    void writeRegister(const uint16_t& address, const uint8_t& value);
+};
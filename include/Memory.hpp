@@ -1,17 +1,23 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 #include <array>
 
-#include <Mapper0.hpp>
+#include <APU.hpp>
+#include <Controller.hpp>
+#include <Mapper.hpp>
 #include <PPU.hpp>
+#include <SaveState.hpp>
+
+class CPU;
 
 // Memory.
 //   $0000 -$07FF
 //    2 KB internal RAM.
 //     $0000-$00FF
 //      Zero page. Addressable with a single byte.
-//     $0100$01FF
+//     $0100-$01FF
 //      Stack memory.
 //   $0800-$1FFF
 //    Mirrors (3) of RAM.
@@ -24,17 +30,99 @@
 //   $4018-$401F
 //    APU and I/O functionality that is normally disabled.
 //   $4020-$FFFF
-//    Cartridge space: PRG ROM, PRG RAM, and mapper registers. 
+//    Cartridge space: PRG ROM, PRG RAM, and mapper registers.
+//
+// The address space is split into 256 pages of 256 bytes, each with an entry in a page table.
+// A page backed by plain memory (RAM, or ROM mapped in by the mapper) points directly to it,
+// so accessing it is a single indexed load or store.
+// Other pages hold null, and are handled by the I/O path, which forwards to the device behind the address.
 class Memory {
 public:
-    Memory(Mapper0* mapper, PPU* ppu);
+    static constexpr int PAGE_SIZE  = 0x100,
+                         PAGE_COUNT = 0x100;
+
+    Memory(PPU* ppu, APU* apu, Controller* controller_1, Controller* controller_2);
+    // Sets the mapper that writes to cartridge space go to, if they aren't to RAM. Until then, they're ignored.
+    void setMapper(Mapper* mapper);
+    // Sets the CPU whose cycle count times accesses, so that devices can be caught up to each (see CPU::accessCycle).
+    // OAM DMA stalls it.
+    void setCPU(CPU* cpu);
+
+    uint8_t read(const uint16_t& address) {
+        const uint8_t* page = pages[address >> 8].read;
+        if (page != nullptr) {
+            return page[address & 0xFF]; }
+        return readIO(address);
+    }
+
+    // Reads without side effects, for logging (see CPU::trace). I/O registers and mapper space that isn't mapped
+    // to memory can't be read that way, so read as open bus: the high byte of the address.
+    uint8_t peek(const uint16_t& address) const {
+        const uint8_t* page = pages[address >> 8].read;
+        if (page != nullptr) {
+            return page[address & 0xFF]; }
+        return address >> 8;
+    }
+
+    void write(const uint16_t& address, const uint8_t& value) {
+        uint8_t* page = pages[address >> 8].write;
+        if (page != nullptr) {
+            page[address & 0xFF] = value; }
+        else {
+            writeIO(address, value); }
+    }
+
+    // Page table updates, used by mappers to map in banks. 'address' and 'size' must be multiples of PAGE_SIZE.
+    // Maps 'size' bytes of read-only memory at 'address'. Writes there still go to the I/O path (i.e. the mapper).
+    void mapRead(const uint16_t& address, const uint8_t* data, const size_t& size);
+    // Maps 'size' bytes of writable memory (e.g. PRG RAM) at 'address', for both reads and writes.
+    void mapReadWrite(const uint16_t& address, uint8_t* data, const size_t& size);
+    // Returns 'size' bytes at 'address' to the I/O path.
+    void unmap(const uint16_t& address, const size_t& size);
+
+    // Host address of 'address', if it's in a read-only page (i.e. mapped ROM). Otherwise null.
+    const uint8_t* romPointer(const uint16_t& address) const {
+        const Page& page = pages[address >> 8];
+        if (page.read == nullptr || page.write != nullptr) {
+            return nullptr; }
+        return page.read + (address & 0xFF);
+    }
 
-    uint8_t read(const uint16_t& address);
-    void write(const uint16_t& address, const uint8_t& value);
+    // Incremented on every page table update, so callers can tell when mappings have changed.
+    uint32_t mappingGeneration() const { return mapping_generation; }
+
+    // The 2 KB of internal RAM.
+    const std::array<uint8_t, 0x800>& internalRam() const { return ram; }
+
+    // Internal RAM. The page table is the mapper's (see Mapper::saveState).
+    void saveState(StateWriter& out) const;
+    void loadState(StateReader& in);
 
 private:
-    Mapper0* mapper;
+    // Generated code reads the page table and RAM directly.
+    friend class Recompiler;
+
+    // Host memory backing a page. Null if accesses must go through the I/O path.
+    struct Page {
+        const uint8_t* read;
+        uint8_t* write;
+    };
+
+    // Accesses to pages that aren't backed by host memory.
+    uint8_t readIO(const uint16_t& address);
+    void writeIO(const uint16_t& address, const uint8_t& value);
+    // OAM DMA: copies page 'page' into OAM, and stalls the CPU for the copy.
+    void writeOAMDMA(const uint8_t& page);
+
+    Mapper* mapper = nullptr;
     PPU* ppu;
+    APU* apu;
+    CPU* cpu = nullptr;
+    Controller* controller_1;
+    Controller* controller_2;
+
+    std::array<Page, PAGE_COUNT> pages;
+    uint32_t mapping_generation = 0;
 
     std::array<uint8_t, 0x800> ram;
-};
\ No newline at end of file
+};
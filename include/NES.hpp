@@ -1,26 +1,92 @@
 #pragma once
 
+#include <stdint.h>
+#include <array>
+#include <memory>
 #include <string>
 
 #include <Cartridge.hpp>
-#include <Mapper0.hpp>
+#include <Controller.hpp>
+#include <Mapper.hpp>
 #include <Memory.hpp>
+#include <Recompiler.hpp>
 #include <CPU.hpp>
 #include <PPU.hpp>
 #include <APU.hpp>
+#include <SaveState.hpp>
+#include <Scheduler.hpp>
+#include <Tracer.hpp>
 
 class NES {
 public:
     NES();
     void load(const std::string& rom_path);
-    void run();
+    // Loads with 'header', as indexed (see RomIndex), rather than the file's own.
+    void load(const std::string& rom_path, const Cartridge::Header& header);
+    // Logs every executed instruction to the file at 'log_path'.
+    void trace(const std::string& log_path);
+    // Translates hot PRG ROM code to native code, where supported. Otherwise it's only interpreted.
+    void enableRecompiler();
+
+    // Selects how the PPU renders (see PPU::Engine). Takes effect on power on.
+    void setPPUEngine(const PPU::Engine& engine);
+
+    void powerOn();
+    // Runs until the current frame is complete, or until 'cycle_limit' CPU cycles have run since power on.
+    void runFrame(const uint64_t& cycle_limit);
+
+    // Sets the buttons held on 'controller' (0 or 1), as Controller::Button flags.
+    void setButtons(const int& controller, const uint8_t& buttons);
+
+    // Output
+    // Reads up to 'count' of the audio samples generated so far (mono, at APU::SAMPLE_RATE) into 'out'.
+    // Returns the number read. Samples not read within a few frames are dropped.
+    size_t readSamples(int16_t* out, const size_t& count);
+    const std::array<uint16_t, PPU::WIDTH * PPU::HEIGHT>& frameBuffer() const;
+    const std::array<uint8_t, 0x800>& ram() const;
+    // Fingerprint of the console's state (CPU, RAM and PPU), e.g. to check two runs ended the same.
+    uint64_t stateHash() const;
+
+    // Save states. Saving copies the console's mutable state into 'state' (see SaveState), sized for the game
+    // on first use, and reused after. Loading copies it back, and the game carries on from where it was saved.
+    // Both are a few KB of copies, so cheap enough to do every frame (e.g. for rewind).
+    // Throw if no game is loaded, or (loading) if the state isn't from this build and game.
+    void saveState(SaveState& state) const;
+    void loadState(const SaveState& state);
+
+    // Stats
+    uint64_t frameCount() const;
+    uint64_t cpuCycles() const;         // Emulated, including skipped.
+    uint64_t instructionCount() const;  // Executed.
+    uint64_t idleCyclesSkipped() const; // Skipped in idle loops, rather than executed. See CPU::idleLoopCycles.
+    PPU::Engine ppuEngine() const;      // In use. DOT if the selected SCANLINE fell back to it.
 
 private:
+    // Microbenchmarks (see bench/) time the parts individually.
+    friend class Benchmark;
+
+    // Wires up the cartridge's ROM.
+    void insert(const Cartridge& cartridge);
+    // Handles the events due by the CPU's current cycle.
+    void handleEvents();
+    // Runs the next CPU step, skipping ahead if it's in an idle loop,
+    // but not past the next event, or 'cycle_limit'.
+    void step(const uint64_t& cycle_limit);
+    // Writes (or with a null blob, counts) the save state's fields, header first.
+    void writeState(StateWriter& out) const;
+
+    Scheduler scheduler;
     Memory memory;
-    Mapper0 mapper; // TODO: Generalize
+    std::unique_ptr<Mapper> mapper; // The cartridge's. Null until one is inserted.
+    Recompiler recompiler;
 
     CPU cpu;
     PPU ppu;
     APU apu;
     Cartridge cart;
+    std::array<Controller, 2> controllers;
+    Tracer tracer;
+
+    uint32_t rom_crc32 = 0;  // Of PRG and CHR ROM, which save states refer to.
+    size_t   state_size = 0; // Of the game's save states, in bytes.
 };
\ No newline at end of file
@@ -60,4 +60,49 @@ constexpr std::array<uint8_t, 0x100> cycle_table =
 /*0xD0*/ 2,5,2,8,4,4,6,6,2,4,2,7,4,4,7,7,
 /*0xE0*/ 2,6,3,8,3,3,5,5,2,2,2,2,4,4,6,6,
 /*0xF0*/ 2,5,2,8,4,4,6,6,2,4,2,7,4,4,7,7,
+};
+
+// Addressing modes. See CPU.hpp for how each gives an address to an instruction.
+enum AddressingMode : uint8_t {
+    IMP, // Implied
+    ACC, // Accumulator
+    IMM, // Immediate
+    ZP0, // Zero Page
+    ZPX, // Zero Page,X
+    ZPY, // Zero Page,Y
+    REL, // Relative
+    ABS, // Absolute
+    ABX, // Absolute,X
+    ABY, // Absolute,Y
+    IND, // Indirect
+    IZX, // Indexed Indirect: (Zero Page,X)
+    IZY  // Indirect Indexed: (Zero Page),Y
+};
+
+// Addressing mode of each operation, indexed by opcode value.
+constexpr std::array<AddressingMode, 0x100> addressing_mode_table =
+{
+/*0x00*/ IMP,IZX,IMP,IZX,ZP0,ZP0,ZP0,ZP0,IMP,IMM,ACC,IMM,ABS,ABS,ABS,ABS,
+/*0x10*/ REL,IZY,IMP,IZY,ZPX,ZPX,ZPX,ZPX,IMP,ABY,IMP,ABY,ABX,ABX,ABX,ABX,
+/*0x20*/ ABS,IZX,IMP,IZX,ZP0,ZP0,ZP0,ZP0,IMP,IMM,ACC,IMM,ABS,ABS,ABS,ABS,
+/*0x30*/ REL,IZY,IMP,IZY,ZPX,ZPX,ZPX,ZPX,IMP,ABY,IMP,ABY,ABX,ABX,ABX,ABX,
+/*0x40*/ IMP,IZX,IMP,IZX,ZP0,ZP0,ZP0,ZP0,IMP,IMM,ACC,IMM,ABS,ABS,ABS,ABS,
+/*0x50*/ REL,IZY,IMP,IZY,ZPX,ZPX,ZPX,ZPX,IMP,ABY,IMP,ABY,ABX,ABX,ABX,ABX,
+/*0x60*/ IMP,IZX,IMP,IZX,ZP0,ZP0,ZP0,ZP0,IMP,IMM,ACC,IMM,IND,ABS,ABS,ABS,
+/*0x70*/ REL,IZY,IMP,IZY,ZPX,ZPX,ZPX,ZPX,IMP,ABY,IMP,ABY,ABX,ABX,ABX,ABX,
+/*0x80*/ IMM,IZX,IMM,IZX,ZP0,ZP0,ZP0,ZP0,IMP,IMM,IMP,IMM,ABS,ABS,ABS,ABS,
+/*0x90*/ REL,IZY,IMP,IZY,ZPX,ZPX,ZPY,ZPY,IMP,ABY,IMP,ABY,ABX,ABX,ABY,ABY,
+/*0xA0*/ IMM,IZX,IMM,IZX,ZP0,ZP0,ZP0,ZP0,IMP,IMM,IMP,IMM,ABS,ABS,ABS,ABS,
+/*0xB0*/ REL,IZY,IMP,IZY,ZPX,ZPX,ZPY,ZPY,IMP,ABY,IMP,ABY,ABX,ABX,ABY,ABY,
+/*0xC0*/ IMM,IZX,IMM,IZX,ZP0,ZP0,ZP0,ZP0,IMP,IMM,IMP,IMM,ABS,ABS,ABS,ABS,
+/*0xD0*/ REL,IZY,IMP,IZY,ZPX,ZPX,ZPX,ZPX,IMP,ABY,IMP,ABY,ABX,ABX,ABX,ABX,
+/*0xE0*/ IMM,IZX,IMM,IZX,ZP0,ZP0,ZP0,ZP0,IMP,IMM,IMP,IMM,ABS,ABS,ABS,ABS,
+/*0xF0*/ REL,IZY,IMP,IZY,ZPX,ZPX,ZPX,ZPX,IMP,ABY,IMP,ABY,ABX,ABX,ABX,ABX,
+};
+
+// Number of bytes following the opcode, indexed by addressing mode.
+constexpr std::array<uint8_t, 13> operand_size_table =
+{
+//  IMP ACC IMM ZP0 ZPX ZPY REL ABS ABX ABY IND IZX IZY
+     0,  0,  1,  1,  1,  1,  1,  2,  2,  2,  2,  1,  1
 };
\ No newline at end of file
@@ -1,25 +1,224 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 #include <array>
+#include <vector>
+
+#include <Cartridge.hpp>
+#include <SaveState.hpp>
+#include <Scheduler.hpp>
+#include <TileCache.hpp>
 
 // Picture Processing Unit.
 // Generates video.
 class PPU {
 public:
+    static constexpr int WIDTH  = 256,
+                         HEIGHT = 240;
+    // Granularity of CHR bank switching (see mapChr).
+    static constexpr int CHR_SLOT_SIZE = TileCache::SLOT_SIZE;
+
+    // How the picture is rendered. Both give the same picture, unless the game changes the PPU's settings
+    // in the middle of a line (e.g. to split the screen at a given pixel), which only DOT renders exactly.
+    enum Engine : uint8_t {
+        // Renders each line all at once, from the state at its end. Fast.
+        // Falls back to DOT for the rest of the run, as soon as a register write changes a line partway through.
+        SCANLINE,
+        // Renders dot by dot, with the hardware's background shift registers and per dot sprite evaluation.
+        DOT
+    };
+
+    // Which nametable each of the four nametable slots ($2000, $2400, $2800, $2C00) shows.
+    enum Mirroring : uint8_t {
+        HORIZONTAL,         // $2000 and $2400 are the same, above $2800 and $2C00.
+        VERTICAL,           // $2000 and $2800 are the same, side by side with $2400 and $2C00.
+        SINGLE_SCREEN_LOW,  // All four are the first of the console's nametables.
+        SINGLE_SCREEN_HIGH, // All four are the second.
+        FOUR_SCREEN         // Each slot has its own. The cartridge adds the other 2 KB.
+    };
+
+    PPU();
+
+    // Sets the scheduler that the PPU's events and NMI output are scheduled on.
+    void setScheduler(Scheduler* scheduler);
+    // Connects the cartridge's CHR ROM (or CHR RAM, if it has none) as pattern tables, showing its first 8 KB,
+    // and sets up nametable mirroring from its header.
+    void load(Cartridge* cartridge);
+
+    // Bank switching, for mappers. The PPU must be caught up to the switch first.
+    // Shows 'size' bytes of CHR memory, from 'offset' (wrapping around its end), at 'address' in the pattern tables.
+    // All three must be multiples of CHR_SLOT_SIZE. Only pointers move: nothing is copied or decoded.
+    void mapChr(const uint16_t& address, const size_t& offset, const size_t& size);
+    void setMirroring(const Mirroring& mirroring);
+    // Size of CHR memory (CHR ROM, or CHR RAM), in bytes.
+    size_t chrSize() const { return chr_size; }
+
+    // Selects the engine to render with, from the next power on. SCANLINE by default.
+    void setEngine(const Engine& engine);
+    // The engine in use. DOT if it was selected, or SCANLINE fell back to it.
+    Engine engine() const { return active_engine; }
+
     void powerOn();
+    // Runs a single cycle (dot).
     void step();
 
+    // The PPU is run lazily. Rather than stepping alongside the CPU, it's brought up to date in one call,
+    // only when something depends on its state: an access to its registers, or one of its events.
+    // Runs up to the time of CPU cycle 'cpu_cycle' (3 dots per CPU cycle), counting from power on.
+    void catchUp(const uint64_t& cpu_cycle);
+    // CPU cycle of the next event: a change the CPU could observe (e.g. vblank starting or ending,
+    // or a possible sprite 0 hit), or the end of the frame. The PPU must be caught up to it before the CPU runs past it.
+    // The PPU keeps it scheduled as Scheduler::PPU_EVENT.
+    uint64_t nextEventCycle() const;
+
+    // PPU address line A12 is high while the PPU fetches from the pattern table at $1000. MMC3 counts scanlines
+    // by its rises, which (once the mapper filters out brief ones) happen once per rendered line, at a dot set by
+    // which tables the background and sprites come from. Rather than watch every fetch, mappers predict the rises
+    // from the current settings, which they must be told are about to change (see Memory).
+    // Dots count from power on, 3 per CPU cycle.
+    // Rises after dot 'from', up to and including dot 'to', with the current settings.
+    uint64_t a12Rises(const uint64_t& from, const uint64_t& to) const;
+    // Dot of the 'n'th rise (from 1) after dot 'from', with the current settings. Scheduler::NEVER if A12 doesn't rise.
+    uint64_t a12RiseDot(const uint64_t& from, const uint64_t& n) const;
+
+    // Frames completed since power on.
+    uint64_t frameCount() const { return frame_count; }
+    // The last completed picture, row by row. Each pixel is a NES palette index (bits 0-5)
+    // and the color emphasis bits of PPUMASK (bits 6-8: red, green, blue). Palette converts them to host colors.
+    const std::array<uint16_t, WIDTH * HEIGHT>& frameBuffer() const { return frame_buffers[drawn_buffer ^ 1]; }
+
+    // Adds the PPU's state to a hash of the whole console's (see NES::stateHash).
+    uint64_t hashState(const uint64_t& hash) const;
+    // Registers, position, OAM, nametables, palette, CHR RAM, and which banks the pattern tables and nametables show
+    // (see NES::saveState). Not the frame buffers: the first picture after loading is finished over the old one.
+    // Loading doesn't reschedule: the scheduler loads its own state.
+    void saveState(StateWriter& out) const;
+    void loadState(StateReader& in);
+
     uint8_t readRegister(const uint16_t& address);
     void writeRegister(const uint16_t& address, const uint8_t& value);
+    // OAM DMA: the 256 bytes at 'data', as if written to OAMDATA one by one (so from OAMADDR, wrapping around).
+    void writeOAMDMA(const uint8_t* data);
 
 private:
-    static constexpr int WIDTH  = 256,
-                         HEIGHT = 240;
+    static constexpr int DOTS_PER_SCANLINE = 341,
+                         SCANLINES         = 262,
+                         DOTS_PER_FRAME    = DOTS_PER_SCANLINE * SCANLINES,
+                         VBLANK_SCANLINE     = 241,
+                         PRE_RENDER_SCANLINE = 261,
+                         // Dot at which a scanline is rendered, all at once: just after its last visible pixel,
+                         // where the PPU moves on to the next line's scroll position.
+                         RENDER_DOT = 257;
+    static constexpr int SPRITES_PER_SCANLINE = 8;
+
+    // Moves the position 'dots' ahead, rendering the lines (SCANLINE) or dots (DOT) passed.
+    // Doesn't handle events, so must not pass one.
+    void advance(const int& dots);
+    // Dots from the current position until the next event.
+    int dotsUntilEvent() const;
+    // Handles an event at the current position, if there's one.
+    void handleEvent();
+    // Keeps Scheduler::PPU_EVENT at the next event, after anything that may have moved it.
+    void reschedule();
+
+    // Dot of each rendered line (0-239, and the pre-render line) at which A12 rises, or -1 if it doesn't.
+    int a12RiseCycle() const;
+    // Rises from power on, up to and including dot 'dot', for rises at 'rise_cycle' of each rendered line.
+    static uint64_t a12RisesUntil(const uint64_t& dot, const int& rise_cycle);
+
+    // Renders the current scanline into the frame buffer, at RENDER_DOT,
+    // then moves the scroll position on to the next line.
+    void renderScanline();
+    // Writes the background pixels of the current scanline, scrolled by 'vram_address' and 'fine_x_scroll',
+    // as palette RAM indices (0 for transparent).
+    void renderBackground(uint8_t* pixels);
+    // Writes the pixels of the sprites on the current scanline, as palette RAM indices (0 for transparent),
+    // and sets 'behind' where the sprite is behind the background. Detects sprite 0 hits against 'background',
+    // setting 'hit_x' to the first pixel of one, or -1. Returns the number of sprites on the line. If it's 0, nothing was written.
+    int renderSprites(const uint8_t* background, uint8_t* pixels, uint8_t* behind, int& hit_x);
+    // SCANLINE: the dot by which the current line has a sprite 0 hit, or DOTS_PER_SCANLINE if it has none.
+    int spriteZeroHitDot();
+
+    // True if SCANLINE is partway through a visible line, which it only renders at its end.
+    bool midLine() const {
+        return active_engine == SCANLINE
+            && scanline < HEIGHT
+            && cycle >= 1
+            && cycle < RENDER_DOT;
+    }
+    // True if writing 'value' to the register at 'address' now would change the line being output.
+    bool changesCurrentLine(const uint16_t& address, const uint8_t& value) const;
+    // Switches to DOT partway through a line. Rebuilds the state DOT would have at this point,
+    // and renders the line so far, as it was before the write that caused the switch.
+    void fallBackToDot();
+
+    // DOT engine.
+    // Runs the dot at the current position, without moving on.
+    void renderDot();
+    // Outputs pixel 'x' of the current line, from the shift registers.
+    void outputPixel(const int& x);
+    // Shifts the background, and sprites that have started.
+    void shiftBackground();
+    void shiftSprites();
+    // Loads the next tile's fetched pattern and attribute into the low byte of the background shift registers.
+    void loadBackgroundShifters();
+    // Evaluates sprite 'index' of OAM for the next line, copying it to secondary OAM if it's on it.
+    void evaluateSprite(const int& index);
+    // Fetches the pattern of the sprite in secondary OAM 'slot' into its sprite unit, for the next line.
+    void fetchSprite(const int& slot);
+    // Moves 'vram_address' to the next tile, wrapping into the horizontally adjacent nametable.
+    void incrementX();
+
+    bool renderingEnabled() const { return ppumask_show_background || ppumask_show_sprites; }
+    // Moves 'vram_address' down a line (fine Y, carrying into coarse Y), as the PPU does after each line.
+    void incrementY();
+    // Moves 'vram_address' on by PPUDATA's increment, after an access.
+    void incrementAddress();
+
+    // PPU address space. Pattern tables, nametables and palette RAM.
+    uint8_t read(const uint16_t& address) const;
+    void write(const uint16_t& address, const uint8_t& value);
+    // Pattern table byte at 'address' ($0000-$1FFF), through the CHR banks.
+    uint8_t patternByte(const uint16_t& address) const {
+        return pattern_tables[address / CHR_SLOT_SIZE][address % CHR_SLOT_SIZE];
+    }
+    // Nametable byte at 'address' ($2000-$2FFF, or its mirror $3000-$3EFF), through the mirroring.
+    uint8_t& nametable(const uint16_t& address) const {
+        return nametables[(address >> 10) & 0x3][address & 0x3FF];
+    }
+    // The pixel showing palette RAM entry 'index', in frameBuffer's format, with the current greyscale and emphasis.
+    uint16_t pixel(const int& index) const {
+        return (palette_ram[index] & (ppumask_greyscale ? 0x30 : 0x3F))
+             | (ppumask_tint_red << 6) | (ppumask_tint_green << 7) | (ppumask_tint_blue << 8);
+    }
+    // Palette RAM index. $3F10/$3F14/$3F18/$3F1C mirror $3F00/$3F04/$3F08/$3F0C.
+    static int paletteIndex(const uint16_t& address) {
+        const int index = address & 0x1F;
+        return ((index & 0x13) == 0x10) ? (index & 0x0F) : index;
+    }
+
+    // $2000: PPUCTRL
+    void writeControl(const uint8_t& value);
+    // $2001: PPUMASK
+    void writeMask(const uint8_t& value);
+    // $2002: PPUSTATUS
+    uint8_t readStatus();
+    // $2004: OAMDATA
+    uint8_t readOAMData();
+    void writeOAMData(const uint8_t& value);
+    // $2005: PPUSCROLL
+    void writeScroll(const uint8_t& value);
+    // $2006: PPUADDR
+    void writeAddress(const uint8_t& value);
+
+    // Asserts NMI at the current position. The CPU services it before its next instruction.
+    void signalNMI();
 
     // $2007: PPUDATA
     // VRAM read/write data register.
     // After access, the video memory address will increment by an amount determined by 'ppuctrl_increment'.
+    uint8_t readData();
     void writeData(const uint8_t& value);
 
     // Registers
@@ -70,19 +269,76 @@ private:
     uint8_t ppustatus_vblank;
 
 
+    // While rendering, 'vram_address' is the scroll position: yyy NN YYYYY XXXXX
+    // (fine Y, nametable, coarse Y, coarse X).
     uint16_t vram_address;      // Current vram address.                                           (15 bit)
     uint16_t vram_address_temp; // Temporary vram address. (address of the top left onscreen tile) (15 bit)
     uint8_t  fine_x_scroll;     //                                                                  (3 bit)
     bool     write_flag;        // (0: 1st write; 1: 2nd write)                                     (1 bit)
+    uint8_t  read_buffer;       // PPUDATA reads (except palette) return the previous read's value.
     bool     odd_frame;        // (0: even frame; 1: odd frame)                                    (1 bit)
 
     // Each frame, 262 scanlines are rendered, each lasting 341 cycles.
-    int scanline; // 0-261
-    int cycle;    // 0-340
+    int scanline = 0; // 0-261
+    int cycle    = 0; // 0-340
+
+    uint64_t dot_count; // Dots run since power on.
+    uint64_t frame_count;
+
+    // The frame being drawn, and the last completed one, swapped at the end of each frame.
+    // The PPU usually runs a few dots into the next frame before anything reads the picture.
+    std::array<std::array<uint16_t, WIDTH * HEIGHT>, 2> frame_buffers;
+    int drawn_buffer;
+
+    Scheduler* scheduler = nullptr;
+
+
+    // Object Attribute Memory, aka Sprite RAM. 64 sprites, of 4 bytes each.
+    std::array<uint8_t, 0x100> oam;
+
+    Engine selected_engine = SCANLINE,
+           active_engine   = SCANLINE;
+
+    // SCANLINE: the line 'spriteZeroHitDot' was last found for.
+    uint64_t hit_prediction_frame;
+    int      hit_prediction_line;
+    int      hit_prediction_dot;
+
+    // DOT engine state.
+    // Background: the next tile's fetched data, and 16 bit shift registers of the current and next tile.
+    uint8_t  next_tile, next_attribute, next_pattern_low, next_pattern_high;
+    uint16_t pattern_shifter_low, pattern_shifter_high;
+    uint16_t attribute_shifter_low, attribute_shifter_high;
+    // Sprites: secondary OAM holds those found on the next line, and the sprite units those on this one.
+    struct SpriteUnit {
+        uint8_t pattern_low, pattern_high; // Shift out from bit 7.
+        uint8_t attributes;
+        uint8_t x;                         // Counts down to 0, where the sprite starts shifting out.
+    };
+    std::array<uint8_t, SPRITES_PER_SCANLINE * 4> secondary_oam;
+    int  secondary_count;
+    bool secondary_has_sprite_zero;
+    std::array<SpriteUnit, SPRITES_PER_SCANLINE> sprite_units;
+    int  sprite_unit_count;
+    bool units_have_sprite_zero; // Unit 0 is sprite 0.
+
+    // Sets the CHR memory the pattern tables show, and decodes it, showing its first 8 KB.
+    void connectChr(const uint8_t* data, const size_t& size, const bool& writable);
 
+    // $0000-$1FFF: Pattern tables. Eight 1 KB slots, each pointing at a bank of CHR memory:
+    // the cartridge's CHR ROM, or 'chr_ram'.
+    std::array<const uint8_t*, 8> pattern_tables;
+    const uint8_t* chr;
+    size_t         chr_size;
+    bool           chr_writable; // CHR RAM: 'chr' is 'chr_ram'.
+    std::vector<uint8_t> chr_ram;
+    TileCache tile_cache; // 'chr', decoded, and banked like 'pattern_tables'.
 
-    // Object Attribute Memory, aka Sprite RAM.
-    std::array<uint8_t, 0xFF> oam;
+    // $2000-$2FFF: Nametables. The console has 2 KB for two of them, and the cartridge wires up
+    // which of the four nametable slots each is seen at (mirroring). Four screen cartridges add the other 2 KB.
+    std::array<uint8_t, 0x1000> nametable_ram;
+    std::array<uint8_t*, 4> nametables;
 
-    std::array<uint8_t, 0x3FFF> vram;
+    // $3F00-$3F1F: Palette RAM. Background palettes, then sprite palettes.
+    std::array<uint8_t, 0x20> palette_ram;
 };
\ No newline at end of file
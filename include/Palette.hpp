@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <array>
+
+// Converts the PPU's pixels to host colors.
+// A PPU pixel is a palette index (bits 0-5) and the PPUMASK color emphasis bits (bits 6-8: red, green, blue),
+// so there are 512 possible values. Each format's colors for all of them are computed once, into a table,
+// and converting is one table lookup per pixel, several pixels at a time with SSE2/AVX2 where available.
+class Palette {
+public:
+    enum Format : uint8_t {
+        RGBA8888, // Bytes R, G, B, A in memory order, as SFML textures take.
+        BGRA8888, // Bytes B, G, R, A in memory order, as most native surfaces take.
+        RGB565,   // 16 bits (5 red, 6 green, 5 blue), native endian.
+        INDEXED8  // The palette index (0x00-0x3F) alone, for hosts with their own palette. Drops emphasis.
+    };
+    static constexpr int PIXEL_VALUES = 512;
+
+    static int bytesPerPixel(const Format& format) {
+        return (format == INDEXED8) ? 1 : (format == RGB565) ? 2 : 4;
+    }
+
+    explicit Palette(const Format& format = RGBA8888);
+
+    void setFormat(const Format& format);
+    Format format() const { return selected_format; }
+
+    // Writes the host colors of 'count' pixels from 'pixels' into 'output'.
+    void convert(const uint16_t* pixels, const size_t& count, void* output) const;
+    // Writes a 'width' x 'height' frame into 'output', whose rows are 'pitch' bytes apart
+    // (e.g. a locked texture or a shared memory segment, written to directly).
+    void convertFrame(const uint16_t* pixels, const int& width, const int& height,
+                      void* output, const size_t& pitch) const;
+
+private:
+    void convert32(const uint16_t* pixels, const size_t& count, uint32_t* output) const;
+    void convert16(const uint16_t* pixels, const size_t& count, uint16_t* output) const;
+    void convert8(const uint16_t* pixels, const size_t& count, uint8_t* output) const;
+
+    Format selected_format;
+    bool   use_avx2; // The CPU supports AVX2 (gathers).
+    // Host color of every pixel value, in the low bytes for the formats narrower than 32 bits.
+    alignas(32) std::array<uint32_t, PIXEL_VALUES> lut;
+};
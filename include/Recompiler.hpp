@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+class CPU;
+class Memory;
+
+// Dynamic recompiler. Translates hot basic blocks of PRG ROM code into native x86-64 code.
+// Only built for x86-64 on POSIX systems (see 'isSupported'). Elsewhere, nothing is ever translated.
+//
+// While a translated block runs, A, X, Y and the Zero and Negative flags are kept in host registers.
+// RAM is accessed directly. Other memory goes through the page table (see Memory),
+// falling back to calls into Memory for I/O and mapper registers.
+// Cycles are charged once per block exit, except before calls into Memory or the interpreter,
+// which first update the CPU's cycle count, so devices see accesses at the right time.
+//
+// The few instructions that aren't translated (BRK, RTI, PHP, PLP, JMP indirect) call the interpreter's handler,
+// so a translated block covers exactly the instructions of the predecoded one, and ends in the same place.
+class Recompiler {
+public:
+    // Registers and flags of the CPU while a block runs, in the form the generated code accesses them.
+    struct Context {
+        uint32_t a,
+                 x,
+                 y,
+                 sp,
+                 zero_result,
+                 negative_result,
+                 carry_result,
+                 overflow_result,
+                 interrupt_disable,
+                 interrupt_disable_delayed,
+                 decimal_mode,
+                 pc,           // PC on exit.
+                 cycles,       // Cycles taken by the block, set on exit.
+                 instructions; // Instructions executed by the block, set on exit.
+        uint64_t start_cycles; // CPU cycle count when the block started, plus stalls since.
+        uint64_t deadline;     // Cycle the block must end by (see CPU::step).
+        CPU* cpu;
+        Memory* memory;
+    };
+
+    using NativeBlock = void (*)(Context* context);
+
+    Recompiler(Memory* memory);
+    ~Recompiler();
+
+    // True if native code can be generated on this platform.
+    static bool isSupported();
+
+    // Translates the block of 'length' instructions at host address 'code', at CPU address 'pc'.
+    // The block must have been decoded by the CPU (see BlockCache), so that it has the same boundaries.
+    // Returns null if the code buffer is full (see 'isFull').
+    NativeBlock compile(const uint8_t* code, const uint16_t& pc, const int& length);
+    // Runs a translated block, starting from and updating the CPU's state.
+    // The whole block must end by 'deadline'. It's left early if a write makes that uncertain (see 'writeHelper').
+    void run(CPU& cpu, const NativeBlock& block, const uint64_t& deadline);
+
+    // True once compile() has failed for lack of space. Blocks must then be discarded, with flush().
+    bool isFull() const { return full; }
+    // Discards all generated code. Any pointer returned by compile() is invalidated.
+    void flush();
+
+    // Called by generated code, for accesses to pages that aren't plain memory.
+    // Each first brings the CPU's cycle count up to date, through the accessing instruction, as the interpreter has it
+    // (see CPU::accessCycle), for devices that depend on the timing of the access.
+    using ReadHelper  = uint32_t (*)(Context* context, uint32_t address, int32_t cycles);
+    using WriteHelper = uint32_t (*)(Context* context, uint32_t address, uint32_t value, int32_t cycles);
+    // Runs an instruction that isn't translated, with the opcode in the low byte of 'instruction'
+    // and its decoded operand (see BlockCache::Operation) above.
+    using InterpretHelper = uint32_t (*)(Context* context, uint32_t instruction, uint32_t next_pc, int32_t cycles);
+
+private:
+    static uint32_t readHelper(Context* context, uint32_t address, int32_t cycles);
+    // Returns nonzero if the block must be left after the writing instruction: the write changed the memory map,
+    // so the rest of the block may no longer be mapped, or it stalled the CPU or scheduled an event,
+    // so the rest may no longer end before the next event.
+    static uint32_t writeHelper(Context* context, uint32_t address, uint32_t value, int32_t cycles);
+    // Returns nonzero if the block must be left after the instruction, as for 'writeHelper'.
+    // The PC is always stored in the context.
+    static uint32_t interpretHelper(Context* context, uint32_t instruction, uint32_t next_pc, int32_t cycles);
+    // After a call into Memory or the CPU that started at cycle 'now', accounts for any stall,
+    // and returns true if the block must be left (see 'writeHelper').
+    static bool mustLeave(Context* context, const uint64_t& now, const uint32_t& mapping);
+
+    // Copy registers and flags between the CPU and the context, both ways.
+    static void copyToContext(Context& context, const CPU& cpu);
+    static void copyFromContext(CPU& cpu, const Context& context);
+
+    static constexpr size_t CODE_BUFFER_SIZE = 0x400000; // 4 MB
+
+    Memory* memory;
+
+    uint8_t* code_buffer = nullptr; // Executable memory, writable only while compile() generates code.
+    size_t   code_used = 0;
+    bool     full = false;
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <array>
+#include <vector>
+
+// Converts mono audio from one sample rate to another, e.g. the APU's output to the audio device's rate,
+// with a polyphase windowed sinc FIR filter: a table of the filter at PHASES offsets between two input samples,
+// interpolated between the two nearest, each output sample a dot product of TAPS input samples (SSE/AVX where available).
+//
+// The ratio can be nudged by a fraction of a percent while running (dynamic rate control), so that the audio
+// device's clock, which never quite matches the emulation's, can be followed without the buffer between them
+// running dry (crackling) or filling up (drifting latency).
+class Resampler {
+public:
+    Resampler();
+
+    // Sets the rates, and clears any buffered input.
+    void setRates(const double& input_rate, const double& output_rate);
+    // Scales the output rate by 'adjustment' (e.g. 1.002 makes 0.2% more samples), keeping the filter.
+    void setRateAdjustment(const double& adjustment);
+
+    // Resamples 'count' input samples, appending the output to 'out'.
+    // Input is buffered across calls, so the output runs on seamlessly, TAPS / 2 input samples behind.
+    void process(const int16_t* in, const size_t& count, std::vector<int16_t>& out);
+
+private:
+    static constexpr int PHASES = 256,
+                         TAPS   = 32;
+
+    // Output samples, from the input buffered, as far as they can be computed.
+    void resample(std::vector<int16_t>& out);
+
+    double ratio;      // Input samples per output sample, before adjustment.
+    double step;       // Input samples per output sample.
+    double position;   // Of the next output sample, in input samples from the start of 'input'.
+    bool   use_avx;    // The CPU supports AVX.
+
+    // PHASES + 1 rows of TAPS: the last repeats the first, a sample later, so any phase can interpolate with the next.
+    alignas(32) std::array<float, (PHASES + 1) * TAPS> kernel;
+    std::vector<float> input;
+};
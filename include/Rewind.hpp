@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <array>
+#include <atomic>
+#include <deque>
+#include <thread>
+#include <vector>
+
+#include <NES.hpp>
+#include <RingBuffer.hpp>
+#include <SaveState.hpp>
+
+// History of save states, one a frame, to step the console back through, compressed to fit a memory budget.
+// The emulation thread only copies the state into a pooled SaveState (see NES::saveState) and queues it.
+// A background thread compresses it into the history, so the cost of a frame's push is that of a save.
+//
+// States come in groups: a keyframe, then the states after it, each stored as its XOR against the keyframe, so mostly
+// zeros. Both are compressed the same way, keyframes as their XOR against zeros. The state is compared to the
+// keyframe a 256 byte page at a time, and an unchanged page, which most are, becomes a zero run without looking
+// at its bytes. The rest are run length encoded:
+//     0x00-0x7F          'n + 1' XORed bytes follow.
+//     0x80-0xFF, lo      '((n & 0x7F) << 8 | lo) + 1' zeros.
+//
+// Compressed states are held in a ring arena of the budget's size. Once full, the oldest group is dropped whole,
+// as its states can't be decoded without its keyframe.
+class Rewind {
+public:
+    // Keeps as much history as fits in 'budget' bytes, with a keyframe every 'keyframe_interval' states.
+    explicit Rewind(const size_t& budget, const int& keyframe_interval = 60);
+    ~Rewind();
+
+    // Emulation thread. Adds the state of 'nes' as the newest.
+    // If the compression has fallen behind, waits for room rather than dropping the state.
+    void push(const NES& nes);
+    // Emulation thread. Drops the newest state, and loads the one before it, which becomes the newest, into 'nes'.
+    // Returns false, leaving both as they are, if there's none before it.
+    bool stepBack(NES& nes);
+
+    // Emulation thread. States held, and the bytes they're compressed to, once the compression has caught up.
+    size_t size();
+    size_t bytesUsed();
+
+private:
+    static constexpr size_t PAGE_SIZE = 0x100;
+    static constexpr size_t MAX_ZERO_RUN = 0x8000,
+                            MAX_LITERAL = 0x80;
+    static constexpr size_t POOL_SIZE = 32; // States queued for compression at most.
+
+    // A compressed state in 'arena'.
+    struct Entry {
+        size_t offset;
+        size_t size;
+        bool keyframe;
+    };
+
+    // Compresses the queued states into the history until stopped.
+    void compress();
+    // Adds 'state' to the history.
+    void add(const SaveState& state);
+    // Offset in 'arena' for 'size' bytes after the newest entry, dropping the oldest groups until there's room.
+    size_t allocate(const size_t& size);
+    // Waits until every state pushed is in the history, which the emulation thread may then use.
+    void waitForCompression() const;
+
+    // Writes 'state' as its XOR against 'base', compressed, to 'out', returning the bytes written.
+    // 'out' must have room for 'maxEncodedSize(size)'.
+    static size_t encode(const uint8_t* state, const uint8_t* base, const size_t& size, uint8_t* out);
+    static size_t maxEncodedSize(const size_t& size) { return size + (size / 32) + 16; }
+    // Decodes what 'encode' wrote back into the state, given the same 'base'.
+    static void decode(const uint8_t* in, const uint8_t* base, const size_t& size, uint8_t* out);
+
+    const int keyframe_interval;
+
+    // Owned by the compression thread while states are queued, by the emulation thread once it's caught up.
+    std::vector<uint8_t> arena;
+    std::deque<Entry> entries; // Oldest first.
+    size_t bytes_used = 0;     // By 'entries'.
+    int group_size = 0;        // States in the newest group, its keyframe included.
+    std::vector<uint8_t> keyframe; // The newest group's keyframe, decoded, which new states are XORed against.
+    std::vector<uint8_t> zeros;    // What keyframes are XORed against.
+    std::vector<uint8_t> encoded;  // Compression scratch.
+    SaveState decoded;
+
+    std::array<SaveState, POOL_SIZE> pool;
+    RingBuffer<SaveState*, POOL_SIZE> queued; // To the compression thread.
+    RingBuffer<SaveState*, POOL_SIZE> spare;  // Back from it, once compressed.
+    std::atomic<size_t> pending{0}; // States pushed, not yet in the history.
+    std::thread compressor;
+    std::atomic<bool> running{true};
+};
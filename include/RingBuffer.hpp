@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stddef.h>
+#include <array>
+#include <atomic>
+
+// Fixed capacity, lock-free, single producer single consumer queue.
+// One thread may push while another pops, without either waiting on a lock.
+// Capacity must be a power of two, so indices wrap with a mask rather than a modulo.
+template <typename T, size_t Capacity>
+class RingBuffer {
+public:
+    static_assert(Capacity != 0 && (Capacity & (Capacity - 1)) == 0,
+                  "RingBuffer capacity must be a power of two.");
+
+    // Producer only. Returns false, leaving the buffer unchanged, if it's full.
+    bool push(const T& value) {
+        const size_t tail = tail_index.load(std::memory_order_relaxed);
+        if (tail - head_index.load(std::memory_order_acquire) == Capacity) {
+            return false; }
+
+        buffer[tail & MASK] = value;
+        tail_index.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only. Returns false, leaving 'value' unchanged, if the buffer is empty.
+    bool pop(T& value) {
+        const size_t head = head_index.load(std::memory_order_relaxed);
+        if (head == tail_index.load(std::memory_order_acquire)) {
+            return false; }
+
+        value = buffer[head & MASK];
+        head_index.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Number of elements waiting to be popped.
+    // Only a snapshot, as the other thread may push or pop concurrently.
+    size_t size() const {
+        return tail_index.load(std::memory_order_acquire) - head_index.load(std::memory_order_acquire);
+    }
+
+    bool empty() const { return size() == 0; }
+
+    static constexpr size_t capacity() { return Capacity; }
+
+private:
+    static constexpr size_t MASK = Capacity - 1;
+
+    std::array<T, Capacity> buffer;
+
+    // Padded onto separate cache lines, so the producer and consumer don't contend over them.
+    std::atomic<size_t> head_index{0}; // Next element to pop. Written by the consumer.
+    char padding[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> tail_index{0}; // Next free element. Written by the producer.
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <Cartridge.hpp>
+#include <Checksum.hpp>
+
+class HeaderDatabase;
+
+// An index of a library of ROM files: each file's checksums, and its header, corrected (see HeaderDatabase).
+// Built by scanning directories, hashing files on a thread per core, each memory mapped (see MappedFile).
+// Saved as a compact binary file, so that a game can be loaded from it by path or checksum, with the header as indexed:
+// no directory scan, and no header parsing or checks but that the file holds the ROM the header describes.
+//
+// Index file (little endian): "TNIX", a version, the entry count, then per entry: its path (length, then bytes),
+// file size, CRC32, SHA-1, and header fields.
+class RomIndex {
+public:
+    struct Entry {
+        std::string path;
+        uint64_t file_size;
+        // Of PRG and CHR ROM, without the header or trainer, as ROM databases checksum them.
+        uint32_t crc32;
+        Sha1::Digest sha1;
+        Cartridge::Header header;
+        bool corrected; // 'header' was corrected by the database.
+    };
+
+    // Indexes every .nes file in 'directories' and their subdirectories, on 'threads' threads (0: one per core).
+    // Files that don't load are reported and skipped. Entries are in order of path.
+    void scan(const std::vector<std::string>& directories, const HeaderDatabase& database, const unsigned& threads);
+
+    // Throw if the file can't be written or read, or isn't an index.
+    void save(const std::string& index_path) const;
+    void load(const std::string& index_path);
+
+    // The entry for 'key': a path, as indexed, or a CRC32 or SHA-1, in hex. nullptr if there's none.
+    const Entry* find(const std::string& key) const;
+
+    const std::vector<Entry>& entries() const { return indexed; }
+
+private:
+    static constexpr uint32_t VERSION = 1;
+
+    // Loads, hashes and corrects one file into 'entry'. Returns false, having reported why, if it doesn't load.
+    static bool indexFile(const std::string& path, const HeaderDatabase& database, Entry& entry);
+
+    std::vector<Entry> indexed;
+};
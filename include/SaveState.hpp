@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+#include <vector>
+
+// A snapshot of the console's mutable state (see NES::saveState): CPU, RAM, PPU, APU, mapper and scheduler.
+// One contiguous blob, sized for the game when it's loaded, so saving into the same SaveState again doesn't allocate.
+// ROM is left out, as it can't change: the blob only refers to it, by a checksum, which loading checks.
+// Neither are host side outputs (the frame buffers, audio not yet played) or the buttons held, which are input.
+//
+// Blob: "TNST", the version, the ROM's CRC32, then each component's fields, as raw host bytes, in a fixed order.
+// It's only meant to be loaded by the same build, on the same machine, into the same game.
+class SaveState {
+public:
+    static constexpr uint32_t MAGIC   = 0x54534E54, // "TNST", little endian.
+                              VERSION = 1;
+
+    const uint8_t* data() const { return blob.data(); }
+    size_t size() const { return blob.size(); }
+    bool empty() const { return blob.empty(); }
+
+private:
+    friend class NES;
+    friend class Rewind;
+
+    std::vector<uint8_t> blob;
+};
+
+// Copies fields into a blob, one after another, as raw bytes.
+// With no blob, only counts the bytes, to size one.
+class StateWriter {
+public:
+    explicit StateWriter(uint8_t* out) : out(out) {}
+
+    template <typename T>
+    void put(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "Fields are copied as raw bytes");
+        bytes(&value, sizeof(T));
+    }
+    void bytes(const void* data, const size_t& size) {
+        if (out != nullptr) {
+            memcpy(out + position, data, size); }
+        position += size;
+    }
+
+    // Bytes written (or counted) so far.
+    size_t size() const { return position; }
+
+private:
+    uint8_t* out;
+    size_t position = 0;
+};
+
+// Copies fields back out of a blob, in the order StateWriter put them. The blob's size must have been checked.
+class StateReader {
+public:
+    explicit StateReader(const uint8_t* in) : in(in) {}
+
+    template <typename T>
+    void get(T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "Fields are copied as raw bytes");
+        bytes(&value, sizeof(T));
+    }
+    void bytes(void* data, const size_t& size) {
+        memcpy(data, in + position, size);
+        position += size;
+    }
+    // The next 'size' bytes, in place, for a caller that compares before it copies.
+    const uint8_t* view(const size_t& size) {
+        const uint8_t* data = in + position;
+        position += size;
+        return data;
+    }
+
+private:
+    const uint8_t* in;
+    size_t position = 0;
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+#include <array>
+#include <vector>
+
+#include <SaveState.hpp>
+
+// Keeps the timestamps of pending hardware events, on the master clock (CPU cycles since power on).
+// The CPU runs in batches up to the earliest one, checking only that single deadline between instructions,
+// rather than polling every device. Components schedule their own events, and the run loop handles them when due.
+class Scheduler {
+public:
+    enum Event : uint8_t {
+        PPU_EVENT, // Something the CPU could observe changes in the PPU (see PPU::nextEventCycle).
+        NMI,       // The PPU's NMI output was asserted.
+        APU_EVENT, // Something the CPU could observe changes in the APU (see APU::nextEventCycle).
+        MAPPER_EVENT, // The mapper raises an IRQ (see Mapper::handleEvent).
+        EVENT_COUNT
+    };
+
+    // Cycle of an event that never happens. Later than any scheduled event.
+    static constexpr uint64_t NEVER = UINT64_MAX;
+
+    Scheduler();
+
+    // Removes every pending event.
+    void reset();
+    // Sets 'event' to happen at 'cycle'. Each event is pending at most once, so this replaces any earlier time.
+    void schedule(const Event& event, const uint64_t& cycle);
+    void cancel(const Event& event);
+    // Cycle 'event' is pending at, or NEVER.
+    uint64_t scheduledCycle(const Event& event) const { return pending[event]; }
+
+    // Cycle of the earliest pending event, or NEVER.
+    uint64_t nextEventCycle() const {
+        return heap.empty() ? NEVER : heap.front().cycle;
+    }
+    // Removes the earliest event due by cycle 'now', into 'event'.
+    // Returns false if there's none.
+    bool pop(const uint64_t& now, Event& event);
+
+    // Pending events, by cycle. Loading replaces every pending event.
+    void saveState(StateWriter& out) const;
+    void loadState(StateReader& in);
+
+private:
+    struct Entry {
+        uint64_t cycle;
+        Event    event;
+        uint32_t generation;
+    };
+    // Orders the heap so the earliest entry is at the front. Ties go to the event listed first.
+    static bool later(const Entry& a, const Entry& b) {
+        return a.cycle != b.cycle ? a.cycle > b.cycle : a.event > b.event;
+    }
+
+    // Drops entries off the front that have been replaced or cancelled, so the front is always current.
+    void dropStale();
+
+    // Min-heap of entries. Rescheduling or cancelling an event doesn't search the heap;
+    // it bumps the event's generation, and the old entry is dropped once it reaches the front.
+    std::vector<Entry> heap;
+    std::array<uint32_t, EVENT_COUNT> generations;
+    std::array<uint64_t, EVENT_COUNT> pending;
+};
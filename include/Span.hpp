@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stddef.h>
+
+// A view of contiguous elements owned by something else, as C++20's std::span.
+template <typename T>
+class Span {
+public:
+    Span() = default;
+    Span(T* data, const size_t& size) : pointer(data), count(size) {}
+
+    T* data() const { return pointer; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    T& operator[](const size_t& index) const { return pointer[index]; }
+    T* begin() const { return pointer; }
+    T* end() const { return pointer + count; }
+
+private:
+    T*     pointer = nullptr;
+    size_t count   = 0;
+};
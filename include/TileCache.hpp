@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <array>
+#include <vector>
+
+// Pattern table tiles, decoded ahead of time for the renderer.
+// In CHR memory, each 8x8 tile is two 8 byte bit planes: a row's low bits, then 8 bytes later its high bits.
+// Decoding a row means interleaving the two planes' bits into 8 pixels (0-3). Rather than doing that for every
+// row of every tile on every scanline, each tile is decoded once, when loaded or written, into one byte per pixel.
+//
+// All of CHR memory is decoded, not just the 8 KB the pattern tables show. Like the PPU's pattern tables,
+// the decoded tiles are seen through eight 1 KB slots, each pointing at a bank of them,
+// so a mapper switching CHR banks only moves pointers, and nothing is decoded again.
+class TileCache {
+public:
+    static constexpr int TILE_COUNT = 512,  // Both pattern tables. 8 KB.
+                         TILE_SIZE  = 16,   // Bytes per encoded tile.
+                         SLOT_SIZE  = 0x400,
+                         SLOT_COUNT = 8,
+                         SLOT_TILES = SLOT_SIZE / TILE_SIZE;
+
+    // Decodes every tile of the CHR memory at 'chr' ('size' bytes, a multiple of SLOT_SIZE, at least 8 KB),
+    // and shows its first 8 KB.
+    void load(const uint8_t* chr, const size_t& size);
+    // Decodes again the tile containing 'offset' into CHR memory, after it was written (CHR RAM).
+    void update(const uint8_t* chr, const size_t& offset);
+    // Shows the tiles at 'offset' into CHR memory (a multiple of SLOT_SIZE) in 'slot' (0-7) of the pattern tables.
+    void mapSlot(const int& slot, const size_t& offset) {
+        slot_rows[slot]         = &rows[(offset / TILE_SIZE) * 8];
+        slot_flipped_rows[slot] = &flipped_rows[(offset / TILE_SIZE) * 8];
+    }
+
+    // Row 'y' (0-7) of 'tile' (0-511, the table being bit 8), as 8 pixels (0-3), one per byte,
+    // leftmost first in memory order. 'flipped' gives it mirrored horizontally, as sprites may be.
+    uint64_t row(const int& tile, const int& y) const {
+        return slot_rows[tile / SLOT_TILES][((tile % SLOT_TILES) * 8) + y];
+    }
+    uint64_t flippedRow(const int& tile, const int& y) const {
+        return slot_flipped_rows[tile / SLOT_TILES][((tile % SLOT_TILES) * 8) + y];
+    }
+
+private:
+    // Decodes the 16 bytes of 'tile' (counted from the start of CHR memory) at 'planes'.
+    void decode(const size_t& tile, const uint8_t* planes);
+
+    std::vector<uint64_t> rows;
+    std::vector<uint64_t> flipped_rows;
+    std::array<const uint64_t*, SLOT_COUNT> slot_rows;
+    std::array<const uint64_t*, SLOT_COUNT> slot_flipped_rows;
+};
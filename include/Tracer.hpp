@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <RingBuffer.hpp>
+
+// Highest trace level compiled into the emulator. Set through the TURBONES_TRACE_LEVEL CMake option.
+// At 0, every trace point is discarded at compile time, so the emulation loop is the same as untraced code.
+#ifndef TURBONES_TRACE_LEVEL
+#define TURBONES_TRACE_LEVEL 0
+#endif
+
+// Logs executed instructions to a file, in the format of Nintendulator logs (as used by nestest.log),
+// so that runs can be diffed against other emulators.
+// The emulation thread only copies a record into a preallocated ring buffer.
+// Formatting and file output happen on a background thread.
+class Tracer {
+public:
+    enum Level {
+        OFF          = 0,
+        INSTRUCTIONS = 1  // Every executed instruction, with the registers before it executes.
+    };
+
+    static constexpr int COMPILED_LEVEL = TURBONES_TRACE_LEVEL;
+
+    // CPU state at the start of an instruction.
+    struct Record {
+        uint64_t cycles;
+        uint16_t pc;
+        uint8_t opcode,
+                operand_lo,
+                operand_hi,
+                a,
+                x,
+                y,
+                p,
+                sp;
+    };
+
+    ~Tracer();
+
+    // Opens the log file and starts the background writer. Throws if the file can't be opened.
+    void start(const std::string& log_path, const Level& level);
+    // Writes any remaining records, and closes the log file.
+    void stop();
+
+    // True if trace points of 'level' are both compiled in and enabled at runtime.
+    // The compiled check comes first, so that the whole trace point folds away when it's false.
+    bool enabled(const Level& level) const {
+        return COMPILED_LEVEL >= level && runtime_level >= level;
+    }
+
+    // Queues a record. If the writer has fallen behind, waits for room rather than dropping the record.
+    void record(const Record& entry);
+
+private:
+    static constexpr size_t BUFFER_SIZE = 0x10000; // Number of records.
+
+    // Drains the buffer into the log file until stopped.
+    void write();
+    // Formats record as a Nintendulator log line.
+    static std::string format(const Record& entry);
+
+    int runtime_level = OFF;
+
+    std::unique_ptr<RingBuffer<Record, BUFFER_SIZE>> buffer;
+    std::ofstream log;
+    std::thread writer;
+    std::atomic<bool> running{false};
+};
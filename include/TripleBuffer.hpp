@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+#include <array>
+#include <atomic>
+
+// Lock-free handoff of the latest value from one producer thread to one consumer thread.
+// The producer fills the back buffer and publishes it; the consumer takes the most recently published one.
+// Neither ever waits for the other: with a third buffer in the middle, each side always has one of its own.
+// Values published while the consumer isn't looking are dropped, only the latest is kept.
+template <typename T>
+class TripleBuffer {
+public:
+    // Producer only. The buffer to write the next value into.
+    T& back() { return buffers[back_index]; }
+    // Producer only. Hands the back buffer over, getting the middle one back to write into.
+    void publish() {
+        back_index = middle.exchange(back_index | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    // Consumer only. Takes the latest published value into front, if there's been one since the last call.
+    // Returns false, leaving front unchanged, if not.
+    bool update() {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH)) {
+            return false; }
+        front_index = middle.exchange(front_index, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+    // Consumer only. The latest value taken by update.
+    const T& front() const { return buffers[front_index]; }
+
+private:
+    // 'middle' holds the index of the buffer between the two sides, and whether it's been published since taken.
+    static constexpr uint8_t INDEX = 0x3,
+                             FRESH = 0x4;
+
+    std::array<T, 3> buffers;
+
+    uint8_t back_index = 0;  // Owned by the producer.
+    // Padded onto separate cache lines, so the producer and consumer don't contend over them.
+    char padding[64 - sizeof(uint8_t)];
+    std::atomic<uint8_t> middle{1};
+    char padding_2[64 - sizeof(std::atomic<uint8_t>)];
+    uint8_t front_index = 2; // Owned by the consumer.
+};
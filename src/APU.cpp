@@ -1,2 +1,609 @@
+#include <algorithm>
+
 #include "APU.hpp"
+#include "CPU.hpp"
+#include "Memory.hpp"
+#include "Scheduler.hpp"
+
+namespace {
+
+// Length counter loads, indexed by the top 5 bits of the channel's 4th register.
+constexpr uint8_t LENGTHS[32] = {
+    10, 254, 20,  2, 40,  4, 80,  6, 160,  8, 60, 10, 14, 12, 26, 14,
+    12,  16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30
+};
+
+constexpr uint8_t DUTY_CYCLES[4][8] = {
+    { 0, 1, 0, 0, 0, 0, 0, 0 }, // 12.5%
+    { 0, 1, 1, 0, 0, 0, 0, 0 }, // 25%
+    { 0, 1, 1, 1, 1, 0, 0, 0 }, // 50%
+    { 1, 0, 0, 1, 1, 1, 1, 1 }  // 25% negated
+};
+
+constexpr uint8_t TRIANGLE_STEPS[32] = {
+    15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0,
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15
+};
+
+// NTSC. In CPU cycles.
+constexpr uint16_t NOISE_PERIODS[16] = {
+    4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068
+};
+constexpr uint16_t DMC_PERIODS[16] = {
+    428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106, 84, 72, 54
+};
+
+// Frame counter sequence, in CPU cycles since it started (NTSC).
+constexpr int QUARTER_1 = 7457,
+              HALF_1    = 14913,
+              QUARTER_3 = 22371,
+              FOUR_STEP_LAST = 29829, // Also raises the IRQ.
+              FOUR_STEP_LENGTH = 29830,
+              FIVE_STEP_LAST = 37281,
+              FIVE_STEP_LENGTH = 37282;
+
+// CPU cycles the CPU is stalled for by a DMC sample fetch (usually).
+constexpr int SAMPLE_FETCH_CYCLES = 4;
+
+// Mixed output level at full volume.
+constexpr double OUTPUT_SCALE = 30000;
+
+// The noise channel's shift register. 'mode' selects the short sequence.
+uint16_t shiftNoise(const uint16_t& shift, const bool& mode) {
+    const uint16_t feedback = (shift ^ (shift >> (mode ? 6 : 1))) & 1;
+    return (shift >> 1) | (feedback << 14);
+}
+
+// Shifting is linear over GF(2), so a shift is a 15x15 bit matrix, and many shifts are one multiplication by its power.
+// Matrices are stored as columns: the result of shifting each single bit.
+typedef std::array<uint16_t, 15> NoiseMatrix;
+
+uint16_t multiply(const NoiseMatrix& matrix, const uint16_t& shift) {
+    uint16_t result = 0;
+    for (int bit = 0; bit < 15; ++bit) {
+        if (shift & (1 << bit)) {
+            result ^= matrix[bit]; }
+    }
+    return result;
+}
+
+// Powers of two of the shift, up to 2^15, for both modes.
+const std::array<std::array<NoiseMatrix, 16>, 2>& noiseJumps() {
+    static const std::array<std::array<NoiseMatrix, 16>, 2> jumps = []() {
+        std::array<std::array<NoiseMatrix, 16>, 2> powers;
+        for (int mode = 0; mode < 2; ++mode) {
+            for (int bit = 0; bit < 15; ++bit) {
+                powers[mode][0][bit] = shiftNoise(1 << bit, mode != 0); }
+            for (int power = 1; power < 16; ++power) {
+                for (int bit = 0; bit < 15; ++bit) {
+                    powers[mode][power][bit] = multiply(powers[mode][power - 1], powers[mode][power - 1][bit]); }
+            }
+        }
+        return powers;
+    }();
+    return jumps;
+}
+
+// Shifts 'count' (under 2^16) times.
+uint16_t shiftNoise(uint16_t shift, const bool& mode, int count) {
+    const std::array<NoiseMatrix, 16>& powers = noiseJumps()[mode];
+    for (int power = 0; count != 0; ++power, count >>= 1) {
+        if (count & 1) {
+            shift = multiply(powers[power], shift); }
+    }
+    return shift;
+}
+
+}
+
+APU::APU() {
+    for (size_t i = 0; i < pulse_levels.size(); ++i) {
+        pulse_levels[i] = (int16_t)((i == 0) ? 0 : OUTPUT_SCALE * 95.52 / ((8128.0 / i) + 100)); }
+    for (size_t i = 0; i < tnd_levels.size(); ++i) {
+        tnd_levels[i] = (int16_t)((i == 0) ? 0 : OUTPUT_SCALE * 163.67 / ((24329.0 / i) + 100)); }
+
+    blip.setRates(1789773.0, SAMPLE_RATE);
+}
+
+void APU::setCPU(CPU* cpu) {
+    this->cpu = cpu;
+}
+
+void APU::setMemory(Memory* memory) {
+    this->memory = memory;
+}
+
+void APU::setScheduler(Scheduler* scheduler) {
+    this->scheduler = scheduler;
+}
+
+void APU::powerOn() {
+    cycle = 0;
+    frame_start_cycle = 0;
+    stall_cycles = 0;
+
+    pulse_1 = Pulse();
+    pulse_2 = Pulse();
+    pulse_1.channel_1 = true;
+    triangle = Triangle();
+    noise = Noise();
+    noise.shift = 1;
+    noise.period = NOISE_PERIODS[0];
+    dmc = DMC();
+    dmc.period = DMC_PERIODS[0];
+    dmc.buffer_empty = true;
+    dmc.bits_remaining = 8;
+    dmc.silence = true;
+    pulse_1.timer = pulse_2.timer = triangle.timer = 1;
+    noise.timer = noise.period;
+    dmc.timer = dmc.period;
+
+    five_step_mode = false;
+    frame_irq_inhibit = false;
+    frame_irq = false;
+    dmc_irq = false;
+    frame_cycle = 0;
+
+    last_output = 0;
+    blip.clear();
+    reschedule();
+}
+
+void APU::catchUp(const uint64_t& cpu_cycle) {
+    // Between changes, the output is constant. Jump from one change to the next, rather than stepping each cycle.
+    while (cycle < cpu_cycle) {
+        const int run = (int)std::min<uint64_t>(cpu_cycle - cycle, cyclesUntilChange());
+        advance(run);
+    }
+    reschedule();
+}
+
+int APU::cyclesUntilChange() const {
+    // Channels that can't change their output at their next timer clock (e.g. silenced) aren't waited for.
+    // They're caught up in bulk by 'advance'.
+    int cycles = cyclesUntilFrameStep();
+    if (pulse_1.audible()) {
+        cycles = std::min(cycles, pulse_1.timer); }
+    if (pulse_2.audible()) {
+        cycles = std::min(cycles, pulse_2.timer); }
+    if (triangle.stepping()) {
+        cycles = std::min(cycles, triangle.timer); }
+    if (noise.audible()) {
+        cycles = std::min(cycles, noise.timer); }
+    if (!dmc.silence
+         || !dmc.buffer_empty
+         || dmc.bytes_remaining > 0) {
+        cycles = std::min(cycles, dmc.timer); }
+    return cycles;
+}
+
+void APU::advance(const int& cycles) {
+    cycle += cycles;
+
+    frame_cycle += cycles;
+    if (frame_cycle == (five_step_mode ? FIVE_STEP_LENGTH : FOUR_STEP_LENGTH)) {
+        frame_cycle = 0; }
+    else if (frame_cycle == QUARTER_1
+              || frame_cycle == QUARTER_3) {
+        clockQuarterFrame(); }
+    else if (frame_cycle == HALF_1) {
+        clockQuarterFrame();
+        clockHalfFrame();
+    }
+    else if (frame_cycle == (five_step_mode ? FIVE_STEP_LAST : FOUR_STEP_LAST)) {
+        clockQuarterFrame();
+        clockHalfFrame();
+        if (!five_step_mode
+             && !frame_irq_inhibit) {
+            setFrameIRQ(true); }
+    }
+
+    // Timers. Any channel may have been clocked several times, if it wasn't waited for.
+    for (Pulse* pulse : { &pulse_1, &pulse_2 }) {
+        const int clocks = clockTimer(pulse->timer, 2 * (pulse->period + 1), cycles);
+        pulse->step = (pulse->step + clocks) & 7;
+    }
+
+    // Only a clock on the last cycle can step the triangle: if it was stepping before, it was waited for.
+    // If it wasn't, only a frame counter step on that cycle (just run) can have started it.
+    if (clockTimer(triangle.timer, triangle.period + 1, cycles) > 0
+         && triangle.timer == triangle.period + 1
+         && triangle.stepping()) {
+        triangle.step = (triangle.step + 1) & 31; }
+
+    const int noise_clocks = clockTimer(noise.timer, noise.period, cycles);
+    if (noise_clocks == 1) {
+        noise.shift = shiftNoise(noise.shift, noise.mode); }
+    else if (noise_clocks > 1) {
+        noise.shift = shiftNoise(noise.shift, noise.mode, noise_clocks); }
+
+    for (int i = clockTimer(dmc.timer, dmc.period, cycles); i > 0; --i) {
+        if (!dmc.silence) {
+            if (dmc.shifter & 1) {
+                if (dmc.level <= 125) {
+                    dmc.level += 2; }
+            }
+            else if (dmc.level >= 2) {
+                dmc.level -= 2; }
+            dmc.shifter >>= 1;
+        }
+        if (--dmc.bits_remaining == 0) {
+            // Next output cycle, with the sample buffer's byte, which is then refilled.
+            dmc.bits_remaining = 8;
+            dmc.silence = dmc.buffer_empty;
+            if (!dmc.buffer_empty) {
+                dmc.shifter = dmc.sample_buffer;
+                dmc.buffer_empty = true;
+                fetchSample();
+            }
+        }
+    }
+
+    updateOutput();
+}
+
+void APU::updateOutput() {
+    const int level = output();
+    if (level != last_output) {
+        blip.addDelta((uint32_t)(cycle - frame_start_cycle), level - last_output);
+        last_output = level;
+    }
+}
+
+int APU::clockTimer(int& timer, const int& period, const int& cycles) {
+    if (cycles < timer) {
+        timer -= cycles;
+        return 0;
+    }
+    const int over = cycles - timer; // Cycles past the first clock.
+    timer = period - (over % period);
+    return 1 + (over / period);
+}
+
+int APU::cyclesUntilFrameStep() const {
+    const int steps[] = { QUARTER_1, HALF_1, QUARTER_3,
+                          five_step_mode ? FIVE_STEP_LAST : FOUR_STEP_LAST,
+                          five_step_mode ? FIVE_STEP_LENGTH : FOUR_STEP_LENGTH };
+    for (const int& step : steps) {
+        if (frame_cycle < step) {
+            return step - frame_cycle; }
+    }
+    return 0;
+}
+
+int APU::output() const {
+    return pulse_levels[pulse_1.output() + pulse_2.output()]
+         + tnd_levels[(3 * triangle.output()) + (2 * noise.output()) + dmc.level];
+}
+
+uint64_t APU::nextEventCycle() const {
+    uint64_t next = Scheduler::NEVER;
+    if (!five_step_mode
+         && !frame_irq_inhibit) {
+        const int until = (frame_cycle < FOUR_STEP_LAST) ? FOUR_STEP_LAST - frame_cycle
+                                                         : FOUR_STEP_LENGTH - frame_cycle + FOUR_STEP_LAST;
+        next = cycle + until;
+    }
+    if (dmc.bytes_remaining > 0) {
+        // The sample buffer is emptied, and refilled, when the next output cycle starts.
+        const uint64_t fetch = cycle + dmc.timer + ((uint64_t)(dmc.bits_remaining - 1) * dmc.period);
+        next = std::min(next, fetch);
+    }
+    return next;
+}
+
+void APU::reschedule() {
+    if (scheduler == nullptr) {
+        return; }
+
+    const uint64_t event_cycle = nextEventCycle();
+    if (scheduler->scheduledCycle(Scheduler::APU_EVENT) == event_cycle) {
+        return; }
+    // Cancelled rather than scheduled for NEVER: such an entry never reaches the front of the heap, to be dropped.
+    if (event_cycle == Scheduler::NEVER) {
+        scheduler->cancel(Scheduler::APU_EVENT); }
+    else {
+        scheduler->schedule(Scheduler::APU_EVENT, event_cycle); }
+}
+
+int APU::takeStallCycles() {
+    const int stalled = stall_cycles;
+    stall_cycles = 0;
+    return stalled;
+}
+
+void APU::saveState(StateWriter& out) const {
+    out.put(cycle);
+    out.put(stall_cycles);
+    out.put(pulse_1);
+    out.put(pulse_2);
+    out.put(triangle);
+    out.put(noise);
+    out.put(dmc);
+    out.put(five_step_mode);
+    out.put(frame_irq_inhibit);
+    out.put(frame_irq);
+    out.put(dmc_irq);
+    out.put(frame_cycle);
+}
+
+void APU::loadState(StateReader& in) {
+    endFrame();
+
+    in.get(cycle);
+    in.get(stall_cycles);
+    in.get(pulse_1);
+    in.get(pulse_2);
+    in.get(triangle);
+    in.get(noise);
+    in.get(dmc);
+    in.get(five_step_mode);
+    in.get(frame_irq_inhibit);
+    in.get(frame_irq);
+    in.get(dmc_irq);
+    in.get(frame_cycle);
+
+    frame_start_cycle = cycle;
+    updateOutput();
+}
+
+void APU::endFrame() {
+    blip.endFrame((uint32_t)(cycle - frame_start_cycle));
+    frame_start_cycle = cycle;
+}
+
+void APU::clockQuarterFrame() {
+    pulse_1.envelope.clock();
+    pulse_2.envelope.clock();
+    noise.envelope.clock();
+
+    if (triangle.linear_reload) {
+        triangle.linear = triangle.linear_reload_value; }
+    else if (triangle.linear > 0) {
+        --triangle.linear; }
+    if (!triangle.control) {
+        triangle.linear_reload = false; }
+}
+
+void APU::clockHalfFrame() {
+    if (pulse_1.length > 0 && !pulse_1.envelope.loop) {
+        --pulse_1.length; }
+    if (pulse_2.length > 0 && !pulse_2.envelope.loop) {
+        --pulse_2.length; }
+    if (triangle.length > 0 && !triangle.control) {
+        --triangle.length; }
+    if (noise.length > 0 && !noise.envelope.loop) {
+        --noise.length; }
+
+    pulse_1.clockSweep();
+    pulse_2.clockSweep();
+}
+
+void APU::Envelope::clock() {
+    if (start) {
+        start = false;
+        decay = 15;
+        divider = volume;
+    }
+    else if (divider == 0) {
+        divider = volume;
+        if (decay > 0) {
+            --decay; }
+        else if (loop) {
+            decay = 15; }
+    }
+    else {
+        --divider; }
+}
+
+uint16_t APU::Pulse::sweepTarget() const {
+    const uint16_t change = period >> sweep_shift;
+    if (!sweep_negate) {
+        return period + change; }
+    // Pulse 1 subtracts one more (one's complement).
+    const int target = period - change - (channel_1 ? 1 : 0);
+    return (uint16_t)std::max(target, 0);
+}
+
+void APU::Pulse::clockSweep() {
+    if (sweep_divider == 0
+         && sweep_enabled
+         && sweep_shift > 0
+         && !muted()) {
+        period = sweepTarget(); }
+
+    if (sweep_divider == 0
+         || sweep_reload) {
+        sweep_divider = sweep_period;
+        sweep_reload = false;
+    }
+    else {
+        --sweep_divider; }
+}
+
+uint8_t APU::Pulse::output() const {
+    if (length == 0
+         || muted()
+         || !DUTY_CYCLES[duty][step]) {
+        return 0; }
+    return envelope.output();
+}
+
+uint8_t APU::Triangle::output() const {
+    return TRIANGLE_STEPS[step];
+}
+
+void APU::fetchSample() {
+    if (!dmc.buffer_empty
+         || dmc.bytes_remaining == 0) {
+        return; }
+
+    stall_cycles += SAMPLE_FETCH_CYCLES;
+    dmc.sample_buffer = memory->read(dmc.address);
+    dmc.buffer_empty = false;
+    dmc.address = (dmc.address == 0xFFFF) ? 0x8000 : dmc.address + 1;
+
+    if (--dmc.bytes_remaining == 0) {
+        if (dmc.loop) {
+            restartSample(); }
+        else if (dmc.irq_enabled) {
+            setDMCIRQ(true); }
+    }
+}
+
+void APU::restartSample() {
+    dmc.address = dmc.sample_address;
+    dmc.bytes_remaining = dmc.sample_length;
+}
+
+void APU::setFrameIRQ(const bool& active) {
+    frame_irq = active;
+    cpu->setIRQ(CPU::IRQ_FRAME_COUNTER, active);
+}
+
+void APU::setDMCIRQ(const bool& active) {
+    dmc_irq = active;
+    cpu->setIRQ(CPU::IRQ_DMC, active);
+}
+
+uint8_t APU::readStatus() {
+    const uint8_t status = (pulse_1.length > 0 ? 0x01 : 0)
+                         | (pulse_2.length > 0 ? 0x02 : 0)
+                         | (triangle.length > 0 ? 0x04 : 0)
+                         | (noise.length > 0 ? 0x08 : 0)
+                         | (dmc.bytes_remaining > 0 ? 0x10 : 0)
+                         | (frame_irq ? 0x40 : 0)
+                         | (dmc_irq ? 0x80 : 0);
+    // Reading acknowledges the frame counter's IRQ.
+    setFrameIRQ(false);
+    return status;
+}
+
+void APU::writeRegister(const uint16_t& address, const uint8_t& value) {
+    switch (address) {
+        case 0x4000:
+        case 0x4004: {
+            Pulse& pulse = (address == 0x4000) ? pulse_1 : pulse_2;
+            pulse.duty              =  value >> 6;
+            pulse.envelope.loop     = (value >> 5) & 0x1;
+            pulse.envelope.constant = (value >> 4) & 0x1;
+            pulse.envelope.volume   =  value       & 0xF;
+            break;
+        }
+        case 0x4001:
+        case 0x4005: {
+            Pulse& pulse = (address == 0x4001) ? pulse_1 : pulse_2;
+            pulse.sweep_enabled =  value >> 7;
+            pulse.sweep_period  = (value >> 4) & 0x7;
+            pulse.sweep_negate  = (value >> 3) & 0x1;
+            pulse.sweep_shift   =  value       & 0x7;
+            pulse.sweep_reload  = true;
+            break;
+        }
+        case 0x4002:
+        case 0x4006: {
+            Pulse& pulse = (address == 0x4002) ? pulse_1 : pulse_2;
+            pulse.period = (pulse.period & 0x700) | value;
+            break;
+        }
+        case 0x4003:
+        case 0x4007: {
+            Pulse& pulse = (address == 0x4003) ? pulse_1 : pulse_2;
+            pulse.period = (pulse.period & 0xFF) | ((value & 0x7) << 8);
+            if (pulse.enabled) {
+                pulse.length = LENGTHS[value >> 3]; }
+            pulse.step = 0;
+            pulse.envelope.start = true;
+            break;
+        }
+
+        case 0x4008:
+            triangle.control             = value >> 7;
+            triangle.linear_reload_value = value & 0x7F;
+            break;
+        case 0x400A:
+            triangle.period = (triangle.period & 0x700) | value;
+            break;
+        case 0x400B:
+            triangle.period = (triangle.period & 0xFF) | ((value & 0x7) << 8);
+            if (triangle.enabled) {
+                triangle.length = LENGTHS[value >> 3]; }
+            triangle.linear_reload = true;
+            break;
+
+        case 0x400C:
+            noise.envelope.loop     = (value >> 5) & 0x1;
+            noise.envelope.constant = (value >> 4) & 0x1;
+            noise.envelope.volume   =  value       & 0xF;
+            break;
+        case 0x400E:
+            noise.mode   = value >> 7;
+            noise.period = NOISE_PERIODS[value & 0xF];
+            break;
+        case 0x400F:
+            if (noise.enabled) {
+                noise.length = LENGTHS[value >> 3]; }
+            noise.envelope.start = true;
+            break;
+
+        case 0x4010:
+            dmc.irq_enabled =  value >> 7;
+            dmc.loop        = (value >> 6) & 0x1;
+            dmc.period      = DMC_PERIODS[value & 0xF];
+            if (!dmc.irq_enabled) {
+                setDMCIRQ(false); }
+            break;
+        case 0x4011:
+            dmc.level = value & 0x7F;
+            break;
+        case 0x4012:
+            dmc.sample_address = 0xC000 + (value * 64);
+            break;
+        case 0x4013:
+            dmc.sample_length = (value * 16) + 1;
+            break;
+
+        case 0x4015:
+            pulse_1.enabled  = value & 0x01;
+            pulse_2.enabled  = value & 0x02;
+            triangle.enabled = value & 0x04;
+            noise.enabled    = value & 0x08;
+            if (!pulse_1.enabled) {
+                pulse_1.length = 0; }
+            if (!pulse_2.enabled) {
+                pulse_2.length = 0; }
+            if (!triangle.enabled) {
+                triangle.length = 0; }
+            if (!noise.enabled) {
+                noise.length = 0; }
+
+            if (!(value & 0x10)) {
+                dmc.bytes_remaining = 0; }
+            else if (dmc.bytes_remaining == 0) {
+                restartSample();
+                fetchSample();
+            }
+            setDMCIRQ(false);
+            break;
+
+        case 0x4017:
+            five_step_mode    = value >> 7;
+            frame_irq_inhibit = (value >> 6) & 0x1;
+            if (frame_irq_inhibit) {
+                setFrameIRQ(false); }
+            // The sequence restarts. The 5 step sequence clocks everything straight away.
+            frame_cycle = 0;
+            if (five_step_mode) {
+                clockQuarterFrame();
+                clockHalfFrame();
+            }
+            break;
+
+        default:
+            break;
+    }
 
+    // A change in volume, or a channel silenced, is heard straight away.
+    updateOutput();
+    reschedule();
+}
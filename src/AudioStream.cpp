@@ -0,0 +1,35 @@
+#include "AudioStream.hpp"
+
+#if TURBONES_SFML
+
+#include "APU.hpp"
+
+AudioStream::AudioStream() {
+    initialize(1, APU::SAMPLE_RATE);
+}
+
+size_t AudioStream::push(const int16_t* samples, const size_t& count) {
+    for (size_t i = 0; i < count; ++i) {
+        if (!queue.push(samples[i])) {
+            return i; }
+    }
+    return count;
+}
+
+bool AudioStream::onGetData(Chunk& data) {
+    size_t i = 0;
+    while (i < CHUNK_SIZE
+            && queue.pop(chunk[i])) {
+        ++i; }
+    if (i > 0) {
+        last_sample = chunk[i - 1]; }
+    // Ran out (emulation fell behind). Hold the last level, rather than dropping to 0 with a click.
+    for (; i < CHUNK_SIZE; ++i) {
+        chunk[i] = last_sample; }
+
+    data.samples = chunk.data();
+    data.sampleCount = CHUNK_SIZE;
+    return true; // Keep playing.
+}
+
+#endif
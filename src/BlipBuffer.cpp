@@ -0,0 +1,102 @@
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+
+#include "BlipBuffer.hpp"
+
+namespace {
+
+constexpr double PI = 3.14159265358979323846;
+// Cutoff of the impulse, as a fraction of the output's Nyquist frequency. Below 1, to leave room for the window's roll off.
+constexpr double CUTOFF = 0.9;
+
+}
+
+BlipBuffer::BlipBuffer() : differences(CAPACITY + TAPS, 0) {
+    // Windowed sinc impulses, one per phase: centered on a point 'phase / PHASES' of a sample
+    // past the middle tap, so every position between two samples has a centered impulse.
+    const double half_width = TAPS / 2.0;
+    for (int phase = 0; phase < PHASES; ++phase) {
+        const double center = (half_width - 1) + ((double)phase / PHASES);
+
+        std::array<double, TAPS> impulse;
+        double sum = 0;
+        for (int tap = 0; tap < TAPS; ++tap) {
+            const double x = tap - center;
+            const double sinc = (x == 0) ? 1.0 : std::sin(PI * CUTOFF * x) / (PI * CUTOFF * x);
+            const double window = (std::abs(x) >= half_width) ? 0.0
+                                : 0.42 + (0.5 * std::cos(PI * x / half_width)) + (0.08 * std::cos(2 * PI * x / half_width));
+            impulse[tap] = sinc * window;
+            sum += impulse[tap];
+        }
+
+        // Normalized exactly, rounding error going to the largest tap, so that steps integrate to their delta.
+        int32_t total = 0;
+        for (int tap = 0; tap < TAPS; ++tap) {
+            kernel[phase][tap] = (int32_t)std::lround(impulse[tap] / sum * (1 << KERNEL_BITS));
+            total += kernel[phase][tap];
+        }
+        const auto largest = std::max_element(kernel[phase].begin(), kernel[phase].end());
+        *largest += (1 << KERNEL_BITS) - total;
+    }
+
+    setRates(1789773.0, 44100.0);
+}
+
+void BlipBuffer::setRates(const double& clock_rate, const double& sample_rate) {
+    factor = (uint64_t)std::llround(sample_rate / clock_rate * (double)(1ULL << FRACTION_BITS));
+    clear();
+}
+
+void BlipBuffer::clear() {
+    offset = 0;
+    available = 0;
+    integrator = 0;
+    std::fill(differences.begin(), differences.end(), 0);
+}
+
+void BlipBuffer::addDelta(const uint32_t& clock, const int& delta) {
+    const uint64_t position = offset + (clock * factor);
+    const size_t index = (size_t)(position >> FRACTION_BITS);
+    if (index >= CAPACITY) { // Frame too long to hold. Dropped, rather than overrunning.
+        return; }
+    const int phase = (int)(position >> (FRACTION_BITS - PHASE_BITS)) & (PHASES - 1);
+
+    int32_t* out = &differences[index];
+    const std::array<int32_t, TAPS>& impulse = kernel[phase];
+    for (int tap = 0; tap < TAPS; ++tap) {
+        out[tap] += impulse[tap] * delta; }
+}
+
+void BlipBuffer::endFrame(const uint32_t& clocks) {
+    offset += clocks * factor;
+    available = std::min((size_t)(offset >> FRACTION_BITS), CAPACITY);
+
+    // Unread samples take up the room the next frame needs. Drop the oldest, keeping up to half.
+    if (available > CAPACITY / 2) {
+        removeSamples(nullptr, available - (CAPACITY / 2)); }
+}
+
+size_t BlipBuffer::readSamples(int16_t* out, const size_t& count) {
+    const size_t read = std::min(count, available);
+    removeSamples(out, read);
+    return read;
+}
+
+void BlipBuffer::removeSamples(int16_t* out, const size_t& count) {
+    for (size_t i = 0; i < count; ++i) {
+        integrator += differences[i];
+        const int32_t sample = integrator >> KERNEL_BITS;
+        if (out != nullptr) {
+            out[i] = (int16_t)std::max(-32768, std::min(32767, sample)); }
+        integrator -= sample * (1 << (KERNEL_BITS - HIGH_PASS_SHIFT));
+    }
+
+    // Shift what's left, including the tails of impulses past the end of the frame, to the front.
+    const size_t used = std::min(differences.size(), (size_t)(offset >> FRACTION_BITS) + TAPS + 1);
+    const size_t remaining = used - count;
+    memmove(differences.data(), differences.data() + count, remaining * sizeof(int32_t));
+    std::fill(differences.begin() + remaining, differences.begin() + used, 0);
+    offset -= (uint64_t)count << FRACTION_BITS;
+    available -= count;
+}
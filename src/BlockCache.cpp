@@ -0,0 +1,46 @@
+#include "BlockCache.hpp"
+
+constexpr uint32_t BlockCache::NONE,
+                   BlockCache::UNCACHEABLE;
+
+void BlockCache::reset(const uint8_t* rom, const size_t& rom_size) {
+    this->rom = rom;
+    this->rom_size = rom_size;
+
+    block_index.assign(rom_size, NONE);
+    blocks.clear();
+    operations_storage.clear();
+}
+
+BlockCache::Block& BlockCache::insert(const uint8_t* code, const uint16_t& pc,
+                                      const std::vector<Operation>& decoded) {
+    Block block;
+    block.pc         = pc;
+    block.first      = (uint32_t)operations_storage.size();
+    block.length     = (uint32_t)decoded.size();
+    block.cycles     = 0;
+    for (const Operation& operation : decoded) {
+        block.cycles += operation.cycles; }
+    block.executions = 0;
+    block.native     = nullptr;
+    block.idle_loop  = false;
+    operations_storage.insert(operations_storage.end(), decoded.begin(), decoded.end());
+
+    // Any blocks already here were decoded for other CPU addresses. They're kept, after this one.
+    uint32_t& index = block_index[code - rom];
+    block.next = (index == UNCACHEABLE) ? NONE : index;
+    index = (uint32_t)blocks.size();
+    blocks.push_back(block);
+    return blocks.back();
+}
+
+void BlockCache::markUncacheable(const uint8_t* code) {
+    block_index[code - rom] = UNCACHEABLE;
+}
+
+void BlockCache::clearNative() {
+    for (Block& block : blocks) {
+        block.native = nullptr;
+        block.executions = 0;
+    }
+}
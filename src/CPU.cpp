@@ -1,10 +1,12 @@
 #include <iostream>
 
 #include "CPU.hpp"
+#include "Hash.hpp"
 #include "Opcodes.hpp"
 
-CPU::CPU(Memory* mem) {
+CPU::CPU(Memory* mem, Tracer* tracer) {
     memory = mem;
+    this->tracer = tracer;
 }
 
 void CPU::powerOn() {
@@ -15,9 +17,12 @@ void CPU::powerOn() {
     pc = read16(0xFFFC);
     sp = 0xFD;
 
-    r_p.set(INTERRUPT_DISABLE);
-    r_p.set(BREAK_MODE_FLAG);
-    r_p.set(UNUSED_BIT);
+    cycles = 0;
+    nmi_pending = false;
+    irq_lines = 0;
+    interrupt_disable_delayed = false;
+
+    setStatus(0x34); // Interrupt Disable set.
 }
 
 uint8_t CPU::fetch() {
@@ -48,6 +53,12 @@ uint16_t CPU::read16(const uint16_t& address) {
     return (hi << 8) | lo; // Little endian
 }
 
+uint16_t CPU::read16WithinPage(const uint16_t& address) {
+    const uint16_t lo = memory->read(address);
+    const uint16_t hi = memory->read((address & 0xFF00) | ((address + 1) & 0x00FF));
+    return (hi << 8) | lo;
+}
+
 void CPU::push16(const uint16_t& value) {
     const uint8_t hi = value >> 8;
     const uint8_t lo = value & 0x00FF;
@@ -61,1243 +72,813 @@ uint16_t CPU::pop16() {
     return (hi << 8) | lo;
 }
 
-void CPU::setZeroFlag(const uint8_t& value) {
-    const bool isZero = (value == 0);
-    r_p.set(ZERO_FLAG, isZero);
+uint8_t CPU::status(const bool& break_flag) const {
+    return (negative()          << NEGATIVE_FLAG)
+         | (overflow()          << OVERFLOW_FLAG)
+         | (1                   << UNUSED_BIT)
+         | (break_flag          << BREAK_MODE_FLAG)
+         | (decimal_mode        << DECIMAL_MODE)
+         | (interrupt_disable   << INTERRUPT_DISABLE)
+         | (zero()              << ZERO_FLAG)
+         | (carry()             << CARRY_FLAG);
 }
 
-void CPU::setNegativeFlag(const uint8_t& value) {
-    const bool negativeBit = ((value) & 0b1000'0000);
-    r_p.set(NEGATIVE_FLAG, negativeBit);
+void CPU::setStatus(const uint8_t& value) {
+    // Values chosen so that each lazily derived flag comes out as the corresponding bit.
+    negative_result   = value & (1 << NEGATIVE_FLAG);
+    overflow_result   = (value & (1 << OVERFLOW_FLAG)) << 1;
+    decimal_mode      = value & (1 << DECIMAL_MODE);
+    interrupt_disable = value & (1 << INTERRUPT_DISABLE);
+    zero_result       = !(value & (1 << ZERO_FLAG));
+    carry_result      = (value & (1 << CARRY_FLAG)) << 8;
 }
 
-void CPU::step() {
-    // TODO: Handle interrupts
-
-    const uint8_t opcode = fetch();
-    execute(opcode);
-    
-    cycles += cycle_table[opcode];
+void CPU::addWithCarry(const uint8_t& value) {
+    const unsigned int sum = (int)r_a + (int)value + carry();
+    carry_result = sum;                                   // Unsigned overflow
+    overflow_result = ~(r_a ^ value) & (r_a ^ sum);       // Signed overflow
+    r_a = (uint8_t)sum;
+    setZeroNegative(r_a);
 }
 
-void CPU::execute(const uint8_t& opcode) {
-    std::cout << "CPU::execute opcode: " << std::hex << (int)opcode << std::endl;  //d
-    switch (opcode) {
-
-        case 0x00:
-            BRK();
-            break;
-
-        case 0x01:
-            ORA(indexedIndirect());
-            break;
-
-        //case 0x02:
-        //    // unofficial opcode: STP
-        //    break;
-
-        //case 0x03:
-        //    // unofficial opcode
-        //    break;
-
-        //case 0x04:
-        //    // unofficial opcode: NOP
-        //    break;
-
-        case 0x05:
-            ORA(zeroPageX());
-            break;
-
-        case 0x06:
-            ASL(zeroPage());
-            break;
-
-        //case 0x07:
-        //    // unofficial opcode
-        //    break;
-
-        case 0x08:
-            PHP();
-            break;
-
-        case 0x09:
-            ORA(immediate());
-            break;
-
-        case 0x0A:
-            ASL();
-            break;
-
-        //case 0x0B:
-        //    // unofficial opcode
-        //    break;
-
-        //case 0x0C:
-        //    // unofficial opcode: NOP
-        //    break;
-
-        case 0x0D:
-            ORA(absolute());
-            break;
-
-        case 0x0E:
-            ASL(absolute());
-            break;
-
-        //case 0x0F:
-        //    // unofficial opcode
-        //    break;
-
-        case 0x10:
-            BPL(relative());
-            break;
-
-        case 0x11:
-            ORA(indirectIndexed());
-            break;
-
-        //case 0x12:
-        //    // unofficial opcode: STP
-        //    break;
-
-        //case 0x13:
-        //    // unofficial opcode
-        //    break;
-
-        //case 0x14:
-        //    // unofficial opcode: NOP
-        //    break;
-
-        case 0x15:
-            ORA(zeroPageX());
-            break;
-
-        case 0x16:
-            ASL(zeroPageX());
-            break;
-
-        //case 0x17:
-        //    // unofficial opcode
-        //    break;
-
-        case 0x18:
-            CLC();
-            break;
-
-        case 0x19:
-            ORA(absoluteY());
-            break;
-
-        //case 0x1A:
-        //    // unofficial opcode: NOP
-        //    break;
-
-        //case 0x1B:
-        //    // unofficial opcode
-        //    break;
-
-        //case 0x1C:
-        //    // unofficial opcode: NOP
-        //    break;
-
-        case 0x1D:
-            ORA(absoluteX());
-            break;
-
-        case 0x1E:
-            ASL(absoluteX());
-            break;
-
-        //case 0x1F:
-        //    // unofficial opcode
-        //    break;
-
-        case 0x20:
-            JSR(absolute());
-            break;
-
-        case 0x21:
-            AND(indexedIndirect());
-            break;
-
-        //case 0x22:
-        //    // unofficial opcode: STP
-        //    break;
-
-        //case 0x23:
-        //    // unofficial opcode
-        //    break;
-
-        case 0x24:
-            BIT(zeroPage());
-            break;
-
-        case 0x25:
-            AND(zeroPage());
-            break;
-
-        case 0x26:
-            ROL(zeroPage());
-            break;
-
-        //case 0x27:
-        //    // unofficial opcode
-        //    break;
-
-        case 0x28:
-            PLP();
-            break;
-
-        case 0x29:
-            AND(immediate());
-            break;
-
-        case 0x2A:
-            ROL();
-            break;
-
-        //case 0x2B:
-        //    // unofficial opcode
-        //    break;
-
-        case 0x2C:
-            BIT(absolute());
-            break;
-
-        case 0x2D:
-            AND(absolute());
-            break;
-
-        case 0x2E:
-            ROL(absolute());
-            break;
-
-        //case 0x2F:
-        //    // unofficial opcode
-        //    break;
-
-        case 0x30:
-            BMI(relative());
-            break;
-
-        case 0x31:
-            AND(indirectIndexed());
-            break;
-
-        //case 0x32:
-        //    // unofficial opcode: STP
-        //    break;
-
-        //case 0x33:
-        //    // unofficial opcode
-        //    break;
-
-        //case 0x34:
-        //    // unofficial opcode: NOP
-        //    break;
-
-        case 0x35:
-            AND(zeroPageX());
-            break;
-
-        case 0x36:
-            ROL(zeroPageX());
-            break;
-
-        //case 0x37:
-        //    // unofficial opcode
-        //    break;
-
-        case 0x38:
-            SEC();
-            break;
-
-        case 0x39:
-            AND(absoluteY());
-            break;
-
-        //case 0x3A:
-        //    // unofficial opcode: NOP
-        //    break;
-
-        //case 0x3B:
-        //    // unofficial opcode
-        //    break;
-
-        //case 0x3C:
-        //    // unofficial opcode: NOP
-        //    break;
-
-        case 0x3D:
-            AND(absoluteX());
-            break;
-
-        case 0x3E:
-            ROL(absoluteX());
-            break;
-
-        //case 0x3F:
-        //    // unofficial opcode
-        //    break;
-
-        case 0x40:
-            RTI();
-            break;
-
-        case 0x41:
-            EOR(indexedIndirect());
-            break;
-
-        //case 0x42:
-        //    // unofficial opcode: STP
-        //    break;
-
-        //case 0x43:
-        //    // unofficial opcode
-        //    break;
-
-        //case 0x44:
-        //    // unofficial opcode: NOP
-        //    break;
-
-        case 0x45:
-            EOR(zeroPage());
-            break;
-
-        case 0x46:
-            LSR(zeroPage());
-            break;
-
-        //case 0x47:
-        //    // unofficial opcode
-        //    break;
-
-        case 0x48:
-            PHA();
-            break;
-
-        case 0x49:
-            EOR(immediate());
-            break;
-
-        case 0x4A:
-            LSR();
-            break;
-
-        //case 0x4B:
-        //    // unofficial opcode
-        //    break;
-
-        case 0x4C:
-            JMP(absolute());
-            break;
-
-        case 0x4D:
-            EOR(absolute());
-            break;
-
-        case 0x4E:
-            LSR(absolute());
-            break;
-
-        //case 0x4F:
-        //    // unofficial opcode
-        //    break;
-
-        case 0x50:
-            BVC(relative());
-            break;
-
-        case 0x51:
-            EOR(indirectIndexed());
-            break;
-
-        //case 0x52:
-        //    // unofficial opcode: STP
-        //    break;
-
-        //case 0x53:
-        //    // unofficial opcode
-        //    break;
-
-        //case 0x54:
-        //    // unofficial opcode: NOP
-        //    break;
-
-        case 0x55:
-            EOR(zeroPageX());
-            break;
-
-        case 0x56:
-            LSR(zeroPageX());
-            break;
-
-        //case 0x57:
-        //    // unofficial opcode
-        //    break;
-
-        case 0x58:
-            CLI();
-            break;
-
-        case 0x59:
-            EOR(absoluteY());
-            break;
-
-        //case 0x5A:
-        //    // unofficial opcode: NOP
-        //    break;
-
-        //case 0x5B:
-        //    // unofficial opcode
-        //    break;
-
-        //case 0x5C:
-        //    // unofficial opcode: NOP
-        //    break;
-
-        case 0x5D:
-            EOR(absoluteX());
-            break;
-
-        case 0x5E:
-            LSR(absoluteX());
-            break;
-
-        //case 0x5F:
-        //    // unofficial opcode
-        //    break;
-
-        case 0x60:
-            RTS();
-            break;
-
-        case 0x61:
-            ADC(indexedIndirect());
-            break;
-
-        //case 0x62:
-        //    // unofficial opcode: STP
-        //    break;
-
-        //case 0x63:
-        //    // unofficial opcode
-        //    break;
-
-        //case 0x64:
-        //    // unofficial opcode: NOP
-        //    break;
-
-        case 0x65:
-            ADC(zeroPage());
-            break;
-
-        case 0x66:
-            ROR(zeroPage());
-            break;
-
-        //case 0x67:
-        //    // unofficial opcode
-        //    break;
-
-        case 0x68:
-            PLA();
-            break;
-
-        case 0x69:
-            ADC(immediate());
-            break;
-
-        case 0x6A:
-            ROR();
-            break;
-
-        //case 0x6B:
-        //    // unofficial opcode
-        //    break;
-
-        case 0x6C:
-            JMP(indirect());
-            break;
-
-        case 0x6D:
-            ADC(absolute());
-            break;
-
-        case 0x6E:
-            ROR(absolute());
-            break;
-
-        //case 0x6F:
-        //    // unofficial opcode
-        //    break;
-
-        case 0x70:
-            BVS(relative());
-            break;
-
-        case 0x71:
-            ADC(indirectIndexed());
-            break;
-
-        //case 0x72:
-        //    // unofficial opcode: STP
-        //    break;
-
-        //case 0x73:
-        //    // unofficial opcode
-        //    break;
-
-        //case 0x74:
-        //    // unofficial opcode: NOP
-        //    break;
-
-        case 0x75:
-            ADC(zeroPageX());
-            break;
-
-        case 0x76:
-            ROR(zeroPageX());
-            break;
-
-        //case 0x77:
-        //    // unofficial opcode
-        //    break;
-
-        case 0x78:
-            SEI();
-            break;
-
-        case 0x79:
-            ADC(absoluteY());
-            break;
-
-        //case 0x7A:
-        //    // unofficial opcode: NOP
-        //    break;
-
-        //case 0x7B:
-        //    // unofficial opcode
-        //    break;
-
-        //case 0x7C:
-        //    // unofficial opcode: NOP
-        //    break;
-
-        case 0x7D:
-            ADC(absoluteX());
-            break;
-
-        case 0x7E:
-            ROR(absoluteX());
-            break;
-
-        //case 0x7F:
-        //    // unofficial opcode
-        //    break;
-
-        //case 0x80:
-        //    // unofficial opcode: NOP
-        //    break;
-
-        case 0x81:
-            STA(indexedIndirect());
-            break;
-
-        //case 0x82:
-        //    // unofficial opcode: NOP
-        //    break;
-
-        //case 0x83:
-        //    // unofficial opcode
-        //    break;
-
-        case 0x84:
-            STY(zeroPage());
-            break;
-
-        case 0x85:
-            STA(zeroPage());
-            break;
-
-        case 0x86:
-            STX(zeroPage());
-            break;
-
-        //case 0x87:
-        //    // unofficial opcode
-        //    break;
-
-        case 0x88:
-            DEY();
-            break;
-
-        //case 0x89:
-        //    // unofficial opcode: NOP
-        //    break;
-
-        case 0x8A:
-            TXA();
-            break;
-
-        //case 0x8B:
-        //    // unofficial opcode
-        //    break;
-
-        case 0x8C:
-            STY(absolute());
-            break;
-
-        case 0x8D:
-            STA(absolute());
-            break;
-
-        case 0x8E:
-            STX(absolute());
-            break;
-
-        //case 0x8F:
-        //    // unofficial opcode
-        //    break;
-
-        case 0x90:
-            BCC(relative());
-            break;
-
-        case 0x91:
-            STA(indirectIndexed());
-            break;
-
-        //case 0x92:
-        //    // unofficial opcode: STP
-        //    break;
-
-        //case 0x93:
-        //    // unofficial opcode
-        //    break;
-
-        case 0x94:
-            STY(zeroPageX());
-            break;
-
-        case 0x95:
-            STA(zeroPageX());
-            break;
-
-        case 0x96:
-            STX(zeroPageY());
-            break;
-
-        //case 0x97:
-        //    // unofficial opcode
-        //    break;
-
-        case 0x98:
-            TYA();
-            break;
-
-        case 0x99:
-            STA(absoluteY());
-            break;
-
-        case 0x9A:
-            TXS();
-            break;
-
-        //case 0x9B:
-        //    // unofficial opcode
-        //    break;
-
-        //case 0x9C:
-        //    // unofficial opcode: SHY
-        //    break;
-
-        case 0x9D:
-            STA(absoluteX());
-            break;
-
-        //case 0x9E:
-        //    // unofficial opcode: SHX
-        //    break;
-
-        //case 0x9F:
-        //    // unofficial opcode
-        //    break;
-
-        case 0xA0:
-            LDY(immediate());
-            break;
-
-        case 0xA1:
-            LDA(indexedIndirect());
-            break;
-
-        case 0xA2:
-            LDX(immediate());
-            break;
-
-        //case 0xA3:
-        //    // unofficial opcode
-        //    break;
-
-        case 0xA4:
-            LDY(zeroPage());
-            break;
-
-        case 0xA5:
-            LDA(zeroPage());
-            break;
-
-        case 0xA6:
-            LDX(zeroPage());
-            break;
-
-        //case 0xA7:
-        //    // unofficial opcode
-        //    break;
-
-        case 0xA8:
-            TAY();
-            break;
-
-        case 0xA9:
-            LDA(immediate());
-            break;
-
-        case 0xAA:
-            TAX();
-            break;
-
-        //case 0xAB:
-        //    // unofficial opcode
-        //    break;
-
-        case 0xAC:
-            LDY(absolute());
-            break;
-
-        case 0xAD:
-            LDA(absolute());
-            break;
-
-        case 0xAE:
-            LDX(absolute());
-            break;
-
-        //case 0xAF:
-        //    // unofficial opcode
-        //    break;
-
-        case 0xB0:
-            BCS(relative());
-            break;
-
-        case 0xB1:
-            LDA(indirectIndexed());
-            break;
-
-        //case 0xB2:
-        //    // unofficial opcode: STP
-        //    break;
-
-        //case 0xB3:
-        //    // unofficial opcode
-        //    break;
-
-        case 0xB4:
-            LDY(zeroPageX());
-            break;
-
-        case 0xB5:
-            LDA(zeroPageX());
-            break;
-
-        case 0xB6:
-            LDX(zeroPageY());
-            break;
-
-        //case 0xB7:
-        //    // unofficial opcode
-        //    break;
-
-        case 0xB8:
-            CLV();
-            break;
-
-        case 0xB9:
-            LDA(absoluteY());
-            break;
-
-        case 0xBA:
-            TSX();
-            break;
-
-        //case 0xBB:
-        //    // unofficial opcode
-        //    break;
-
-        case 0xBC:
-            LDY(absoluteX());
-            break;
-
-        case 0xBD:
-            LDA(absoluteX());
-            break;
-
-        case 0xBE:
-            LDX(absoluteY());
-            break;
-
-        //case 0xBF:
-        //    // unofficial opcode
-        //    break;
-
-        case 0xC0:
-            CPY(immediate());
-            break;
-
-        case 0xC1:
-            CMP(indexedIndirect());
-            break;
-
-        //case 0xC2:
-        //    // unofficial opcode: NOP
-        //    break;
-
-        //case 0xC3:
-        //    // unofficial opcode
-        //    break;
-
-        case 0xC4:
-            CPY(zeroPage());
-            break;
-
-        case 0xC5:
-            CMP(zeroPage());
-            break;
-
-        case 0xC6:
-            DEC(zeroPage());
-            break;
-
-        //case 0xC7:
-        //    // unofficial opcode
-        //    break;
-
-        case 0xC8:
-            INY();
-            break;
-
-        case 0xC9:
-            CMP(immediate());
-            break;
-
-        case 0xCA:
-            DEX();
-            break;
-
-        //case 0xCB:
-        //    // unofficial opcode
-        //    break;
-
-        case 0xCC:
-            CPY(absolute());
-            break;
-
-        case 0xCD:
-            CMP(absolute());
-            break;
-
-        case 0xCE:
-            DEC(absolute());
-            break;
-
-        //case 0xCF:
-        //    // unofficial opcode
-        //    break;
-
-        case 0xD0:
-            BNE(relative());
-            break;
-
-        case 0xD1:
-            CMP(indirectIndexed());
-            break;
-
-        //case 0xD2:
-        //    // unofficial opcode: STP
-        //    break;
-
-        //case 0xD3:
-        //    // unofficial opcode
-        //    break;
-
-        //case 0xD4:
-        //    // unofficial opcode: NOP
-        //    break;
-
-        case 0xD5:
-            CMP(zeroPageX());
-            break;
-
-        case 0xD6:
-            DEC(zeroPageX());
-            break;
-
-        //case 0xD7:
-        //    // unofficial opcode
-        //    break;
-
-        case 0xD8:
-            CLD();
-            break;
-
-        case 0xD9:
-            CMP(absoluteY());
-            break;
-
-        //case 0xDA:
-        //    // unofficial opcode: NOP
-        //    break;
-
-        //case 0xDB:
-        //    // unofficial opcode
-        //    break;
-
-        //case 0xDC:
-        //    // unofficial opcode: NOP
-        //    break;
-
-        case 0xDD:
-            CMP(absoluteX());
-            break;
-
-        case 0xDE:
-            DEC(absoluteX());
-            break;
-
-        //case 0xDF:
-        //    // unofficial opcode
-        //    break;
-
-        case 0xE0:
-            CPX(immediate());
-            break;
-
-        case 0xE1:
-            SBC(indexedIndirect());
-            break;
-
-        //case 0xE2:
-        //    // unofficial opcode: NOP
-        //    break;
-
-        //case 0xE3:
-        //    // unofficial opcode
-        //    break;
-
-        case 0xE4:
-            CPX(zeroPage());
-            break;
-
-        case 0xE5:
-            SBC(zeroPage());
-            break;
-
-        case 0xE6:
-            INC(zeroPage());
-            break;
-
-        //case 0xE7:
-        //    // unofficial opcode
-        //    break;
-
-        case 0xE8:
-            INX();
-            break;
-
-        case 0xE9:
-            SBC(immediate());
-            break;
-
-        case 0xEA:
-            NOP();
-            break;
-
-        //case 0xEB:
-        //    // unofficial opcode
-        //    break;
-
-        case 0xEC:
-            CPX(absolute());
-            break;
-
-        case 0xED:
-            SBC(absolute());
-            break;
-
-        case 0xEE:
-            INC(absolute());
-            break;
-
-        //case 0xEF:
-        //    // unofficial opcode
-        //    break;
+void CPU::compare(const uint8_t& reg, const uint8_t& value) {
+    // reg - value, computed as reg + ~value + 1, so bit 8 is set (no borrow) if reg >= value.
+    const unsigned int difference = (int)reg + (uint8_t)~value + 1;
+    carry_result = difference;
+    setZeroNegative((uint8_t)difference);
+}
 
-        case 0xF0:
-            BEQ(relative());
-            break;
+void CPU::resetBlockCache(const uint8_t* rom, const size_t& rom_size) {
+    block_cache.reset(rom, rom_size);
+    if (recompiler != nullptr) {
+        recompiler->flush(); }
+}
 
-        case 0xF1:
-            SBC(indirectIndexed());
-            break;
+void CPU::setRecompiler(Recompiler* recompiler) {
+    this->recompiler = recompiler;
+    block_cache.clearNative();
+}
 
-        //case 0xF2:
-        //    // unofficial opcode: STP
-        //    break;
+int CPU::step(const uint64_t& deadline) {
+    const uint64_t start_cycles = cycles;
+    idle_loop_cycles = 0;
 
-        //case 0xF3:
-        //    // unofficial opcode
-        //    break;
+    // Only the poll right after a change to Interrupt Disable is delayed.
+    const bool delayed = interrupt_disable_delayed;
+    interrupt_disable_delayed = false;
+    if ((nmi_pending || irq_lines != 0)
+         && handleInterrupt(delayed)) {
+        return (int)(cycles - start_cycles); }
 
-        //case 0xF4:
-        //    // unofficial opcode: NOP
-        //    break;
+    // An IRQ held back by the delay is serviced after the next instruction. Only that one is run.
+    const bool irq_next = delayed
+        && irq_lines != 0
+        && !interrupt_disable;
 
-        case 0xF5:
-            SBC(zeroPageX());
-            break;
+    if (tracer->enabled(Tracer::INSTRUCTIONS)) {
+        // Traced instruction by instruction.
+        trace();
+        execute(fetch());
+        ++instructions;
+        return (int)(cycles - start_cycles);
+    }
 
-        case 0xF6:
-            INC(zeroPageX());
-            break;
+    const uint8_t* code = memory->romPointer(pc);
+    if (irq_next
+         || code == nullptr
+         || !executeBlock(code, deadline)) {
+        execute(fetch());
+        ++instructions;
+    }
 
-        //case 0xF7:
-        //    // unofficial opcode
-        //    break;
+    return (int)(cycles - start_cycles);
+}
 
-        case 0xF8:
-            SED();
-            break;
+void CPU::setIRQ(const IRQSource& source, const bool& active) {
+    if (active) {
+        irq_lines |= source; }
+    else {
+        irq_lines &= ~source; }
+}
 
-        case 0xF9:
-            SBC(absolute());
-            break;
+bool CPU::handleInterrupt(const bool& delayed) {
+    if (nmi_pending) {
+        nmi_pending = false;
+        interrupt(0xFFFA);
+        return true;
+    }
+    if (interrupt_disable == delayed) { // Clear, or just set.
+        interrupt(0xFFFE);
+        return true;
+    }
+    return false;
+}
 
-        //case 0xFA:
-        //    // unofficial opcode: NOP
-        //    break;
+void CPU::interrupt(const uint16_t& vector) {
+    push16(pc);
+    push(status(false));
+    interrupt_disable = true;
+    pc = read16(vector);
+    cycles += 7;
+}
 
-        //case 0xFB:
-        //    // unofficial opcode
-        //    break;
+void CPU::execute(const uint8_t& opcode) {
+    operation_table[opcode].handler(*this);
+}
+
+void CPU::trace() {
+    Tracer::Record entry;
+    entry.cycles     = cycles;
+    entry.pc         = pc;
+    // Peeked, as the instruction's own fetch must be the only read, and only up to its length.
+    const uint8_t opcode = memory->peek(pc);
+    const int operand_size = operand_size_table[addressing_mode_table[opcode]];
+    entry.opcode     = opcode;
+    entry.operand_lo = (operand_size >= 1) ? memory->peek(pc + 1) : 0;
+    entry.operand_hi = (operand_size >= 2) ? memory->peek(pc + 2) : 0;
+    entry.a  = r_a;
+    entry.x  = r_x;
+    entry.y  = r_y;
+    entry.p  = status(false);
+    entry.sp = sp;
+    tracer->record(entry);
+}
+
+bool CPU::executeBlock(const uint8_t* code, const uint64_t& deadline) {
+    if (!block_cache.covers(code)
+         || block_cache.isUncacheable(code)) {
+        return false; }
+
+    BlockCache::Block* block = block_cache.find(code, pc);
+    if (block == nullptr) {
+        if (decodeBlock(code, decode_buffer) == 0) {
+            block_cache.markUncacheable(code);
+            return false;
+        }
+        block = &block_cache.insert(code, pc, decode_buffer);
+        block->idle_loop = isIdleLoop(code, *block);
+    }
 
-        //case 0xFC:
-        //    // unofficial opcode: NOP
-        //    break;
+    const uint64_t start_cycles = cycles;
+    runBlock(code, *block, deadline);
+
+    // Back at the start, having changed nothing that the next iteration depends on.
+    if (block->idle_loop
+         && pc == block->pc) {
+        idle_loop_cycles = (int)(cycles - start_cycles); }
+
+    return true;
+}
+
+void CPU::runBlock(const uint8_t* code, BlockCache::Block& block, const uint64_t& deadline) {
+    if (recompiler != nullptr) {
+        // Compiling fails once the code buffer is full. The block is then tried again on its next run,
+        // after a flush.
+        if (block.native == nullptr
+             && ++block.executions >= HOT_BLOCK_THRESHOLD) {
+            if (recompiler->isFull()) {
+                // Start over, and let blocks that are still hot be translated again.
+                block_cache.clearNative();
+                recompiler->flush();
+            }
+            block.native = (void*)recompiler->compile(code, pc, block.length);
+        }
+        if (block.native != nullptr
+             && cycles + block.cycles <= deadline) {
+            recompiler->run(*this, (Recompiler::NativeBlock)block.native, deadline);
+            BlockCache::Block* next = block.idle_loop ? nullptr : nextNativeBlock(deadline);
+            while (next != nullptr) {
+                recompiler->run(*this, (Recompiler::NativeBlock)next->native, deadline);
+                next = nextNativeBlock(deadline);
+            }
+            return;
+        }
+    }
 
-        case 0xFD:
-            SBC(absoluteX());
-            break;
+    // Stops for an event, as a step would, including one that an access schedules partway through the block
+    // (e.g. enabling NMI during vblank). A write may also switch the bank the rest of the block was decoded from.
+    const uint32_t mapping = memory->mappingGeneration();
+    const BlockCache::Operation* operation = block_cache.operations(block);
+    for (uint32_t i = 0; i < block.length; ++i, ++operation) {
+        pc = operation->next_pc;
+        cycles += operation->cycles;
+        operation->handler(*this, operation->operand);
+        ++instructions;
+
+        if (cycles >= deadline
+             || scheduler->nextEventCycle() < deadline
+             || memory->mappingGeneration() != mapping) {
+            break; }
+    }
+}
 
-        case 0xFE:
-            INC(absoluteX());
-            break;
+BlockCache::Block* CPU::nextNativeBlock(const uint64_t& deadline) {
+    // What a step does before a block: poll for interrupts, and stop for an event.
+    if (nmi_pending
+         || interrupt_disable_delayed
+         || (irq_lines != 0 && !interrupt_disable)
+         || scheduler->nextEventCycle() < deadline) {
+        return nullptr; }
+
+    const uint8_t* code = memory->romPointer(pc);
+    if (code == nullptr
+         || !block_cache.covers(code)) {
+        return nullptr; }
+    BlockCache::Block* block = block_cache.find(code, pc);
+    if (block == nullptr
+         || block->native == nullptr
+         || block->idle_loop
+         || cycles + block->cycles > deadline) {
+        return nullptr; }
+    return block;
+}
+
+bool CPU::isIdleLoop(const uint8_t* code, const BlockCache::Block& block) const {
+    if (block.length > MAX_IDLE_LOOP_LENGTH) {
+        return false; }
+
+    int offset = 0;
+    for (uint32_t i = 0; i < block.length; ++i) {
+        const uint8_t opcode = code[offset];
+        const AddressingMode mode = addressing_mode_table[opcode];
+        const int size = 1 + operand_size_table[mode];
+        uint16_t operand = 0;
+        if      (size == 2) { operand = code[offset + 1]; }
+        else if (size == 3) { operand = code[offset + 1] | (code[offset + 2] << 8); }
+        offset += size;
+
+        if (i == block.length - 1) {
+            // Must jump back to the start.
+            if (mode == REL) {
+                return (uint16_t)(block.pc + offset + (int8_t)operand) == block.pc; }
+            return opcode == 0x4C // JMP
+                && operand == block.pc;
+        }
+
+        // Only instructions whose results are the same on every iteration, as long as what they read is:
+        // loads, comparisons, and AND (which is idempotent).
+        const std::string& name = instruction_table[opcode];
+        if (name == "NOP") {
+            continue; }
+        if (name != "LDA" && name != "LDX" && name != "LDY"
+             && name != "CMP" && name != "CPX" && name != "CPY"
+             && name != "BIT" && name != "AND") {
+            return false; }
+
+        // Only reads of memory that can't change during the loop, but by a hardware event:
+        // RAM (changed by interrupt handlers), PPUSTATUS, and ROM.
+        if (mode == IMM || mode == ZP0) {
+            continue; }
+        if (mode != ABS) {
+            return false; }
+        const bool ppu_status = (operand >= 0x2000 && operand < 0x4000 && (operand & 0x7) == 2);
+        if (operand >= 0x2000
+             && !ppu_status
+             && memory->romPointer(operand) == nullptr) {
+            return false; }
+    }
+    return false;
+}
+
+uint64_t CPU::hashState(const uint64_t& hash) const {
+    const uint8_t registers[] = {
+        r_a, r_x, r_y, sp, status(false), (uint8_t)(pc & 0xFF), (uint8_t)(pc >> 8),
+        nmi_pending, irq_lines
+    };
+    return fnv1a(fnv1a(hash, registers, sizeof(registers)), &cycles, sizeof(cycles));
+}
+
+void CPU::saveState(StateWriter& out) const {
+    out.put(cycles);
+    out.put(nmi_pending);
+    out.put(irq_lines);
+    out.put(interrupt_disable_delayed);
+    out.put(r_a);
+    out.put(r_x);
+    out.put(r_y);
+    out.put(pc);
+    out.put(sp);
+    out.put(carry_result);
+    out.put(zero_result);
+    out.put(overflow_result);
+    out.put(negative_result);
+    out.put(interrupt_disable);
+    out.put(decimal_mode);
+}
+
+void CPU::loadState(StateReader& in) {
+    in.get(cycles);
+    in.get(nmi_pending);
+    in.get(irq_lines);
+    in.get(interrupt_disable_delayed);
+    in.get(r_a);
+    in.get(r_x);
+    in.get(r_y);
+    in.get(pc);
+    in.get(sp);
+    in.get(carry_result);
+    in.get(zero_result);
+    in.get(overflow_result);
+    in.get(negative_result);
+    in.get(interrupt_disable);
+    in.get(decimal_mode);
+    idle_loop_cycles = 0;
+}
+
+void CPU::skipIdleLoop(const int& iterations) {
+    const int skipped = iterations * idle_loop_cycles;
+    cycles += skipped;
+    idle_cycles_skipped += skipped;
+}
+
+int CPU::decodeBlock(const uint8_t* code, std::vector<BlockCache::Operation>& decoded) {
+    decoded.clear();
+
+    // Offsets are relative to the PC, which 'code' points to.
+    const int page_end = Memory::PAGE_SIZE - (pc & 0xFF);
+    int offset = 0;
+    while ((int)decoded.size() < BlockCache::MAX_BLOCK_LENGTH) {
+        const uint8_t opcode = code[offset];
+        const AddressingMode mode = addressing_mode_table[opcode];
+        const int size = 1 + operand_size_table[mode];
+
+        if (operation_table[opcode].decoded == nullptr // Unsupported opcode. Left to 'execute' to report.
+             || offset + size > page_end) {
+            break; }
+
+        BlockCache::Operation operation;
+        operation.handler = operation_table[opcode].decoded;
+        operation.next_pc = pc + offset + size;
+        operation.cycles  = cycle_table[opcode];
+        if      (mode == IMM || mode == REL) { operation.operand = pc + offset + 1; }
+        else if (size == 2)                  { operation.operand = code[offset + 1]; }
+        else if (size == 3)                  { operation.operand = code[offset + 1] | (code[offset + 2] << 8); }
+        else                                 { operation.operand = 0; }
+        decoded.push_back(operation);
+
+        offset += size;
+
+        if (BlockCache::endsBlock(opcode)) {
+            break; }
+    }
 
-        //case 0xFF:
-        //    // unofficial opcode
-        //    break;
+    return (int)decoded.size();
+}
 
-        default:
-            std::cerr << "Unsupported instruction: " << instruction_table[opcode]
-                << ". Opcode: " << std::hex << (int)opcode << std::endl;
-            break;
+template <AddressingMode mode>
+uint16_t CPU::fetchOperand() {
+    if (mode == IMM || mode == REL) {
+        const uint16_t address = pc;
+        ++pc;
+        return address;
     }
-}
+    else if (operand_size_table[mode] == 1) {
+        return fetch(); }
+    else {
+        return fetch16(); }
+}
+
+template <uint8_t opcode, uint16_t (CPU::*mode)(const uint16_t&), void (CPU::*instruction)(const uint16_t&)>
+void CPU::handle(CPU& cpu) {
+    const uint16_t operand = cpu.fetchOperand<addressing_mode_table[opcode]>();
+    cpu.cycles += cycle_table[opcode];
+    handleDecoded<opcode, mode, instruction>(cpu, operand);
+}
+
+template <uint8_t opcode, uint16_t (CPU::*mode)(const uint16_t&), void (CPU::*instruction)(const uint16_t&)>
+void CPU::handleDecoded(CPU& cpu, const uint16_t& operand) {
+    (cpu.*instruction)((cpu.*mode)(operand));
+}
+
+template <uint8_t opcode, void (CPU::*instruction)()>
+void CPU::handle(CPU& cpu) {
+    cpu.cycles += cycle_table[opcode];
+    (cpu.*instruction)();
+}
+
+template <uint8_t opcode, void (CPU::*instruction)()>
+void CPU::handleDecoded(CPU& cpu, const uint16_t&) {
+    (cpu.*instruction)();
+}
+
+template <uint8_t opcode>
+void CPU::handleUnsupported(CPU& cpu) {
+    std::cerr << "Unsupported instruction: " << instruction_table[opcode]
+        << ". Opcode: " << std::hex << (int)opcode << std::endl;
+    cpu.cycles += cycle_table[opcode];
+}
+
+const std::array<CPU::Operation, 0x100> CPU::operation_table =
+{
+    operation<0x00, &CPU::BRK>(),
+    operation<0x01, &CPU::indexedIndirect, &CPU::ORA>(),
+    unsupported<0x02>(),
+    unsupported<0x03>(),
+    unsupported<0x04>(),
+    operation<0x05, &CPU::zeroPage, &CPU::ORA>(),
+    operation<0x06, &CPU::zeroPage, &CPU::ASL>(),
+    unsupported<0x07>(),
+    operation<0x08, &CPU::PHP>(),
+    operation<0x09, &CPU::immediate, &CPU::ORA>(),
+    operation<0x0A, &CPU::ASL>(),
+    unsupported<0x0B>(),
+    unsupported<0x0C>(),
+    operation<0x0D, &CPU::absolute, &CPU::ORA>(),
+    operation<0x0E, &CPU::absolute, &CPU::ASL>(),
+    unsupported<0x0F>(),
+    operation<0x10, &CPU::relative, &CPU::BPL>(),
+    operation<0x11, &CPU::indirectIndexed, &CPU::ORA>(),
+    unsupported<0x12>(),
+    unsupported<0x13>(),
+    unsupported<0x14>(),
+    operation<0x15, &CPU::zeroPageX, &CPU::ORA>(),
+    operation<0x16, &CPU::zeroPageX, &CPU::ASL>(),
+    unsupported<0x17>(),
+    operation<0x18, &CPU::CLC>(),
+    operation<0x19, &CPU::absoluteY, &CPU::ORA>(),
+    unsupported<0x1A>(),
+    unsupported<0x1B>(),
+    unsupported<0x1C>(),
+    operation<0x1D, &CPU::absoluteX, &CPU::ORA>(),
+    operation<0x1E, &CPU::absoluteX, &CPU::ASL>(),
+    unsupported<0x1F>(),
+    operation<0x20, &CPU::absolute, &CPU::JSR>(),
+    operation<0x21, &CPU::indexedIndirect, &CPU::AND>(),
+    unsupported<0x22>(),
+    unsupported<0x23>(),
+    operation<0x24, &CPU::zeroPage, &CPU::BIT>(),
+    operation<0x25, &CPU::zeroPage, &CPU::AND>(),
+    operation<0x26, &CPU::zeroPage, &CPU::ROL>(),
+    unsupported<0x27>(),
+    operation<0x28, &CPU::PLP>(),
+    operation<0x29, &CPU::immediate, &CPU::AND>(),
+    operation<0x2A, &CPU::ROL>(),
+    unsupported<0x2B>(),
+    operation<0x2C, &CPU::absolute, &CPU::BIT>(),
+    operation<0x2D, &CPU::absolute, &CPU::AND>(),
+    operation<0x2E, &CPU::absolute, &CPU::ROL>(),
+    unsupported<0x2F>(),
+    operation<0x30, &CPU::relative, &CPU::BMI>(),
+    operation<0x31, &CPU::indirectIndexed, &CPU::AND>(),
+    unsupported<0x32>(),
+    unsupported<0x33>(),
+    unsupported<0x34>(),
+    operation<0x35, &CPU::zeroPageX, &CPU::AND>(),
+    operation<0x36, &CPU::zeroPageX, &CPU::ROL>(),
+    unsupported<0x37>(),
+    operation<0x38, &CPU::SEC>(),
+    operation<0x39, &CPU::absoluteY, &CPU::AND>(),
+    unsupported<0x3A>(),
+    unsupported<0x3B>(),
+    unsupported<0x3C>(),
+    operation<0x3D, &CPU::absoluteX, &CPU::AND>(),
+    operation<0x3E, &CPU::absoluteX, &CPU::ROL>(),
+    unsupported<0x3F>(),
+    operation<0x40, &CPU::RTI>(),
+    operation<0x41, &CPU::indexedIndirect, &CPU::EOR>(),
+    unsupported<0x42>(),
+    unsupported<0x43>(),
+    unsupported<0x44>(),
+    operation<0x45, &CPU::zeroPage, &CPU::EOR>(),
+    operation<0x46, &CPU::zeroPage, &CPU::LSR>(),
+    unsupported<0x47>(),
+    operation<0x48, &CPU::PHA>(),
+    operation<0x49, &CPU::immediate, &CPU::EOR>(),
+    operation<0x4A, &CPU::LSR>(),
+    unsupported<0x4B>(),
+    operation<0x4C, &CPU::absolute, &CPU::JMP>(),
+    operation<0x4D, &CPU::absolute, &CPU::EOR>(),
+    operation<0x4E, &CPU::absolute, &CPU::LSR>(),
+    unsupported<0x4F>(),
+    operation<0x50, &CPU::relative, &CPU::BVC>(),
+    operation<0x51, &CPU::indirectIndexed, &CPU::EOR>(),
+    unsupported<0x52>(),
+    unsupported<0x53>(),
+    unsupported<0x54>(),
+    operation<0x55, &CPU::zeroPageX, &CPU::EOR>(),
+    operation<0x56, &CPU::zeroPageX, &CPU::LSR>(),
+    unsupported<0x57>(),
+    operation<0x58, &CPU::CLI>(),
+    operation<0x59, &CPU::absoluteY, &CPU::EOR>(),
+    unsupported<0x5A>(),
+    unsupported<0x5B>(),
+    unsupported<0x5C>(),
+    operation<0x5D, &CPU::absoluteX, &CPU::EOR>(),
+    operation<0x5E, &CPU::absoluteX, &CPU::LSR>(),
+    unsupported<0x5F>(),
+    operation<0x60, &CPU::RTS>(),
+    operation<0x61, &CPU::indexedIndirect, &CPU::ADC>(),
+    unsupported<0x62>(),
+    unsupported<0x63>(),
+    unsupported<0x64>(),
+    operation<0x65, &CPU::zeroPage, &CPU::ADC>(),
+    operation<0x66, &CPU::zeroPage, &CPU::ROR>(),
+    unsupported<0x67>(),
+    operation<0x68, &CPU::PLA>(),
+    operation<0x69, &CPU::immediate, &CPU::ADC>(),
+    operation<0x6A, &CPU::ROR>(),
+    unsupported<0x6B>(),
+    operation<0x6C, &CPU::indirect, &CPU::JMP>(),
+    operation<0x6D, &CPU::absolute, &CPU::ADC>(),
+    operation<0x6E, &CPU::absolute, &CPU::ROR>(),
+    unsupported<0x6F>(),
+    operation<0x70, &CPU::relative, &CPU::BVS>(),
+    operation<0x71, &CPU::indirectIndexed, &CPU::ADC>(),
+    unsupported<0x72>(),
+    unsupported<0x73>(),
+    unsupported<0x74>(),
+    operation<0x75, &CPU::zeroPageX, &CPU::ADC>(),
+    operation<0x76, &CPU::zeroPageX, &CPU::ROR>(),
+    unsupported<0x77>(),
+    operation<0x78, &CPU::SEI>(),
+    operation<0x79, &CPU::absoluteY, &CPU::ADC>(),
+    unsupported<0x7A>(),
+    unsupported<0x7B>(),
+    unsupported<0x7C>(),
+    operation<0x7D, &CPU::absoluteX, &CPU::ADC>(),
+    operation<0x7E, &CPU::absoluteX, &CPU::ROR>(),
+    unsupported<0x7F>(),
+    unsupported<0x80>(),
+    operation<0x81, &CPU::indexedIndirect, &CPU::STA>(),
+    unsupported<0x82>(),
+    unsupported<0x83>(),
+    operation<0x84, &CPU::zeroPage, &CPU::STY>(),
+    operation<0x85, &CPU::zeroPage, &CPU::STA>(),
+    operation<0x86, &CPU::zeroPage, &CPU::STX>(),
+    unsupported<0x87>(),
+    operation<0x88, &CPU::DEY>(),
+    unsupported<0x89>(),
+    operation<0x8A, &CPU::TXA>(),
+    unsupported<0x8B>(),
+    operation<0x8C, &CPU::absolute, &CPU::STY>(),
+    operation<0x8D, &CPU::absolute, &CPU::STA>(),
+    operation<0x8E, &CPU::absolute, &CPU::STX>(),
+    unsupported<0x8F>(),
+    operation<0x90, &CPU::relative, &CPU::BCC>(),
+    operation<0x91, &CPU::indirectIndexed, &CPU::STA>(),
+    unsupported<0x92>(),
+    unsupported<0x93>(),
+    operation<0x94, &CPU::zeroPageX, &CPU::STY>(),
+    operation<0x95, &CPU::zeroPageX, &CPU::STA>(),
+    operation<0x96, &CPU::zeroPageY, &CPU::STX>(),
+    unsupported<0x97>(),
+    operation<0x98, &CPU::TYA>(),
+    operation<0x99, &CPU::absoluteY, &CPU::STA>(),
+    operation<0x9A, &CPU::TXS>(),
+    unsupported<0x9B>(),
+    unsupported<0x9C>(),
+    operation<0x9D, &CPU::absoluteX, &CPU::STA>(),
+    unsupported<0x9E>(),
+    unsupported<0x9F>(),
+    operation<0xA0, &CPU::immediate, &CPU::LDY>(),
+    operation<0xA1, &CPU::indexedIndirect, &CPU::LDA>(),
+    operation<0xA2, &CPU::immediate, &CPU::LDX>(),
+    unsupported<0xA3>(),
+    operation<0xA4, &CPU::zeroPage, &CPU::LDY>(),
+    operation<0xA5, &CPU::zeroPage, &CPU::LDA>(),
+    operation<0xA6, &CPU::zeroPage, &CPU::LDX>(),
+    unsupported<0xA7>(),
+    operation<0xA8, &CPU::TAY>(),
+    operation<0xA9, &CPU::immediate, &CPU::LDA>(),
+    operation<0xAA, &CPU::TAX>(),
+    unsupported<0xAB>(),
+    operation<0xAC, &CPU::absolute, &CPU::LDY>(),
+    operation<0xAD, &CPU::absolute, &CPU::LDA>(),
+    operation<0xAE, &CPU::absolute, &CPU::LDX>(),
+    unsupported<0xAF>(),
+    operation<0xB0, &CPU::relative, &CPU::BCS>(),
+    operation<0xB1, &CPU::indirectIndexed, &CPU::LDA>(),
+    unsupported<0xB2>(),
+    unsupported<0xB3>(),
+    operation<0xB4, &CPU::zeroPageX, &CPU::LDY>(),
+    operation<0xB5, &CPU::zeroPageX, &CPU::LDA>(),
+    operation<0xB6, &CPU::zeroPageY, &CPU::LDX>(),
+    unsupported<0xB7>(),
+    operation<0xB8, &CPU::CLV>(),
+    operation<0xB9, &CPU::absoluteY, &CPU::LDA>(),
+    operation<0xBA, &CPU::TSX>(),
+    unsupported<0xBB>(),
+    operation<0xBC, &CPU::absoluteX, &CPU::LDY>(),
+    operation<0xBD, &CPU::absoluteX, &CPU::LDA>(),
+    operation<0xBE, &CPU::absoluteY, &CPU::LDX>(),
+    unsupported<0xBF>(),
+    operation<0xC0, &CPU::immediate, &CPU::CPY>(),
+    operation<0xC1, &CPU::indexedIndirect, &CPU::CMP>(),
+    unsupported<0xC2>(),
+    unsupported<0xC3>(),
+    operation<0xC4, &CPU::zeroPage, &CPU::CPY>(),
+    operation<0xC5, &CPU::zeroPage, &CPU::CMP>(),
+    operation<0xC6, &CPU::zeroPage, &CPU::DEC>(),
+    unsupported<0xC7>(),
+    operation<0xC8, &CPU::INY>(),
+    operation<0xC9, &CPU::immediate, &CPU::CMP>(),
+    operation<0xCA, &CPU::DEX>(),
+    unsupported<0xCB>(),
+    operation<0xCC, &CPU::absolute, &CPU::CPY>(),
+    operation<0xCD, &CPU::absolute, &CPU::CMP>(),
+    operation<0xCE, &CPU::absolute, &CPU::DEC>(),
+    unsupported<0xCF>(),
+    operation<0xD0, &CPU::relative, &CPU::BNE>(),
+    operation<0xD1, &CPU::indirectIndexed, &CPU::CMP>(),
+    unsupported<0xD2>(),
+    unsupported<0xD3>(),
+    unsupported<0xD4>(),
+    operation<0xD5, &CPU::zeroPageX, &CPU::CMP>(),
+    operation<0xD6, &CPU::zeroPageX, &CPU::DEC>(),
+    unsupported<0xD7>(),
+    operation<0xD8, &CPU::CLD>(),
+    operation<0xD9, &CPU::absoluteY, &CPU::CMP>(),
+    unsupported<0xDA>(),
+    unsupported<0xDB>(),
+    unsupported<0xDC>(),
+    operation<0xDD, &CPU::absoluteX, &CPU::CMP>(),
+    operation<0xDE, &CPU::absoluteX, &CPU::DEC>(),
+    unsupported<0xDF>(),
+    operation<0xE0, &CPU::immediate, &CPU::CPX>(),
+    operation<0xE1, &CPU::indexedIndirect, &CPU::SBC>(),
+    unsupported<0xE2>(),
+    unsupported<0xE3>(),
+    operation<0xE4, &CPU::zeroPage, &CPU::CPX>(),
+    operation<0xE5, &CPU::zeroPage, &CPU::SBC>(),
+    operation<0xE6, &CPU::zeroPage, &CPU::INC>(),
+    unsupported<0xE7>(),
+    operation<0xE8, &CPU::INX>(),
+    operation<0xE9, &CPU::immediate, &CPU::SBC>(),
+    operation<0xEA, &CPU::NOP>(),
+    unsupported<0xEB>(),
+    operation<0xEC, &CPU::absolute, &CPU::CPX>(),
+    operation<0xED, &CPU::absolute, &CPU::SBC>(),
+    operation<0xEE, &CPU::absolute, &CPU::INC>(),
+    unsupported<0xEF>(),
+    operation<0xF0, &CPU::relative, &CPU::BEQ>(),
+    operation<0xF1, &CPU::indirectIndexed, &CPU::SBC>(),
+    unsupported<0xF2>(),
+    unsupported<0xF3>(),
+    unsupported<0xF4>(),
+    operation<0xF5, &CPU::zeroPageX, &CPU::SBC>(),
+    operation<0xF6, &CPU::zeroPageX, &CPU::INC>(),
+    unsupported<0xF7>(),
+    operation<0xF8, &CPU::SED>(),
+    operation<0xF9, &CPU::absoluteY, &CPU::SBC>(),
+    unsupported<0xFA>(),
+    unsupported<0xFB>(),
+    unsupported<0xFC>(),
+    operation<0xFD, &CPU::absoluteX, &CPU::SBC>(),
+    operation<0xFE, &CPU::absoluteX, &CPU::INC>(),
+    unsupported<0xFF>()
+};
 
 
 
 void CPU::ADC(const uint16_t& address) {
-    const uint8_t value = memory->read(address);
-    const unsigned int sum = (int)r_a + (int)value + r_p.test(CARRY_FLAG);
-    r_p.set(CARRY_FLAG,  // Unsigned overflow
-            sum & 0b1'0000'0000);
-    r_p.set(OVERFLOW_FLAG, // Signed overflow
-            ~(r_a ^ value) & (r_a ^ sum) & 0b1000'0000);
-    r_a = (uint8_t)sum;
-    setZeroFlag(r_a);
-    setNegativeFlag(r_a);
+    addWithCarry(memory->read(address));
 }
 
 void CPU::AND(const uint16_t& address) {
     r_a &= memory->read(address);
-    setZeroFlag(r_a);
-    setNegativeFlag(r_a);
+    setZeroNegative(r_a);
 }
 
 void CPU::ASL() {
-    const uint8_t carry_bit = r_a & 0b1000'0000;
+    carry_result = r_a << 1;
     r_a <<= 1;
-    r_p.set(CARRY_FLAG, carry_bit);
-    setZeroFlag(r_a);
-    setNegativeFlag(r_a);
+    setZeroNegative(r_a);
 }
 
 void CPU::ASL(const uint16_t& address) {
     const uint8_t value = memory->read(address);
-    const uint8_t carry_bit = value & 0b1000'0000;
+    carry_result = value << 1;
     const uint8_t result = value << 1;
     memory->write(address, result);
-    r_p.set(CARRY_FLAG, carry_bit);
-    setZeroFlag(result);
-    setNegativeFlag(result);
+    setZeroNegative(result);
 }
 
 void CPU::BCC(const uint16_t& address) {
     const int8_t offset = memory->read(address);
-    if (!r_p.test(CARRY_FLAG)) {
+    if (!carry()) {
         pc = (int)pc + offset; }
 }
 
 void CPU::BCS(const uint16_t& address) {
     const int8_t offset = memory->read(address);
-    if (r_p.test(CARRY_FLAG)) {
+    if (carry()) {
         pc = (int)pc + offset; }
 }
 
 void CPU::BEQ(const uint16_t& address) {
     const int8_t offset = memory->read(address);
-    if (r_p.test(ZERO_FLAG)) {
+    if (zero()) {
         pc = (int)pc + offset; }
 }
 
 void CPU::BIT(const uint16_t& address) {
     const uint8_t value = memory->read(address);
-    r_p.set(OVERFLOW_FLAG,
-            ((value >> 6) & 1));
-    setZeroFlag(value & r_a);
-    setNegativeFlag(value);
+    overflow_result = value << 1; // Bit 6 of value
+    zero_result = value & r_a;
+    negative_result = value;
 }
 
 void CPU::BMI(const uint16_t& address) {
     const int8_t offset = memory->read(address);
-    if (r_p.test(NEGATIVE_FLAG)) {
+    if (negative()) {
         pc = (int)pc + offset; }
 }
 
 void CPU::BNE(const uint16_t& address) {
     const int8_t offset = memory->read(address);
-    if (!r_p.test(ZERO_FLAG)) {
+    if (!zero()) {
         pc = (int)pc + offset; }
 }
 
 void CPU::BPL(const uint16_t& address) {
     const int8_t offset = memory->read(address);
-    if (!r_p.test(NEGATIVE_FLAG)) {
+    if (!negative()) {
         pc = (int)pc + offset; }
 }
 
 void CPU::BRK() {
-    push16(pc);
-    push((uint8_t)r_p.to_ulong());
+    push16(pc + 1); // BRK is followed by a padding byte, which is skipped on return.
+    push(status(true));
     pc = read16(0xFFFE);
-    r_p.set(BREAK_MODE_FLAG);
+    interrupt_disable = true;
 }
 
 void CPU::BVC(const uint16_t& address) {
     const int8_t offset = memory->read(address);
-    if (!r_p.test(OVERFLOW_FLAG)) {
+    if (!overflow()) {
         pc = (int)pc + offset; }
 }
 
 void CPU::BVS(const uint16_t& address) {
     const int8_t offset = memory->read(address);
-    if (r_p.test(OVERFLOW_FLAG)) {
+    if (overflow()) {
         pc = (int)pc + offset; }
 }
 
 void CPU::CLC() {
-    r_p.reset(CARRY_FLAG);
+    carry_result = 0;
 }
 
 void CPU::CLD() {
-    r_p.reset(DECIMAL_MODE);
+    decimal_mode = false;
 }
 
 void CPU::CLI() {
-    r_p.reset(INTERRUPT_DISABLE);
+    interrupt_disable_delayed = interrupt_disable;
+    interrupt_disable = false;
 }
 
 void CPU::CLV() {
-    r_p.reset(OVERFLOW_FLAG);
+    overflow_result = 0;
 }
 
 void CPU::CMP(const uint16_t& address) {
-    const uint8_t value = memory->read(address);
-    const uint8_t result = r_a - value;
-    r_p.set(CARRY_FLAG, (result >= 0));
-    setZeroFlag(result);
-    setNegativeFlag(result);
+    compare(r_a, memory->read(address));
 }
 
 void CPU::CPX(const uint16_t& address) {
-    const uint8_t value = memory->read(address);
-    const uint8_t result = r_x - value;
-    r_p.set(CARRY_FLAG, (result >= 0));
-    setZeroFlag(result);
-    setNegativeFlag(result);
+    compare(r_x, memory->read(address));
 }
 
 void CPU::CPY(const uint16_t& address) {
-    const uint8_t value = memory->read(address);
-    const uint8_t result = r_y - value;
-    r_p.set(CARRY_FLAG, (result >= 0));
-    setZeroFlag(result);
-    setNegativeFlag(result);
+    compare(r_y, memory->read(address));
 }
 
 void CPU::DEC(const uint16_t& address) {
     const uint8_t result = memory->read(address) - 1;
     memory->write(address, result);
-    setZeroFlag(result);
-    setNegativeFlag(result);
+    setZeroNegative(result);
 }
 
 void CPU::DEX() {
     --r_x;
-    setZeroFlag(r_x);
-    setNegativeFlag(r_x);
+    setZeroNegative(r_x);
 }
 
 void CPU::DEY() {
     --r_y;
-    setZeroFlag(r_y);
-    setNegativeFlag(r_y);
+    setZeroNegative(r_y);
 }
 
 void CPU::EOR(const uint16_t& address) {
     r_a ^= memory->read(address);
-    setZeroFlag(r_a);
-    setNegativeFlag(r_a);
+    setZeroNegative(r_a);
 }
 
 void CPU::INC(const uint16_t& address) {
     const uint8_t result = memory->read(address) + 1;
     memory->write(address, result);
-    setZeroFlag(result);
-    setNegativeFlag(result);
+    setZeroNegative(result);
 }
 
 void CPU::INX() {
     ++r_x;
-    setZeroFlag(r_x);
-    setNegativeFlag(r_x);
+    setZeroNegative(r_x);
 }
 
 void CPU::INY() {
     ++r_y;
-    setZeroFlag(r_y);
-    setNegativeFlag(r_y);
+    setZeroNegative(r_y);
 }
 
 void CPU::JMP(const uint16_t& address) {
@@ -1311,41 +892,31 @@ void CPU::JSR(const uint16_t& address) {
 
 void CPU::LDA(const uint16_t& address) {
     r_a = memory->read(address);
-
-    setZeroFlag(r_a);
-    setNegativeFlag(r_a);
+    setZeroNegative(r_a);
 }
 
 void CPU::LDX(const uint16_t& address) {
     r_x = memory->read(address);
-
-    setZeroFlag(r_x);
-    setNegativeFlag(r_x);
+    setZeroNegative(r_x);
 }
 
 void CPU::LDY(const uint16_t& address) {
     r_y = memory->read(address);
-
-    setZeroFlag(r_y);
-    setNegativeFlag(r_y);
+    setZeroNegative(r_y);
 }
 
 void CPU::LSR() {
-    const uint8_t carry_bit = r_a & 0b0000'0001;
+    carry_result = r_a << 8; // Bit 0 of A
     r_a >>= 1;
-    r_p.set(CARRY_FLAG, carry_bit);
-    setZeroFlag(r_a);
-    setNegativeFlag(r_a);
+    setZeroNegative(r_a);
 }
 
 void CPU::LSR(const uint16_t& address) {
     const uint8_t value = memory->read(address);
-    const uint8_t carry_bit = value & 0b0000'0001;
+    carry_result = value << 8; // Bit 0 of value
     const uint8_t result = value >> 1;
     memory->write(address, result);
-    r_p.set(CARRY_FLAG, carry_bit);
-    setZeroFlag(result);
-    setNegativeFlag(result);
+    setZeroNegative(result);
 }
 
 void CPU::NOP() {
@@ -1354,8 +925,7 @@ void CPU::NOP() {
 
 void CPU::ORA(const uint16_t& address) {
     r_a |= memory->read(address);
-    setZeroFlag(r_a);
-    setNegativeFlag(r_a);
+    setZeroNegative(r_a);
 }
 
 void CPU::PHA() {
@@ -1363,57 +933,52 @@ void CPU::PHA() {
 }
 
 void CPU::PHP() {
-    push((uint8_t)r_p.to_ulong());
+    push(status(true));
 }
 
 void CPU::PLA() {
     r_a = pop();
-    setZeroFlag(r_a);
-    setNegativeFlag(r_a);
+    setZeroNegative(r_a);
 }
 
 void CPU::PLP() {
-    r_p = pop();
+    const bool interrupt_disable_before = interrupt_disable;
+    setStatus(pop());
+    interrupt_disable_delayed = (interrupt_disable != interrupt_disable_before);
 }
 
 void CPU::ROL() {
-    const uint8_t carry_bit = r_a & 0b1000'0000;
-    r_a = (r_a << 1) & r_p.test(CARRY_FLAG);
-    r_p.set(CARRY_FLAG, carry_bit);
-    setZeroFlag(r_a);
-    setNegativeFlag(r_a);
+    const uint16_t shifted = (r_a << 1) | carry();
+    carry_result = shifted;
+    r_a = (uint8_t)shifted;
+    setZeroNegative(r_a);
 }
 
 void CPU::ROL(const uint16_t& address) {
-    const uint8_t value = memory->read(address);
-    const uint8_t carry_bit = value & 0b1000'0000;
-    const uint8_t result = (value << 1) & r_p.test(CARRY_FLAG);
+    const uint16_t shifted = (memory->read(address) << 1) | carry();
+    carry_result = shifted;
+    const uint8_t result = (uint8_t)shifted;
     memory->write(address, result);
-    r_p.set(CARRY_FLAG, carry_bit);
-    setZeroFlag(result);
-    setNegativeFlag(result);
+    setZeroNegative(result);
 }
 
 void CPU::ROR() {
-    const uint8_t carry_bit = r_a & 0b0000'0001;
-    r_a = (r_a >> 1) & (r_p.test(CARRY_FLAG) << 7);
-    r_p.set(CARRY_FLAG, carry_bit);
-    setZeroFlag(r_a);
-    setNegativeFlag(r_a);
+    const uint8_t result = (r_a >> 1) | (carry() << 7);
+    carry_result = r_a << 8; // Bit 0 of A
+    r_a = result;
+    setZeroNegative(r_a);
 }
 
 void CPU::ROR(const uint16_t& address) {
     const uint8_t value = memory->read(address);
-    const uint8_t carry_bit = value & 0b0000'0001;
-    const uint8_t result = (value >> 1) & (r_p.test(CARRY_FLAG) << 7);
+    const uint8_t result = (value >> 1) | (carry() << 7);
+    carry_result = value << 8; // Bit 0 of value
     memory->write(address, result);
-    r_p.set(CARRY_FLAG, carry_bit);
-    setZeroFlag(result);
-    setNegativeFlag(result);
+    setZeroNegative(result);
 }
 
 void CPU::RTI() {
-    r_p = pop();
+    setStatus(pop());
     pc = pop16();
 }
 
@@ -1422,27 +987,20 @@ void CPU::RTS() {
 }
 
 void CPU::SBC(const uint16_t& address) {
-    const uint8_t value = memory->read(address) ^ 0xFF;
-    const unsigned int sum = (int)r_a + (int)value + r_p.test(CARRY_FLAG);
-    r_p.set(CARRY_FLAG,  // Unsigned overflow
-        sum & 0b1'0000'0000);
-    r_p.set(OVERFLOW_FLAG, // Signed overflow
-        ~(r_a ^ value) & (r_a ^ sum) & 0b1000'0000);
-    r_a = (uint8_t)sum;
-    setZeroFlag(r_a);
-    setNegativeFlag(r_a);
+    addWithCarry(memory->read(address) ^ 0xFF);
 }
 
 void CPU::SEC() {
-    r_p.set(CARRY_FLAG);
+    carry_result = 0x100;
 }
 
 void CPU::SED() {
-    r_p.set(DECIMAL_MODE);
+    decimal_mode = true;
 }
 
 void CPU::SEI() {
-    r_p.set(INTERRUPT_DISABLE);
+    interrupt_disable_delayed = !interrupt_disable;
+    interrupt_disable = true;
 }
 
 void CPU::STA(const uint16_t& address) {
@@ -1459,27 +1017,22 @@ void CPU::STY(const uint16_t& address) {
 
 void CPU::TAX() {
     r_x = r_a;
-    setZeroFlag(r_x);
-    setNegativeFlag(r_x);
+    setZeroNegative(r_x);
 }
 
 void CPU::TAY() {
     r_y = r_a;
-    setZeroFlag(r_y);
-    setNegativeFlag(r_y);
+    setZeroNegative(r_y);
 }
 
 void CPU::TSX() {
     r_x = sp;
-
-    setZeroFlag(r_x);
-    setNegativeFlag(r_x);
+    setZeroNegative(r_x);
 }
 
 void CPU::TXA() {
     r_a = r_x;
-    setZeroFlag(r_a);
-    setNegativeFlag(r_a);
+    setZeroNegative(r_a);
 }
 
 void CPU::TXS() {
@@ -1487,7 +1040,6 @@ void CPU::TXS() {
 }
 
 void CPU::TYA() {
-    r_a = r_x;
-    setZeroFlag(r_a);
-    setNegativeFlag(r_a);
+    r_a = r_y;
+    setZeroNegative(r_a);
 }
\ No newline at end of file
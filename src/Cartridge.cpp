@@ -1,71 +1,79 @@
+#include <algorithm>
 #include <iostream>
-#include <fstream>
+#include <limits>
 #include <stdexcept>
 
 #include "Cartridge.hpp"
 
-Cartridge::Cartridge() {};
+namespace {
 
-Cartridge::Cartridge(const std::string& rom_path) {
-    loadRom(rom_path);
-}
+// NES 2.0 ROM size, from its least significant byte and most significant nibble, in units of 'unit' bytes.
+// A most significant nibble of $F makes the byte an exponent and multiplier instead: 2^E * (MM * 2 + 1) bytes,
+// for sizes that aren't a multiple of the unit.
+uint64_t romSize(const uint8_t& lsb, const uint8_t& msb, const uint64_t& unit) {
+    if (msb != 0xF) {
+        return (((uint64_t)msb << 8) | lsb) * unit; }
 
-void Cartridge::loadRom(const std::string& rom_path) {
-    std::ifstream rom(rom_path, std::ios::binary);
-
-    checkStream(rom, rom_path);
-    checkFileSize(rom);
+    const int exponent = lsb >> 2;
+    const uint64_t multiplier = ((lsb & 0b11) * 2) + 1;
+    if (exponent > 60) { // More than any file could hold. Caught by the file size check.
+        return std::numeric_limits<uint64_t>::max(); }
+    return (1ULL << exponent) * multiplier;
+}
 
-    loadHeader(rom);
-    loadPRG(rom);
-    loadCHR(rom);
+// NES 2.0 RAM size, from a shift count: 64 << shift bytes, or none if 0.
+uint32_t ramSize(const uint8_t& shift) {
+    return (shift == 0) ? 0 : (64U << shift);
+}
 
-    std::cout << "File loaded." << std::endl;
 }
 
-void Cartridge::checkStream(const std::ifstream& rom, const std::string& rom_path) {
-    if (rom.fail()) {
-        std::cerr
-            << "Couldn't load file at designated path: " << rom_path << '\n'
-            << "Usage: turbones [options] <path-to-rom-file>" << std::endl;
-        throw std::runtime_error("Failed ifstream");
-    }
+Cartridge::Cartridge() {};
 
-    if (rom.bad()) {
-        std::cerr << "Unknown file error." << std::endl;
-        throw std::runtime_error("Bad ifstream");
-    }
+Cartridge::Cartridge(const std::string& rom_path) {
+    loadRom(rom_path);
 }
 
-void Cartridge::checkFileSize(std::ifstream& rom) {
-    // Get length of file
-    rom.seekg(0, std::ios::end);
-    const std::streampos rom_size = (int)rom.tellg();
-    rom.seekg(0, std::ios::beg);
-
-    if (rom_size > MAX_FILE_SIZE) {
-        std::cerr
-            << "File too large: " << rom_size << " bytes.\n"
-            << "Max file size: 1 MB = " << MAX_FILE_SIZE << " bytes." << std::endl;
-        throw std::runtime_error("File too large");
-    }
+Cartridge::Cartridge(const std::string& rom_path, const Header& known_header) : header(known_header) {
+    file = std::make_shared<const MappedFile>(rom_path);
+    checkFileSize(rom_path);
+    mapRom();
 }
 
-void Cartridge::loadHeader(std::ifstream& rom) {
-    std::array<uint8_t, Header::HEADER_SIZE> buffer;
-    rom.read(reinterpret_cast<char *>(buffer.data()), buffer.size());
+void Cartridge::loadRom(const std::string& rom_path) {
+    file = std::make_shared<const MappedFile>(rom_path);
 
+    // Files too short for a header fail its check, as zeroes.
+    std::array<uint8_t, Header::HEADER_SIZE> buffer{};
+    std::copy_n(file->data(), std::min(file->size(), buffer.size()), buffer.begin());
     header.load(buffer);
+    checkFileSize(rom_path);
+    mapRom();
 }
 
-void Cartridge::loadPRG(std::ifstream& rom) {
-    prg_rom.resize(PRG_PAGE_SIZE * header.prg_rom_pages);
-    rom.read(reinterpret_cast<char *>(prg_rom.data()), prg_rom.size());
+void Cartridge::mapRom() {
+    // The trainer, if any, comes between the header and PRG ROM.
+    const uint8_t* prg = file->data() + Header::HEADER_SIZE + (header.trainer ? TRAINER_SIZE : 0);
+    prg_rom = Span<const uint8_t>(prg, header.prg_rom_size);
+    chr_rom = Span<const uint8_t>(prg + header.prg_rom_size, header.chr_rom_size);
 }
 
-void Cartridge::loadCHR(std::ifstream& rom) {
-    chr_rom.resize(CHR_PAGE_SIZE * header.chr_rom_pages);
-    rom.read(reinterpret_cast<char *>(chr_rom.data()), chr_rom.size());
+void Cartridge::checkFileSize(const std::string& rom_path) const {
+    // Sizes from the header are checked one at a time, so that absurd ones can't overflow a sum.
+    const uint64_t start = Header::HEADER_SIZE + (header.trainer ? TRAINER_SIZE : 0);
+    const uint64_t available = (file->size() > start) ? file->size() - start : 0;
+    const bool fits = file->size() >= start
+                       && header.prg_rom_size <= available
+                       && header.chr_rom_size <= available - header.prg_rom_size;
+
+    if (!fits) {
+        std::cerr
+            << "File too small for the ROM its header describes: " << rom_path << '\n'
+            << "File size: " << file->size() << " bytes. "
+            << "PRG ROM: " << header.prg_rom_size << " bytes, CHR ROM: " << header.chr_rom_size << " bytes"
+            << (header.trainer ? ", after a 512 byte trainer." : ".") << std::endl;
+        throw std::runtime_error("File truncated");
+    }
 }
 
 
@@ -73,19 +81,65 @@ void Cartridge::loadCHR(std::ifstream& rom) {
 void Cartridge::Header::load(const std::array<uint8_t, HEADER_SIZE>& input) {
     checkHeader(input);
 
-    prg_rom_pages = input[4];
-    chr_rom_pages = input[5];
-
-    mapper_number = (input[7] & 0xF0) | (input[6] & 0xF0 >> 4);
-
     mirroring   = input[6] & 0b0000'0001;
-    battery     = input[6] & 0b0000'0010 >> 1;
-    trainer     = input[6] & 0b0000'0100 >> 2;
-    four_screen = input[6] & 0b0000'1000 >> 3;
+    battery     = (input[6] & 0b0000'0010) >> 1;
+    trainer     = (input[6] & 0b0000'0100) >> 2;
+    four_screen = (input[6] & 0b0000'1000) >> 3;
 
     vs_unisystem    = input[7] & 0b0000'0001;
-    playchoice_10   = input[7] & 0b0000'0010 >> 1;
-    nes_2 = (0b10 == (input[7] & 0b0000'1100 >> 2));
+    playchoice_10   = (input[7] & 0b0000'0010) >> 1;
+    nes_2 = (0b10 == ((input[7] & 0b0000'1100) >> 2));
+
+    if (nes_2) {
+        loadNES2(input); }
+    else {
+        loadINES(input); }
+}
+
+void Cartridge::Header::loadINES(const std::array<uint8_t, HEADER_SIZE>& input) {
+    prg_rom_size = input[4] * (uint64_t)PRG_PAGE_SIZE;
+    chr_rom_size = input[5] * (uint64_t)CHR_PAGE_SIZE;
+
+    // Bytes 12-15 are unused, and should be 0. Old tools wrote their name over bytes 7-15 ("DiskDude!"),
+    // in which case byte 7 isn't to be trusted for the mapper's upper nibble either.
+    const bool padded = (input[12] | input[13] | input[14] | input[15]) == 0;
+    mapper_number = (input[6] >> 4) | (padded ? (input[7] & 0xF0) : 0);
+    submapper = 0;
+
+    // PRG RAM in 8 KB units, where 0 also means 8 KB, for compatibility. Battery backed, with the flag.
+    const uint32_t prg_ram = std::max<uint32_t>(1, padded ? input[8] : 0) * 0x2000;
+    prg_ram_size   = battery ? 0 : prg_ram;
+    prg_nvram_size = battery ? prg_ram : 0;
+    // Without CHR ROM, there's 8 KB of CHR RAM.
+    chr_ram_size   = (chr_rom_size == 0) ? CHR_PAGE_SIZE : 0;
+    chr_nvram_size = 0;
+
+    timing = (padded && (input[9] & 0b0000'0001)) ? PAL : NTSC;
+
+    console_type = vs_unisystem ? 1 : (playchoice_10 ? 2 : 0);
+    vs_type = 0;
+    misc_roms = 0;
+    expansion_device = 0;
+}
+
+void Cartridge::Header::loadNES2(const std::array<uint8_t, HEADER_SIZE>& input) {
+    prg_rom_size = romSize(input[4], input[9] & 0x0F, PRG_PAGE_SIZE);
+    chr_rom_size = romSize(input[5], input[9] >> 4,   CHR_PAGE_SIZE);
+
+    mapper_number = (input[6] >> 4) | (input[7] & 0xF0) | ((input[8] & 0x0F) << 8);
+    submapper = input[8] >> 4;
+
+    prg_ram_size   = ramSize(input[10] & 0x0F);
+    prg_nvram_size = ramSize(input[10] >> 4);
+    chr_ram_size   = ramSize(input[11] & 0x0F);
+    chr_nvram_size = ramSize(input[11] >> 4);
+
+    timing = static_cast<Timing>(input[12] & 0b11);
+
+    console_type = input[7] & 0b11;
+    vs_type = input[13];
+    misc_roms = input[14] & 0b11;
+    expansion_device = input[15] & 0b0011'1111;
 }
 
 // The first four bytes of the iNES header are always the same.
@@ -99,4 +153,4 @@ void Cartridge::Header::checkHeader(const std::array<uint8_t, HEADER_SIZE>& inpu
         std::cerr << "Invalid or unsupported file format." << std::endl;
         throw std::runtime_error("iNES header not found");
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,332 @@
+#include <string.h>
+#include <algorithm>
+
+#include "Checksum.hpp"
+
+// Neither PCLMULQDQ nor the SHA extensions are assumed by the build, so their kernels are compiled for them on their own,
+// and used if the CPU has them.
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+    #define TURBONES_CHECKSUM_X86 1
+    #include <cpuid.h>
+    #include <immintrin.h>
+#else
+    #define TURBONES_CHECKSUM_X86 0
+#endif
+
+namespace {
+
+// CRC32's polynomial, bit reversed.
+constexpr uint32_t CRC32_POLYNOMIAL = 0xEDB8'8320;
+
+// Tables for slicing by 8: 'tables[k][b]' is the CRC of byte 'b' followed by 'k' zero bytes.
+struct Crc32Tables {
+    uint32_t tables[8][256];
+
+    Crc32Tables() {
+        for (uint32_t byte = 0; byte < 256; ++byte) {
+            uint32_t crc = byte;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc >> 1) ^ ((crc & 1) ? CRC32_POLYNOMIAL : 0); }
+            tables[0][byte] = crc;
+        }
+        for (int k = 1; k < 8; ++k) {
+            for (int byte = 0; byte < 256; ++byte) {
+                tables[k][byte] = (tables[k - 1][byte] >> 8) ^ tables[0][tables[k - 1][byte] & 0xFF]; }
+        }
+    }
+};
+
+const Crc32Tables& crc32Tables() {
+    static const Crc32Tables tables;
+    return tables;
+}
+
+// On the inverted CRC, as the kernels below are.
+uint32_t crc32Sliced(uint32_t crc, const uint8_t* data, size_t size) {
+    const Crc32Tables& t = crc32Tables();
+    for (; size >= 8; data += 8, size -= 8) {
+        uint32_t low, high;
+        memcpy(&low,  data,     4);
+        memcpy(&high, data + 4, 4);
+        low ^= crc; // Little endian.
+        crc = t.tables[7][low & 0xFF] ^ t.tables[6][(low >> 8) & 0xFF] ^ t.tables[5][(low >> 16) & 0xFF] ^ t.tables[4][low >> 24]
+            ^ t.tables[3][high & 0xFF] ^ t.tables[2][(high >> 8) & 0xFF] ^ t.tables[1][(high >> 16) & 0xFF] ^ t.tables[0][high >> 24];
+    }
+    for (; size > 0; ++data, --size) {
+        crc = (crc >> 8) ^ t.tables[0][(crc ^ *data) & 0xFF]; }
+    return crc;
+}
+
+uint32_t rotateLeft(const uint32_t& value, const int& bits) {
+    return (value << bits) | (value >> (32 - bits));
+}
+
+uint32_t loadBigEndian(const uint8_t* bytes) {
+    return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | bytes[3];
+}
+
+void sha1Blocks(uint32_t* state, const uint8_t* data, size_t blocks) {
+    for (; blocks > 0; --blocks, data += 64) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = loadBigEndian(data + (i * 4)); }
+        for (int i = 16; i < 80; ++i) {
+            w[i] = rotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1); }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+        for (int i = 0; i < 80; ++i) {
+            uint32_t f, k;
+            if      (i < 20) { f = (b & c) | (~b & d);          k = 0x5A82'7999; }
+            else if (i < 40) { f = b ^ c ^ d;                   k = 0x6ED9'EBA1; }
+            else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1B'BCDC; }
+            else             { f = b ^ c ^ d;                   k = 0xCA62'C1D6; }
+            const uint32_t temp = rotateLeft(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rotateLeft(b, 30);
+            b = a;
+            a = temp;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+    }
+}
+
+#if TURBONES_CHECKSUM_X86
+
+// From CPUID, as not every compiler's __builtin_cpu_supports knows the SHA extensions.
+bool cpuHasPCLMUL() {
+    unsigned int eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx)
+            && (ecx & bit_PCLMUL)
+            && (ecx & bit_SSE4_1);
+}
+
+bool cpuHasSHA() {
+    unsigned int eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx)
+            && (ecx & bit_SSE4_1)
+            && __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)
+            && (ebx & (1U << 29));
+}
+
+// 'lane' times the low and high halves of 'k', added to 'next'.
+__attribute__((target("pclmul,sse4.1"))) inline
+__m128i fold(const __m128i& lane, const __m128i& next, const __m128i& k) {
+    return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(lane, k, 0x00), _mm_clmulepi64_si128(lane, k, 0x11)), next);
+}
+
+// Folds 64 bytes at a time into 4 128-bit lanes with carry-less multiplies by x^(512+64) and x^512 mod P,
+// then the lanes into one, and reduces that to 32 bits (Barrett reduction).
+// After Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction" (Gopal et al., 2009).
+// Takes at least 64 bytes, a multiple of 16. On the inverted CRC.
+__attribute__((target("pclmul,sse4.1")))
+uint32_t crc32Folded(const uint32_t& crc, const uint8_t* data, size_t size) {
+    const __m128i k1k2 = _mm_set_epi64x(0x01'C6E4'1596, 0x01'5444'2BD4);
+    const __m128i k3k4 = _mm_set_epi64x(0x00'CCAA'009E, 0x01'7519'97D0);
+    const __m128i k5k0 = _mm_set_epi64x(0,              0x01'63CD'6124);
+    const __m128i poly = _mm_set_epi64x(0x01'F701'1641, 0x01'DB71'0641);
+    const __m128i low_32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+    __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+    __m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16));
+    __m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 32));
+    __m128i x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 48));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+    data += 64;
+    size -= 64;
+
+    for (; size >= 64; data += 64, size -= 64) {
+        x1 = fold(x1, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data)),      k1k2);
+        x2 = fold(x2, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16)), k1k2);
+        x3 = fold(x3, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 32)), k1k2);
+        x4 = fold(x4, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 48)), k1k2);
+    }
+
+    // Four lanes into one, then any 16 byte blocks left.
+    x1 = fold(x1, x2, k3k4);
+    x1 = fold(x1, x3, k3k4);
+    x1 = fold(x1, x4, k3k4);
+    for (; size >= 16; data += 16, size -= 16) {
+        x1 = fold(x1, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data)), k3k4); }
+
+    // 128 bits to 64.
+    x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, low_32), k5k0, 0x00), x2);
+
+    // Barrett reduction to 32.
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, low_32), poly, 0x10);
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, low_32), poly, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+// Four of SHA-1's 80 rounds, 'GROUP' * 4 on, with the message schedule for later groups run alongside.
+// The two 'e' registers take turns: one carries E into this group's rounds, the other saves A-D for the next.
+template <int GROUP>
+__attribute__((target("sha,sse4.1"))) inline
+void sha1Rounds(__m128i& abcd, __m128i* e, __m128i* message) {
+    __m128i& current = e[GROUP % 2];
+    current = (GROUP == 0) ? _mm_add_epi32(current, message[0])
+                           : _mm_sha1nexte_epu32(current, message[GROUP % 4]);
+    e[(GROUP + 1) % 2] = abcd;
+    if (GROUP >= 3 && GROUP <= 18) {
+        message[(GROUP + 1) % 4] = _mm_sha1msg2_epu32(message[(GROUP + 1) % 4], message[GROUP % 4]); }
+    abcd = _mm_sha1rnds4_epu32(abcd, current, GROUP / 5);
+    if (GROUP >= 1 && GROUP <= 16) {
+        message[(GROUP + 3) % 4] = _mm_sha1msg1_epu32(message[(GROUP + 3) % 4], message[GROUP % 4]); }
+    if (GROUP >= 2 && GROUP <= 17) {
+        message[(GROUP + 2) % 4] = _mm_xor_si128(message[(GROUP + 2) % 4], message[GROUP % 4]); }
+}
+
+template <int GROUP>
+struct Sha1Groups {
+    __attribute__((target("sha,sse4.1"))) static inline
+    void run(__m128i& abcd, __m128i* e, __m128i* message) {
+        Sha1Groups<GROUP - 1>::run(abcd, e, message);
+        sha1Rounds<GROUP>(abcd, e, message);
+    }
+};
+
+template <>
+struct Sha1Groups<0> {
+    __attribute__((target("sha,sse4.1"))) static inline
+    void run(__m128i& abcd, __m128i* e, __m128i* message) {
+        sha1Rounds<0>(abcd, e, message);
+    }
+};
+
+__attribute__((target("sha,sse4.1")))
+void sha1BlocksNI(uint32_t* state, const uint8_t* data, size_t blocks) {
+    // Words are big endian, and the rounds take A-D with A in the top lane.
+    const __m128i byte_swap = _mm_set_epi64x(0x0001'0203'0405'0607, 0x0809'0A0B'0C0D'0E0F);
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0x1B);
+    __m128i e0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+
+    for (; blocks > 0; --blocks, data += 64) {
+        const __m128i abcd_saved = abcd,
+                      e_saved    = e0;
+        __m128i message[4];
+        for (int i = 0; i < 4; ++i) {
+            message[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + (i * 16))), byte_swap); }
+        __m128i e[2] = { e0, _mm_setzero_si128() };
+
+        Sha1Groups<19>::run(abcd, e, message);
+
+        // After group 19, 'e[0]' holds A-D from before it, which gives E.
+        e0 = _mm_sha1nexte_epu32(e[0], e_saved);
+        abcd = _mm_add_epi32(abcd, abcd_saved);
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_shuffle_epi32(abcd, 0x1B));
+    state[4] = (uint32_t)_mm_extract_epi32(e0, 3);
+}
+
+#endif
+
+}
+
+uint32_t updateCrc32(const uint32_t& crc, const void* data, const size_t& size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint32_t inverted = ~crc;
+    size_t remaining = size;
+#if TURBONES_CHECKSUM_X86
+    static const bool use_pclmul = cpuHasPCLMUL();
+    if (use_pclmul
+         && remaining >= 64) {
+        const size_t folded = remaining & ~(size_t)15;
+        inverted = crc32Folded(inverted, bytes, folded);
+        bytes += folded;
+        remaining -= folded;
+    }
+#endif
+    return ~crc32Sliced(inverted, bytes, remaining);
+}
+
+Sha1::Sha1() {
+#if TURBONES_CHECKSUM_X86
+    use_sha_ni = cpuHasSHA();
+#else
+    use_sha_ni = false;
+#endif
+    reset();
+}
+
+void Sha1::reset() {
+    state = { 0x6745'2301, 0xEFCD'AB89, 0x98BA'DCFE, 0x1032'5476, 0xC3D2'E1F0 };
+    buffered = 0;
+    length = 0;
+}
+
+void Sha1::update(const void* data, const size_t& size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    size_t remaining = size;
+    length += size;
+
+    if (buffered > 0) {
+        const size_t taken = std::min(remaining, BLOCK_SIZE - buffered);
+        memcpy(buffer.data() + buffered, bytes, taken);
+        buffered += taken;
+        bytes += taken;
+        remaining -= taken;
+        if (buffered < BLOCK_SIZE) {
+            return; }
+        processBlocks(buffer.data(), 1);
+        buffered = 0;
+    }
+
+    const size_t blocks = remaining / BLOCK_SIZE;
+    processBlocks(bytes, blocks);
+    bytes += blocks * BLOCK_SIZE;
+    remaining -= blocks * BLOCK_SIZE;
+
+    memcpy(buffer.data(), bytes, remaining);
+    buffered = remaining;
+}
+
+Sha1::Digest Sha1::finish() {
+    // Padding: a 1 bit, zeroes up to 8 bytes short of a block, then the length in bits, big endian.
+    const uint64_t bits = length * 8;
+    std::array<uint8_t, BLOCK_SIZE + 8> padding{};
+    padding[0] = 0x80;
+    const size_t zeroes = (buffered < BLOCK_SIZE - 8) ? (BLOCK_SIZE - 8 - buffered) : (BLOCK_SIZE * 2 - 8 - buffered);
+    for (int i = 0; i < 8; ++i) {
+        padding[zeroes + i] = (uint8_t)(bits >> (56 - (i * 8))); }
+    update(padding.data(), zeroes + 8);
+
+    Digest digest;
+    for (int i = 0; i < 5; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            digest[(i * 4) + j] = (uint8_t)(state[i] >> (24 - (j * 8))); }
+    }
+    reset();
+    return digest;
+}
+
+void Sha1::processBlocks(const uint8_t* data, const size_t& blocks) {
+    if (blocks == 0) {
+        return; }
+#if TURBONES_CHECKSUM_X86
+    if (use_sha_ni) {
+        sha1BlocksNI(state.data(), data, blocks);
+        return;
+    }
+#endif
+    sha1Blocks(state.data(), data, blocks);
+}
+
+std::string toHex(const uint8_t* bytes, const size_t& size) {
+    static constexpr char digits[] = "0123456789abcdef";
+    std::string hex;
+    hex.reserve(size * 2);
+    for (size_t i = 0; i < size; ++i) {
+        hex += digits[bytes[i] >> 4];
+        hex += digits[bytes[i] & 0xF];
+    }
+    return hex;
+}
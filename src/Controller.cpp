@@ -0,0 +1,30 @@
+#include "Controller.hpp"
+
+void Controller::setButtons(const uint8_t& buttons) {
+    this->buttons = buttons;
+}
+
+void Controller::write(const uint8_t& value) {
+    strobe = value & 1;
+    if (strobe) {
+        shift = buttons; }
+}
+
+uint8_t Controller::read() {
+    if (strobe) {
+        return buttons & 1; }
+
+    const uint8_t value = shift & 1;
+    shift = (shift >> 1) | 0x80; // Official controllers return 1 once empty.
+    return value;
+}
+
+void Controller::saveState(StateWriter& out) const {
+    out.put(shift);
+    out.put(strobe);
+}
+
+void Controller::loadState(StateReader& in) {
+    in.get(shift);
+    in.get(strobe);
+}
@@ -1,9 +1,340 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#if TURBONES_SFML
+    #include <SFML/Graphics.hpp>
+#endif
+
 #include "Emulator.hpp"
+#include "HeaderDatabase.hpp"
+#include "RomIndex.hpp"
+
+namespace {
+
+void writeFile(const std::string& path, const void* data, const size_t& size) {
+    std::ofstream file(path, std::ios::binary);
+    file.write(static_cast<const char*>(data), size);
+    if (file.fail()) {
+        std::cerr << "Couldn't write file: " << path << std::endl;
+        throw std::runtime_error("Failed ofstream");
+    }
+}
+
+// NTSC frame rate: 1.789773 MHz CPU clock, 29780.5 CPU cycles per frame.
+constexpr double FRAMES_PER_SECOND = 1789773.0 / 29780.5;
+
+// Audio queued for the device, aimed for, in seconds. Enough to ride out a late frame, and SFML taking a chunk at a time.
+constexpr double AUDIO_LATENCY = 0.075;
+// Most the resampling ratio is nudged by, to keep the audio queued at its target. Too little to hear as a change in pitch.
+constexpr double MAX_RATE_ADJUSTMENT = 0.005;
+
+// Appends 'value' to 'out', as 'size' bytes, little endian.
+void appendLittleEndian(std::string& out, const uint32_t& value, const int& size) {
+    for (int i = 0; i < size; ++i) {
+        out += (char)((value >> (8 * i)) & 0xFF); }
+}
+
+#if TURBONES_SFML
+
+constexpr int WINDOW_SCALE = 3;
+
+// Controller 1 buttons held on the keyboard.
+uint8_t keyboardButtons() {
+    const std::pair<sf::Keyboard::Key, Controller::Button> keys[] = {
+        { sf::Keyboard::X,      Controller::A },
+        { sf::Keyboard::Z,      Controller::B },
+        { sf::Keyboard::RShift, Controller::SELECT },
+        { sf::Keyboard::Return, Controller::START },
+        { sf::Keyboard::Up,     Controller::UP },
+        { sf::Keyboard::Down,   Controller::DOWN },
+        { sf::Keyboard::Left,   Controller::LEFT },
+        { sf::Keyboard::Right,  Controller::RIGHT }
+    };
+    uint8_t buttons = 0;
+    for (const auto& key : keys) {
+        if (sf::Keyboard::isKeyPressed(key.first)) {
+            buttons |= key.second; }
+    }
+    return buttons;
+}
+
+#endif
+
+}
 
 void Emulator::run() {
-    nes.load(rom_path);
-    nes.run();
+    if (build_index) {
+        buildIndex();
+        return;
+    }
+
+    if (recompile) {
+        nes.enableRecompiler(); }
+    nes.setPPUEngine(ppu_engine);
+    if (!index_path.empty()) {
+        RomIndex index;
+        index.load(index_path);
+        const RomIndex::Entry* entry = index.find(rom_path);
+        if (entry == nullptr) {
+            std::cerr << "Not in the ROM index: " << rom_path << std::endl;
+            throw std::runtime_error("ROM not indexed");
+        }
+        nes.load(entry->path, entry->header);
+    }
+    else {
+        nes.load(rom_path); }
+    if (!trace_path.empty()) {
+        nes.trace(trace_path); }
+    if (!input_path.empty()) {
+        input.load(input_path); }
+
+    resampler.setRates(APU::SAMPLE_RATE, sample_rate);
+#if TURBONES_SFML
+    audio.setSampleRate(sample_rate);
+#endif
+    if (!audio_path.empty()) {
+        audio_file.open(audio_path, std::ios::binary);
+        writeAudioHeader(); // Rewritten with the final size once the run stops.
+    }
+
+    nes.powerOn();
+    if (rewind_budget != 0) {
+        rewind.reset(new Rewind(rewind_budget)); }
+
+    const auto start = std::chrono::steady_clock::now();
+    running = true;
+#if TURBONES_SFML
+    if (!headless) {
+        runWindowed(); }
+    else {
+        emulate(false); }
+#else
+    emulate(false);
+#endif
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    printStats(elapsed.count());
+    writeOutputs();
+    if (audio_file.is_open()) {
+        writeAudioHeader(); }
+}
+
+void Emulator::emulate(const bool& realtime) {
+    const uint64_t cycle_limit = (cycle_budget != 0) ? cycle_budget : std::numeric_limits<uint64_t>::max();
+    const std::chrono::duration<double> frame_time(1.0 / FRAMES_PER_SECOND);
+    auto next_frame = std::chrono::steady_clock::now();
+
+    while (running.load(std::memory_order_relaxed)
+            && (frame_budget == 0 || nes.frameCount() < frame_budget)
+            && nes.cpuCycles() < cycle_limit) {
+        InputEvent event;
+        while (input_events.pop(event)) {
+            keyboard_buttons[event.controller] = event.buttons; }
+        for (int controller = 0; controller < 2; ++controller) {
+            nes.setButtons(controller, input.buttons(nes.frameCount(), controller) | keyboard_buttons[controller]); }
+
+        // The newest state held is the one the frame shown started in.
+        // Back a frame: to the state the frame before started in, then through that frame again, to show it.
+        if (rewind
+             && rewinding.load(std::memory_order_relaxed)) {
+            if (rewind->stepBack(nes)) {
+                nes.runFrame(cycle_limit); }
+        }
+        else {
+            if (rewind) {
+                rewind->push(nes); }
+            nes.runFrame(cycle_limit);
+        }
+
+        if (realtime
+             || audio_file.is_open()) {
+            outputAudio(realtime); }
+
+        if (realtime) {
+            // Converted straight into the buffer the window thread will upload from.
+            frame_palette.convert(nes.frameBuffer().data(), nes.frameBuffer().size(), frames.back().data());
+            frames.publish();
+
+            // Wait for the frame's time to be up. If far behind (e.g. the machine was suspended), don't rush to catch up.
+            next_frame += std::chrono::duration_cast<std::chrono::steady_clock::duration>(frame_time);
+            const auto now = std::chrono::steady_clock::now();
+            if (next_frame < now - (frame_time * 4)) {
+                next_frame = now; }
+            std::this_thread::sleep_until(next_frame);
+#if TURBONES_SFML
+            // Further ahead of the device than the rate adjustment makes up for: its clock is well off. Let it drain.
+            const size_t latency_samples = (size_t)(AUDIO_LATENCY * sample_rate);
+            while (running.load(std::memory_order_relaxed)
+                    && audio.getStatus() == sf::SoundStream::Playing
+                    && audio.queued() > latency_samples * 2) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                next_frame = std::chrono::steady_clock::now();
+            }
+#endif
+        }
+    }
+    running = false; // Tells the window thread, if there's one.
+}
+
+void Emulator::outputAudio(const bool& realtime) {
+#if TURBONES_SFML
+    if (realtime) {
+        const double target = AUDIO_LATENCY * sample_rate;
+        const double error = (target - (double)audio.queued()) / target;
+        resampler.setRateAdjustment(1.0 + (MAX_RATE_ADJUSTMENT * std::max(-1.0, std::min(1.0, error))));
+    }
+#else
+    (void)realtime;
+#endif
+
+    std::array<int16_t, 1024> samples;
+    size_t count;
+    while ((count = nes.readSamples(samples.data(), samples.size())) > 0) {
+        resampler.process(samples.data(), count, resampled); }
+
+    if (audio_file.is_open()) {
+        audio_file.write(reinterpret_cast<const char*>(resampled.data()), resampled.size() * sizeof(int16_t));
+        audio_bytes += (uint32_t)(resampled.size() * sizeof(int16_t));
+    }
+#if TURBONES_SFML
+    if (realtime) {
+        audio.push(resampled.data(), resampled.size()); }
+#endif
+    resampled.clear();
 }
 
+#if TURBONES_SFML
 
+void Emulator::runWindowed() {
+    sf::RenderWindow window(sf::VideoMode(PPU::WIDTH * WINDOW_SCALE, PPU::HEIGHT * WINDOW_SCALE), "turbones");
+    window.setVerticalSyncEnabled(true);
+    sf::Texture texture;
+    if (!texture.create(PPU::WIDTH, PPU::HEIGHT)) {
+        std::cerr << "Couldn't create the frame texture" << std::endl;
+        throw std::runtime_error("Failed sf::Texture::create");
+    }
+    sf::Sprite sprite(texture);
+    sprite.setScale(WINDOW_SCALE, WINDOW_SCALE);
+
+    std::thread emulation(&Emulator::emulate, this, true);
+    audio.play();
+
+    uint8_t buttons = 0;
+    while (window.isOpen()
+            && running.load(std::memory_order_relaxed)) {
+        sf::Event event;
+        while (window.pollEvent(event)) {
+            if (event.type == sf::Event::Closed) {
+                window.close(); }
+        }
+
+        // Only changes are sent. If the queue is full, the change is sent again next time round.
+        const uint8_t held = window.hasFocus() ? keyboardButtons() : 0;
+        if (held != buttons
+             && input_events.push({ 0, held })) {
+            buttons = held; }
+        rewinding = window.hasFocus() && sf::Keyboard::isKeyPressed(sf::Keyboard::BackSpace);
+
+        if (frames.update()) {
+            texture.update(frames.front().data()); }
+        window.clear();
+        window.draw(sprite);
+        window.display(); // Waits for vsync.
+    }
+
+    running = false;
+    emulation.join();
+    audio.stop();
+}
 
+#endif
+
+void Emulator::buildIndex() const {
+    HeaderDatabase database;
+    if (!header_database_path.empty()) {
+        database.load(header_database_path); }
+
+    const auto start = std::chrono::steady_clock::now();
+    RomIndex index;
+    index.scan({ rom_path }, database, 0);
+    index.save(index_path);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    const auto corrected = std::count_if(index.entries().begin(), index.entries().end(),
+                                         [](const RomIndex::Entry& entry) { return entry.corrected; });
+    std::cout
+        << std::fixed << std::setprecision(2)
+        << "Indexed " << index.entries().size() << " ROM files in " << elapsed.count() << " s"
+        << " (" << corrected << " headers corrected)" << std::endl;
+}
+
+void Emulator::printStats(const double& seconds) const {
+    // Avoid dividing by 0 on runs too short to measure.
+    const double measured = std::max(seconds, 1e-9);
+
+    std::cout
+        << std::fixed << std::setprecision(2)
+        << "Frames: " << nes.frameCount() << " in " << seconds << " s"
+        << " (" << nes.frameCount() / measured << " frames/s)\n"
+        << "CPU instructions: " << nes.instructionCount()
+        << " (" << nes.instructionCount() / measured / 1e6 << " million/s)\n"
+        << "CPU cycles: " << nes.cpuCycles()
+        << " (skipped in idle loops: " << nes.idleCyclesSkipped() << ")\n"
+        << "PPU engine: " << (nes.ppuEngine() == PPU::DOT ? "dot" : "scanline");
+    if (ppu_engine == PPU::SCANLINE
+         && nes.ppuEngine() == PPU::DOT) {
+        std::cout << " (fell back to dot on a mid-line write)"; }
+    if (rewind) {
+        std::cout
+            << "\nRewind: " << rewind->size() << " frames in "
+            << rewind->bytesUsed() / (1024.0 * 1024.0) << " MB"; }
+    std::cout << std::endl;
+}
+
+void Emulator::writeOutputs() const {
+    if (!frame_buffer_path.empty()) {
+        const Palette palette(frame_format);
+        std::vector<uint8_t> pixels(nes.frameBuffer().size() * Palette::bytesPerPixel(frame_format));
+        palette.convert(nes.frameBuffer().data(), nes.frameBuffer().size(), pixels.data());
+        writeFile(frame_buffer_path, pixels.data(), pixels.size());
+    }
+    if (!ram_path.empty()) {
+        writeFile(ram_path, nes.ram().data(), nes.ram().size()); }
+    if (!hash_path.empty()) {
+        std::ostringstream hash;
+        hash << std::hex << std::setw(16) << std::setfill('0') << nes.stateHash() << '\n';
+        writeFile(hash_path, hash.str().data(), hash.str().size());
+    }
+}
+
+void Emulator::writeAudioHeader() {
+    // RIFF WAVE, with a single PCM format chunk: 16-bit mono at 'sample_rate'.
+    std::string header = "RIFF";
+    appendLittleEndian(header, 36 + audio_bytes, 4);
+    header += "WAVEfmt ";
+    appendLittleEndian(header, 16, 4);              // Format chunk size.
+    appendLittleEndian(header, 1, 2);               // PCM.
+    appendLittleEndian(header, 1, 2);               // Channels.
+    appendLittleEndian(header, sample_rate, 4);
+    appendLittleEndian(header, sample_rate * 2, 4); // Bytes per second.
+    appendLittleEndian(header, 2, 2);               // Bytes per sample frame.
+    appendLittleEndian(header, 16, 2);              // Bits per sample.
+    header += "data";
+    appendLittleEndian(header, audio_bytes, 4);
+
+    audio_file.seekp(0);
+    audio_file.write(header.data(), header.size());
+    audio_file.seekp(0, std::ios::end);
+    if (audio_file.fail()) {
+        std::cerr << "Couldn't write file: " << audio_path << std::endl;
+        throw std::runtime_error("Failed ofstream");
+    }
+}
@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include "HeaderDatabase.hpp"
+
+namespace {
+
+void failLine(const int& line_number, const std::string& message) {
+    std::cerr << "Header database line " << line_number << ": " << message << std::endl;
+    throw std::runtime_error("Invalid header database");
+}
+
+bool isHex(const std::string& text) {
+    return std::all_of(text.begin(), text.end(), [](const char& c) { return std::isxdigit((unsigned char)c) != 0; });
+}
+
+}
+
+void HeaderDatabase::load(const std::string& database_path) {
+    std::ifstream database(database_path);
+    if (database.fail()) {
+        std::cerr << "Couldn't open header database: " << database_path << std::endl;
+        throw std::runtime_error("Failed ifstream");
+    }
+
+    corrections.clear();
+    std::string line;
+    for (int line_number = 1; std::getline(database, line); ++line_number) {
+        std::istringstream fields(line);
+        std::string checksum;
+        fields >> checksum;
+        if (checksum.empty()
+             || checksum[0] == '#') {
+            continue; }
+
+        std::transform(checksum.begin(), checksum.end(), checksum.begin(), [](const char& c) { return (char)std::tolower((unsigned char)c); });
+        if (!isHex(checksum)
+             || (checksum.size() != 8 && checksum.size() != 40)) {
+            failLine(line_number, "expected a CRC32 (8 hex digits) or SHA-1 (40), got: " + checksum); }
+
+        Correction correction;
+        std::string field;
+        while (fields >> field) {
+            parseField(field, line_number, correction); }
+        corrections[checksum] = correction;
+    }
+}
+
+void HeaderDatabase::parseField(const std::string& field, const int& line_number, Correction& correction) const {
+    const size_t equals = field.find('=');
+    if (equals == std::string::npos) {
+        failLine(line_number, "expected <field>=<value>, got: " + field); }
+    const std::string name  = field.substr(0, equals),
+                      value = field.substr(equals + 1);
+
+    // Numeric fields.
+    const std::pair<const char*, Field> numbers[] = {
+        { "mapper",    MAPPER },    { "submapper", SUBMAPPER },
+        { "prg-rom",   PRG_ROM },   { "chr-rom",   CHR_ROM },
+        { "prg-ram",   PRG_RAM },   { "prg-nvram", PRG_NVRAM },
+        { "chr-ram",   CHR_RAM },   { "chr-nvram", CHR_NVRAM },
+        { "battery",   BATTERY }
+    };
+    Cartridge::Header& values = correction.values;
+    for (const auto& number : numbers) {
+        if (name != number.first) {
+            continue; }
+
+        uint64_t parsed = 0;
+        try {
+            size_t length = 0;
+            parsed = std::stoull(value, &length);
+            if (length != value.size()
+                 || value[0] == '-') {
+                throw std::invalid_argument(value); }
+        }
+        catch (const std::logic_error&) {
+            failLine(line_number, "invalid number for " + name + ": " + value); }
+
+        switch (number.second) {
+            case MAPPER:    values.mapper_number  = (uint16_t)std::min<uint64_t>(parsed, 0xFFF); break;
+            case SUBMAPPER: values.submapper      = (uint8_t)std::min<uint64_t>(parsed, 0xF);    break;
+            case PRG_ROM:   values.prg_rom_size   = parsed;                                      break;
+            case CHR_ROM:   values.chr_rom_size   = parsed;                                      break;
+            case PRG_RAM:   values.prg_ram_size   = (uint32_t)parsed;                            break;
+            case PRG_NVRAM: values.prg_nvram_size = (uint32_t)parsed;                            break;
+            case CHR_RAM:   values.chr_ram_size   = (uint32_t)parsed;                            break;
+            case CHR_NVRAM: values.chr_nvram_size = (uint32_t)parsed;                            break;
+            default:        values.battery        = (parsed != 0);                               break;
+        }
+        correction.fields |= number.second;
+        return;
+    }
+
+    if (name == "mirroring") {
+        if      (value == "horizontal") {
+            values.mirroring = false;
+            values.four_screen = false;
+        }
+        else if (value == "vertical") {
+            values.mirroring = true;
+            values.four_screen = false;
+        }
+        else if (value == "four-screen") {
+            values.mirroring = false;
+            values.four_screen = true;
+        }
+        else {
+            failLine(line_number, "invalid mirroring (horizontal, vertical or four-screen): " + value); }
+        correction.fields |= MIRRORING;
+    }
+    else if (name == "timing") {
+        if      (value == "ntsc") {
+            values.timing = Cartridge::Header::NTSC; }
+        else if (value == "pal") {
+            values.timing = Cartridge::Header::PAL; }
+        else if (value == "multi") {
+            values.timing = Cartridge::Header::MULTI_REGION; }
+        else if (value == "dendy") {
+            values.timing = Cartridge::Header::DENDY; }
+        else {
+            failLine(line_number, "invalid timing (ntsc, pal, multi or dendy): " + value); }
+        correction.fields |= TIMING;
+    }
+    else {
+        failLine(line_number, "unknown field: " + name); }
+}
+
+bool HeaderDatabase::apply(const uint32_t& crc32, const Sha1::Digest& sha1, Cartridge::Header& header) const {
+    auto match = corrections.find(toHex(sha1.data(), sha1.size()));
+    if (match == corrections.end()) {
+        const uint8_t crc_bytes[] = { (uint8_t)(crc32 >> 24), (uint8_t)(crc32 >> 16), (uint8_t)(crc32 >> 8), (uint8_t)crc32 };
+        match = corrections.find(toHex(crc_bytes, sizeof(crc_bytes)));
+    }
+    if (match == corrections.end()) {
+        return false; }
+
+    const Correction& correction = match->second;
+    const Cartridge::Header& values = correction.values;
+    if (correction.fields & MAPPER) {
+        header.mapper_number = values.mapper_number; }
+    if (correction.fields & SUBMAPPER) {
+        header.submapper = values.submapper; }
+    if (correction.fields & MIRRORING) {
+        header.mirroring = values.mirroring;
+        header.four_screen = values.four_screen;
+    }
+    if (correction.fields & BATTERY) {
+        header.battery = values.battery; }
+    if (correction.fields & PRG_ROM) {
+        header.prg_rom_size = values.prg_rom_size; }
+    if (correction.fields & CHR_ROM) {
+        header.chr_rom_size = values.chr_rom_size; }
+    if (correction.fields & PRG_RAM) {
+        header.prg_ram_size = values.prg_ram_size; }
+    if (correction.fields & PRG_NVRAM) {
+        header.prg_nvram_size = values.prg_nvram_size; }
+    if (correction.fields & CHR_RAM) {
+        header.chr_ram_size = values.chr_ram_size; }
+    if (correction.fields & CHR_NVRAM) {
+        header.chr_nvram_size = values.chr_nvram_size; }
+    if (correction.fields & TIMING) {
+        header.timing = values.timing; }
+    return true;
+}
@@ -0,0 +1,73 @@
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "InputScript.hpp"
+#include "Controller.hpp"
+
+void InputScript::load(const std::string& script_path) {
+    std::ifstream script(script_path);
+    if (script.fail()) {
+        std::cerr << "Couldn't open input script: " << script_path << std::endl;
+        throw std::runtime_error("Failed ifstream");
+    }
+
+    entries.clear();
+    std::string line;
+    for (int line_number = 1; std::getline(script, line); ++line_number) {
+        std::istringstream fields(line);
+        std::string frame, controller_1, controller_2;
+        fields >> frame;
+        if (frame.empty()
+             || frame[0] == '#') {
+            continue; }
+        fields >> controller_1 >> controller_2;
+
+        Entry entry;
+        try {
+            entry.frame = std::stoull(frame); }
+        catch (const std::logic_error&) {
+            std::cerr << "Input script line " << line_number << ": invalid frame number: " << frame << std::endl;
+            throw std::runtime_error("Invalid input script");
+        }
+        if (!entries.empty()
+             && entry.frame <= entries.back().frame) {
+            std::cerr << "Input script line " << line_number << ": frames must increase." << std::endl;
+            throw std::runtime_error("Invalid input script");
+        }
+        entry.buttons[0] = parseButtons(controller_1, line_number);
+        entry.buttons[1] = controller_2.empty() ? 0 : parseButtons(controller_2, line_number);
+        entries.push_back(entry);
+    }
+}
+
+uint8_t InputScript::parseButtons(const std::string& field, const int& line_number) const {
+    // In the script's order: RLDUTSBA
+    static constexpr Controller::Button order[] = {
+        Controller::RIGHT, Controller::LEFT, Controller::DOWN, Controller::UP,
+        Controller::START, Controller::SELECT, Controller::B, Controller::A
+    };
+
+    if (field.size() != 8) {
+        std::cerr << "Input script line " << line_number << ": expected 8 buttons (RLDUTSBA), got: " << field << std::endl;
+        throw std::runtime_error("Invalid input script");
+    }
+
+    uint8_t buttons = 0;
+    for (int i = 0; i < 8; ++i) {
+        if (field[i] != '.') {
+            buttons |= order[i]; }
+    }
+    return buttons;
+}
+
+uint8_t InputScript::buttons(const uint64_t& frame, const int& controller) const {
+    // Last entry at or before 'frame'.
+    const auto next = std::upper_bound(entries.begin(), entries.end(), frame,
+        [](const uint64_t& frame, const Entry& entry) { return frame < entry.frame; });
+    if (next == entries.begin()) {
+        return 0; }
+    return std::prev(next)->buttons[controller];
+}
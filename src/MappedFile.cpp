@@ -0,0 +1,104 @@
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+#include "MappedFile.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+    #define TURBONES_MAP_POSIX 1
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#else
+    #define TURBONES_MAP_POSIX 0
+#endif
+
+#if defined(_WIN32)
+    #define TURBONES_MAP_WINDOWS 1
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #define TURBONES_MAP_WINDOWS 0
+#endif
+
+namespace {
+
+void failOpen(const std::string& path) {
+    std::cerr << "Couldn't open file: " << path << std::endl;
+    throw std::runtime_error("Failed to open file");
+}
+
+}
+
+MappedFile::MappedFile(const std::string& path) {
+#if TURBONES_MAP_POSIX
+    const int descriptor = open(path.c_str(), O_RDONLY);
+    struct stat status;
+    if (descriptor < 0
+         || fstat(descriptor, &status) != 0
+         || !S_ISREG(status.st_mode)) {
+        if (descriptor >= 0) {
+            close(descriptor); }
+        failOpen(path);
+    }
+
+    length = (size_t)status.st_size;
+    if (length > 0) { // Empty files can't be mapped, and have nothing to map.
+        void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if (mapping == MAP_FAILED) {
+            close(descriptor);
+            failOpen(path);
+        }
+        bytes = static_cast<const uint8_t*>(mapping);
+    }
+    close(descriptor); // The mapping holds the file open.
+#elif TURBONES_MAP_WINDOWS
+    const HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                    FILE_ATTRIBUTE_NORMAL, nullptr);
+    LARGE_INTEGER file_size;
+    if (file == INVALID_HANDLE_VALUE
+         || !GetFileSizeEx(file, &file_size)) {
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file); }
+        failOpen(path);
+    }
+
+    length = (size_t)file_size.QuadPart;
+    if (length > 0) {
+        handle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        const void* view = (handle != nullptr) ? MapViewOfFile(handle, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (view == nullptr) {
+            if (handle != nullptr) {
+                CloseHandle(handle); }
+            CloseHandle(file);
+            failOpen(path);
+        }
+        bytes = static_cast<const uint8_t*>(view);
+    }
+    CloseHandle(file); // The mapping holds the file open.
+#else
+    std::ifstream file(path, std::ios::binary);
+    if (file.fail()) {
+        failOpen(path); }
+    copy.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if (file.bad()) {
+        failOpen(path); }
+    bytes = copy.data();
+    length = copy.size();
+#endif
+}
+
+MappedFile::~MappedFile() {
+#if TURBONES_MAP_POSIX
+    if (bytes != nullptr) {
+        munmap(const_cast<uint8_t*>(bytes), length); }
+#elif TURBONES_MAP_WINDOWS
+    if (bytes != nullptr) {
+        UnmapViewOfFile(bytes);
+        CloseHandle(handle);
+    }
+#endif
+}
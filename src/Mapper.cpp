@@ -0,0 +1,207 @@
+#include <iostream>
+#include <stdexcept>
+
+#include "Mapper.hpp"
+#include "CPU.hpp"
+#include "Mapper0.hpp"
+#include "Mapper1.hpp"
+#include "Mapper2.hpp"
+#include "Mapper3.hpp"
+#include "Mapper4.hpp"
+#include "Mapper7.hpp"
+#include "Memory.hpp"
+
+std::unique_ptr<Mapper> Mapper::create(const Cartridge::Header& header) {
+    switch (header.mapper_number) {
+        case NROM:  return std::unique_ptr<Mapper>(new Mapper0());
+        case MMC1:  return std::unique_ptr<Mapper>(new Mapper1());
+        case UXROM: return std::unique_ptr<Mapper>(new Mapper2());
+        case CNROM: return std::unique_ptr<Mapper>(new Mapper3());
+        case MMC3:  return std::unique_ptr<Mapper>(new Mapper4());
+        case AXROM: return std::unique_ptr<Mapper>(new Mapper7());
+        default:
+            std::cerr << "Unsupported mapper: " << header.mapper_number << std::endl;
+            throw std::runtime_error("Unsupported mapper");
+    }
+}
+
+void Mapper::load(Cartridge* cartridge, Memory* memory, PPU* ppu, CPU* cpu, Scheduler* scheduler) {
+    this->cart = cartridge;
+    this->memory = memory;
+    this->ppu = ppu;
+    this->cpu = cpu;
+    this->scheduler = scheduler;
+
+    if (cart->prg_rom.empty()
+         || cart->prg_rom.size() % PRG_BANK_SIZE != 0) {
+        std::cerr << "Unsupported PRG ROM size: " << cart->prg_rom.size() << " bytes (expected a multiple of 8 KB)" << std::endl;
+        throw std::runtime_error("Unsupported PRG ROM size");
+    }
+
+    const Cartridge::Header& header = cart->header;
+    bus_conflicts = header.submapper == 2
+                 && (mapper_type == UXROM || mapper_type == CNROM || mapper_type == AXROM);
+
+    // Work RAM and battery backed RAM are banked together, e.g. 8 KB of each on SOROM.
+    const size_t prg_ram_size = (size_t)header.prg_ram_size + header.prg_nvram_size;
+    prg_ram.assign((prg_ram_size + PRG_BANK_SIZE - 1) / PRG_BANK_SIZE * PRG_BANK_SIZE, 0);
+    prg_ram_access = PRG_RAM_DISABLED;
+    prg_ram_bank = 0;
+    if (prgRamBanks() > 1
+         && mapper_type != MMC1) {
+        std::cerr << "Only the first 8 KB of this cartridge's " << prg_ram.size() / 1024
+            << " KB of PRG RAM can be mapped on this mapper" << std::endl;
+    }
+    memory->unmap(0x6000, 0xA000);
+
+    powerOn();
+}
+
+void Mapper::powerOn() {
+    // Enabled, unless the mapper's reset says otherwise.
+    mapPrgRam(PRG_RAM_ENABLED);
+
+    switch (mapper_type) {
+        case NROM:  static_cast<Mapper0*>(this)->reset(); break;
+        case MMC1:  static_cast<Mapper1*>(this)->reset(); break;
+        case UXROM: static_cast<Mapper2*>(this)->reset(); break;
+        case CNROM: static_cast<Mapper3*>(this)->reset(); break;
+        case MMC3:  static_cast<Mapper4*>(this)->reset(); break;
+        case AXROM: static_cast<Mapper7*>(this)->reset(); break;
+    }
+}
+
+void Mapper::write(const uint16_t& address, const uint8_t& value) {
+    switch (mapper_type) {
+        case NROM:  static_cast<Mapper0*>(this)->writeRegister(address, value); break;
+        case MMC1:  static_cast<Mapper1*>(this)->writeRegister(address, value); break;
+        case UXROM: static_cast<Mapper2*>(this)->writeRegister(address, value); break;
+        case CNROM: static_cast<Mapper3*>(this)->writeRegister(address, value); break;
+        case MMC3:  static_cast<Mapper4*>(this)->writeRegister(address, value); break;
+        case AXROM: static_cast<Mapper7*>(this)->writeRegister(address, value); break;
+    }
+}
+
+void Mapper::handleEvent() {
+    if (mapper_type == MMC3) {
+        static_cast<Mapper4*>(this)->handleEvent(); }
+}
+
+void Mapper::syncPPU() {
+    if (mapper_type == MMC3) {
+        static_cast<Mapper4*>(this)->syncCounter(cpu->accessCycle()); }
+}
+
+void Mapper::ppuSettingsChanged() {
+    if (mapper_type == MMC3) {
+        static_cast<Mapper4*>(this)->reschedule(); }
+}
+
+void Mapper::saveState(StateWriter& out) const {
+    // Offsets into PRG ROM, as the pointers are only good for this run.
+    std::array<uint32_t, 4> prg_banks;
+    for (size_t i = 0; i < prg_banks.size(); ++i) {
+        const uint8_t* rom = memory->romPointer(0x8000 + (uint16_t)(i * PRG_BANK_SIZE));
+        prg_banks[i] = (rom != nullptr) ? (uint32_t)(rom - cart->prg_rom.data()) : UINT32_MAX;
+    }
+    out.put(prg_banks);
+    out.put(prg_ram_access);
+    out.put(prg_ram_bank);
+    out.bytes(prg_ram.data(), prg_ram.size());
+
+    switch (mapper_type) {
+        case MMC1: static_cast<const Mapper1*>(this)->saveState(out); break;
+        case MMC3: static_cast<const Mapper4*>(this)->saveState(out); break;
+        default:   break;
+    }
+}
+
+void Mapper::loadState(StateReader& in) {
+    std::array<uint32_t, 4> prg_banks;
+    in.get(prg_banks);
+    for (size_t i = 0; i < prg_banks.size(); ++i) {
+        const uint16_t window = 0x8000 + (uint16_t)(i * PRG_BANK_SIZE);
+        if (prg_banks[i] == UINT32_MAX) {
+            memory->unmap(window, PRG_BANK_SIZE); }
+        else if (memory->romPointer(window) != cart->prg_rom.data() + prg_banks[i]) {
+            memory->mapRead(window, cart->prg_rom.data() + prg_banks[i], PRG_BANK_SIZE); }
+    }
+    PrgRamAccess access;
+    uint8_t bank;
+    in.get(access);
+    in.get(bank);
+    if (!prg_ram.empty()
+         && (access != prg_ram_access || bank != prg_ram_bank)) {
+        prg_ram_access = access;
+        prg_ram_bank = (uint8_t)(bank % prgRamBanks());
+        remapPrgRam();
+    }
+    in.bytes(prg_ram.data(), prg_ram.size());
+
+    switch (mapper_type) {
+        case MMC1: static_cast<Mapper1*>(this)->loadState(in); break;
+        case MMC3: static_cast<Mapper4*>(this)->loadState(in); break;
+        default:   break;
+    }
+}
+
+void Mapper::mapPrg(const uint16_t& address, const size_t& size, const int& bank) {
+    const int pages = (int)(cart->prg_rom.size() / PRG_BANK_SIZE),
+              pages_per_bank = (int)(size / PRG_BANK_SIZE);
+    for (int i = 0; i < pages_per_bank; ++i) {
+        int page = ((bank * pages_per_bank) + i) % pages;
+        if (page < 0) {
+            page += pages; }
+
+        const uint16_t window = address + (i * PRG_BANK_SIZE);
+        const uint8_t* data = cart->prg_rom.data() + ((size_t)page * PRG_BANK_SIZE);
+        // Remapping the same bank would still count as a change of mappings, and cut short the block running.
+        if (memory->romPointer(window) != data) {
+            memory->mapRead(window, data, PRG_BANK_SIZE); }
+    }
+}
+
+void Mapper::mapPrgRam(const PrgRamAccess& access) {
+    if (prg_ram.empty()
+         || access == prg_ram_access) {
+        return; }
+
+    prg_ram_access = access;
+    remapPrgRam();
+}
+
+void Mapper::selectPrgRamBank(const int& bank) {
+    if (prg_ram.empty()) {
+        return; }
+    const uint8_t selected = (uint8_t)(bank % prgRamBanks());
+    if (selected == prg_ram_bank) {
+        return; }
+
+    prg_ram_bank = selected;
+    remapPrgRam();
+}
+
+void Mapper::remapPrgRam() {
+    uint8_t* data = prg_ram.data() + (size_t)prg_ram_bank * PRG_BANK_SIZE;
+    switch (prg_ram_access) {
+        case PRG_RAM_DISABLED:  memory->unmap(0x6000, PRG_BANK_SIZE);               break;
+        case PRG_RAM_READ_ONLY: memory->mapRead(0x6000, data, PRG_BANK_SIZE);       break;
+        case PRG_RAM_ENABLED:   memory->mapReadWrite(0x6000, data, PRG_BANK_SIZE); break;
+    }
+}
+
+void Mapper::mapChr(const uint16_t& address, const size_t& size, const int& bank) {
+    ppu->mapChr(address, ((size_t)bank * size) % ppu->chrSize(), size);
+}
+
+void Mapper::setMirroring(const PPU::Mirroring& mirroring) {
+    if (!cart->header.four_screen) {
+        ppu->setMirroring(mirroring); }
+}
+
+uint8_t Mapper::busConflict(const uint16_t& address, const uint8_t& value) const {
+    if (!bus_conflicts) {
+        return value; }
+    const uint8_t* rom = memory->romPointer(address);
+    return (rom != nullptr) ? (value & *rom) : value;
+}
@@ -1,27 +1,9 @@
-#include <iostream>
-
 #include "Mapper0.hpp"
 
-void Mapper0::load(Cartridge* cartridge) {
-    this->cart = cartridge;
-
-    prg_mirrored = (cart->prg_rom.size() == Cartridge::PRG_PAGE_SIZE);
-}
-
-uint8_t Mapper0::read(const uint16_t& address) {
-    if        (address < 0x6000) {
-        std::cerr << "Mapper0 read out of bounds: " << std::hex << (int)address << std::endl;
-    } else if (address < 0xC000) {
-        return cart->prg_rom[address % 0x8000];
-    } else { // (address >= 0xC000)
-        if (prg_mirrored) {
-            return cart->prg_rom[address % Cartridge::PRG_PAGE_SIZE]; }
-        else {
-            return cart->prg_rom[address % 0x8000]; }
-    }
-}
-
-void Mapper0::write(const uint16_t& address, const uint8_t& value) {
-    // TODO
-    std::cerr << "Mapper0::write called." << std::endl;
+void Mapper0::reset() {
+    // $8000-$BFFF: First 16 KB of PRG ROM.
+    // $C000-$FFFF: Last  16 KB of PRG ROM, or a mirror of $8000-$BFFF if there's only 16 KB.
+    mapPrg(0x8000, 0x4000, 0);
+    mapPrg(0xC000, 0x4000, 1);
+    mapChr(0x0000, 0x2000, 0);
 }
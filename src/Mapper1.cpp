@@ -0,0 +1,98 @@
+#include "Mapper1.hpp"
+#include "CPU.hpp"
+
+void Mapper1::reset() {
+    shift_register = 0;
+    shift_count = 0;
+    control = 0x0C; // Last bank fixed at $C000, so the reset vector is found.
+    chr_bank_0 = 0;
+    chr_bank_1 = 0;
+    prg_bank = 0;
+    last_write_cycle = 0;
+    updateBanks();
+}
+
+void Mapper1::writeRegister(const uint16_t& address, const uint8_t& value) {
+    if (address < 0x8000) {
+        return; }
+
+    const uint64_t cycle = cpu->cycleCount();
+    const bool consecutive = (cycle <= last_write_cycle + 1);
+    last_write_cycle = cycle;
+    if (consecutive) {
+        return; }
+
+    if (value & 0x80) {
+        shift_register = 0;
+        shift_count = 0;
+        control |= 0x0C;
+        updateBanks();
+        return;
+    }
+
+    shift_register |= (value & 1) << shift_count;
+    if (++shift_count < 5) {
+        return; }
+
+    switch (address & 0xE000) {
+        case 0x8000: control    = shift_register; break;
+        case 0xA000: chr_bank_0 = shift_register; break;
+        case 0xC000: chr_bank_1 = shift_register; break;
+        default:     prg_bank   = shift_register; break;
+    }
+    shift_register = 0;
+    shift_count = 0;
+    updateBanks();
+}
+
+void Mapper1::updateBanks() {
+    // In 16 KB banks.
+    const int outer = (cart->prg_rom.size() > 0x40000) ? (chr_bank_0 & 0x10) : 0,
+              bank  = outer | (prg_bank & 0x0F);
+    switch ((control >> 2) & 0x3) {
+        case 0:
+        case 1:
+            mapPrg(0x8000, 0x8000, bank >> 1);
+            break;
+        case 2:
+            mapPrg(0x8000, 0x4000, outer);
+            mapPrg(0xC000, 0x4000, bank);
+            break;
+        default:
+            mapPrg(0x8000, 0x4000, bank);
+            mapPrg(0xC000, 0x4000, outer | 0x0F);
+            break;
+    }
+
+    if (control & 0x10) {
+        mapChr(0x0000, 0x1000, chr_bank_0);
+        mapChr(0x1000, 0x1000, chr_bank_1);
+    } else {
+        mapChr(0x0000, 0x2000, chr_bank_0 >> 1);
+    }
+
+    static const PPU::Mirroring MIRRORING[] = { PPU::SINGLE_SCREEN_LOW, PPU::SINGLE_SCREEN_HIGH, PPU::VERTICAL, PPU::HORIZONTAL };
+    setMirroring(MIRRORING[control & 0x3]);
+
+    // SOROM's 16 KB of PRG RAM is banked by bit 3 of CHR bank 0, and SXROM's 32 KB by bits 2-3.
+    selectPrgRamBank((prgRamBanks() > 2) ? (chr_bank_0 >> 2) & 0x3 : (chr_bank_0 >> 3) & 0x1);
+    mapPrgRam((prg_bank & 0x10) ? PRG_RAM_DISABLED : PRG_RAM_ENABLED);
+}
+
+void Mapper1::saveState(StateWriter& out) const {
+    const uint8_t registers[] = { shift_register, shift_count, control, chr_bank_0, chr_bank_1, prg_bank };
+    out.put(registers);
+    out.put(last_write_cycle);
+}
+
+void Mapper1::loadState(StateReader& in) {
+    uint8_t registers[6];
+    in.get(registers);
+    shift_register = registers[0];
+    shift_count    = registers[1];
+    control        = registers[2];
+    chr_bank_0     = registers[3];
+    chr_bank_1     = registers[4];
+    prg_bank       = registers[5];
+    in.get(last_write_cycle);
+}
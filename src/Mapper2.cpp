@@ -0,0 +1,12 @@
+#include "Mapper2.hpp"
+
+void Mapper2::reset() {
+    mapPrg(0x8000, 0x4000, 0);
+    mapPrg(0xC000, 0x4000, -1);
+    mapChr(0x0000, 0x2000, 0);
+}
+
+void Mapper2::writeRegister(const uint16_t& address, const uint8_t& value) {
+    if (address >= 0x8000) {
+        mapPrg(0x8000, 0x4000, busConflict(address, value)); }
+}
@@ -0,0 +1,144 @@
+#include <algorithm>
+
+#include "Mapper4.hpp"
+#include "CPU.hpp"
+#include "Scheduler.hpp"
+
+void Mapper4::reset() {
+    bank_select = 0;
+    bank_registers = { 0, 2, 4, 5, 6, 7, 0, 1 };
+    prg_ram_protect = 0x80; // Enabled and writable, as boards without protection behave.
+    irq_latch = 0;
+    irq_counter = 0;
+    irq_reload = false;
+    irq_enabled = false;
+    synced_dot = cpu->cycleCount() * 3;
+    cpu->setIRQ(CPU::IRQ_MAPPER, false);
+    scheduler->cancel(Scheduler::MAPPER_EVENT);
+
+    setMirroring(PPU::VERTICAL);
+    updateBanks();
+}
+
+void Mapper4::writeRegister(const uint16_t& address, const uint8_t& value) {
+    const bool odd = (address & 1) != 0;
+    switch (address & 0xE000) {
+        case 0x8000:
+            if (odd) {
+                bank_registers[bank_select & 0x7] = value; }
+            else {
+                bank_select = value; }
+            updateBanks();
+            break;
+        case 0xA000:
+            if (odd) {
+                prg_ram_protect = value;
+                mapPrgRam(!(value & 0x80) ? PRG_RAM_DISABLED
+                                          : ((value & 0x40) ? PRG_RAM_READ_ONLY : PRG_RAM_ENABLED));
+            } else {
+                setMirroring((value & 1) ? PPU::HORIZONTAL : PPU::VERTICAL);
+            }
+            break;
+        case 0xC000:
+            syncCounter(cpu->accessCycle());
+            if (odd) {
+                irq_reload = true; }
+            else {
+                irq_latch = value; }
+            reschedule();
+            break;
+        case 0xE000:
+            syncCounter(cpu->accessCycle());
+            irq_enabled = odd;
+            if (!irq_enabled) { // Also acknowledges a pending IRQ.
+                cpu->setIRQ(CPU::IRQ_MAPPER, false); }
+            reschedule();
+            break;
+        default: // PRG RAM, while it's disabled or write protected.
+            break;
+    }
+}
+
+void Mapper4::updateBanks() {
+    // PRG ROM: R6 and the second to last bank swap places with the mode. R7 and the last bank stay put.
+    const bool prg_swapped = (bank_select & 0x40) != 0;
+    mapPrg(0x8000, 0x2000, prg_swapped ? -2 : bank_registers[6]);
+    mapPrg(0xA000, 0x2000, bank_registers[7]);
+    mapPrg(0xC000, 0x2000, prg_swapped ? bank_registers[6] : -2);
+    mapPrg(0xE000, 0x2000, -1);
+
+    // CHR: two 2 KB banks and four 1 KB banks, the halves swapped by the inversion.
+    const uint16_t inversion = (bank_select & 0x80) ? 0x1000 : 0x0000;
+    mapChr(0x0000 ^ inversion, 0x800, bank_registers[0] >> 1);
+    mapChr(0x0800 ^ inversion, 0x800, bank_registers[1] >> 1);
+    mapChr(0x1000 ^ inversion, 0x400, bank_registers[2]);
+    mapChr(0x1400 ^ inversion, 0x400, bank_registers[3]);
+    mapChr(0x1800 ^ inversion, 0x400, bank_registers[4]);
+    mapChr(0x1C00 ^ inversion, 0x400, bank_registers[5]);
+}
+
+void Mapper4::handleEvent() {
+    syncCounter(cpu->cycleCount());
+    reschedule();
+}
+
+void Mapper4::syncCounter(const uint64_t& cycle) {
+    const uint64_t now = cycle * 3;
+    uint64_t clocks = ppu->a12Rises(synced_dot, now);
+    synced_dot = std::max(synced_dot, now);
+
+    while (clocks > 0) {
+        if (irq_counter == 0
+             || irq_reload) {
+            irq_counter = irq_latch;
+            irq_reload = false;
+        } else {
+            --irq_counter;
+        }
+        --clocks;
+
+        if (irq_counter == 0) {
+            if (irq_enabled) {
+                cpu->setIRQ(CPU::IRQ_MAPPER, true); }
+            // From 0, the counter comes back to 0 every latch + 1 clocks, so whole rounds change nothing.
+            clocks %= (uint64_t)irq_latch + 1;
+        }
+    }
+}
+
+void Mapper4::reschedule() {
+    if (!irq_enabled) {
+        scheduler->cancel(Scheduler::MAPPER_EVENT);
+        return;
+    }
+
+    // Clocks until the counter reaches 0: from a reload, the latch takes one clock to load, then counts down.
+    const uint64_t clocks = (irq_reload || irq_counter == 0) ? (uint64_t)irq_latch + 1 : irq_counter;
+    const uint64_t dot = ppu->a12RiseDot(synced_dot, clocks);
+    if (dot == Scheduler::NEVER) {
+        scheduler->cancel(Scheduler::MAPPER_EVENT); }
+    else {
+        scheduler->schedule(Scheduler::MAPPER_EVENT, (dot + 2) / 3); } // The first CPU cycle at or after the rise.
+}
+
+void Mapper4::saveState(StateWriter& out) const {
+    out.put(bank_select);
+    out.put(bank_registers);
+    out.put(prg_ram_protect);
+    out.put(irq_latch);
+    out.put(irq_counter);
+    out.put(irq_reload);
+    out.put(irq_enabled);
+    out.put(synced_dot);
+}
+
+void Mapper4::loadState(StateReader& in) {
+    in.get(bank_select);
+    in.get(bank_registers);
+    in.get(prg_ram_protect);
+    in.get(irq_latch);
+    in.get(irq_counter);
+    in.get(irq_reload);
+    in.get(irq_enabled);
+    in.get(synced_dot);
+}
@@ -0,0 +1,16 @@
+#include "Mapper7.hpp"
+
+void Mapper7::reset() {
+    mapPrg(0x8000, 0x8000, 0);
+    mapChr(0x0000, 0x2000, 0);
+    setMirroring(PPU::SINGLE_SCREEN_LOW);
+}
+
+void Mapper7::writeRegister(const uint16_t& address, const uint8_t& value) {
+    if (address < 0x8000) {
+        return; }
+
+    const uint8_t selected = busConflict(address, value);
+    mapPrg(0x8000, 0x8000, selected & 0x07);
+    setMirroring((selected & 0x10) ? PPU::SINGLE_SCREEN_HIGH : PPU::SINGLE_SCREEN_LOW);
+}
@@ -1,51 +1,141 @@
 #include <iostream>
 
 #include "Memory.hpp"
+#include "CPU.hpp"
 
-Memory::Memory(Mapper0* mapper, PPU* ppu) {
-    this->mapper = mapper;
+Memory::Memory(PPU* ppu, APU* apu, Controller* controller_1, Controller* controller_2) {
     this->ppu = ppu;
+    this->apu = apu;
+    this->controller_1 = controller_1;
+    this->controller_2 = controller_2;
+
+    unmap(0x0000, PAGE_SIZE * PAGE_COUNT);
+
+    // Internal RAM, and its mirrors.
+    for (int address = 0x0000; address < 0x2000; address += (int)ram.size()) {
+        mapReadWrite(address, ram.data(), ram.size()); }
+}
+
+void Memory::setCPU(CPU* cpu) {
+    this->cpu = cpu;
+}
+
+void Memory::setMapper(Mapper* mapper) {
+    this->mapper = mapper;
+}
+
+void Memory::mapRead(const uint16_t& address, const uint8_t* data, const size_t& size) {
+    ++mapping_generation;
+    const int first = address / PAGE_SIZE;
+    for (size_t i = 0; i < size / PAGE_SIZE; ++i) {
+        pages[first + i].read  = data + (i * PAGE_SIZE);
+        pages[first + i].write = nullptr;
+    }
+}
+
+void Memory::mapReadWrite(const uint16_t& address, uint8_t* data, const size_t& size) {
+    ++mapping_generation;
+    const int first = address / PAGE_SIZE;
+    for (size_t i = 0; i < size / PAGE_SIZE; ++i) {
+        pages[first + i].read  = data + (i * PAGE_SIZE);
+        pages[first + i].write = data + (i * PAGE_SIZE);
+    }
 }
 
-uint8_t Memory::read(const uint16_t& address) {
-    if        (address <  0x2000) {
-        return ram[address % 0x800];
-    } else if (address <  0x4000) {
+void Memory::unmap(const uint16_t& address, const size_t& size) {
+    ++mapping_generation;
+    const int first = address / PAGE_SIZE;
+    for (size_t i = 0; i < size / PAGE_SIZE; ++i) {
+        pages[first + i].read  = nullptr;
+        pages[first + i].write = nullptr;
+    }
+}
+
+void Memory::saveState(StateWriter& out) const {
+    out.put(ram);
+}
+
+void Memory::loadState(StateReader& in) {
+    in.get(ram);
+}
+
+// RAM, PRG ROM and PRG RAM are mapped, so never get here.
+uint8_t Memory::readIO(const uint16_t& address) {
+    if        (address <  0x4000) {
+        ppu->catchUp(cpu->accessCycle());
         return ppu->readRegister(0x2000 + (address % 8));
     } else if (address == 0x4014) {
-        ppu->readRegister(address);
+        ppu->catchUp(cpu->accessCycle());
+        return ppu->readRegister(address);
     } else if (address == 0x4015) {
-        // apu->readRegister(address);
+        apu->catchUp(cpu->accessCycle());
+        return apu->readStatus();
     } else if (address == 0x4016) {
-        // Controller 1
+        return 0x40 | controller_1->read(); // Upper bits are open bus, usually the high byte of the address.
     } else if (address == 0x4017) {
-        // Controller 2
-    } else if (address >= 0x6000) {
-        return mapper->read(address);
+        return 0x40 | controller_2->read();
+    } else if (address >= 0x4020) {
+        return address >> 8; // Nothing's there, so open bus: usually the high byte of the address.
     } else {
         std::cerr << "Unhandled memory read at: " << std::hex << (int)address << std::endl;
     }
+
+    return 0;
 }
 
-void Memory::write(const uint16_t& address, const uint8_t& value) {
-    if        (address <  0x2000) {
-        ram[address % 0x800] = value;
-    } else if (address <  0x4000) {
+void Memory::writeIO(const uint16_t& address, const uint8_t& value) {
+    if        (address <  0x4000) {
+        ppu->catchUp(cpu->accessCycle());
+        // PPUCTRL and PPUMASK decide when the PPU fetches from which pattern table, which mappers may count.
+        if ((address % 8) <= 1
+             && mapper != nullptr) {
+            mapper->syncPPU();
+            ppu->writeRegister(0x2000 + (address % 8), value);
+            mapper->ppuSettingsChanged();
+            return;
+        }
         return ppu->writeRegister(0x2000 + (address % 8), value);
     } else if (address <= 0x4013) {
-        // apu->writeRegister(address, value);
+        apu->catchUp(cpu->accessCycle());
+        apu->writeRegister(address, value);
     } else if (address == 0x4014) {
-        ppu->writeRegister(address, value);
+        writeOAMDMA(value);
     } else if (address == 0x4015) {
-        // apu->writeRegister(address, value);
+        apu->catchUp(cpu->accessCycle());
+        apu->writeRegister(address, value);
     } else if (address == 0x4016) {
-        // Controllers
+        controller_1->write(value);
+        controller_2->write(value);
     } else if (address == 0x4017) {
-        // apu->writeRegister(address, value);
-    } else if (address >= 0x6000) {
-        return mapper->write(address, value);
+        apu->catchUp(cpu->accessCycle());
+        apu->writeRegister(address, value);
+    } else if (address >= 0x4020) {
+        // Mappers may switch CHR banks or mirroring, so the PPU must have drawn everything before the write.
+        if (mapper != nullptr) {
+            ppu->catchUp(cpu->accessCycle());
+            mapper->write(address, value);
+        }
     } else {
         std::cerr << "Unhandled memory write at: " << std::hex << (int)address
             << "\nwith value: " << (int)value << std::endl;
     }
-}
\ No newline at end of file
+}
+
+void Memory::writeOAMDMA(const uint8_t& page) {
+    ppu->catchUp(cpu->accessCycle());
+
+    // Games do this every frame, from RAM (or, rarely, ROM), which is backed by host memory: copied in one go.
+    // Only a page on the I/O path is read byte by byte, for the side effects of reading registers.
+    const uint8_t* source = pages[page].read;
+    std::array<uint8_t, PAGE_SIZE> bus;
+    if (source == nullptr) {
+        for (int i = 0; i < PAGE_SIZE; ++i) {
+            bus[i] = read((page << 8) | i); }
+        source = bus.data();
+    }
+    ppu->writeOAMDMA(source);
+
+    // The CPU halts for a cycle, another if the write was on an odd cycle (DMA reads on even ones),
+    // then a read and a write per byte.
+    cpu->stall(513 + (int)(cpu->accessCycle() & 1));
+}
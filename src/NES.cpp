@@ -1,27 +1,218 @@
+#include <algorithm>
 #include <iostream>
+#include <stdexcept>
 
 #include "NES.hpp"
+#include "Checksum.hpp"
+#include "Hash.hpp"
 
-NES::NES() : memory(&mapper, &ppu), cpu(&memory) {
-
+NES::NES() : memory(&ppu, &apu, &controllers[0], &controllers[1]), recompiler(&memory), cpu(&memory, &tracer) {
+    memory.setCPU(&cpu);
+    cpu.setScheduler(&scheduler);
+    ppu.setScheduler(&scheduler);
+    apu.setCPU(&cpu);
+    apu.setMemory(&memory);
+    apu.setScheduler(&scheduler);
 }
 
 void NES::load(const std::string& rom_path) {
-    cart = Cartridge(rom_path);
-    mapper.load(&cart);
+    insert(Cartridge(rom_path));
+}
+
+void NES::load(const std::string& rom_path, const Cartridge::Header& header) {
+    insert(Cartridge(rom_path, header));
+}
+
+void NES::insert(const Cartridge& cartridge) {
+    std::unique_ptr<Mapper> inserted = Mapper::create(cartridge.header);
+    cart = cartridge;
+    ppu.load(&cart);
+    inserted->load(&cart, &memory, &ppu, &cpu, &scheduler);
+    mapper = std::move(inserted);
+    memory.setMapper(mapper.get());
+    cpu.resetBlockCache(cart.prg_rom.data(), cart.prg_rom.size());
+
+    rom_crc32 = updateCrc32(updateCrc32(0, cart.prg_rom.data(), cart.prg_rom.size()),
+                            cart.chr_rom.data(), cart.chr_rom.size());
+    StateWriter counter(nullptr);
+    writeState(counter);
+    state_size = counter.size();
+    std::cout << "File loaded." << std::endl;
+}
+
+void NES::trace(const std::string& log_path) {
+    tracer.start(log_path, Tracer::INSTRUCTIONS);
+}
+
+void NES::enableRecompiler() {
+    if (!Recompiler::isSupported()) {
+        std::cerr << "Recompiler isn't supported on this platform. Interpreting instead." << std::endl;
+        return;
+    }
+    cpu.setRecompiler(&recompiler);
+}
+
+void NES::setPPUEngine(const PPU::Engine& engine) {
+    ppu.setEngine(engine);
 }
 
-void NES::run() {
+void NES::powerOn() {
+    scheduler.reset();
     cpu.powerOn();
     ppu.powerOn();
+    apu.powerOn();
+    if (mapper) {
+        mapper->powerOn(); }
+}
+
+void NES::runFrame(const uint64_t& cycle_limit) {
+    const uint64_t frame = ppu.frameCount();
+    while (ppu.frameCount() == frame
+            && cpu.cycleCount() < cycle_limit) {
+        // The CPU runs ahead of every other component, up to the next scheduled event.
+        // The deadline is read again after each step, as an access may schedule an earlier event (e.g. NMI).
+        while (cpu.cycleCount() < std::min(scheduler.nextEventCycle(), cycle_limit)) {
+            step(cycle_limit); }
+        handleEvents();
+    }
+
+    // The frame's audio, up to where the CPU stopped.
+    apu.catchUp(cpu.cycleCount());
+    cpu.stall(apu.takeStallCycles());
+    apu.endFrame();
+}
+
+void NES::handleEvents() {
+    Scheduler::Event event;
+    while (scheduler.pop(cpu.cycleCount(), event)) {
+        switch (event) {
+            case Scheduler::PPU_EVENT:
+                // The PPU only runs when the CPU accesses it (see Memory), and here, to handle the event.
+                // Catching up schedules its next one.
+                ppu.catchUp(cpu.cycleCount());
+                break;
+            case Scheduler::NMI:
+                cpu.requestNMI();
+                break;
+            case Scheduler::APU_EVENT:
+                apu.catchUp(cpu.cycleCount());
+                break;
+            case Scheduler::MAPPER_EVENT:
+                mapper->handleEvent();
+                break;
+            default:
+                break;
+        }
+    }
+    // DMC sample fetches take the bus from the CPU.
+    cpu.stall(apu.takeStallCycles());
+}
+
+void NES::step(const uint64_t& cycle_limit) {
+    cpu.step(std::min(scheduler.nextEventCycle(), cycle_limit));
+    // Read again, as an access may have scheduled an earlier event.
+    const uint64_t deadline = std::min(scheduler.nextEventCycle(), cycle_limit);
+
+    // Fast-forward through an idle loop, up to the iteration that may observe the next event.
+    // No event happened during the iteration just run, as the CPU never runs past one,
+    // so what it read is still current.
+    const int loop_cycles = cpu.idleLoopCycles();
+    if (loop_cycles > 0
+         && cpu.cycleCount() < deadline) {
+        cpu.skipIdleLoop((int)((deadline - cpu.cycleCount()) / loop_cycles)); }
+}
+
+void NES::setButtons(const int& controller, const uint8_t& buttons) {
+    controllers[controller].setButtons(buttons);
+}
+
+size_t NES::readSamples(int16_t* out, const size_t& count) {
+    return apu.readSamples(out, count);
+}
 
-    // TODO
+const std::array<uint16_t, PPU::WIDTH * PPU::HEIGHT>& NES::frameBuffer() const {
+    return ppu.frameBuffer();
+}
 
-    for (int i = 0; i < 50; ++i) { // testing
-        cpu.step();
+const std::array<uint8_t, 0x800>& NES::ram() const {
+    return memory.internalRam();
+}
+
+uint64_t NES::stateHash() const {
+    uint64_t hash = cpu.hashState(FNV_OFFSET_BASIS);
+    hash = fnv1a(hash, memory.internalRam().data(), memory.internalRam().size());
+    return ppu.hashState(hash);
+}
 
-        ppu.step();
-        ppu.step();
-        ppu.step();
+void NES::saveState(SaveState& state) const {
+    if (!mapper) {
+        std::cerr << "Can't save state: no game is loaded." << std::endl;
+        throw std::runtime_error("No game loaded");
     }
+    state.blob.resize(state_size);
+    StateWriter out(state.blob.data());
+    writeState(out);
+}
+
+void NES::loadState(const SaveState& state) {
+    if (!mapper) {
+        std::cerr << "Can't load state: no game is loaded." << std::endl;
+        throw std::runtime_error("No game loaded");
+    }
+    StateReader in(state.data());
+    uint32_t magic = 0, version = 0, crc32 = 0;
+    if (state.size() == state_size) {
+        in.get(magic);
+        in.get(version);
+        in.get(crc32);
+    }
+    if (magic != SaveState::MAGIC
+         || version != SaveState::VERSION
+         || crc32 != rom_crc32) {
+        std::cerr << "Save state is from another version, or another game." << std::endl;
+        throw std::runtime_error("Invalid save state");
+    }
+
+    // In the order written. Nothing reschedules: the scheduler's pending events are loaded as they were.
+    scheduler.loadState(in);
+    cpu.loadState(in);
+    memory.loadState(in);
+    ppu.loadState(in);
+    apu.loadState(in);
+    mapper->loadState(in);
+    for (Controller& controller : controllers) {
+        controller.loadState(in); }
+}
+
+void NES::writeState(StateWriter& out) const {
+    const uint32_t header[] = { SaveState::MAGIC, SaveState::VERSION, rom_crc32 };
+    out.put(header);
+    scheduler.saveState(out);
+    cpu.saveState(out);
+    memory.saveState(out);
+    ppu.saveState(out);
+    apu.saveState(out);
+    mapper->saveState(out);
+    for (const Controller& controller : controllers) {
+        controller.saveState(out); }
+}
+
+uint64_t NES::frameCount() const {
+    return ppu.frameCount();
+}
+
+uint64_t NES::cpuCycles() const {
+    return cpu.cycleCount();
+}
+
+uint64_t NES::instructionCount() const {
+    return cpu.instructionCount();
+}
+
+uint64_t NES::idleCyclesSkipped() const {
+    return cpu.idleCyclesSkipped();
+}
+
+PPU::Engine NES::ppuEngine() const {
+    return ppu.engine();
 }
\ No newline at end of file
@@ -1,36 +1,957 @@
 #include "PPU.hpp"
 
+#include <string.h>
+#include <algorithm>
+
+#include "Hash.hpp"
+
+namespace {
+
+// Mirrors a byte's bits, for horizontally flipped sprites.
+uint8_t reverseBits(uint8_t value) {
+    value = ((value & 0xF0) >> 4) | ((value & 0x0F) << 4);
+    value = ((value & 0xCC) >> 2) | ((value & 0x33) << 2);
+    value = ((value & 0xAA) >> 1) | ((value & 0x55) << 1);
+    return value;
+}
+
+}
+
+PPU::PPU() {
+    // No cartridge yet: blank CHR RAM, and horizontal mirroring.
+    chr_ram.assign(Cartridge::CHR_PAGE_SIZE, 0);
+    connectChr(chr_ram.data(), chr_ram.size(), true);
+    setMirroring(HORIZONTAL);
+}
+
+void PPU::setEngine(const Engine& engine) {
+    selected_engine = engine;
+}
+
+void PPU::setScheduler(Scheduler* scheduler) {
+    this->scheduler = scheduler;
+}
+
+void PPU::load(Cartridge* cartridge) {
+    const Cartridge::Header& header = cartridge->header;
+    // At least 8 KB, in whole banks.
+    const auto chrMemorySize = [](const size_t& size) {
+        const size_t slots = (size + CHR_SLOT_SIZE - 1) / CHR_SLOT_SIZE;
+        return std::max<size_t>(Cartridge::CHR_PAGE_SIZE, slots * CHR_SLOT_SIZE);
+    };
+
+    if (cartridge->chr_rom.empty()) {
+        chr_ram.assign(chrMemorySize(header.chr_ram_size + header.chr_nvram_size), 0);
+        connectChr(chr_ram.data(), chr_ram.size(), true);
+    } else if (cartridge->chr_rom.size() != chrMemorySize(cartridge->chr_rom.size())) { // Possible with NES 2.0. Padded out.
+        chr_ram.assign(chrMemorySize(cartridge->chr_rom.size()), 0);
+        std::copy(cartridge->chr_rom.begin(), cartridge->chr_rom.end(), chr_ram.begin());
+        connectChr(chr_ram.data(), chr_ram.size(), false);
+    } else {
+        connectChr(cartridge->chr_rom.data(), cartridge->chr_rom.size(), false);
+    }
+
+    if (header.four_screen) {
+        setMirroring(FOUR_SCREEN); }
+    else {
+        setMirroring(header.mirroring ? VERTICAL : HORIZONTAL); }
+}
+
+void PPU::connectChr(const uint8_t* data, const size_t& size, const bool& writable) {
+    chr = data;
+    chr_size = size;
+    chr_writable = writable;
+    for (size_t slot = 0; slot < pattern_tables.size(); ++slot) {
+        pattern_tables[slot] = chr + (slot * CHR_SLOT_SIZE); }
+    tile_cache.load(chr, chr_size);
+}
+
+void PPU::mapChr(const uint16_t& address, const size_t& offset, const size_t& size) {
+    for (size_t i = 0; i < size; i += CHR_SLOT_SIZE) {
+        const int slot = (int)((address + i) / CHR_SLOT_SIZE);
+        const size_t bank = (offset + i) % chr_size;
+        if (pattern_tables[slot] == chr + bank) {
+            continue; }
+
+        // The rest of the line shows the new bank.
+        if (midLine()
+             && renderingEnabled()) {
+            fallBackToDot(); }
+        pattern_tables[slot] = chr + bank;
+        tile_cache.mapSlot(slot, bank);
+    }
+}
+
+void PPU::setMirroring(const Mirroring& mirroring) {
+    uint8_t* ram = nametable_ram.data();
+    std::array<uint8_t*, 4> slots;
+    switch (mirroring) {
+        case HORIZONTAL:         slots = { ram,         ram,         ram + 0x400, ram + 0x400 }; break;
+        case VERTICAL:           slots = { ram,         ram + 0x400, ram,         ram + 0x400 }; break;
+        case SINGLE_SCREEN_LOW:  slots = { ram,         ram,         ram,         ram };         break;
+        case SINGLE_SCREEN_HIGH: slots = { ram + 0x400, ram + 0x400, ram + 0x400, ram + 0x400 }; break;
+        default:                 slots = { ram,         ram + 0x400, ram + 0x800, ram + 0xC00 }; break;
+    }
+    if (slots == nametables) {
+        return; }
+
+    if (midLine()
+         && renderingEnabled()) {
+        fallBackToDot(); }
+    nametables = slots;
+}
+
 void PPU::powerOn() {
+    scanline = 0;
+    cycle = 0;
+    odd_frame = false;
+    dot_count = 0;
+    frame_count = 0;
+
+    ppustatus_sprite_overflow = 0;
+    ppustatus_sprite_zero_hit = 0;
+    ppustatus_vblank = 0;
+    write_flag = false;
+    writeControl(0);
+    writeMask(0);
+    oam_address = 0;
+    vram_address = 0;
+    vram_address_temp = 0;
+    fine_x_scroll = 0;
+    read_buffer = 0;
 
+    active_engine = selected_engine;
+    hit_prediction_frame = UINT64_MAX;
+    pattern_shifter_low = pattern_shifter_high = 0;
+    attribute_shifter_low = attribute_shifter_high = 0;
+    next_tile = next_attribute = next_pattern_low = next_pattern_high = 0;
+    secondary_count = 0;
+    secondary_has_sprite_zero = false;
+    sprite_unit_count = 0;
+    units_have_sprite_zero = false;
+
+    drawn_buffer = 0;
+    frame_buffers[0].fill(0);
+    frame_buffers[1].fill(0);
+    oam.fill(0);
+    nametable_ram.fill(0);
+    palette_ram.fill(0);
+
+    reschedule();
 }
 
 void PPU::step() {
-    ++cycle;
+    advance(1);
+    ++dot_count;
+    handleEvent();
+}
+
+void PPU::catchUp(const uint64_t& cpu_cycle) {
+    const uint64_t target = cpu_cycle * 3;
+
+    // Nothing happens between events, so skip from one to the next.
+    while (dot_count < target) {
+        const int run = (int)std::min<uint64_t>(target - dot_count, dotsUntilEvent());
+        advance(run);
+        dot_count += run;
+        handleEvent();
+    }
+
+    reschedule();
+}
+
+uint64_t PPU::nextEventCycle() const {
+    const uint64_t event_dot = dot_count + dotsUntilEvent();
+    return (event_dot + 2) / 3; // First CPU cycle at or after it.
+}
+
+void PPU::reschedule() {
+    if (scheduler == nullptr) {
+        return; }
+
+    const uint64_t event_cycle = nextEventCycle();
+    if (scheduler->scheduledCycle(Scheduler::PPU_EVENT) != event_cycle) {
+        scheduler->schedule(Scheduler::PPU_EVENT, event_cycle); }
+}
+
+int PPU::a12RiseCycle() const {
+    if (!renderingEnabled()) {
+        return -1; }
+
+    // Backgrounds are fetched at dots 1-256 and 321-336, sprites for the next line at 257-320.
+    // A12 also drops between pattern fetches, for nametable fetches, but too briefly for the mapper to count.
+    // With 8x16 sprites, each sprite picks its table, and empty slots fetch from $1000, so most lines go as if
+    // sprites were all at $1000.
+    const bool sprites_high = ppuctrl_sprite_size || ppuctrl_sprite_table;
+    if (!ppuctrl_background_table
+         && sprites_high) {
+        return 260; } // Rises with the first sprite fetch.
+    if (ppuctrl_background_table
+         && !sprites_high) {
+        return 324; } // Rises with the first background fetch for the next line.
+    return -1;        // Stays low, or stays high.
+}
+
+uint64_t PPU::a12RisesUntil(const uint64_t& dot, const int& rise_cycle) {
+    // A rise per visible line, then one on the pre-render line.
+    constexpr int RISES_PER_FRAME = HEIGHT + 1;
+    const uint64_t frames = dot / DOTS_PER_FRAME;
+    const int position = (int)(dot % DOTS_PER_FRAME);
+
+    uint64_t rises = frames * RISES_PER_FRAME;
+    if (position >= rise_cycle) {
+        rises += std::min(HEIGHT, ((position - rise_cycle) / DOTS_PER_SCANLINE) + 1); }
+    if (position >= (PRE_RENDER_SCANLINE * DOTS_PER_SCANLINE) + rise_cycle) {
+        ++rises; }
+    return rises;
+}
+
+uint64_t PPU::a12Rises(const uint64_t& from, const uint64_t& to) const {
+    const int rise_cycle = a12RiseCycle();
+    if (rise_cycle < 0
+         || to <= from) {
+        return 0; }
+    return a12RisesUntil(to, rise_cycle) - a12RisesUntil(from, rise_cycle);
+}
+
+uint64_t PPU::a12RiseDot(const uint64_t& from, const uint64_t& n) const {
+    constexpr int RISES_PER_FRAME = HEIGHT + 1;
+    const int rise_cycle = a12RiseCycle();
+    if (rise_cycle < 0) {
+        return Scheduler::NEVER; }
+
+    // Rises are numbered from 0, from power on.
+    const uint64_t rise = a12RisesUntil(from, rise_cycle) + n - 1;
+    const int index = (int)(rise % RISES_PER_FRAME);
+    const int line = (index < HEIGHT) ? index : PRE_RENDER_SCANLINE;
+    return ((rise / RISES_PER_FRAME) * DOTS_PER_FRAME) + (line * DOTS_PER_SCANLINE) + rise_cycle;
+}
+
+void PPU::handleEvent() {
+    if (active_engine == SCANLINE
+         && scanline < HEIGHT
+         && cycle > 1
+         && cycle < RENDER_DOT) {
+        // One of sprite 0's pixels was output. SCANLINE only renders at the end of the line,
+        // so finds whether there was a hit by then ahead of time.
+        if (!ppustatus_sprite_zero_hit
+             && spriteZeroHitDot() <= cycle) {
+            ppustatus_sprite_zero_hit = 1; }
+        return;
+    }
+    if (cycle != 1) {
+        return; }
+
+    if (scanline == VBLANK_SCANLINE) {
+        ppustatus_vblank = 1;
+        if (ppuctrl_nmi) {
+            signalNMI(); }
+    }
+    else if (scanline == PRE_RENDER_SCANLINE) {
+        ppustatus_vblank = 0;
+        ppustatus_sprite_zero_hit = 0;
+        ppustatus_sprite_overflow = 0;
+    }
+}
 
-    if (cycle >= 341) { // scanline done
-        ++scanline;
-        cycle = 0;
+void PPU::advance(const int& dots) {
+    int remaining = dots;
+    while (remaining > 0) {
+        // SCANLINE stops visible lines at RENDER_DOT to render them. The pre-render line stops there too,
+        // as that's where the scroll position is reset for the next frame.
+        // DOT runs those lines dot by dot. The rest of the frame (vblank) is skipped over either way.
+        const bool renders = (scanline < HEIGHT || scanline == PRE_RENDER_SCANLINE);
+        int run;
+        if (renders
+             && active_engine == DOT) {
+            renderDot();
+            run = 1;
+        } else {
+            const int stop = (renders && cycle < RENDER_DOT) ? RENDER_DOT : DOTS_PER_SCANLINE;
+            run = std::min(remaining, stop - cycle);
+        }
+        cycle += run;
+        remaining -= run;
+
+        if (cycle == RENDER_DOT
+             && renders
+             && active_engine == SCANLINE) {
+            if (scanline != PRE_RENDER_SCANLINE) {
+                renderScanline(); }
+            else if (renderingEnabled()) {
+                vram_address = vram_address_temp; }
+        }
+        else if (cycle >= DOTS_PER_SCANLINE) {
+            ++scanline;
+            cycle = 0;
+
+            if (scanline >= SCANLINES) {
+                scanline = 0;
+                odd_frame ^= 1;
+                ++frame_count;
+                drawn_buffer ^= 1;
+            }
+        }
+    }
+}
+
+int PPU::dotsUntilEvent() const {
+    // Vblank is set at dot 1 of its first scanline, and cleared at dot 1 of the pre-render line.
+    // The start of a frame also counts, as the emulator's run loop acts on frame boundaries.
+    constexpr int frame = DOTS_PER_FRAME;
+    const int position = (scanline * DOTS_PER_SCANLINE) + cycle;
+
+    int dots = frame;
+    const auto consider = [&](const int& event) {
+        int until = event - position;
+        if (until <= 0) {
+            until += frame; }
+        dots = std::min(dots, until);
+    };
+    consider(0);
+    consider((VBLANK_SCANLINE * DOTS_PER_SCANLINE) + 1);
+    consider((PRE_RENDER_SCANLINE * DOTS_PER_SCANLINE) + 1);
+
+    // Sprite 0 hit happens as one of sprite 0's pixels is output (pixel x at dot x + 1).
+    // Games poll for it to time mid-frame changes, so those are events.
+    if (ppumask_show_background
+         && ppumask_show_sprites
+         && !ppustatus_sprite_zero_hit) {
+        const int top = oam[0] + 1;
+        const int bottom = std::min(top + (ppuctrl_sprite_size ? 16 : 8), HEIGHT);
+        const int left  = oam[3];
+        const int right = std::min(left + 8, WIDTH);
+        for (int line = top; line < bottom; ++line) {
+            for (int x = left; x < right; ++x) {
+                consider((line * DOTS_PER_SCANLINE) + x + 2); }
+        }
+    }
+    return dots;
+}
+
+void PPU::renderScanline() {
+    uint16_t* line = &frame_buffers[drawn_buffer][scanline * WIDTH];
+
+    if (!renderingEnabled()) {
+        std::fill(line, line + WIDTH, pixel(0));
+        return;
+    }
+
+    // Palette RAM indices. 0 is transparent, showing the backdrop color.
+    alignas(16) std::array<uint8_t, WIDTH> background;
+    alignas(16) std::array<uint8_t, WIDTH> sprites;
+    alignas(16) std::array<uint8_t, WIDTH> behind;
+    renderBackground(background.data());
+    if (!ppumask_show_left_background) {
+        std::fill(background.begin(), background.begin() + 8, 0); }
+
+    int hit_x;
+    const int sprite_count = renderSprites(background.data(), sprites.data(), behind.data(), hit_x);
+    if (hit_x >= 0) {
+        ppustatus_sprite_zero_hit = 1; }
+
+    std::array<uint16_t, 0x20> pixels;
+    for (int i = 0; i < 0x20; ++i) {
+        pixels[i] = pixel(i); }
+
+    if (sprite_count == 0) {
+        for (int x = 0; x < WIDTH; ++x) {
+            line[x] = pixels[background[x]]; }
+    } else {
+        for (int x = 0; x < WIDTH; ++x) {
+            const bool sprite_shown = sprites[x] != 0
+                                   && (background[x] == 0 || !behind[x]);
+            line[x] = pixels[sprite_shown ? sprites[x] : background[x]];
+        }
+    }
+
+    // On to the next line: down a row, and back to the left edge.
+    incrementY();
+    vram_address = (vram_address & ~0x041F) | (vram_address_temp & 0x041F);
+}
+
+int PPU::spriteZeroHitDot() {
+    // Cached, as each of sprite 0's pixels is an event.
+    if (hit_prediction_frame != frame_count
+         || hit_prediction_line != scanline) {
+        alignas(16) std::array<uint8_t, WIDTH> background;
+        alignas(16) std::array<uint8_t, WIDTH> sprites;
+        alignas(16) std::array<uint8_t, WIDTH> behind;
+        renderBackground(background.data());
+        if (!ppumask_show_left_background) {
+            std::fill(background.begin(), background.begin() + 8, 0); }
+        const uint8_t overflow = ppustatus_sprite_overflow; // Only set when the line is actually rendered.
+        int hit_x;
+        renderSprites(background.data(), sprites.data(), behind.data(), hit_x);
+        ppustatus_sprite_overflow = overflow;
+
+        hit_prediction_frame = frame_count;
+        hit_prediction_line  = scanline;
+        hit_prediction_dot   = (hit_x >= 0) ? hit_x + 2 : DOTS_PER_SCANLINE;
+    }
+    return hit_prediction_dot;
+}
+
+void PPU::renderBackground(uint8_t* pixels) {
+    if (!ppumask_show_background) {
+        memset(pixels, 0, WIDTH);
+        return;
+    }
 
-        if (scanline >= 262) { // frame done
-            scanline = 0;
-            odd_frame ^= 1;
+    // With a partial tile scrolled off the left, 33 tiles are visible.
+    constexpr int TILES = (WIDTH / 8) + 1;
+    alignas(16) uint8_t tiles[TILES * 8];
+
+    uint16_t address = vram_address;
+    const int table  = ppuctrl_background_table << 8;
+    const int fine_y = (address >> 12) & 0x7;
+    for (int i = 0; i < TILES; ++i) {
+        const uint8_t tile      = nametable(0x2000 | (address & 0x0FFF));
+        const uint8_t attribute = nametable(0x23C0 | (address & 0x0C00) | ((address >> 4) & 0x38) | ((address >> 2) & 0x07));
+        // Each attribute byte holds the palettes of four 2x2 tile quadrants.
+        const int palette = (attribute >> (((address >> 4) & 0x4) | (address & 0x2))) & 0x3;
+
+        // Palette bits go on opaque pixels only, so transparent ones stay 0.
+        // Each byte is a pixel (0-3), so the bytewise arithmetic never carries into a neighbour.
+        uint64_t row = tile_cache.row(table | tile, fine_y);
+        const uint64_t opaque = (row | (row >> 1)) & 0x0101010101010101;
+        row |= opaque * (palette << 2);
+        memcpy(tiles + (i * 8), &row, sizeof(row));
+
+        // Coarse X, wrapping into the horizontally adjacent nametable.
+        if ((address & 0x001F) == 31) {
+            address = (address & ~0x001F) ^ 0x0400; }
+        else {
+            ++address; }
+    }
+
+    memcpy(pixels, tiles + fine_x_scroll, WIDTH);
+}
+
+int PPU::renderSprites(const uint8_t* background, uint8_t* pixels, uint8_t* behind, int& hit_x) {
+    hit_x = -1;
+    if (!ppumask_show_sprites) {
+        return 0; }
+    memset(pixels, 0, WIDTH);
+
+    const int height = ppuctrl_sprite_size ? 16 : 8;
+    const int left = ppumask_show_left_sprites ? 0 : 8;
+    // Sprite 0 hits aren't detected where either layer is clipped, nor at the rightmost pixel.
+    const int hit_left = (ppumask_show_left_sprites && ppumask_show_left_background) ? 0 : 8;
+
+    int found = 0;
+    for (int i = 0; i < 64; ++i) {
+        const uint8_t* sprite = &oam[i * 4]; // Y, tile, attributes, X
+        // Sprites are drawn a line below their Y.
+        const int row = scanline - (sprite[0] + 1);
+        if (row < 0 || row >= height) {
+            continue; }
+        if (found == SPRITES_PER_SCANLINE) {
+            ppustatus_sprite_overflow = 1;
+            break;
+        }
+        ++found;
+
+        // Attributes: 76543210
+        //             VHP...PP (flip vertically, flip horizontally, behind background, palette)
+        const uint8_t attributes = sprite[2];
+        const int y = (attributes & 0x80) ? (height - 1 - row) : row;
+        int tile;
+        if (height == 16) { // The tile's bit 0 picks the table, and the bottom half is the next tile.
+            tile = ((sprite[1] & 0x01) << 8) | ((sprite[1] & 0xFE) + (y >> 3)); }
+        else {
+            tile = (ppuctrl_sprite_table << 8) | sprite[1]; }
+
+        const uint64_t bits = (attributes & 0x40) ? tile_cache.flippedRow(tile, y & 0x7)
+                                                  : tile_cache.row(tile, y & 0x7);
+        uint8_t row_pixels[8];
+        memcpy(row_pixels, &bits, sizeof(row_pixels));
+
+        // Earlier sprites are in front of later ones, so only transparent pixels are drawn over.
+        const uint8_t palette = 0x10 | ((attributes & 0x3) << 2);
+        const int x = sprite[3];
+        const int width = std::min(8, WIDTH - x);
+        for (int j = std::max(0, left - x); j < width; ++j) {
+            if (row_pixels[j] == 0
+                 || pixels[x + j] != 0) {
+                continue; }
+            pixels[x + j] = palette | row_pixels[j];
+            behind[x + j] = attributes & 0x20;
+
+            if (i == 0
+                 && hit_x < 0
+                 && background[x + j] != 0
+                 && x + j >= hit_left
+                 && x + j != WIDTH - 1) {
+                hit_x = x + j; }
         }
     }
+    return found;
+}
 
+bool PPU::changesCurrentLine(const uint16_t& address, const uint8_t& value) const {
+    if (!midLine()) {
+        return false; }
 
+    switch (address) {
+        case 0x2000: { // Pattern tables and sprite size. (The nametable bits only go to the temporary address.)
+            const uint8_t control = (ppuctrl_sprite_table << 3) | (ppuctrl_background_table << 4) | (ppuctrl_sprite_size << 5);
+            return renderingEnabled()
+                && ((value & 0x38) != control);
+        }
+        case 0x2001: {
+            const uint8_t mask = ppumask_greyscale | (ppumask_show_left_background << 1) | (ppumask_show_left_sprites << 2)
+                               | (ppumask_show_background << 3) | (ppumask_show_sprites << 4);
+            return (value & 0x1F) != mask;
+        }
+        case 0x2005: // Fine X takes effect immediately. The rest goes to the temporary address.
+            return renderingEnabled()
+                && !write_flag
+                && (value & 0x7) != fine_x_scroll;
+        case 0x2006: // The second write sets the address, which is the scroll position.
+            return renderingEnabled()
+                && write_flag;
+        case 0x2004: // Sprites, which SCANLINE evaluates at the end of the line rather than the one before.
+        case 0x2007: // Moves the address.
+            return renderingEnabled();
+        default:
+            return false;
+    }
+}
+
+void PPU::fallBackToDot() {
+    active_engine = DOT;
+
+    // The previous line evaluated and fetched this line's sprites, and prefetched its first two tiles.
+    // (The scroll position at the start of the line is still current, as SCANLINE only moves it at its end.)
+    const int line = scanline,
+              resume = cycle;
+    scanline = (line == 0) ? PRE_RENDER_SCANLINE : line - 1;
+    secondary_count = 0;
+    secondary_has_sprite_zero = false;
+    for (int index = 0; index < 64; ++index) {
+        evaluateSprite(index); }
+    for (int slot = 0; slot < SPRITES_PER_SCANLINE; ++slot) {
+        fetchSprite(slot); }
+    for (cycle = 321; cycle < DOTS_PER_SCANLINE; ++cycle) {
+        renderDot(); }
+
+    // Then this line, up to now.
+    scanline = line;
+    for (cycle = 0; cycle < resume; ++cycle) {
+        renderDot(); }
+}
+
+void PPU::renderDot() {
+    const bool visible = (scanline < HEIGHT);
+
+    if (!renderingEnabled()) {
+        if (visible
+             && cycle >= 1
+             && cycle <= WIDTH) {
+            frame_buffers[drawn_buffer][(scanline * WIDTH) + cycle - 1] = pixel(0); }
+        return;
+    }
+
+    // Sprites for the next line. Secondary OAM is cleared over dots 1-64, then each sprite in OAM is
+    // checked in turn (two dots each), and the patterns of those found are fetched over dots 257-320.
+    if (cycle == 1) {
+        secondary_count = 0;
+        secondary_has_sprite_zero = false;
+    }
+    else if (cycle >= 65
+              && cycle < 65 + 128
+              && (cycle & 1)) {
+        evaluateSprite((cycle - 65) >> 1); }
+    else if (cycle >= 257
+              && cycle <= 320
+              && ((cycle - 257) & 0x7) == 0x7) {
+        fetchSprite((cycle - 257) >> 3); }
+
+    // Background. Each tile takes 8 dots: nametable, attribute, pattern low, pattern high, then the next tile.
+    // The first two tiles of a line are fetched at the end of the line before.
+    if ((cycle >= 2 && cycle <= 257)
+         || (cycle >= 321 && cycle <= 337)) {
+        shiftBackground();
+        if (cycle <= 257) {
+            shiftSprites(); }
+
+        const uint16_t fine_y = (vram_address >> 12) & 0x7;
+        const uint16_t pattern = (ppuctrl_background_table << 12) | (next_tile << 4) | fine_y;
+        switch ((cycle - 1) & 0x7) {
+            case 0:
+                loadBackgroundShifters();
+                next_tile = nametable(0x2000 | (vram_address & 0x0FFF));
+                break;
+            case 2: {
+                const uint8_t attribute = nametable(0x23C0 | (vram_address & 0x0C00)
+                                                    | ((vram_address >> 4) & 0x38) | ((vram_address >> 2) & 0x07));
+                next_attribute = (attribute >> (((vram_address >> 4) & 0x4) | (vram_address & 0x2))) & 0x3;
+                break;
+            }
+            case 4:
+                next_pattern_low = patternByte(pattern);
+                break;
+            case 6:
+                next_pattern_high = patternByte(pattern + 8);
+                break;
+            case 7:
+                incrementX();
+                break;
+        }
+    }
+
+    if (cycle == 256) {
+        incrementY(); }
+    else if (cycle == 257) { // Back to the left edge.
+        loadBackgroundShifters();
+        vram_address = (vram_address & ~0x041F) | (vram_address_temp & 0x041F);
+    }
+    else if (scanline == PRE_RENDER_SCANLINE
+              && cycle >= 280
+              && cycle <= 304) { // Back to the top.
+        vram_address = (vram_address & ~0x7BE0) | (vram_address_temp & 0x7BE0); }
+
+    if (visible
+         && cycle >= 1
+         && cycle <= WIDTH) {
+        outputPixel(cycle - 1); }
+}
+
+void PPU::outputPixel(const int& x) {
+    uint8_t background = 0;
+    if (ppumask_show_background
+         && (ppumask_show_left_background || x >= 8)) {
+        const uint16_t bit = 0x8000 >> fine_x_scroll;
+        const uint8_t pixel = ((pattern_shifter_low & bit) ? 1 : 0) | ((pattern_shifter_high & bit) ? 2 : 0);
+        if (pixel != 0) {
+            const uint8_t palette = ((attribute_shifter_low & bit) ? 1 : 0) | ((attribute_shifter_high & bit) ? 2 : 0);
+            background = (palette << 2) | pixel;
+        }
+    }
+
+    uint8_t sprite = 0;
+    bool behind = false;
+    if (ppumask_show_sprites
+         && (ppumask_show_left_sprites || x >= 8)) {
+        // The first opaque sprite pixel wins, as earlier sprites are in front.
+        for (int i = 0; i < sprite_unit_count; ++i) {
+            const SpriteUnit& unit = sprite_units[i];
+            if (unit.x != 0) {
+                continue; }
+            const uint8_t pixel = (unit.pattern_low >> 7) | ((unit.pattern_high >> 7) << 1);
+            if (pixel == 0) {
+                continue; }
+
+            sprite = 0x10 | ((unit.attributes & 0x3) << 2) | pixel;
+            behind = unit.attributes & 0x20;
+            if (i == 0
+                 && units_have_sprite_zero
+                 && background != 0
+                 && x != WIDTH - 1) {
+                ppustatus_sprite_zero_hit = 1; }
+            break;
+        }
+    }
+
+    const bool sprite_shown = sprite != 0
+                           && (background == 0 || !behind);
+    frame_buffers[drawn_buffer][(scanline * WIDTH) + x] = pixel(sprite_shown ? sprite : background);
+}
+
+void PPU::shiftBackground() {
+    pattern_shifter_low    <<= 1;
+    pattern_shifter_high   <<= 1;
+    attribute_shifter_low  <<= 1;
+    attribute_shifter_high <<= 1;
+}
+
+void PPU::shiftSprites() {
+    for (int i = 0; i < sprite_unit_count; ++i) {
+        SpriteUnit& unit = sprite_units[i];
+        if (unit.x != 0) {
+            --unit.x; }
+        else {
+            unit.pattern_low  <<= 1;
+            unit.pattern_high <<= 1;
+        }
+    }
+}
+
+void PPU::loadBackgroundShifters() {
+    pattern_shifter_low    = (pattern_shifter_low  & 0xFF00) | next_pattern_low;
+    pattern_shifter_high   = (pattern_shifter_high & 0xFF00) | next_pattern_high;
+    // The palette is the same across the tile, so its bits are spread over all 8.
+    attribute_shifter_low  = (attribute_shifter_low  & 0xFF00) | ((next_attribute & 0x1) ? 0xFF : 0x00);
+    attribute_shifter_high = (attribute_shifter_high & 0xFF00) | ((next_attribute & 0x2) ? 0xFF : 0x00);
+}
+
+void PPU::evaluateSprite(const int& index) {
+    if (scanline >= HEIGHT) {
+        return; }
+
+    // Sprites are drawn a line below their Y, so those on the next line have this line within their height.
+    const uint8_t* sprite = &oam[index * 4];
+    const int row = scanline - sprite[0];
+    if (row < 0 || row >= (ppuctrl_sprite_size ? 16 : 8)) {
+        return; }
+    if (secondary_count == SPRITES_PER_SCANLINE) {
+        ppustatus_sprite_overflow = 1;
+        return;
+    }
+
+    if (index == 0) {
+        secondary_has_sprite_zero = true; }
+    std::copy(sprite, sprite + 4, &secondary_oam[secondary_count * 4]);
+    ++secondary_count;
+}
+
+void PPU::fetchSprite(const int& slot) {
+    if (slot == 0) {
+        sprite_unit_count = secondary_count;
+        units_have_sprite_zero = secondary_has_sprite_zero;
+    }
+    if (slot >= secondary_count) {
+        return; }
+
+    const uint8_t* sprite = &secondary_oam[slot * 4]; // Y, tile, attributes, X
+    const uint8_t attributes = sprite[2];
+    const int height = ppuctrl_sprite_size ? 16 : 8;
+    const int row = scanline - sprite[0];
+    const int y = (attributes & 0x80) ? (height - 1 - row) : row;
+
+    uint16_t address;
+    if (height == 16) { // The tile's bit 0 picks the table, and the bottom half is the next tile.
+        address = ((sprite[1] & 0x01) << 12) | (((sprite[1] & 0xFE) + (y >> 3)) << 4) | (y & 0x7); }
+    else {
+        address = (ppuctrl_sprite_table << 12) | (sprite[1] << 4) | y; }
+
+    SpriteUnit& unit = sprite_units[slot];
+    unit.pattern_low  = patternByte(address);
+    unit.pattern_high = patternByte(address + 8);
+    if (attributes & 0x40) {
+        unit.pattern_low  = reverseBits(unit.pattern_low);
+        unit.pattern_high = reverseBits(unit.pattern_high);
+    }
+    unit.attributes = attributes;
+    unit.x = sprite[3];
+}
+
+void PPU::incrementX() {
+    if ((vram_address & 0x001F) == 31) {
+        vram_address = (vram_address & ~0x001F) ^ 0x0400; }
+    else {
+        ++vram_address; }
+}
+
+void PPU::incrementY() {
+    if ((vram_address & 0x7000) != 0x7000) { // Fine Y
+        vram_address += 0x1000;
+        return;
+    }
+    vram_address &= ~0x7000;
+
+    // Coarse Y. Row 29 is the last of the nametable, so it wraps into the vertically adjacent one.
+    // Rows 30 and 31 are attribute data, which wrap within the same nametable.
+    int coarse_y = (vram_address & 0x03E0) >> 5;
+    if (coarse_y == 29) {
+        coarse_y = 0;
+        vram_address ^= 0x0800;
+    }
+    else if (coarse_y == 31) {
+        coarse_y = 0; }
+    else {
+        ++coarse_y; }
+    vram_address = (vram_address & ~0x03E0) | (coarse_y << 5);
+}
+
+void PPU::incrementAddress() {
+    if (ppuctrl_increment == 0) {
+        vram_address += 1; }
+    else {
+        vram_address += 32; }
+    vram_address &= 0x7FFF;
+}
+
+uint64_t PPU::hashState(const uint64_t& hash) const {
+    const int position[] = { scanline, cycle, odd_frame, ppustatus_vblank, vram_address };
+    uint64_t result = fnv1a(hash, position, sizeof(position));
+    result = fnv1a(result, frameBuffer().data(), frameBuffer().size() * sizeof(uint16_t));
+    result = fnv1a(result, oam.data(), oam.size());
+    result = fnv1a(result, nametable_ram.data(), nametable_ram.size());
+    return fnv1a(result, palette_ram.data(), palette_ram.size());
+}
+
+void PPU::saveState(StateWriter& out) const {
+    const uint8_t control[] = { ppuctrl_nametable, ppuctrl_increment, ppuctrl_sprite_table, ppuctrl_background_table,
+                                ppuctrl_sprite_size, ppuctrl_master_slave, ppuctrl_nmi };
+    const uint8_t mask[] = { ppumask_greyscale, ppumask_show_left_background, ppumask_show_left_sprites,
+                             ppumask_show_background, ppumask_show_sprites,
+                             ppumask_tint_red, ppumask_tint_green, ppumask_tint_blue };
+    const uint8_t status[] = { ppustatus_sprite_overflow, ppustatus_sprite_zero_hit, ppustatus_vblank };
+    out.put(control);
+    out.put(mask);
+    out.put(status);
+    out.put(oam_address);
+    out.put(vram_address);
+    out.put(vram_address_temp);
+    out.put(fine_x_scroll);
+    out.put(write_flag);
+    out.put(read_buffer);
+    out.put(odd_frame);
+
+    out.put(scanline);
+    out.put(cycle);
+    out.put(dot_count);
+    out.put(frame_count);
+    out.put(drawn_buffer);
+    out.put(active_engine);
+
+    out.put(next_tile);
+    out.put(next_attribute);
+    out.put(next_pattern_low);
+    out.put(next_pattern_high);
+    out.put(pattern_shifter_low);
+    out.put(pattern_shifter_high);
+    out.put(attribute_shifter_low);
+    out.put(attribute_shifter_high);
+    out.put(secondary_oam);
+    out.put(secondary_count);
+    out.put(secondary_has_sprite_zero);
+    out.put(sprite_units);
+    out.put(sprite_unit_count);
+    out.put(units_have_sprite_zero);
+
+    out.put(oam);
+    out.put(nametable_ram);
+    out.put(palette_ram);
+
+    // Banks, as offsets: the pointers are only good for this run.
+    std::array<uint32_t, 8> chr_banks;
+    for (size_t slot = 0; slot < pattern_tables.size(); ++slot) {
+        chr_banks[slot] = (uint32_t)(pattern_tables[slot] - chr); }
+    std::array<uint16_t, 4> nametable_banks;
+    for (size_t slot = 0; slot < nametables.size(); ++slot) {
+        nametable_banks[slot] = (uint16_t)(nametables[slot] - nametable_ram.data()); }
+    out.put(chr_banks);
+    out.put(nametable_banks);
+    if (chr_writable) {
+        out.bytes(chr_ram.data(), chr_ram.size()); }
+}
+
+void PPU::loadState(StateReader& in) {
+    uint8_t control[7], mask[8], status[3];
+    in.get(control);
+    in.get(mask);
+    in.get(status);
+    ppuctrl_nametable        = control[0];
+    ppuctrl_increment        = control[1];
+    ppuctrl_sprite_table     = control[2];
+    ppuctrl_background_table = control[3];
+    ppuctrl_sprite_size      = control[4];
+    ppuctrl_master_slave     = control[5];
+    ppuctrl_nmi              = control[6];
+    ppumask_greyscale            = mask[0];
+    ppumask_show_left_background = mask[1];
+    ppumask_show_left_sprites    = mask[2];
+    ppumask_show_background      = mask[3];
+    ppumask_show_sprites         = mask[4];
+    ppumask_tint_red             = mask[5];
+    ppumask_tint_green           = mask[6];
+    ppumask_tint_blue            = mask[7];
+    ppustatus_sprite_overflow = status[0];
+    ppustatus_sprite_zero_hit = status[1];
+    ppustatus_vblank          = status[2];
+    in.get(oam_address);
+    in.get(vram_address);
+    in.get(vram_address_temp);
+    in.get(fine_x_scroll);
+    in.get(write_flag);
+    in.get(read_buffer);
+    in.get(odd_frame);
+
+    in.get(scanline);
+    in.get(cycle);
+    in.get(dot_count);
+    in.get(frame_count);
+    in.get(drawn_buffer);
+    in.get(active_engine);
+    hit_prediction_frame = UINT64_MAX; // Predicted again when needed.
+
+    in.get(next_tile);
+    in.get(next_attribute);
+    in.get(next_pattern_low);
+    in.get(next_pattern_high);
+    in.get(pattern_shifter_low);
+    in.get(pattern_shifter_high);
+    in.get(attribute_shifter_low);
+    in.get(attribute_shifter_high);
+    in.get(secondary_oam);
+    in.get(secondary_count);
+    in.get(secondary_has_sprite_zero);
+    in.get(sprite_units);
+    in.get(sprite_unit_count);
+    in.get(units_have_sprite_zero);
+
+    in.get(oam);
+    in.get(nametable_ram);
+    in.get(palette_ram);
+
+    std::array<uint32_t, 8> chr_banks;
+    std::array<uint16_t, 4> nametable_banks;
+    in.get(chr_banks);
+    in.get(nametable_banks);
+    for (size_t slot = 0; slot < pattern_tables.size(); ++slot) {
+        pattern_tables[slot] = chr + chr_banks[slot];
+        tile_cache.mapSlot((int)slot, chr_banks[slot]);
+    }
+    for (size_t slot = 0; slot < nametables.size(); ++slot) {
+        nametables[slot] = nametable_ram.data() + nametable_banks[slot]; }
+
+    if (chr_writable) {
+        // Only tiles that differ are copied and decoded again. Usually, few or none do.
+        const uint8_t* saved = in.view(chr_ram.size());
+        if (memcmp(chr_ram.data(), saved, chr_ram.size()) == 0) {
+            return; }
+        for (size_t offset = 0; offset < chr_ram.size(); offset += TileCache::TILE_SIZE) {
+            if (memcmp(&chr_ram[offset], saved + offset, TileCache::TILE_SIZE) != 0) {
+                memcpy(&chr_ram[offset], saved + offset, TileCache::TILE_SIZE);
+                tile_cache.update(chr, offset);
+            }
+        }
+    }
+}
+
+uint8_t PPU::read(const uint16_t& address) const {
+    if (address < 0x2000) {
+        return patternByte(address); }
+    if (address < 0x3F00) {
+        return nametable(address); }
+    return palette_ram[paletteIndex(address)];
+}
+
+void PPU::write(const uint16_t& address, const uint8_t& value) {
+    if (address < 0x2000) {
+        if (chr_writable) {
+            const size_t offset = (pattern_tables[address / CHR_SLOT_SIZE] - chr) + (address % CHR_SLOT_SIZE);
+            chr_ram[offset] = value;
+            tile_cache.update(chr, offset);
+        }
+    }
+    else if (address < 0x3F00) {
+        nametable(address) = value; }
+    else {
+        palette_ram[paletteIndex(address)] = value & 0x3F; }
 }
 
 uint8_t PPU::readRegister(const uint16_t& address) {
     switch (address) {
         case 0x2002:
-            //return readStatus();
-            break;
+            return readStatus();
         case 0x2004:
-            //return readOAMData();
-            break;
+            return readOAMData();
         case 0x2007:
-            //return readData();
-            break;
+            return readData();
         default:
             // TODO: ERROR
             break;
@@ -41,44 +962,142 @@ uint8_t PPU::readRegister(const uint16_t& address) {
 }
 
 void PPU::writeRegister(const uint16_t& address, const uint8_t& value) {
+    if (changesCurrentLine(address, value)) {
+        fallBackToDot(); }
+
     switch (address) {
         case 0x2000:
-            //writeControl(value);
+            writeControl(value);
             break;
         case 0x2001:
-            //writeMask(value);
+            writeMask(value);
             break;
         case 0x2003:
-            //writeOAMAddress(value);
+            oam_address = value;
             break;
         case 0x2004:
-            //writeOAMData(value);
+            writeOAMData(value);
             break;
         case 0x2005:
-            //writeScroll(value);
+            writeScroll(value);
             break;
         case 0x2006:
-            //writeAddress(value);
+            writeAddress(value);
             break;
         case 0x2007:
-            //writeData(value);
-            break;
-        case 0x4014:
-            //writeDMA(value);
+            writeData(value);
             break;
         default:
             // TODO: ERROR
             break;
     }
+
+    // Rendering settings and sprite 0 decide whether there's a sprite 0 hit to predict.
+    reschedule();
 }
 
+void PPU::writeOAMDMA(const uint8_t* data) {
+    if (changesCurrentLine(0x2004, 0)) {
+        fallBackToDot(); }
 
+    const size_t first = oam.size() - oam_address;
+    memcpy(&oam[oam_address], data, first);
+    memcpy(&oam[0], data + first, oam_address);
 
-void PPU::writeData(const uint8_t& value) {
-    vram_address = value;
+    reschedule();
+}
 
-    if (ppuctrl_increment == 0) {
-        vram_address += 1; }
-    else {
-        vram_address += 32; }
-}
\ No newline at end of file
+
+
+void PPU::writeControl(const uint8_t& value) {
+    const uint8_t nmi_was_enabled = ppuctrl_nmi;
+
+    ppuctrl_nametable        =  value       & 0x3;
+    ppuctrl_increment        = (value >> 2) & 0x1;
+    ppuctrl_sprite_table     = (value >> 3) & 0x1;
+    ppuctrl_background_table = (value >> 4) & 0x1;
+    ppuctrl_sprite_size      = (value >> 5) & 0x1;
+    ppuctrl_master_slave     = (value >> 6) & 0x1;
+    ppuctrl_nmi              = (value >> 7) & 0x1;
+
+    vram_address_temp = (vram_address_temp & ~0x0C00) | (ppuctrl_nametable << 10);
+
+    // Enabling NMI during vblank asserts it immediately.
+    if (!nmi_was_enabled
+         && ppuctrl_nmi
+         && ppustatus_vblank) {
+        signalNMI(); }
+}
+
+void PPU::writeMask(const uint8_t& value) {
+    ppumask_greyscale            =  value       & 0x1;
+    ppumask_show_left_background = (value >> 1) & 0x1;
+    ppumask_show_left_sprites    = (value >> 2) & 0x1;
+    ppumask_show_background      = (value >> 3) & 0x1;
+    ppumask_show_sprites         = (value >> 4) & 0x1;
+    ppumask_tint_red             = (value >> 5) & 0x1;
+    ppumask_tint_green           = (value >> 6) & 0x1;
+    ppumask_tint_blue            = (value >> 7) & 0x1;
+}
+
+uint8_t PPU::readStatus() {
+    const uint8_t status = (ppustatus_vblank << 7)
+                         | (ppustatus_sprite_zero_hit << 6)
+                         | (ppustatus_sprite_overflow << 5);
+    ppustatus_vblank = 0;
+    write_flag = false;
+    return status;
+}
+
+uint8_t PPU::readOAMData() {
+    return oam[oam_address];
+}
+
+void PPU::writeOAMData(const uint8_t& value) {
+    oam[oam_address] = value;
+    ++oam_address;
+}
+
+void PPU::writeScroll(const uint8_t& value) {
+    if (!write_flag) { // X: coarse X, and fine X.
+        vram_address_temp = (vram_address_temp & ~0x001F) | (value >> 3);
+        fine_x_scroll = value & 0x7;
+    } else {           // Y: fine Y, and coarse Y.
+        vram_address_temp = (vram_address_temp & ~0x73E0) | ((value & 0x07) << 12) | ((value & 0xF8) << 2);
+    }
+    write_flag = !write_flag;
+}
+
+void PPU::writeAddress(const uint8_t& value) {
+    if (!write_flag) { // High byte. Only 6 bits, and bit 14 is cleared.
+        vram_address_temp = (vram_address_temp & 0x00FF) | ((value & 0x3F) << 8); }
+    else {             // Low byte. The address takes effect.
+        vram_address_temp = (vram_address_temp & 0xFF00) | value;
+        vram_address = vram_address_temp;
+    }
+    write_flag = !write_flag;
+}
+
+void PPU::signalNMI() {
+    if (scheduler != nullptr) {
+        scheduler->schedule(Scheduler::NMI, (dot_count + 2) / 3); }
+}
+
+uint8_t PPU::readData() {
+    const uint16_t address = vram_address & 0x3FFF;
+    uint8_t value;
+    if (address < 0x3F00) { // Buffered: the value read is only returned by the next read.
+        value = read_buffer;
+        read_buffer = read(address);
+    } else {                // Palette reads are immediate, but still fill the buffer, from the nametable beneath.
+        value = read(address);
+        read_buffer = read(address - 0x1000);
+    }
+    incrementAddress();
+    return value;
+}
+
+void PPU::writeData(const uint8_t& value) {
+    write(vram_address & 0x3FFF, value);
+    incrementAddress();
+}
@@ -0,0 +1,196 @@
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+
+#include "Palette.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define TURBONES_PALETTE_SSE2 1
+    #include <emmintrin.h>
+#else
+    #define TURBONES_PALETTE_SSE2 0
+#endif
+
+// AVX2 isn't assumed by the build, so its kernels are compiled for it on their own, and used if the CPU has it.
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+    #define TURBONES_PALETTE_AVX2 1
+    #include <immintrin.h>
+#else
+    #define TURBONES_PALETTE_AVX2 0
+#endif
+
+namespace {
+
+// The 2C02's colors, as RGB.
+constexpr uint8_t COLORS[64][3] = {
+    {  84,  84,  84 }, {   0,  30, 116 }, {   8,  16, 144 }, {  48,   0, 136 },
+    {  68,   0, 100 }, {  92,   0,  48 }, {  84,   4,   0 }, {  60,  24,   0 },
+    {  32,  42,   0 }, {   8,  58,   0 }, {   0,  64,   0 }, {   0,  60,   0 },
+    {   0,  50,  60 }, {   0,   0,   0 }, {   0,   0,   0 }, {   0,   0,   0 },
+    { 152, 150, 152 }, {   8,  76, 196 }, {  48,  50, 236 }, {  92,  30, 228 },
+    { 136,  20, 176 }, { 160,  20, 100 }, { 152,  34,  32 }, { 120,  60,   0 },
+    {  84,  90,   0 }, {  40, 114,   0 }, {   8, 124,   0 }, {   0, 118,  40 },
+    {   0, 102, 120 }, {   0,   0,   0 }, {   0,   0,   0 }, {   0,   0,   0 },
+    { 236, 238, 236 }, {  76, 154, 236 }, { 120, 124, 236 }, { 176,  98, 236 },
+    { 228,  84, 236 }, { 236,  88, 180 }, { 236, 106, 100 }, { 212, 136,  32 },
+    { 160, 170,   0 }, { 116, 196,   0 }, {  76, 208,  32 }, {  56, 204, 108 },
+    {  56, 180, 204 }, {  60,  60,  60 }, {   0,   0,   0 }, {   0,   0,   0 },
+    { 236, 238, 236 }, { 168, 204, 236 }, { 188, 188, 236 }, { 212, 178, 236 },
+    { 236, 174, 236 }, { 236, 174, 212 }, { 236, 180, 176 }, { 228, 196, 144 },
+    { 204, 210, 120 }, { 180, 222, 120 }, { 168, 226, 144 }, { 152, 226, 180 },
+    { 160, 214, 228 }, { 160, 162, 160 }, {   0,   0,   0 }, {   0,   0,   0 }
+};
+
+// Emphasizing a color darkens the other ones (approximately, by this factor).
+constexpr double DEEMPHASIS = 0.816;
+
+#if TURBONES_PALETTE_AVX2
+
+bool cpuHasAVX2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+// Each kernel returns how many pixels it converted (a multiple of its batch), leaving the rest.
+__attribute__((target("avx2")))
+size_t gather32(const uint32_t* lut, const uint16_t* pixels, const size_t& count, uint32_t* output) {
+    const __m256i mask = _mm256_set1_epi32(Palette::PIXEL_VALUES - 1);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i indices = _mm256_and_si256(
+            _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i))), mask);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + i),
+                            _mm256_i32gather_epi32(reinterpret_cast<const int*>(lut), indices, 4));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+size_t gather16(const uint32_t* lut, const uint16_t* pixels, const size_t& count, uint16_t* output) {
+    const __m256i mask = _mm256_set1_epi32(Palette::PIXEL_VALUES - 1);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m256i low_indices = _mm256_and_si256(
+            _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i))), mask);
+        const __m256i high_indices = _mm256_and_si256(
+            _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i + 8))), mask);
+        const __m256i low  = _mm256_i32gather_epi32(reinterpret_cast<const int*>(lut), low_indices, 4);
+        const __m256i high = _mm256_i32gather_epi32(reinterpret_cast<const int*>(lut), high_indices, 4);
+        // Packing works within 128 bit lanes, interleaving the halves of 'low' and 'high'. Put them back in order.
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(low, high), 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + i), packed);
+    }
+    return i;
+}
+
+#endif
+
+}
+
+Palette::Palette(const Format& format) {
+#if TURBONES_PALETTE_AVX2
+    use_avx2 = cpuHasAVX2();
+#else
+    use_avx2 = false;
+#endif
+    setFormat(format);
+}
+
+void Palette::setFormat(const Format& format) {
+    selected_format = format;
+
+    for (int value = 0; value < PIXEL_VALUES; ++value) {
+        const int index = value & 0x3F;
+        const int emphasis = value >> 6;
+
+        uint8_t rgb[3];
+        for (int channel = 0; channel < 3; ++channel) {
+            double level = COLORS[index][channel];
+            if (emphasis != 0
+                 && !(emphasis & (1 << channel))) {
+                level *= DEEMPHASIS; }
+            rgb[channel] = (uint8_t)std::lround(level);
+        }
+
+        switch (format) {
+            case RGBA8888: {
+                const uint8_t bytes[4] = { rgb[0], rgb[1], rgb[2], 0xFF };
+                memcpy(&lut[value], bytes, sizeof(bytes));
+                break;
+            }
+            case BGRA8888: {
+                const uint8_t bytes[4] = { rgb[2], rgb[1], rgb[0], 0xFF };
+                memcpy(&lut[value], bytes, sizeof(bytes));
+                break;
+            }
+            case RGB565:
+                lut[value] = ((rgb[0] >> 3) << 11) | ((rgb[1] >> 2) << 5) | (rgb[2] >> 3);
+                break;
+            case INDEXED8:
+                lut[value] = index;
+                break;
+        }
+    }
+}
+
+void Palette::convert(const uint16_t* pixels, const size_t& count, void* output) const {
+    switch (selected_format) {
+        case RGBA8888:
+        case BGRA8888:
+            convert32(pixels, count, static_cast<uint32_t*>(output));
+            break;
+        case RGB565:
+            convert16(pixels, count, static_cast<uint16_t*>(output));
+            break;
+        case INDEXED8:
+            convert8(pixels, count, static_cast<uint8_t*>(output));
+            break;
+    }
+}
+
+void Palette::convertFrame(const uint16_t* pixels, const int& width, const int& height,
+                           void* output, const size_t& pitch) const {
+    const size_t row_size = (size_t)width * bytesPerPixel(selected_format);
+    uint8_t* row = static_cast<uint8_t*>(output);
+    if (pitch == row_size) { // Contiguous. One run, so the kernels' leftovers are only at the very end.
+        convert(pixels, (size_t)width * height, row);
+        return;
+    }
+    for (int y = 0; y < height; ++y) {
+        convert(pixels + ((size_t)y * width), width, row + (y * pitch)); }
+}
+
+void Palette::convert32(const uint16_t* pixels, const size_t& count, uint32_t* output) const {
+    size_t i = 0;
+#if TURBONES_PALETTE_AVX2
+    if (use_avx2) {
+        i = gather32(lut.data(), pixels, count, output); }
+#endif
+    for (; i < count; ++i) {
+        output[i] = lut[pixels[i] & (PIXEL_VALUES - 1)]; }
+}
+
+void Palette::convert16(const uint16_t* pixels, const size_t& count, uint16_t* output) const {
+    size_t i = 0;
+#if TURBONES_PALETTE_AVX2
+    if (use_avx2) {
+        i = gather16(lut.data(), pixels, count, output); }
+#endif
+    for (; i < count; ++i) {
+        output[i] = (uint16_t)lut[pixels[i] & (PIXEL_VALUES - 1)]; }
+}
+
+void Palette::convert8(const uint16_t* pixels, const size_t& count, uint8_t* output) const {
+    // The index is the low bits of the pixel itself. No lookup needed.
+    size_t i = 0;
+#if TURBONES_PALETTE_SSE2
+    const __m128i mask = _mm_set1_epi16(0x3F);
+    for (; i + 16 <= count; i += 16) {
+        const __m128i low  = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i)), mask);
+        const __m128i high = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i + 8)), mask);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm_packus_epi16(low, high));
+    }
+#endif
+    for (; i < count; ++i) {
+        output[i] = pixels[i] & 0x3F; }
+}
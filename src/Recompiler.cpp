@@ -0,0 +1,875 @@
+#include <stddef.h>
+#include <string.h>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "Recompiler.hpp"
+#include "BlockCache.hpp"
+#include "CPU.hpp"
+#include "Memory.hpp"
+#include "Opcodes.hpp"
+
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))
+#define TURBONES_RECOMPILER_SUPPORTED 1
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#define TURBONES_RECOMPILER_SUPPORTED 0
+#endif
+
+#if TURBONES_RECOMPILER_SUPPORTED
+
+namespace {
+
+// Host registers, by x86-64 encoding.
+enum Register {
+    RAX = 0, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15
+};
+
+// Register allocation inside a translated block.
+// Everything kept across calls into Memory is in a callee-saved register.
+constexpr Register CONTEXT  = RBX,
+                   REG_A    = R12,
+                   REG_X    = R13,
+                   REG_Y    = R14,
+                   ZERO     = RBP, // Zero flag's result (see CPU's status register).
+                   NEGATIVE = R15; // Negative flag's result.
+
+// Arithmetic operations, by the opcode of their "r/m32, r32" form.
+enum AluOp : uint8_t { ADD = 0x01, OR = 0x09, AND = 0x21, SUB = 0x29, XOR = 0x31, CMP = 0x39 };
+// Arithmetic operations, by their /digit in the "r/m32, imm32" form.
+enum AluExtension : uint8_t { ADD_IMM = 0, OR_IMM = 1, AND_IMM = 4, SUB_IMM = 5, XOR_IMM = 6 };
+// Condition codes, for Jcc.
+enum Condition : uint8_t { ZERO_SET = 0x4, ZERO_CLEAR = 0x5 };
+
+// Writes x86-64 machine code into a buffer. Only the instruction forms the recompiler needs are here.
+// Operations are 32-bit unless noted. Memory operands always use a 32-bit displacement.
+class Emitter {
+public:
+    Emitter(uint8_t* start, const size_t& capacity) : start(start), cursor(start), end(start + capacity) {}
+
+    size_t size() const { return cursor - start; }
+    bool overflowed() const { return overflow; }
+    uint8_t* position() const { return cursor; }
+
+    void movRR(const int& dst, const int& src) { rex(false, src, 0, dst); byte(0x89); modrmReg(src, dst); }
+    void movRI(const int& dst, const uint32_t& imm) { rex(false, 0, 0, dst); byte(0xB8 + (dst & 7)); dword(imm); }
+    void movRI64(const int& dst, const uint64_t& imm) { rex(true, 0, 0, dst); byte(0xB8 + (dst & 7)); qword(imm); }
+    void movRQ(const int& dst, const int& src) { rex(true, src, 0, dst); byte(0x89); modrmReg(src, dst); }
+
+    // dst = [base + disp]
+    void load(const int& dst, const int& base, const int32_t& disp) {
+        rex(false, dst, 0, base); byte(0x8B); modrmDisp(dst, base, disp);
+    }
+    // [base + disp] = src
+    void store(const int& base, const int32_t& disp, const int& src) {
+        rex(false, src, 0, base); byte(0x89); modrmDisp(src, base, disp);
+    }
+    // [base + disp] = imm
+    void storeImm(const int& base, const int32_t& disp, const uint32_t& imm) {
+        rex(false, 0, 0, base); byte(0xC7); modrmDisp(0, base, disp); dword(imm);
+    }
+    // 64-bit dst = [base + index + disp]
+    void loadQIndexed(const int& dst, const int& base, const int& index, const int32_t& disp) {
+        rex(true, dst, index, base); byte(0x8B); modrmIndexed(dst, base, index, disp);
+    }
+    // dst = zero extended byte [base + disp]
+    void loadByte(const int& dst, const int& base, const int32_t& disp) {
+        rex(false, dst, 0, base); byte(0x0F); byte(0xB6); modrmDisp(dst, base, disp);
+    }
+    // dst = zero extended byte [base + index + disp]
+    void loadByteIndexed(const int& dst, const int& base, const int& index, const int32_t& disp) {
+        rex(false, dst, index, base); byte(0x0F); byte(0xB6); modrmIndexed(dst, base, index, disp);
+    }
+    // byte [base + disp] = low byte of src
+    void storeByte(const int& base, const int32_t& disp, const int& src) {
+        rex(false, src, 0, base, true); byte(0x88); modrmDisp(src, base, disp);
+    }
+    // byte [base + index + disp] = low byte of src
+    void storeByteIndexed(const int& base, const int& index, const int32_t& disp, const int& src) {
+        rex(false, src, index, base, true); byte(0x88); modrmIndexed(src, base, index, disp);
+    }
+
+    void alu(const AluOp& op, const int& dst, const int& src) { rex(false, src, 0, dst); byte(op); modrmReg(src, dst); }
+    void aluImm(const AluExtension& ext, const int& dst, const uint32_t& imm) {
+        rex(false, 0, 0, dst); byte(0x81); modrmReg(ext, dst); dword(imm);
+    }
+    void aluImm64(const AluExtension& ext, const int& dst, const uint32_t& imm) {
+        rex(true, 0, 0, dst); byte(0x81); modrmReg(ext, dst); dword(imm);
+    }
+    void shl(const int& dst, const uint8_t& count) { rex(false, 0, 0, dst); byte(0xC1); modrmReg(4, dst); byte(count); }
+    void shr(const int& dst, const uint8_t& count) { rex(false, 0, 0, dst); byte(0xC1); modrmReg(5, dst); byte(count); }
+    void notR(const int& dst) { rex(false, 0, 0, dst); byte(0xF7); modrmReg(2, dst); }
+    void testImm(const int& dst, const uint32_t& imm) { rex(false, 0, 0, dst); byte(0xF7); modrmReg(0, dst); dword(imm); }
+    void testMemImm(const int& base, const int32_t& disp, const uint32_t& imm) {
+        rex(false, 0, 0, base); byte(0xF7); modrmDisp(0, base, disp); dword(imm);
+    }
+    void testQ(const int& a, const int& b) { rex(true, b, 0, a); byte(0x85); modrmReg(b, a); }
+
+    void push(const int& reg) { rex(false, 0, 0, reg); byte(0x50 + (reg & 7)); }
+    void pop(const int& reg)  { rex(false, 0, 0, reg); byte(0x58 + (reg & 7)); }
+    void call(const int& reg) { rex(false, 0, 0, reg); byte(0xFF); modrmReg(2, reg); }
+    void ret() { byte(0xC3); }
+
+    // Jumps with a 32-bit displacement, to be set with 'patch'. Return the location of the displacement.
+    uint8_t* jcc(const Condition& condition) { byte(0x0F); byte(0x80 | condition); return displacement(); }
+    uint8_t* jmp() { byte(0xE9); return displacement(); }
+    // Points the jump with displacement at 'location' to the current position.
+    void patch(uint8_t* location) { patchTo(location, cursor); }
+    void patchTo(uint8_t* location, uint8_t* target) {
+        if (location == nullptr) {
+            return; }
+        const int32_t offset = (int32_t)(target - (location + 4));
+        memcpy(location, &offset, 4);
+    }
+
+private:
+    void byte(const uint8_t& value) {
+        if (cursor < end) {
+            *cursor++ = value; }
+        else {
+            overflow = true; }
+    }
+    void dword(const uint32_t& value) { for (int i = 0; i < 4; ++i) { byte(value >> (i * 8)); } }
+    void qword(const uint64_t& value) { for (int i = 0; i < 8; ++i) { byte(value >> (i * 8)); } }
+
+    uint8_t* displacement() {
+        uint8_t* location = (cursor + 4 <= end) ? cursor : nullptr;
+        dword(0);
+        return location;
+    }
+
+    // REX prefix, if any extension bit is needed.
+    // 'byte_registers' forces it, so that byte operations on registers 4-7 address SPL-DIL rather than AH-BH.
+    void rex(const bool& wide, const int& reg, const int& index, const int& base, const bool& byte_registers = false) {
+        const uint8_t value = 0x40 | (wide << 3) | ((reg >> 3) << 2) | ((index >> 3) << 1) | (base >> 3);
+        if (value != 0x40 || byte_registers) {
+            byte(value); }
+    }
+    void modrmReg(const int& reg, const int& rm) { byte(0xC0 | ((reg & 7) << 3) | (rm & 7)); }
+    void modrmDisp(const int& reg, const int& base, const int32_t& disp) {
+        byte(0x80 | ((reg & 7) << 3) | (base & 7));
+        if ((base & 7) == RSP) {
+            byte(0x24); } // SIB: no index.
+        dword(disp);
+    }
+    void modrmIndexed(const int& reg, const int& base, const int& index, const int32_t& disp) {
+        byte(0x80 | ((reg & 7) << 3) | 0x04);
+        byte(((index & 7) << 3) | (base & 7));
+        dword(disp);
+    }
+
+    uint8_t* start;
+    uint8_t* cursor;
+    uint8_t* end;
+    bool overflow = false;
+};
+
+#define CONTEXT_FIELD(field) ((int32_t)offsetof(Recompiler::Context, field))
+
+// Translates one block. Addresses computed at runtime are held in EAX, and values read in EAX.
+// RCX, RDX, RSI, RDI and R8 are scratch.
+class Translator {
+public:
+    Translator(Emitter& emit, const uint8_t* ram, const void* page_table,
+               const Recompiler::ReadHelper& read_helper, const Recompiler::WriteHelper& write_helper,
+               const Recompiler::InterpretHelper& interpret_helper)
+        : emit(emit), ram(ram), page_table(page_table),
+          read_helper(read_helper), write_helper(write_helper), interpret_helper(interpret_helper) {}
+
+    // Translates 'length' instructions, already known to form a block (see CPU::decodeBlock).
+    void translate(const uint8_t* code, const uint16_t& pc, const int& length);
+
+private:
+    // Where an instruction's effective address is.
+    enum AddressKind {
+        CONSTANT,  // Known at translation time.
+        ZERO_PAGE, // In EAX, and within the zero page.
+        COMPUTED   // In EAX.
+    };
+
+    // Returns true if the instruction always leaves the block itself (control flow).
+    bool translateInstruction(const uint8_t& opcode, const AddressingMode& mode, const uint16_t& operand,
+                              const uint8_t& immediate, const uint16_t& next_pc);
+    // Calls the interpreter to run the instruction. Returns true if it ends the block, as above.
+    bool interpret(const uint8_t& opcode, const uint16_t& operand, const uint16_t& next_pc);
+
+    AddressKind address(const AddressingMode& mode, const uint16_t& operand);
+    // Reads the operand into EAX. 'immediate' is the operand byte, for immediate mode.
+    void readOperand(const AddressingMode& mode, const uint16_t& operand, const uint8_t& immediate);
+    void read(const AddressKind& kind, const uint16_t& constant);
+    // Writes R8 to the address.
+    void write(const AddressKind& kind, const uint16_t& constant, const uint16_t& next_pc);
+
+    void setZeroNegative(const int& reg) {
+        emit.movRR(ZERO, reg);
+        emit.movRR(NEGATIVE, reg);
+    }
+    void loadRam(const int& reg) { emit.movRI64(reg, (uint64_t)ram); }
+
+    void push(const int& reg);
+    void pop(); // Into EAX.
+
+    // CLI and SEI. Like the interpreter's, delays the change for the next interrupt poll, if it is one.
+    void setInterruptDisable(const bool& value);
+
+    // Between the host registers and the context.
+    void loadRegisters();
+    void storeRegisters();
+
+    // Stores the registers, sets the PC, the cycles and instructions taken, and returns.
+    // 'completed' is whether the current instruction has run, rather than the block ending before it.
+    void exit(const uint16_t& pc, const bool& completed);
+    // Like exit, but with the PC already stored.
+    void exitStoredPC(const bool& completed);
+
+    Emitter& emit;
+    const uint8_t* ram;
+    const void* page_table;
+    Recompiler::ReadHelper  read_helper;
+    Recompiler::WriteHelper write_helper;
+    Recompiler::InterpretHelper interpret_helper;
+
+    int cycles;     // Taken by the instructions before the current one.
+    int cost;       // Of the current one.
+    int translated; // Instructions before the current one.
+    std::vector<uint8_t*> exits; // Jumps to the epilogue.
+};
+
+void Translator::exit(const uint16_t& pc, const bool& completed) {
+    emit.storeImm(CONTEXT, CONTEXT_FIELD(pc), pc);
+    exitStoredPC(completed);
+}
+
+void Translator::loadRegisters() {
+    emit.load(REG_A, CONTEXT, CONTEXT_FIELD(a));
+    emit.load(REG_X, CONTEXT, CONTEXT_FIELD(x));
+    emit.load(REG_Y, CONTEXT, CONTEXT_FIELD(y));
+    emit.load(ZERO, CONTEXT, CONTEXT_FIELD(zero_result));
+    emit.load(NEGATIVE, CONTEXT, CONTEXT_FIELD(negative_result));
+}
+
+void Translator::storeRegisters() {
+    emit.store(CONTEXT, CONTEXT_FIELD(a), REG_A);
+    emit.store(CONTEXT, CONTEXT_FIELD(x), REG_X);
+    emit.store(CONTEXT, CONTEXT_FIELD(y), REG_Y);
+    emit.store(CONTEXT, CONTEXT_FIELD(zero_result), ZERO);
+    emit.store(CONTEXT, CONTEXT_FIELD(negative_result), NEGATIVE);
+}
+
+void Translator::exitStoredPC(const bool& completed) {
+    storeRegisters();
+    emit.storeImm(CONTEXT, CONTEXT_FIELD(cycles), completed ? cycles + cost : cycles);
+    emit.storeImm(CONTEXT, CONTEXT_FIELD(instructions), completed ? translated + 1 : translated);
+    exits.push_back(emit.jmp());
+}
+
+Translator::AddressKind Translator::address(const AddressingMode& mode, const uint16_t& operand) {
+    switch (mode) {
+        case ZP0:
+        case ABS:
+            return CONSTANT;
+        case ZPX:
+        case ZPY:
+            emit.movRR(RAX, mode == ZPX ? REG_X : REG_Y);
+            emit.aluImm(ADD_IMM, RAX, operand);
+            emit.aluImm(AND_IMM, RAX, 0xFF);
+            return ZERO_PAGE;
+        case ABX:
+        case ABY:
+            emit.movRR(RAX, mode == ABX ? REG_X : REG_Y);
+            emit.aluImm(ADD_IMM, RAX, operand);
+            emit.aluImm(AND_IMM, RAX, 0xFFFF);
+            return COMPUTED;
+        case IZX: // Pointer at (operand + X), wrapping within the zero page.
+            loadRam(RCX);
+            emit.movRR(RAX, REG_X);
+            emit.aluImm(ADD_IMM, RAX, operand);
+            emit.aluImm(AND_IMM, RAX, 0xFF);
+            emit.loadByteIndexed(RDX, RCX, RAX, 0);
+            emit.aluImm(ADD_IMM, RAX, 1);
+            emit.aluImm(AND_IMM, RAX, 0xFF);
+            emit.loadByteIndexed(RAX, RCX, RAX, 0);
+            emit.shl(RAX, 8);
+            emit.alu(OR, RAX, RDX);
+            return COMPUTED;
+        case IZY: // Pointer at operand, wrapping within the zero page, plus Y.
+            loadRam(RCX);
+            emit.loadByte(RDX, RCX, operand);
+            emit.loadByte(RAX, RCX, (operand + 1) & 0xFF);
+            emit.shl(RAX, 8);
+            emit.alu(OR, RAX, RDX);
+            emit.alu(ADD, RAX, REG_Y);
+            emit.aluImm(AND_IMM, RAX, 0xFFFF);
+            return COMPUTED;
+        default:
+            return CONSTANT;
+    }
+}
+
+void Translator::read(const AddressKind& kind, const uint16_t& constant) {
+    if (kind == CONSTANT && constant < 0x2000) {
+        loadRam(RCX);
+        emit.loadByte(RAX, RCX, constant % 0x800);
+        return;
+    }
+    if (kind == ZERO_PAGE) {
+        loadRam(RCX);
+        emit.loadByteIndexed(RAX, RCX, RAX, 0);
+        return;
+    }
+    if (kind == CONSTANT) {
+        emit.movRI(RAX, constant); }
+
+    // Page table lookup.
+    emit.movRR(RDX, RAX);
+    emit.shr(RDX, 8);
+    emit.shl(RDX, 4); // sizeof(Memory::Page)
+    emit.movRI64(RCX, (uint64_t)page_table);
+    emit.loadQIndexed(RCX, RCX, RDX, 0); // Page::read
+    emit.testQ(RCX, RCX);
+    uint8_t* io = emit.jcc(ZERO_SET);
+    emit.movRR(RDX, RAX);
+    emit.aluImm(AND_IMM, RDX, 0xFF);
+    emit.loadByteIndexed(RAX, RCX, RDX, 0);
+    uint8_t* done = emit.jmp();
+
+    emit.patch(io);
+    emit.movRQ(RDI, CONTEXT);
+    emit.movRR(RSI, RAX);
+    emit.movRI(RDX, cycles + cost);
+    emit.movRI64(RAX, (uint64_t)read_helper);
+    emit.call(RAX);
+
+    emit.patch(done);
+}
+
+void Translator::write(const AddressKind& kind, const uint16_t& constant, const uint16_t& next_pc) {
+    if (kind == CONSTANT && constant < 0x2000) {
+        loadRam(RCX);
+        emit.storeByte(RCX, constant % 0x800, R8);
+        return;
+    }
+    if (kind == ZERO_PAGE) {
+        loadRam(RCX);
+        emit.storeByteIndexed(RCX, RAX, 0, R8);
+        return;
+    }
+    if (kind == CONSTANT) {
+        emit.movRI(RAX, constant); }
+
+    // Page table lookup.
+    emit.movRR(RDX, RAX);
+    emit.shr(RDX, 8);
+    emit.shl(RDX, 4); // sizeof(Memory::Page)
+    emit.movRI64(RCX, (uint64_t)page_table);
+    emit.loadQIndexed(RCX, RCX, RDX, 8); // Page::write
+    emit.testQ(RCX, RCX);
+    uint8_t* io = emit.jcc(ZERO_SET);
+    emit.movRR(RDX, RAX);
+    emit.aluImm(AND_IMM, RDX, 0xFF);
+    emit.storeByteIndexed(RCX, RDX, 0, R8);
+    uint8_t* done = emit.jmp();
+
+    emit.patch(io);
+    emit.movRQ(RDI, CONTEXT);
+    emit.movRR(RSI, RAX);
+    emit.movRR(RDX, R8);
+    emit.movRI(RCX, cycles + cost);
+    emit.movRI64(RAX, (uint64_t)write_helper);
+    emit.call(RAX);
+    // If the memory map changed, the rest of the block may be gone, and if an event is now earlier, it may come
+    // before the block ends. Leave it after this instruction.
+    emit.testImm(RAX, 0xFFFFFFFF);
+    uint8_t* unchanged = emit.jcc(ZERO_SET);
+    exit(next_pc, true);
+
+    emit.patch(unchanged);
+    emit.patch(done);
+}
+
+void Translator::setInterruptDisable(const bool& value) {
+    emit.load(RCX, CONTEXT, CONTEXT_FIELD(interrupt_disable));
+    if (value) {
+        emit.aluImm(XOR_IMM, RCX, 1); }
+    emit.store(CONTEXT, CONTEXT_FIELD(interrupt_disable_delayed), RCX);
+    emit.storeImm(CONTEXT, CONTEXT_FIELD(interrupt_disable), value);
+}
+
+bool Translator::interpret(const uint8_t& opcode, const uint16_t& operand, const uint16_t& next_pc) {
+    storeRegisters();
+    emit.movRQ(RDI, CONTEXT);
+    emit.movRI(RSI, opcode | (operand << 8));
+    emit.movRI(RDX, next_pc);
+    emit.movRI(RCX, cycles + cost);
+    emit.movRI64(RAX, (uint64_t)interpret_helper);
+    emit.call(RAX);
+    loadRegisters();
+    if (BlockCache::endsBlock(opcode)) {
+        exitStoredPC(true);
+        return true;
+    }
+
+    emit.testImm(RAX, 0xFFFFFFFF);
+    uint8_t* unchanged = emit.jcc(ZERO_SET);
+    exitStoredPC(true);
+    emit.patch(unchanged);
+    return false;
+}
+
+void Translator::readOperand(const AddressingMode& mode, const uint16_t& operand, const uint8_t& immediate) {
+    if (mode == IMM) {
+        emit.movRI(RAX, immediate);
+        return;
+    }
+    const AddressKind kind = address(mode, operand);
+    read(kind, operand);
+}
+
+void Translator::push(const int& reg) {
+    emit.load(RDX, CONTEXT, CONTEXT_FIELD(sp));
+    loadRam(RCX);
+    emit.storeByteIndexed(RCX, RDX, 0x100, reg);
+    emit.aluImm(SUB_IMM, RDX, 1);
+    emit.aluImm(AND_IMM, RDX, 0xFF);
+    emit.store(CONTEXT, CONTEXT_FIELD(sp), RDX);
+}
+
+void Translator::pop() {
+    emit.load(RDX, CONTEXT, CONTEXT_FIELD(sp));
+    emit.aluImm(ADD_IMM, RDX, 1);
+    emit.aluImm(AND_IMM, RDX, 0xFF);
+    emit.store(CONTEXT, CONTEXT_FIELD(sp), RDX);
+    loadRam(RCX);
+    emit.loadByteIndexed(RAX, RCX, RDX, 0x100);
+}
+
+bool Translator::translateInstruction(const uint8_t& opcode, const AddressingMode& mode, const uint16_t& operand,
+                                      const uint8_t& immediate, const uint16_t& next_pc) {
+    // Read-modify-write instructions. The value is in EAX. The address is kept at [RSP] across the read.
+    auto modify = [&](const auto& operation) {
+        if (mode == ACC) {
+            emit.movRR(RAX, REG_A);
+            operation();
+            emit.movRR(REG_A, RAX);
+            setZeroNegative(REG_A);
+            return;
+        }
+        const AddressKind kind = address(mode, operand);
+        if (kind != CONSTANT) {
+            emit.store(RSP, 0, RAX); }
+        read(kind, operand);
+        operation();
+        emit.movRR(R8, RAX);
+        setZeroNegative(RAX);
+        if (kind != CONSTANT) {
+            emit.load(RAX, RSP, 0); }
+        write(kind, operand, next_pc);
+    };
+    // Loads the carry flag (0 or 1) into ECX.
+    auto loadCarry = [&]() {
+        emit.load(RCX, CONTEXT, CONTEXT_FIELD(carry_result));
+        emit.shr(RCX, 8);
+        emit.aluImm(AND_IMM, RCX, 1);
+    };
+    auto compare = [&](const Register& reg) {
+        readOperand(mode, operand, immediate);
+        emit.aluImm(XOR_IMM, RAX, 0xFF);
+        emit.movRR(RDX, reg);
+        emit.alu(ADD, RDX, RAX);
+        emit.aluImm(ADD_IMM, RDX, 1);
+        emit.store(CONTEXT, CONTEXT_FIELD(carry_result), RDX);
+        emit.aluImm(AND_IMM, RDX, 0xFF);
+        setZeroNegative(RDX);
+    };
+    auto addWithCarry = [&](const bool& subtract) {
+        readOperand(mode, operand, immediate);
+        if (subtract) {
+            emit.aluImm(XOR_IMM, RAX, 0xFF); }
+        loadCarry();
+        emit.movRR(RDX, REG_A);
+        emit.alu(ADD, RDX, RAX);
+        emit.alu(ADD, RDX, RCX);
+        emit.store(CONTEXT, CONTEXT_FIELD(carry_result), RDX);
+        // Overflow: ~(A ^ value) & (A ^ sum)
+        emit.movRR(RSI, REG_A);
+        emit.alu(XOR, RSI, RAX);
+        emit.notR(RSI);
+        emit.movRR(RDI, REG_A);
+        emit.alu(XOR, RDI, RDX);
+        emit.alu(AND, RSI, RDI);
+        emit.aluImm(AND_IMM, RSI, 0xFF);
+        emit.store(CONTEXT, CONTEXT_FIELD(overflow_result), RSI);
+        emit.movRR(REG_A, RDX);
+        emit.aluImm(AND_IMM, REG_A, 0xFF);
+        setZeroNegative(REG_A);
+    };
+    auto load = [&](const Register& reg) {
+        readOperand(mode, operand, immediate);
+        emit.movRR(reg, RAX);
+        setZeroNegative(reg);
+    };
+    auto store = [&](const Register& reg) {
+        const AddressKind kind = address(mode, operand);
+        emit.movRR(R8, reg);
+        write(kind, operand, next_pc);
+    };
+    auto logical = [&](const AluOp& op) {
+        readOperand(mode, operand, immediate);
+        emit.alu(op, REG_A, RAX);
+        setZeroNegative(REG_A);
+    };
+    auto step = [&](const Register& reg, const AluExtension& ext) {
+        emit.aluImm(ext, reg, 1);
+        emit.aluImm(AND_IMM, reg, 0xFF);
+        setZeroNegative(reg);
+    };
+    auto transfer = [&](const Register& dst, const Register& src) {
+        emit.movRR(dst, src);
+        setZeroNegative(dst);
+    };
+    auto branch = [&](const int& base, const int32_t& disp, const uint32_t& mask, const bool& branch_if_set) {
+        if (base == CONTEXT) {
+            emit.testMemImm(base, disp, mask); }
+        else {
+            emit.testImm(base, mask); }
+        uint8_t* taken = emit.jcc(branch_if_set ? ZERO_CLEAR : ZERO_SET);
+        exit(next_pc, true);
+        emit.patch(taken);
+        exit(next_pc + (int8_t)immediate, true);
+    };
+
+    switch (opcode) {
+        case 0xA1: case 0xA5: case 0xA9: case 0xAD: case 0xB1: case 0xB5: case 0xB9: case 0xBD: // LDA
+            load(REG_A); break;
+        case 0xA2: case 0xA6: case 0xAE: case 0xB6: case 0xBE: // LDX
+            load(REG_X); break;
+        case 0xA0: case 0xA4: case 0xAC: case 0xB4: case 0xBC: // LDY
+            load(REG_Y); break;
+        case 0x81: case 0x85: case 0x8D: case 0x91: case 0x95: case 0x99: case 0x9D: // STA
+            store(REG_A); break;
+        case 0x86: case 0x8E: case 0x96: // STX
+            store(REG_X); break;
+        case 0x84: case 0x8C: case 0x94: // STY
+            store(REG_Y); break;
+        case 0xAA: transfer(REG_X, REG_A); break;                                       // TAX
+        case 0xA8: transfer(REG_Y, REG_A); break;                                       // TAY
+        case 0x8A: transfer(REG_A, REG_X); break;                                       // TXA
+        case 0x98: transfer(REG_A, REG_Y); break;                                       // TYA
+        case 0xBA: // TSX
+            emit.load(REG_X, CONTEXT, CONTEXT_FIELD(sp));
+            setZeroNegative(REG_X);
+            break;
+        case 0x9A: emit.store(CONTEXT, CONTEXT_FIELD(sp), REG_X); break;                // TXS
+        case 0xE8: step(REG_X, ADD_IMM); break;                                         // INX
+        case 0xC8: step(REG_Y, ADD_IMM); break;                                         // INY
+        case 0xCA: step(REG_X, SUB_IMM); break;                                         // DEX
+        case 0x88: step(REG_Y, SUB_IMM); break;                                         // DEY
+        case 0x21: case 0x25: case 0x29: case 0x2D: case 0x31: case 0x35: case 0x39: case 0x3D: // AND
+            logical(AND); break;
+        case 0x01: case 0x05: case 0x09: case 0x0D: case 0x11: case 0x15: case 0x19: case 0x1D: // ORA
+            logical(OR); break;
+        case 0x41: case 0x45: case 0x49: case 0x4D: case 0x51: case 0x55: case 0x59: case 0x5D: // EOR
+            logical(XOR); break;
+        case 0x61: case 0x65: case 0x69: case 0x6D: case 0x71: case 0x75: case 0x79: case 0x7D: // ADC
+            addWithCarry(false); break;
+        case 0xE1: case 0xE5: case 0xE9: case 0xED: case 0xF1: case 0xF5: case 0xF9: case 0xFD: // SBC
+            addWithCarry(true); break;
+        case 0xC1: case 0xC5: case 0xC9: case 0xCD: case 0xD1: case 0xD5: case 0xD9: case 0xDD: // CMP
+            compare(REG_A); break;
+        case 0xE0: case 0xE4: case 0xEC: // CPX
+            compare(REG_X); break;
+        case 0xC0: case 0xC4: case 0xCC: // CPY
+            compare(REG_Y); break;
+        case 0x24: case 0x2C: // BIT
+            readOperand(mode, operand, immediate);
+            emit.movRR(RCX, RAX);
+            emit.shl(RCX, 1); // Bit 6 into bit 7
+            emit.aluImm(AND_IMM, RCX, 0xFF);
+            emit.store(CONTEXT, CONTEXT_FIELD(overflow_result), RCX);
+            emit.movRR(NEGATIVE, RAX);
+            emit.movRR(ZERO, RAX);
+            emit.alu(AND, ZERO, REG_A);
+            break;
+        case 0xE6: case 0xEE: case 0xF6: case 0xFE: // INC
+            modify([&]() { emit.aluImm(ADD_IMM, RAX, 1); emit.aluImm(AND_IMM, RAX, 0xFF); });
+            break;
+        case 0xC6: case 0xCE: case 0xD6: case 0xDE: // DEC
+            modify([&]() { emit.aluImm(SUB_IMM, RAX, 1); emit.aluImm(AND_IMM, RAX, 0xFF); });
+            break;
+        case 0x06: case 0x0A: case 0x0E: case 0x16: case 0x1E: // ASL
+            modify([&]() {
+                emit.shl(RAX, 1);
+                emit.store(CONTEXT, CONTEXT_FIELD(carry_result), RAX);
+                emit.aluImm(AND_IMM, RAX, 0xFF);
+            });
+            break;
+        case 0x46: case 0x4A: case 0x4E: case 0x56: case 0x5E: // LSR
+            modify([&]() {
+                emit.movRR(RCX, RAX);
+                emit.shl(RCX, 8); // Bit 0 into bit 8
+                emit.store(CONTEXT, CONTEXT_FIELD(carry_result), RCX);
+                emit.shr(RAX, 1);
+            });
+            break;
+        case 0x26: case 0x2A: case 0x2E: case 0x36: case 0x3E: // ROL
+            modify([&]() {
+                loadCarry();
+                emit.shl(RAX, 1);
+                emit.alu(OR, RAX, RCX);
+                emit.store(CONTEXT, CONTEXT_FIELD(carry_result), RAX);
+                emit.aluImm(AND_IMM, RAX, 0xFF);
+            });
+            break;
+        case 0x66: case 0x6A: case 0x6E: case 0x76: case 0x7E: // ROR
+            modify([&]() {
+                loadCarry();
+                emit.shl(RCX, 7);
+                emit.movRR(RDX, RAX);
+                emit.shl(RDX, 8); // Bit 0 into bit 8
+                emit.store(CONTEXT, CONTEXT_FIELD(carry_result), RDX);
+                emit.shr(RAX, 1);
+                emit.alu(OR, RAX, RCX);
+            });
+            break;
+        case 0x18: emit.storeImm(CONTEXT, CONTEXT_FIELD(carry_result), 0); break;       // CLC
+        case 0x38: emit.storeImm(CONTEXT, CONTEXT_FIELD(carry_result), 0x100); break;   // SEC
+        case 0xB8: emit.storeImm(CONTEXT, CONTEXT_FIELD(overflow_result), 0); break;    // CLV
+        case 0x58: setInterruptDisable(false); break;                                   // CLI
+        case 0x78: setInterruptDisable(true); break;                                    // SEI
+        case 0xD8: emit.storeImm(CONTEXT, CONTEXT_FIELD(decimal_mode), 0); break;       // CLD
+        case 0xF8: emit.storeImm(CONTEXT, CONTEXT_FIELD(decimal_mode), 1); break;       // SED
+        case 0xEA: break;                                                               // NOP
+        case 0x48: push(REG_A); break;                                                  // PHA
+        case 0x68: // PLA
+            pop();
+            emit.movRR(REG_A, RAX);
+            setZeroNegative(REG_A);
+            break;
+        case 0xF0: branch(ZERO, 0, 0xFF, false); break;                                 // BEQ
+        case 0xD0: branch(ZERO, 0, 0xFF, true); break;                                  // BNE
+        case 0x30: branch(NEGATIVE, 0, 0x80, true); break;                              // BMI
+        case 0x10: branch(NEGATIVE, 0, 0x80, false); break;                             // BPL
+        case 0xB0: branch(CONTEXT, CONTEXT_FIELD(carry_result), 0x100, true); break;    // BCS
+        case 0x90: branch(CONTEXT, CONTEXT_FIELD(carry_result), 0x100, false); break;   // BCC
+        case 0x70: branch(CONTEXT, CONTEXT_FIELD(overflow_result), 0x80, true); break;  // BVS
+        case 0x50: branch(CONTEXT, CONTEXT_FIELD(overflow_result), 0x80, false); break; // BVC
+        case 0x4C: exit(operand, true); return true;                                    // JMP
+        case 0x20: { // JSR
+            const uint16_t return_address = next_pc - 1;
+            emit.movRI(R8, return_address >> 8);
+            push(R8);
+            emit.movRI(R8, return_address & 0xFF);
+            push(R8);
+            exit(operand, true);
+            return true;
+        }
+        case 0x60: // RTS
+            pop();
+            emit.store(RSP, 0, RAX);
+            pop();
+            emit.shl(RAX, 8);
+            emit.load(RCX, RSP, 0);
+            emit.alu(OR, RAX, RCX);
+            emit.aluImm(ADD_IMM, RAX, 1);
+            emit.aluImm(AND_IMM, RAX, 0xFFFF);
+            emit.store(CONTEXT, CONTEXT_FIELD(pc), RAX);
+            exitStoredPC(true);
+            return true;
+        default: // BRK, PHP, PLP, RTI, JMP indirect.
+            return interpret(opcode, operand, next_pc);
+    }
+
+    return mode == REL;
+}
+
+void Translator::translate(const uint8_t* code, const uint16_t& pc, const int& length) {
+    // Prologue. Six pushes and the return address, plus 8 bytes, keep the stack 16-byte aligned for calls.
+    // The 8 bytes are also scratch space, at [RSP].
+    const int saved[] = { RBX, RBP, R12, R13, R14, R15 };
+    for (const int& reg : saved) {
+        emit.push(reg); }
+    emit.aluImm64(SUB_IMM, RSP, 8);
+    emit.movRQ(CONTEXT, RDI);
+    loadRegisters();
+
+    int offset = 0;
+    bool ended = false;
+    cycles = 0;
+    translated = 0;
+    while (translated < length) {
+        const uint8_t opcode = code[offset];
+        const AddressingMode mode = addressing_mode_table[opcode];
+        const int size = 1 + operand_size_table[mode];
+        const uint16_t instruction_pc = pc + offset;
+        const uint16_t next_pc = instruction_pc + size;
+
+        uint16_t operand = 0;
+        if      (mode == IMM || mode == REL) { operand = instruction_pc + 1; }
+        else if (size == 2)                  { operand = code[offset + 1]; }
+        else if (size == 3)                  { operand = code[offset + 1] | (code[offset + 2] << 8); }
+        const uint8_t immediate = (size > 1) ? code[offset + 1] : 0;
+
+        cost = cycle_table[opcode];
+        ended = translateInstruction(opcode, mode, operand, immediate, next_pc);
+
+        cycles += cost;
+        offset += size;
+        ++translated;
+    }
+    if (!ended) {
+        cost = 0;
+        exit(pc + offset, false); }
+
+    // Epilogue.
+    for (uint8_t* location : exits) {
+        emit.patch(location); }
+    emit.aluImm64(ADD_IMM, RSP, 8);
+    for (int i = 5; i >= 0; --i) {
+        emit.pop(saved[i]); }
+    emit.ret();
+}
+
+} // namespace
+
+#endif // TURBONES_RECOMPILER_SUPPORTED
+
+Recompiler::Recompiler(Memory* memory) : memory(memory) {
+#if TURBONES_RECOMPILER_SUPPORTED
+    // Never writable and executable at once (see 'compile').
+    void* buffer = mmap(nullptr, CODE_BUFFER_SIZE, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer != MAP_FAILED) {
+        code_buffer = static_cast<uint8_t*>(buffer); }
+#endif
+}
+
+Recompiler::~Recompiler() {
+#if TURBONES_RECOMPILER_SUPPORTED
+    if (code_buffer != nullptr) {
+        munmap(code_buffer, CODE_BUFFER_SIZE); }
+#endif
+}
+
+bool Recompiler::isSupported() {
+    return TURBONES_RECOMPILER_SUPPORTED;
+}
+
+uint32_t Recompiler::readHelper(Context* context, uint32_t address, int32_t cycles) {
+    context->cpu->cycles = context->start_cycles + cycles;
+    return context->memory->read(address);
+}
+
+uint32_t Recompiler::writeHelper(Context* context, uint32_t address, uint32_t value, int32_t cycles) {
+    const uint64_t now = context->start_cycles + cycles;
+    context->cpu->cycles = now;
+    const uint32_t mapping = context->memory->mappingGeneration();
+    context->memory->write(address, value);
+    return mustLeave(context, now, mapping);
+}
+
+uint32_t Recompiler::interpretHelper(Context* context, uint32_t instruction, uint32_t next_pc, int32_t cycles) {
+    CPU& cpu = *context->cpu;
+    const uint64_t now = context->start_cycles + cycles;
+    copyFromContext(cpu, *context);
+    cpu.pc     = next_pc;
+    cpu.cycles = now;
+    const uint32_t mapping = context->memory->mappingGeneration();
+    CPU::operation_table[instruction & 0xFF].decoded(cpu, instruction >> 8);
+    copyToContext(*context, cpu);
+    context->pc = cpu.pc;
+    return mustLeave(context, now, mapping);
+}
+
+bool Recompiler::mustLeave(Context* context, const uint64_t& now, const uint32_t& mapping) {
+    // A write may stall the CPU (OAM DMA), which puts the rest of the block that much later.
+    const uint64_t stalled = context->cpu->cycles - now;
+    context->start_cycles += stalled;
+    return context->memory->mappingGeneration() != mapping
+        || stalled != 0
+        || context->cpu->scheduler->nextEventCycle() < context->deadline;
+}
+
+Recompiler::NativeBlock Recompiler::compile(const uint8_t* code, const uint16_t& pc, const int& length) {
+#if TURBONES_RECOMPILER_SUPPORTED
+    if (code_buffer == nullptr || full) {
+        return nullptr; }
+
+    // The unused part of the buffer is made writable while the block is generated, from the start of the page
+    // it begins in, and then executable again.
+    uint8_t* start = code_buffer + code_used;
+    const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    uint8_t* writable = code_buffer + code_used / page_size * page_size;
+    const size_t writable_size = CODE_BUFFER_SIZE - (writable - code_buffer);
+    if (mprotect(writable, writable_size, PROT_READ | PROT_WRITE) != 0) {
+        return nullptr; }
+
+    Emitter emit(start, CODE_BUFFER_SIZE - code_used);
+    Translator translator(emit, memory->ram.data(), memory->pages.data(), &readHelper, &writeHelper, &interpretHelper);
+    translator.translate(code, pc, length);
+
+    if (mprotect(writable, writable_size, PROT_READ | PROT_EXEC) != 0) {
+        std::cerr << "Failed to make generated code executable." << std::endl;
+        throw std::runtime_error("mprotect failed");
+    }
+    if (emit.overflowed()) {
+        full = true;
+        return nullptr;
+    }
+
+    code_used += emit.size();
+    return reinterpret_cast<NativeBlock>(start);
+#else
+    return nullptr;
+#endif
+}
+
+void Recompiler::run(CPU& cpu, const NativeBlock& block, const uint64_t& deadline) {
+    Context context;
+    copyToContext(context, cpu);
+    context.start_cycles = cpu.cycles;
+    context.deadline     = deadline;
+    context.cpu          = &cpu;
+    context.memory       = memory;
+
+    block(&context);
+
+    copyFromContext(cpu, context);
+    cpu.pc            = context.pc;
+    cpu.cycles        = context.start_cycles + context.cycles;
+    cpu.instructions += context.instructions;
+}
+
+void Recompiler::copyToContext(Context& context, const CPU& cpu) {
+    context.a                 = cpu.r_a;
+    context.x                 = cpu.r_x;
+    context.y                 = cpu.r_y;
+    context.sp                = cpu.sp;
+    context.zero_result       = cpu.zero_result;
+    context.negative_result   = cpu.negative_result;
+    context.carry_result      = cpu.carry_result;
+    context.overflow_result   = cpu.overflow_result;
+    context.interrupt_disable = cpu.interrupt_disable;
+    context.interrupt_disable_delayed = cpu.interrupt_disable_delayed;
+    context.decimal_mode      = cpu.decimal_mode;
+}
+
+void Recompiler::copyFromContext(CPU& cpu, const Context& context) {
+    cpu.r_a               = context.a;
+    cpu.r_x               = context.x;
+    cpu.r_y               = context.y;
+    cpu.sp                = context.sp;
+    cpu.zero_result       = context.zero_result;
+    cpu.negative_result   = context.negative_result;
+    cpu.carry_result      = context.carry_result;
+    cpu.overflow_result   = context.overflow_result;
+    cpu.interrupt_disable = context.interrupt_disable;
+    cpu.interrupt_disable_delayed = context.interrupt_disable_delayed;
+    cpu.decimal_mode      = context.decimal_mode;
+}
+
+void Recompiler::flush() {
+    code_used = 0;
+    full = false;
+}
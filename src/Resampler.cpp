@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <cmath>
+
+#include "Resampler.hpp"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #define TURBONES_RESAMPLER_SSE 1
+    #include <xmmintrin.h>
+#else
+    #define TURBONES_RESAMPLER_SSE 0
+#endif
+
+// AVX isn't assumed by the build, so its kernel is compiled for it on its own, and used if the CPU has it.
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+    #define TURBONES_RESAMPLER_AVX 1
+    #include <immintrin.h>
+#else
+    #define TURBONES_RESAMPLER_AVX 0
+#endif
+
+namespace {
+
+constexpr double PI = 3.14159265358979323846;
+// Cutoff of the filter, as a fraction of the lower of the two rates' Nyquist frequency. Below 1, to leave room for the window's roll off.
+constexpr double CUTOFF = 0.9;
+
+// Each kernel returns the output sample at 't' of the way between two adjacent phases of the filter, 'row' and the next,
+// over the TAPS input samples from 'input'.
+
+template <int TAPS>
+float interpolate(const float* row, const float* input, const float& t) {
+    float sum_0 = 0, sum_1 = 0;
+    for (int tap = 0; tap < TAPS; ++tap) {
+        sum_0 += row[tap] * input[tap];
+        sum_1 += row[TAPS + tap] * input[tap];
+    }
+    return sum_0 + (t * (sum_1 - sum_0));
+}
+
+#if TURBONES_RESAMPLER_SSE
+
+template <int TAPS>
+float interpolateSSE(const float* row, const float* input, const float& t) {
+    __m128 sum_0 = _mm_setzero_ps(),
+           sum_1 = _mm_setzero_ps();
+    for (int tap = 0; tap < TAPS; tap += 4) {
+        const __m128 samples = _mm_loadu_ps(input + tap);
+        sum_0 = _mm_add_ps(sum_0, _mm_mul_ps(_mm_loadu_ps(row + tap), samples));
+        sum_1 = _mm_add_ps(sum_1, _mm_mul_ps(_mm_loadu_ps(row + TAPS + tap), samples));
+    }
+    __m128 sum = _mm_add_ps(sum_0, _mm_mul_ps(_mm_set1_ps(t), _mm_sub_ps(sum_1, sum_0)));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+
+#endif
+
+#if TURBONES_RESAMPLER_AVX
+
+bool cpuHasAVX() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx");
+}
+
+template <int TAPS>
+__attribute__((target("avx")))
+float interpolateAVX(const float* row, const float* input, const float& t) {
+    __m256 sum_0 = _mm256_setzero_ps(),
+           sum_1 = _mm256_setzero_ps();
+    for (int tap = 0; tap < TAPS; tap += 8) {
+        const __m256 samples = _mm256_loadu_ps(input + tap);
+        sum_0 = _mm256_add_ps(sum_0, _mm256_mul_ps(_mm256_loadu_ps(row + tap), samples));
+        sum_1 = _mm256_add_ps(sum_1, _mm256_mul_ps(_mm256_loadu_ps(row + TAPS + tap), samples));
+    }
+    const __m256 sum = _mm256_add_ps(sum_0, _mm256_mul_ps(_mm256_set1_ps(t), _mm256_sub_ps(sum_1, sum_0)));
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+    return _mm_cvtss_f32(half);
+}
+
+#endif
+
+}
+
+Resampler::Resampler() {
+#if TURBONES_RESAMPLER_AVX
+    use_avx = cpuHasAVX();
+#else
+    use_avx = false;
+#endif
+    setRates(44100.0, 44100.0);
+}
+
+void Resampler::setRates(const double& input_rate, const double& output_rate) {
+    ratio = input_rate / output_rate;
+    step = ratio;
+    position = 0;
+    input.clear();
+
+    // Windowed sinc, one row per phase: centered on a point 'phase / PHASES' of an input sample past the middle tap.
+    // Going down in rate, the cutoff goes down with it, so that nothing above the output's Nyquist frequency aliases.
+    const double cutoff = CUTOFF * std::min(1.0, 1.0 / ratio);
+    const double half_width = TAPS / 2.0;
+    for (int phase = 0; phase <= PHASES; ++phase) {
+        const double center = (half_width - 1) + ((double)phase / PHASES);
+
+        std::array<double, TAPS> impulse;
+        double sum = 0;
+        for (int tap = 0; tap < TAPS; ++tap) {
+            const double x = tap - center;
+            const double sinc = (x == 0) ? 1.0 : std::sin(PI * cutoff * x) / (PI * cutoff * x);
+            const double window = (std::abs(x) >= half_width) ? 0.0
+                                : 0.42 + (0.5 * std::cos(PI * x / half_width)) + (0.08 * std::cos(2 * PI * x / half_width));
+            impulse[tap] = sinc * window;
+            sum += impulse[tap];
+        }
+        // Normalized, so that a constant level passes unchanged.
+        for (int tap = 0; tap < TAPS; ++tap) {
+            kernel[(phase * TAPS) + tap] = (float)(impulse[tap] / sum); }
+    }
+}
+
+void Resampler::setRateAdjustment(const double& adjustment) {
+    step = ratio / adjustment;
+}
+
+void Resampler::process(const int16_t* in, const size_t& count, std::vector<int16_t>& out) {
+    input.insert(input.end(), in, in + count);
+    resample(out);
+
+    // Drop the input no output sample will need again.
+    const size_t consumed = std::min((size_t)position, input.size());
+    input.erase(input.begin(), input.begin() + consumed);
+    position -= consumed;
+}
+
+void Resampler::resample(std::vector<int16_t>& out) {
+    while ((size_t)position + TAPS <= input.size()) {
+        const size_t start = (size_t)position;
+        const double phase = (position - start) * PHASES;
+        const int row = (int)phase;
+        const float t = (float)(phase - row);
+
+        const float* const filter = &kernel[row * TAPS];
+        float sample;
+#if TURBONES_RESAMPLER_AVX
+        if (use_avx) {
+            sample = interpolateAVX<TAPS>(filter, &input[start], t); }
+        else
+#endif
+        {
+#if TURBONES_RESAMPLER_SSE
+            sample = interpolateSSE<TAPS>(filter, &input[start], t);
+#else
+            sample = interpolate<TAPS>(filter, &input[start], t);
+#endif
+        }
+
+        out.push_back((int16_t)std::max(-32768L, std::min(32767L, std::lround(sample))));
+        position += step;
+    }
+}
@@ -0,0 +1,224 @@
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+#include "Rewind.hpp"
+
+namespace {
+
+// How long the compression thread waits for the next state before it sleeps.
+constexpr std::chrono::microseconds IDLE_SPIN(200);
+
+}
+
+Rewind::Rewind(const size_t& budget, const int& keyframe_interval) :
+    keyframe_interval(std::max(1, keyframe_interval)),
+    arena(budget) {
+    for (SaveState& state : pool) {
+        spare.push(&state); }
+    compressor = std::thread(&Rewind::compress, this);
+}
+
+Rewind::~Rewind() {
+    running = false;
+    compressor.join();
+}
+
+void Rewind::push(const NES& nes) {
+    SaveState* state;
+    while (!spare.pop(state)) {
+        std::this_thread::yield(); }
+    nes.saveState(*state);
+    pending.fetch_add(1, std::memory_order_relaxed);
+    queued.push(state); // Always room: there are only as many states as it holds.
+}
+
+bool Rewind::stepBack(NES& nes) {
+    waitForCompression();
+    if (entries.size() < 2) {
+        return false; }
+
+    const Entry dropped = entries.back();
+    entries.pop_back();
+    bytes_used -= dropped.size;
+    --group_size;
+    // Back into the group before: new states are XORed against its keyframe.
+    if (dropped.keyframe) {
+        auto first = entries.end();
+        do {
+            --first;
+            ++group_size;
+        } while (!first->keyframe);
+        decode(arena.data() + first->offset, zeros.data(), keyframe.size(), keyframe.data());
+    }
+
+    const Entry& newest = entries.back();
+    decoded.blob.resize(keyframe.size());
+    decode(arena.data() + newest.offset, newest.keyframe ? zeros.data() : keyframe.data(), keyframe.size(), decoded.blob.data());
+    nes.loadState(decoded);
+    return true;
+}
+
+size_t Rewind::size() {
+    waitForCompression();
+    return entries.size();
+}
+
+size_t Rewind::bytesUsed() {
+    waitForCompression();
+    return bytes_used;
+}
+
+void Rewind::compress() {
+    SaveState* state;
+    auto last_state = std::chrono::steady_clock::now();
+    while (running) {
+        if (queued.pop(state)) {
+            add(*state);
+            spare.push(state);
+            pending.fetch_sub(1, std::memory_order_release);
+            last_state = std::chrono::steady_clock::now();
+        }
+        // Keeps up with states pushed back to back (e.g. headless), and only sleeps once they've stopped coming.
+        else if (std::chrono::steady_clock::now() - last_state < IDLE_SPIN) {
+            std::this_thread::yield(); }
+        else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+    }
+}
+
+void Rewind::add(const SaveState& state) {
+    const size_t size = state.size();
+    // The first state. They're all the same size, for a game.
+    if (keyframe.size() != size) {
+        entries.clear();
+        bytes_used = 0;
+        group_size = 0;
+        keyframe.assign(size, 0);
+        zeros.assign(size, 0);
+        encoded.resize(maxEncodedSize(size));
+    }
+
+    bool is_keyframe = entries.empty() || group_size >= keyframe_interval;
+    size_t encoded_size = encode(state.data(), is_keyframe ? zeros.data() : keyframe.data(), size, encoded.data());
+    size_t offset = (encoded_size <= arena.size()) ? allocate(encoded_size) : 0;
+    // Its keyframe was dropped to make room: it has to be one itself.
+    if (!is_keyframe
+         && entries.empty()) {
+        is_keyframe = true;
+        encoded_size = encode(state.data(), zeros.data(), size, encoded.data());
+    }
+    // Too big for the budget. There's no history until one fits.
+    if (encoded_size > arena.size()) {
+        entries.clear();
+        bytes_used = 0;
+        group_size = 0;
+        return;
+    }
+
+    memcpy(arena.data() + offset, encoded.data(), encoded_size);
+    entries.push_back({ offset, encoded_size, is_keyframe });
+    bytes_used += encoded_size;
+    if (is_keyframe) {
+        memcpy(keyframe.data(), state.data(), size);
+        group_size = 0;
+    }
+    ++group_size;
+}
+
+size_t Rewind::allocate(const size_t& size) {
+    while (!entries.empty()) {
+        const size_t head = entries.front().offset,
+                     tail = entries.back().offset + entries.back().size;
+        // Not wrapped: free after the newest entry, up to the end, and before the oldest, from the start.
+        if (entries.back().offset >= head) {
+            if (arena.size() - tail >= size) {
+                return tail; }
+            if (head >= size) {
+                return 0; }
+        }
+        // Wrapped: free between the newest entry and the oldest.
+        else if (head - tail >= size) {
+            return tail; }
+
+        // Drop the oldest group.
+        do {
+            bytes_used -= entries.front().size;
+            entries.pop_front();
+        } while (!entries.empty()
+                  && !entries.front().keyframe);
+    }
+    return 0;
+}
+
+void Rewind::waitForCompression() const {
+    while (pending.load(std::memory_order_acquire) != 0) {
+        std::this_thread::yield(); }
+}
+
+size_t Rewind::encode(const uint8_t* state, const uint8_t* base, const size_t& size, uint8_t* out) {
+    uint8_t* const start = out;
+    size_t zero_run = 0; // Unchanged bytes not yet written.
+    const auto writeZeroRun = [&]() {
+        while (zero_run > 0) {
+            const size_t run = std::min(zero_run, MAX_ZERO_RUN);
+            *out++ = (uint8_t)(0x80 | ((run - 1) >> 8));
+            *out++ = (uint8_t)((run - 1) & 0xFF);
+            zero_run -= run;
+        }
+    };
+
+    for (size_t page = 0; page < size; page += PAGE_SIZE) {
+        const size_t end = std::min(size, page + PAGE_SIZE);
+        if (memcmp(state + page, base + page, end - page) == 0) {
+            zero_run += end - page;
+            continue;
+        }
+
+        // Three unchanged bytes in a row are shorter as a zero run than as literals.
+        const auto unchangedRun = [&](const size_t& i) {
+            return i + 2 < end
+                    && state[i] == base[i]
+                    && state[i + 1] == base[i + 1]
+                    && state[i + 2] == base[i + 2];
+        };
+        size_t i = page;
+        while (i < end) {
+            if (state[i] == base[i]) {
+                ++zero_run;
+                ++i;
+                continue;
+            }
+            writeZeroRun();
+            size_t literal_end = i + 1;
+            while (literal_end < end
+                    && literal_end - i < MAX_LITERAL
+                    && !unchangedRun(literal_end)) {
+                ++literal_end; }
+            *out++ = (uint8_t)(literal_end - i - 1);
+            for (; i < literal_end; ++i) {
+                *out++ = state[i] ^ base[i]; }
+        }
+    }
+    writeZeroRun();
+    return out - start;
+}
+
+void Rewind::decode(const uint8_t* in, const uint8_t* base, const size_t& size, uint8_t* out) {
+    size_t i = 0;
+    while (i < size) {
+        const uint8_t token = *in++;
+        size_t run;
+        if (token < 0x80) {
+            run = (size_t)token + 1;
+            for (size_t j = 0; j < run; ++j) {
+                out[i + j] = base[i + j] ^ in[j]; }
+            in += run;
+        }
+        else {
+            run = ((size_t)(token & 0x7F) << 8 | *in++) + 1;
+            memcpy(out + i, base + i, run);
+        }
+        i += run;
+    }
+}
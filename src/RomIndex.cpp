@@ -0,0 +1,293 @@
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <thread>
+
+#include "RomIndex.hpp"
+#include "HeaderDatabase.hpp"
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <dirent.h>
+    #include <sys/stat.h>
+#endif
+
+namespace {
+
+constexpr char MAGIC[4] = { 'T', 'N', 'I', 'X' };
+
+bool hasRomExtension(const std::string& name) {
+    if (name.size() < 4) {
+        return false; }
+    std::string extension = name.substr(name.size() - 4);
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](const char& c) { return (char)std::tolower((unsigned char)c); });
+    return extension == ".nes";
+}
+
+// Appends the paths of ROM files in 'directory', and its subdirectories, to 'paths'.
+void findRoms(const std::string& directory, std::vector<std::string>& paths) {
+#if defined(_WIN32)
+    WIN32_FIND_DATAA found;
+    const HANDLE search = FindFirstFileA((directory + "\\*").c_str(), &found);
+    if (search == INVALID_HANDLE_VALUE) {
+        std::cerr << "Couldn't read directory: " << directory << std::endl;
+        return;
+    }
+    do {
+        const std::string name = found.cFileName;
+        if (name == "."
+             || name == "..") {
+            continue; }
+        const std::string path = directory + "\\" + name;
+        if (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            findRoms(path, paths); }
+        else if (hasRomExtension(name)) {
+            paths.push_back(path); }
+    } while (FindNextFileA(search, &found));
+    FindClose(search);
+#else
+    DIR* listing = opendir(directory.c_str());
+    if (listing == nullptr) {
+        std::cerr << "Couldn't read directory: " << directory << std::endl;
+        return;
+    }
+    while (const dirent* found = readdir(listing)) {
+        const std::string name = found->d_name;
+        if (name == "."
+             || name == "..") {
+            continue; }
+        const std::string path = directory + (directory.back() == '/' ? "" : "/") + name;
+        struct stat status;
+        if (stat(path.c_str(), &status) != 0) {
+            continue; }
+        if (S_ISDIR(status.st_mode)) {
+            findRoms(path, paths); }
+        else if (S_ISREG(status.st_mode)
+                  && hasRomExtension(name)) {
+            paths.push_back(path); }
+    }
+    closedir(listing);
+#endif
+}
+
+// Little endian fields, to and from the index file.
+void writeField(std::string& out, const uint64_t& value, const int& size) {
+    for (int i = 0; i < size; ++i) {
+        out += (char)((value >> (8 * i)) & 0xFF); }
+}
+
+class IndexReader {
+public:
+    IndexReader(const std::string& data, const std::string& path) : data(data), path(path) {}
+
+    uint64_t field(const int& size) {
+        need(size);
+        uint64_t value = 0;
+        for (int i = 0; i < size; ++i) {
+            value |= (uint64_t)(uint8_t)data[position + i] << (8 * i); }
+        position += size;
+        return value;
+    }
+
+    void bytes(void* out, const size_t& size) {
+        need(size);
+        memcpy(out, data.data() + position, size);
+        position += size;
+    }
+
+private:
+    void need(const size_t& size) const {
+        if (data.size() - position < size) {
+            std::cerr << "ROM index is cut short: " << path << std::endl;
+            throw std::runtime_error("Invalid ROM index");
+        }
+    }
+
+    const std::string& data;
+    const std::string& path;
+    size_t position = 0;
+};
+
+}
+
+void RomIndex::scan(const std::vector<std::string>& directories, const HeaderDatabase& database, const unsigned& threads) {
+    std::vector<std::string> paths;
+    for (const std::string& directory : directories) {
+        findRoms(directory, paths); }
+    std::sort(paths.begin(), paths.end());
+
+    // Each worker takes the next file not yet taken, so that big files don't hold up a whole share of the work.
+    std::vector<Entry> results(paths.size());
+    std::vector<char> loaded(paths.size(), 0);
+    std::atomic<size_t> next{0};
+    const auto work = [&]() {
+        for (size_t i = next++; i < paths.size(); i = next++) {
+            loaded[i] = indexFile(paths[i], database, results[i]); }
+    };
+
+    const unsigned workers = std::max(1U, std::min<unsigned>(threads != 0 ? threads : std::thread::hardware_concurrency(),
+                                                             (unsigned)paths.size()));
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < workers; ++i) {
+        pool.emplace_back(work); }
+    work();
+    for (std::thread& thread : pool) {
+        thread.join(); }
+
+    indexed.clear();
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (loaded[i]) {
+            indexed.push_back(std::move(results[i])); }
+    }
+}
+
+bool RomIndex::indexFile(const std::string& path, const HeaderDatabase& database, Entry& entry) {
+    try {
+        const Cartridge cartridge(path);
+        entry.path = path;
+        entry.file_size = cartridge.fileSize();
+        entry.crc32 = updateCrc32(updateCrc32(0, cartridge.prg_rom.data(), cartridge.prg_rom.size()),
+                                  cartridge.chr_rom.data(), cartridge.chr_rom.size());
+        Sha1 sha1;
+        sha1.update(cartridge.prg_rom.data(), cartridge.prg_rom.size());
+        sha1.update(cartridge.chr_rom.data(), cartridge.chr_rom.size());
+        entry.sha1 = sha1.finish();
+
+        entry.header = cartridge.header;
+        entry.corrected = database.apply(entry.crc32, entry.sha1, entry.header);
+        if (entry.corrected) { // The file must still hold the ROM, as corrected. Throws if it doesn't.
+            const Cartridge corrected(path, entry.header); }
+        return true;
+    }
+    catch (const std::runtime_error&) { // Reported where it was thrown.
+        std::cerr << "Skipped: " << path << std::endl;
+        return false;
+    }
+}
+
+void RomIndex::save(const std::string& index_path) const {
+    std::string out(MAGIC, sizeof(MAGIC));
+    writeField(out, VERSION, 4);
+    writeField(out, indexed.size(), 4);
+
+    for (const Entry& entry : indexed) {
+        const Cartridge::Header& header = entry.header;
+        const std::string path = entry.path.substr(0, 0xFFFF);
+        writeField(out, path.size(), 2);
+        out += path;
+        writeField(out, entry.file_size, 8);
+        writeField(out, entry.crc32, 4);
+        out.append(reinterpret_cast<const char*>(entry.sha1.data()), entry.sha1.size());
+
+        writeField(out, header.prg_rom_size,   8);
+        writeField(out, header.chr_rom_size,   8);
+        writeField(out, header.prg_ram_size,   4);
+        writeField(out, header.prg_nvram_size, 4);
+        writeField(out, header.chr_ram_size,   4);
+        writeField(out, header.chr_nvram_size, 4);
+        writeField(out, header.mapper_number,  2);
+        writeField(out, header.submapper,      1);
+        writeField(out, header.timing,         1);
+        writeField(out, header.mirroring
+                         | (header.battery       << 1)
+                         | (header.trainer       << 2)
+                         | (header.four_screen   << 3)
+                         | (header.vs_unisystem  << 4)
+                         | (header.playchoice_10 << 5)
+                         | (header.nes_2         << 6)
+                         | (entry.corrected      << 7), 1);
+        writeField(out, header.console_type,     1);
+        writeField(out, header.vs_type,          1);
+        writeField(out, header.misc_roms,        1);
+        writeField(out, header.expansion_device, 1);
+    }
+
+    std::ofstream file(index_path, std::ios::binary);
+    file.write(out.data(), out.size());
+    if (file.fail()) {
+        std::cerr << "Couldn't write file: " << index_path << std::endl;
+        throw std::runtime_error("Failed ofstream");
+    }
+}
+
+void RomIndex::load(const std::string& index_path) {
+    std::ifstream file(index_path, std::ios::binary);
+    if (file.fail()) {
+        std::cerr << "Couldn't open ROM index: " << index_path << std::endl;
+        throw std::runtime_error("Failed ifstream");
+    }
+    const std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    IndexReader reader(data, index_path);
+    char magic[sizeof(MAGIC)];
+    reader.bytes(magic, sizeof(magic));
+    if (memcmp(magic, MAGIC, sizeof(MAGIC)) != 0
+         || reader.field(4) != VERSION) {
+        std::cerr << "Not a ROM index, or from another version: " << index_path << std::endl;
+        throw std::runtime_error("Invalid ROM index");
+    }
+
+    indexed.clear();
+    const uint64_t count = reader.field(4);
+    for (uint64_t i = 0; i < count; ++i) {
+        Entry entry;
+        Cartridge::Header& header = entry.header;
+        entry.path.resize(reader.field(2));
+        reader.bytes(&entry.path[0], entry.path.size());
+        entry.file_size = reader.field(8);
+        entry.crc32 = (uint32_t)reader.field(4);
+        reader.bytes(entry.sha1.data(), entry.sha1.size());
+
+        header.prg_rom_size   = reader.field(8);
+        header.chr_rom_size   = reader.field(8);
+        header.prg_ram_size   = (uint32_t)reader.field(4);
+        header.prg_nvram_size = (uint32_t)reader.field(4);
+        header.chr_ram_size   = (uint32_t)reader.field(4);
+        header.chr_nvram_size = (uint32_t)reader.field(4);
+        header.mapper_number  = (uint16_t)reader.field(2);
+        header.submapper      = (uint8_t)reader.field(1);
+        header.timing         = static_cast<Cartridge::Header::Timing>(reader.field(1) & 0b11);
+        const uint64_t flags  = reader.field(1);
+        header.mirroring      = flags & 0b0000'0001;
+        header.battery        = (flags & 0b0000'0010) != 0;
+        header.trainer        = (flags & 0b0000'0100) != 0;
+        header.four_screen    = (flags & 0b0000'1000) != 0;
+        header.vs_unisystem   = (flags & 0b0001'0000) != 0;
+        header.playchoice_10  = (flags & 0b0010'0000) != 0;
+        header.nes_2          = (flags & 0b0100'0000) != 0;
+        entry.corrected       = (flags & 0b1000'0000) != 0;
+        header.console_type     = (uint8_t)reader.field(1);
+        header.vs_type          = (uint8_t)reader.field(1);
+        header.misc_roms        = (uint8_t)reader.field(1);
+        header.expansion_device = (uint8_t)reader.field(1);
+        indexed.push_back(std::move(entry));
+    }
+}
+
+const RomIndex::Entry* RomIndex::find(const std::string& key) const {
+    std::string hex = key;
+    std::transform(hex.begin(), hex.end(), hex.begin(), [](const char& c) { return (char)std::tolower((unsigned char)c); });
+
+    for (const Entry& entry : indexed) {
+        if (entry.path == key) {
+            return &entry; }
+        if (hex.size() == 40
+             && hex == toHex(entry.sha1.data(), entry.sha1.size())) {
+            return &entry; }
+        if (hex.size() == 8) {
+            const uint8_t crc_bytes[] = { (uint8_t)(entry.crc32 >> 24), (uint8_t)(entry.crc32 >> 16),
+                                          (uint8_t)(entry.crc32 >> 8),  (uint8_t)entry.crc32 };
+            if (hex == toHex(crc_bytes, sizeof(crc_bytes))) {
+                return &entry; }
+        }
+    }
+    return nullptr;
+}
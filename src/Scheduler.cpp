@@ -0,0 +1,63 @@
+#include "Scheduler.hpp"
+
+#include <algorithm>
+
+Scheduler::Scheduler() {
+    reset();
+}
+
+void Scheduler::reset() {
+    heap.clear();
+    generations.fill(0);
+    pending.fill(NEVER);
+}
+
+void Scheduler::schedule(const Event& event, const uint64_t& cycle) {
+    ++generations[event];
+    pending[event] = cycle;
+    heap.push_back({ cycle, event, generations[event] });
+    std::push_heap(heap.begin(), heap.end(), later);
+    dropStale();
+}
+
+void Scheduler::cancel(const Event& event) {
+    ++generations[event];
+    pending[event] = NEVER;
+    dropStale();
+}
+
+bool Scheduler::pop(const uint64_t& now, Event& event) {
+    if (heap.empty()
+         || heap.front().cycle > now) {
+        return false; }
+
+    event = heap.front().event;
+    ++generations[event]; // No longer pending.
+    pending[event] = NEVER;
+    std::pop_heap(heap.begin(), heap.end(), later);
+    heap.pop_back();
+    dropStale();
+    return true;
+}
+
+void Scheduler::dropStale() {
+    while (!heap.empty()
+            && heap.front().generation != generations[heap.front().event]) {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        heap.pop_back();
+    }
+}
+
+void Scheduler::saveState(StateWriter& out) const {
+    out.put(pending);
+}
+
+void Scheduler::loadState(StateReader& in) {
+    std::array<uint64_t, EVENT_COUNT> saved;
+    in.get(saved);
+    reset();
+    for (int event = 0; event < EVENT_COUNT; ++event) {
+        if (saved[event] != NEVER) {
+            schedule(static_cast<Event>(event), saved[event]); }
+    }
+}
@@ -0,0 +1,77 @@
+#include "TileCache.hpp"
+
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define TURBONES_TILE_CACHE_SSE2 1
+    #include <emmintrin.h>
+#else
+    #define TURBONES_TILE_CACHE_SSE2 0
+#endif
+
+void TileCache::load(const uint8_t* chr, const size_t& size) {
+    const size_t tiles = size / TILE_SIZE;
+    rows.resize(tiles * 8);
+    flipped_rows.resize(tiles * 8);
+    for (size_t tile = 0; tile < tiles; ++tile) {
+        decode(tile, chr + (tile * TILE_SIZE)); }
+
+    for (int slot = 0; slot < SLOT_COUNT; ++slot) {
+        mapSlot(slot, slot * SLOT_SIZE); }
+}
+
+void TileCache::update(const uint8_t* chr, const size_t& offset) {
+    const size_t tile = offset / TILE_SIZE;
+    decode(tile, chr + (tile * TILE_SIZE));
+}
+
+#if TURBONES_TILE_CACHE_SSE2
+
+void TileCache::decode(const size_t& tile, const uint8_t* planes) {
+    // Two rows at a time, one per 8 byte half. Each plane byte is broadcast across its half,
+    // and each lane tests the bit of its pixel: bit 7 is the leftmost (or rightmost, when flipped).
+    const __m128i bits = _mm_setr_epi8((char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+                                       (char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+    const __m128i flipped_bits = _mm_setr_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80,
+                                               0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80);
+    const __m128i ones = _mm_set1_epi8(1),
+                  twos = _mm_set1_epi8(2);
+
+    uint64_t* decoded = &rows[tile * 8];
+    uint64_t* flipped = &flipped_rows[tile * 8];
+    for (int y = 0; y < 8; y += 2) {
+        const __m128i low  = _mm_unpacklo_epi64(_mm_set1_epi8((char)planes[y]),
+                                                _mm_set1_epi8((char)planes[y + 1]));
+        const __m128i high = _mm_unpacklo_epi64(_mm_set1_epi8((char)planes[y + 8]),
+                                                _mm_set1_epi8((char)planes[y + 9]));
+
+        // All ones where the bit is set. Then 1 from the low plane, 2 from the high.
+        const __m128i pixels = _mm_or_si128(
+            _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(low,  bits), bits), ones),
+            _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(high, bits), bits), twos));
+        const __m128i flipped_pixels = _mm_or_si128(
+            _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(low,  flipped_bits), flipped_bits), ones),
+            _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(high, flipped_bits), flipped_bits), twos));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(decoded + y), pixels);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(flipped + y), flipped_pixels);
+    }
+}
+
+#else
+
+void TileCache::decode(const size_t& tile, const uint8_t* planes) {
+    for (int y = 0; y < 8; ++y) {
+        uint8_t pixels[8];
+        uint8_t flipped[8];
+        for (int x = 0; x < 8; ++x) {
+            const int bit = 7 - x;
+            pixels[x] = ((planes[y] >> bit) & 1) | (((planes[y + 8] >> bit) & 1) << 1);
+            flipped[7 - x] = pixels[x];
+        }
+        memcpy(&rows[(tile * 8) + y], pixels, sizeof(pixels));
+        memcpy(&flipped_rows[(tile * 8) + y], flipped, sizeof(flipped));
+    }
+}
+
+#endif
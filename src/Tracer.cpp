@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+#include "Tracer.hpp"
+#include "Opcodes.hpp"
+
+Tracer::~Tracer() {
+    stop();
+}
+
+void Tracer::start(const std::string& log_path, const Level& level) {
+    stop();
+
+    if (COMPILED_LEVEL < level) {
+        std::cerr
+            << "Tracing isn't compiled in. Rebuild with -DTURBONES_TRACE_LEVEL=" << level
+            << " to enable it." << std::endl;
+        return;
+    }
+
+    log.open(log_path);
+    if (log.fail()) {
+        std::cerr << "Couldn't open trace log at: " << log_path << std::endl;
+        throw std::runtime_error("Failed to open trace log");
+    }
+
+    buffer.reset(new RingBuffer<Record, BUFFER_SIZE>());
+    runtime_level = level;
+    running = true;
+    writer = std::thread(&Tracer::write, this);
+}
+
+void Tracer::stop() {
+    runtime_level = OFF;
+    running = false;
+
+    if (writer.joinable()) {
+        writer.join(); }
+    if (log.is_open()) {
+        log.close(); }
+}
+
+void Tracer::record(const Record& entry) {
+    while (!buffer->push(entry)) {
+        std::this_thread::yield(); }
+}
+
+void Tracer::write() {
+    Record entry;
+    // Keep draining after being stopped, until the buffer is empty.
+    while (running || !buffer->empty()) {
+        if (buffer->pop(entry)) {
+            log << format(entry) << '\n'; }
+        else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+    }
+    log.flush();
+}
+
+std::string Tracer::format(const Record& entry) {
+    const AddressingMode mode = addressing_mode_table[entry.opcode];
+    const int operand_size = operand_size_table[mode];
+    const uint16_t operand16 = (entry.operand_hi << 8) | entry.operand_lo;
+
+    // Raw instruction bytes, e.g. "4C F5 C5".
+    char bytes[9];
+    if      (operand_size == 0) { snprintf(bytes, sizeof(bytes), "%02X", entry.opcode); }
+    else if (operand_size == 1) { snprintf(bytes, sizeof(bytes), "%02X %02X", entry.opcode, entry.operand_lo); }
+    else                        { snprintf(bytes, sizeof(bytes), "%02X %02X %02X", entry.opcode, entry.operand_lo, entry.operand_hi); }
+
+    // Disassembled operand, e.g. "$C5F5".
+    char operand[16] = "";
+    switch (mode) {
+        case ACC: snprintf(operand, sizeof(operand), "A");                             break;
+        case IMM: snprintf(operand, sizeof(operand), "#$%02X",    entry.operand_lo);   break;
+        case ZP0: snprintf(operand, sizeof(operand), "$%02X",     entry.operand_lo);   break;
+        case ZPX: snprintf(operand, sizeof(operand), "$%02X,X",   entry.operand_lo);   break;
+        case ZPY: snprintf(operand, sizeof(operand), "$%02X,Y",   entry.operand_lo);   break;
+        case ABS: snprintf(operand, sizeof(operand), "$%04X",     operand16);          break;
+        case ABX: snprintf(operand, sizeof(operand), "$%04X,X",   operand16);          break;
+        case ABY: snprintf(operand, sizeof(operand), "$%04X,Y",   operand16);          break;
+        case IND: snprintf(operand, sizeof(operand), "($%04X)",   operand16);          break;
+        case IZX: snprintf(operand, sizeof(operand), "($%02X,X)", entry.operand_lo);   break;
+        case IZY: snprintf(operand, sizeof(operand), "($%02X),Y", entry.operand_lo);   break;
+        case REL: // Show the branch target, rather than the offset.
+            snprintf(operand, sizeof(operand), "$%04X",
+                     (uint16_t)(entry.pc + 2 + (int8_t)entry.operand_lo));
+            break;
+        default: break;
+    }
+
+    char line[96];
+    snprintf(line, sizeof(line), "%04X  %-8s  %s %-28s  A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%llu",
+             entry.pc, bytes, instruction_table[entry.opcode].c_str(), operand,
+             entry.a, entry.x, entry.y, entry.p, entry.sp, (unsigned long long)entry.cycles);
+    return line;
+}
@@ -11,10 +11,63 @@ void printHelpMessage() {
         << "Usage: turbones [options] <path-to-rom-file>\n\n"
         << "Options:\n"
         << "\t-h  --help\n"
-        << "\t\tPrint this help text and exit."
+        << "\t\tPrint this help text and exit.\n"
+        << "\t--headless\n"
+        << "\t\tRun as fast as possible without a window (always, in builds without SFML).\n"
+        << "\t--jit\n"
+        << "\t\tTranslate frequently run code to native code (x86-64 only).\n"
+        << "\t--ppu <scanline|dot>\n"
+        << "\t\tRender a line at a time (default, falls back to dot when needed), or dot by dot.\n"
+        << "\t--trace <file>\n"
+        << "\t\tLog every executed instruction to file, in Nintendulator's format.\n"
+        << "\t\tRequires a build with TURBONES_TRACE_LEVEL of 1 or more.\n"
+        << "\t--frames <n>\n"
+        << "\t\tStop after n frames.\n"
+        << "\t--cycles <n>\n"
+        << "\t\tStop after n CPU cycles.\n"
+        << "\t--input <file>\n"
+        << "\t\tPlay controller input from a script (see Readme).\n"
+        << "\t--rewind <MB>\n"
+        << "\t\tKeep a history of every frame, compressed to fit in MB of memory, to step back\n"
+        << "\t\tthrough by holding Backspace.\n"
+        << "\t--sample-rate <hz>\n"
+        << "\t\tAudio sample rate (default 48000).\n"
+        << "\t--dump-audio <file>\n"
+        << "\t\tWrite the audio to file as it's made, as a 16-bit mono WAV (also when headless).\n"
+        << "\t--index <file>\n"
+        << "\t\tLoad the ROM through a ROM index, by its path, CRC32 or SHA-1, in place of <path-to-rom-file>.\n"
+        << "\t--build-index <file>\n"
+        << "\t\tIndex the ROM files in the directory given in place of <path-to-rom-file>, and its\n"
+        << "\t\tsubdirectories, writing the index to file. Doesn't run a game.\n"
+        << "\t--header-db <file>\n"
+        << "\t\tHeader corrections to apply while indexing (see Readme).\n"
+        << "\t--dump-framebuffer <file>\n"
+        << "\t\tOnce stopped, write the last frame to file, as raw 256x240 pixels (see --frame-format).\n"
+        << "\t--frame-format <indexed|rgba|bgra|rgb565>\n"
+        << "\t\tPixel format of --dump-framebuffer: 8-bit palette indices (default),\n"
+        << "\t\t32-bit RGBA or BGRA (byte order), or 16-bit RGB565 (little endian).\n"
+        << "\t--dump-ram <file>\n"
+        << "\t\tOnce stopped, write the 2 KB of internal RAM to file.\n"
+        << "\t--dump-hash <file>\n"
+        << "\t\tOnce stopped, write a hash of the console's state to file, in hex."
         << std::endl;
 }
 
+// Parses a count given to an option. Exits if it isn't a number.
+uint64_t parseCount(const std::string& option, const std::string& value) {
+    try {
+        size_t parsed = 0;
+        const uint64_t count = std::stoull(value, &parsed);
+        if (parsed == value.size()
+             && value[0] != '-') {
+            return count; }
+    }
+    catch (const std::logic_error&) {}
+
+    std::cerr << "Invalid number for " << option << ": " << value << std::endl;
+    exit(EXIT_FAILURE);
+}
+
 void handleArguments(const int& argc, char* argv[], Emulator& emulator) {
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
@@ -24,6 +77,99 @@ void handleArguments(const int& argc, char* argv[], Emulator& emulator) {
             printHelpMessage();
             exit(EXIT_SUCCESS);
         }
+        else if (arg == "--headless") {
+            emulator.headless = true;
+        }
+        else if (arg == "--jit") {
+            emulator.recompile = true;
+        }
+        else if (arg == "--ppu"
+                  && i + 1 < argc - 1) {
+            const std::string engine = argv[++i];
+            if      (engine == "scanline") {
+                emulator.ppu_engine = PPU::SCANLINE; }
+            else if (engine == "dot") {
+                emulator.ppu_engine = PPU::DOT; }
+            else {
+                std::cerr << "Invalid PPU engine: " << engine << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (arg == "--trace"
+                  && i + 1 < argc - 1) {
+            emulator.trace_path = argv[++i];
+        }
+        else if (arg == "--frames"
+                  && i + 1 < argc - 1) {
+            emulator.frame_budget = parseCount(arg, argv[++i]);
+        }
+        else if (arg == "--cycles"
+                  && i + 1 < argc - 1) {
+            emulator.cycle_budget = parseCount(arg, argv[++i]);
+        }
+        else if (arg == "--input"
+                  && i + 1 < argc - 1) {
+            emulator.input_path = argv[++i];
+        }
+        else if (arg == "--rewind"
+                  && i + 1 < argc - 1) {
+            emulator.rewind_budget = (size_t)parseCount(arg, argv[++i]) * 1024 * 1024;
+        }
+        else if (arg == "--sample-rate"
+                  && i + 1 < argc - 1) {
+            const uint64_t rate = parseCount(arg, argv[++i]);
+            if (rate < 8000
+                 || rate > 192000) {
+                std::cerr << "Sample rate out of range (8000-192000): " << rate << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            emulator.sample_rate = (int)rate;
+        }
+        else if (arg == "--dump-audio"
+                  && i + 1 < argc - 1) {
+            emulator.audio_path = argv[++i];
+        }
+        else if (arg == "--index"
+                  && i + 1 < argc - 1) {
+            emulator.index_path = argv[++i];
+        }
+        else if (arg == "--build-index"
+                  && i + 1 < argc - 1) {
+            emulator.build_index = true;
+            emulator.index_path = argv[++i];
+        }
+        else if (arg == "--header-db"
+                  && i + 1 < argc - 1) {
+            emulator.header_database_path = argv[++i];
+        }
+        else if (arg == "--dump-framebuffer"
+                  && i + 1 < argc - 1) {
+            emulator.frame_buffer_path = argv[++i];
+        }
+        else if (arg == "--frame-format"
+                  && i + 1 < argc - 1) {
+            const std::string format = argv[++i];
+            if      (format == "indexed") {
+                emulator.frame_format = Palette::INDEXED8; }
+            else if (format == "rgba") {
+                emulator.frame_format = Palette::RGBA8888; }
+            else if (format == "bgra") {
+                emulator.frame_format = Palette::BGRA8888; }
+            else if (format == "rgb565") {
+                emulator.frame_format = Palette::RGB565; }
+            else {
+                std::cerr << "Invalid frame format: " << format << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (arg == "--dump-ram"
+                  && i + 1 < argc - 1) {
+            emulator.ram_path = argv[++i];
+        }
+        else if (arg == "--dump-hash"
+                  && i + 1 < argc - 1) {
+            emulator.hash_path = argv[++i];
+        }
         else if (i == argc - 1) {
             emulator.rom_path = arg;
         }
@@ -32,13 +178,14 @@ void handleArguments(const int& argc, char* argv[], Emulator& emulator) {
     }
 }
 
-// Prints failure message, and then waits until Enter ('\n') is pressed,
+// Prints failure message, and then, if 'wait', waits until Enter ('\n') is pressed,
 // so there's time for the message to be read, in case the console closes itself immediately afterwards.
 // It turns out to be simpler to write this portably, if we wait for Enter, rather than "any key".
-void printFailureAndWait(const std::runtime_error& e) {
-    std::cerr
-        << "\nFailed to run (" << e.what() << "). Shutting down.\n"
-        << "Press Enter to exit . . . " << std::flush;
+void printFailure(const std::runtime_error& e, const bool& wait) {
+    std::cerr << "\nFailed to run (" << e.what() << "). Shutting down." << std::endl;
+    if (!wait) {
+        return; }
+    std::cerr << "Press Enter to exit . . . " << std::flush;
     std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); // Wait for enter key.
 }
 
@@ -49,7 +196,12 @@ int main(const int argc, char* argv[]) {
     try {
         emulator.run(); }
     catch (const std::runtime_error& e) {
-        printFailureAndWait(e);
+        // Headless runs are scripted, or from a console that stays open. Nobody may be there to press Enter.
+#if TURBONES_SFML
+        printFailure(e, !emulator.headless);
+#else
+        printFailure(e, false);
+#endif
         return EXIT_FAILURE;
     }
 }
\ No newline at end of file